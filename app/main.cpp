@@ -1,16 +1,27 @@
+#include <array>
 #include <exception>
 #include <iostream>
+#include <optional>
+#include <utility>
+#include <vector>
 
+#include <csignal>
+#include <cstdint>
 #include <cstdlib>
 
+#include <sys/socket.h>
+
 #include <zportal/iouring/iouring.hpp>
-#include <zportal/net/address.hpp>
 #include <zportal/net/connection.hpp>
+#include <zportal/net/shm_ring.hpp>
 #include <zportal/net/socket.hpp>
 #include <zportal/net/tun.hpp>
+#include <zportal/session/server.hpp>
 #include <zportal/session/session.hpp>
+#include <zportal/session/shard_group.hpp>
 #include <zportal/session/transmitter.hpp>
 #include <zportal/tools/config.hpp>
+#include <zportal/tools/system.hpp>
 
 int main(int argn, char* argv[]) {
     zportal::Config cfg{};
@@ -30,57 +41,162 @@ int main(int argn, char* argv[]) {
         return EXIT_SUCCESS;
     }
 
-    auto ring = zportal::IoUring::create_queue(64);
-    if (!ring) {
-        std::cerr << ring.error().to_string() << '\n';
+    auto tun_device =
+        zportal::TunDevice::create_tun_device(cfg.interface_name, cfg.inner_address, cfg.mtu, cfg.shards > 1);
+    if (!tun_device) {
+        std::cerr << tun_device.error().to_string() << '\n';
         return EXIT_FAILURE;
     }
 
-    auto tun_device = zportal::TunDevice::create_tun_device(cfg.interface_name, cfg.inner_address, cfg.mtu);
-    if (!tun_device) {
-        std::cerr << tun_device.error().to_string() << '\n';
+    if (cfg.shards > 1) {
+        std::vector<zportal::TunDevice> tuns;
+        std::vector<zportal::Socket> sockets;
+        tuns.push_back(std::move(*tun_device));
+
+        for (std::uint16_t i = 1; i < cfg.shards; i++) {
+            auto queue = tuns.front().open_queue();
+            if (!queue) {
+                std::cerr << queue.error().to_string() << '\n';
+                return EXIT_FAILURE;
+            }
+            tuns.push_back(std::move(*queue));
+        }
+
+        // Both ends must run the same number of shards, every shard pairs with one connection.
+        zportal::Socket listener;
+        if (cfg.bind_address) {
+            auto created = zportal::create_listener(*cfg.bind_address, cfg.shards);
+            if (!created) {
+                std::cerr << created.error().to_string() << '\n';
+                return EXIT_FAILURE;
+            }
+            listener = std::move(*created);
+        }
+
+        auto peers = cfg.bind_address ? zportal::accept_from(listener, cfg.shards)
+                                      : zportal::connect_to(*cfg.connect_address, cfg.proxies, cfg.shards);
+        if (!peers) {
+            std::cerr << peers.error().to_string() << '\n';
+            return EXIT_FAILURE;
+        }
+        sockets = std::move(*peers);
+
+        if (const auto set_up_result = tuns.front().set_up(); !set_up_result) {
+            std::cerr << set_up_result.error().to_string() << '\n';
+            return EXIT_FAILURE;
+        }
+
+        auto shards = zportal::ShardGroup::create_shard_group(std::move(tuns), std::move(sockets), cfg);
+        if (!shards) {
+            std::cerr << shards.error().to_string() << '\n';
+            return EXIT_FAILURE;
+        }
+
+        std::cout << "Running " << shards->size() << " shards" << '\n';
+
+        const auto run_result = shards->run();
+        if (!run_result) {
+            std::cerr << run_result.error().to_string() << '\n';
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    auto ring = zportal::IoUring::create_queue(64);
+    if (!ring) {
+        std::cerr << ring.error().to_string() << '\n';
         return EXIT_FAILURE;
     }
+    ring->set_buffer_ring_options({.kernel_allocated = cfg.kernel_buffer_rings, .numa_node = cfg.numa_node});
 
-    zportal::Socket socket;
-    if (cfg.bind_address) {
-        auto listener = zportal::create_listener(*cfg.bind_address);
+    if (cfg.bind_address && cfg.max_peers > 0) {
+        auto listener = zportal::create_listener(*cfg.bind_address, SOMAXCONN, cfg.transport);
         if (!listener) {
             std::cerr << listener.error().to_string() << '\n';
             return EXIT_FAILURE;
         }
 
-        auto peer = zportal::accept_from(*listener);
-        if (!peer) {
-            std::cerr << peer.error().to_string() << '\n';
+        // Accepted sockets get SO_BUSY_POLL from the server, the ring polls all of them.
+        if (cfg.busy_poll.count() > 0) {
+            const auto napi = ring->register_napi(cfg.busy_poll, cfg.prefer_busy_poll);
+            if (!napi) {
+                std::cerr << napi.error().to_string() << '\n';
+                return EXIT_FAILURE;
+            }
+            if (!*napi) {
+                std::cerr << "io_uring NAPI busy poll is not supported, only the sockets busy poll" << '\n';
+            }
+        }
+
+        if (const auto set_up_result = tun_device->set_up(); !set_up_result) {
+            std::cerr << set_up_result.error().to_string() << '\n';
             return EXIT_FAILURE;
         }
-        socket = std::move(*peer);
 
-        const auto remote_address = socket.get_remote_address();
-        if (!remote_address) {
-            std::cerr << remote_address.error().to_string() << '\n';
+        auto server = zportal::Server::create_server(std::move(*ring), std::move(*tun_device), std::move(*listener),
+                                                     cfg.tx_buffer_classes, cfg.rx_buffer_classes, cfg, cfg.max_peers);
+        if (!server) {
+            std::cerr << server.error().to_string() << '\n';
             return EXIT_FAILURE;
         }
 
-        std::cout << "Accepted connection";
-        if (*remote_address) {
-            try {
-                std::cout << " from " << zportal::to_string(*remote_address);
-            } catch (const std::exception& e) {
-                std::cout << " from <unprintable: " << e.what() << '>';
-            }
+        std::cout << "Serving up to " << cfg.max_peers << " peers" << '\n';
+
+        const auto run_result = server->run();
+        if (!run_result) {
+            std::cerr << run_result.error().to_string() << '\n';
+            return EXIT_FAILURE;
         }
-        std::cout << '\n';
-    } else if (cfg.connect_address) {
-        auto peer = zportal::connect_to(*cfg.connect_address, cfg.proxies);
-        if (!peer) {
-            std::cerr << peer.error().to_string() << '\n';
+
+        return EXIT_SUCCESS;
+    }
+
+    // A datagram peer is known once its first datagram arrived, the session starts with the socket connected to it.
+    zportal::Socket datagram;
+    if (cfg.transport == zportal::Transport::UDP) {
+        auto created = cfg.bind_address ? zportal::accept_datagram(*cfg.bind_address)
+                                        : zportal::connect_datagram(*cfg.connect_address);
+        if (!created) {
+            std::cerr << created.error().to_string() << '\n';
             return EXIT_FAILURE;
         }
-        socket = std::move(*peer);
+        datagram = std::move(*created);
+    }
 
-        std::cout << "Connected to " << zportal::to_string(*cfg.connect_address) << '\n';
+    // A same host peer hands its ring over the Unix socket, which then only tells when it goes away.
+    std::optional<zportal::ShmChannel> channel;
+    if (cfg.transport == zportal::Transport::SHM) {
+        auto created = cfg.bind_address ? zportal::accept_shm(*cfg.bind_address)
+                                        : zportal::connect_shm(*cfg.connect_address);
+        if (!created) {
+            std::cerr << created.error().to_string() << '\n';
+            return EXIT_FAILURE;
+        }
+        channel = std::move(*created);
+    }
+
+    // Both ends must stripe over the same number of connections, the session accepts or connects them on the ring.
+    zportal::Socket listener;
+    if (cfg.bind_address && !datagram && !channel) {
+        auto created = zportal::create_listener(*cfg.bind_address, cfg.stripes, cfg.transport);
+        if (!created) {
+            std::cerr << created.error().to_string() << '\n';
+            return EXIT_FAILURE;
+        }
+        listener = std::move(*created);
+    }
+
+    // Connected sockets get SO_BUSY_POLL from the session, the ring polls all of them.
+    if (cfg.busy_poll.count() > 0) {
+        const auto napi = ring->register_napi(cfg.busy_poll, cfg.prefer_busy_poll);
+        if (!napi) {
+            std::cerr << napi.error().to_string() << '\n';
+            return EXIT_FAILURE;
+        }
+        if (!*napi) {
+            std::cerr << "io_uring NAPI busy poll is not supported, only the socket busy polls" << '\n';
+        }
     }
 
     const auto set_up_result = tun_device->set_up();
@@ -89,13 +205,32 @@ int main(int argn, char* argv[]) {
         return EXIT_FAILURE;
     }
 
-    auto session = zportal::Session::create_session(std::move(*ring), std::move(*tun_device), std::move(socket), 4096,
-                                                    4096, 4096, cfg);
+    auto session = [&]() {
+        if (channel) {
+            return zportal::Session::create_session(std::move(*ring), std::move(*tun_device), std::move(*channel),
+                                                    cfg.tx_buffer_classes, cfg.rx_buffer_classes, cfg);
+        }
+        if (datagram) {
+            return zportal::Session::create_session(std::move(*ring), std::move(*tun_device), std::move(datagram),
+                                                    cfg.tx_buffer_classes, cfg.rx_buffer_classes, cfg);
+        }
+        return zportal::Session::create_session(std::move(*ring), std::move(*tun_device), std::move(listener),
+                                                cfg.stripes, cfg.tx_buffer_classes, cfg.rx_buffer_classes, cfg);
+    }();
     if (!session) {
         std::cerr << session.error().to_string() << '\n';
         return EXIT_FAILURE;
     }
 
+    // SIGTERM and SIGINT drain the session instead of killing it, see -D.
+    constexpr std::array<int, 2> drain_signals = {SIGTERM, SIGINT};
+    auto signal_fd = zportal::system::create_signal_fd(drain_signals);
+    if (!signal_fd) {
+        std::cerr << signal_fd.error().to_string() << '\n';
+        return EXIT_FAILURE;
+    }
+    session->set_signal_fd(std::move(*signal_fd));
+
     const auto run_result = session->run();
     if (!run_result) {
         std::cerr << run_result.error().to_string() << '\n';
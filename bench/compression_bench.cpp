@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <charconv>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <zportal/tools/compression.hpp>
+
+namespace {
+
+double cpu_seconds() {
+    timespec ts{};
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+// JSON log lines, about what HTTP APIs and log shipping put through a tunnel.
+std::vector<std::byte> text_payload(std::size_t size) {
+    std::mt19937 random(1);
+    std::vector<std::byte> payload;
+    payload.reserve(size);
+    while (payload.size() < size) {
+        const auto line = R"({"ts":)" + std::to_string(1700000000 + random() % 100000) +
+                          R"(,"level":"info","path":"/api/v1/items/)" + std::to_string(random() % 1000) +
+                          R"(","status":200,"bytes":)" + std::to_string(random() % 65536) + "}\n";
+        for (const char c : line) {
+            payload.push_back(static_cast<std::byte>(c));
+        }
+    }
+    payload.resize(size);
+    return payload;
+}
+
+// Stands in for TLS or video, nothing to find.
+std::vector<std::byte> random_payload(std::size_t size) {
+    std::mt19937 random(2);
+    std::vector<std::byte> payload(size);
+    std::ranges::generate(payload, [&random] { return static_cast<std::byte>(random()); });
+    return payload;
+}
+
+// Compresses every frame of `payload` and then decompresses them again, each pass timed as a whole.
+bool run(std::string_view name, std::span<const std::byte> payload, std::size_t frame_size) {
+    const std::size_t frames = (payload.size() + frame_size - 1) / frame_size;
+    const std::size_t bound = zportal::compression::bound(frame_size);
+    std::vector<std::byte> compressed(frames * bound);
+    std::vector<std::size_t> sizes(frames);
+
+    auto start = cpu_seconds();
+    for (std::size_t i = 0; i < frames; i++) {
+        const auto frame = payload.subspan(i * frame_size, std::min(frame_size, payload.size() - i * frame_size));
+        // The transmitter sends a frame compressed only when that saves an eighth of it.
+        const auto output = std::span<std::byte>{compressed}.subspan(i * bound, frame.size() - frame.size() / 8);
+        sizes[i] = zportal::compression::compress(frame, output);
+    }
+    const double compress_time = cpu_seconds() - start;
+
+    std::vector<std::byte> restored(payload.size());
+    start = cpu_seconds();
+    for (std::size_t i = 0; i < frames; i++) {
+        if (sizes[i] == 0) {
+            continue;
+        }
+
+        const auto input = std::span<const std::byte>{compressed}.subspan(i * bound, sizes[i]);
+        const auto output = std::span<std::byte>{restored}.subspan(i * frame_size);
+        if (!zportal::compression::decompress(input, output.first(std::min(frame_size, output.size())))) {
+            std::cerr << name << ": frame " << i << " doesn't decompress" << '\n';
+            return false;
+        }
+    }
+    const double decompress_time = cpu_seconds() - start;
+
+    std::size_t wire{};
+    std::size_t raw{};
+    for (std::size_t i = 0; i < frames; i++) {
+        const auto size = std::min(frame_size, payload.size() - i * frame_size);
+        if (sizes[i] == 0) {
+            std::memcpy(restored.data() + i * frame_size, payload.data() + i * frame_size, size);
+            raw++;
+        }
+        wire += sizes[i] == 0 ? size : sizes[i];
+    }
+    if (!std::ranges::equal(restored, payload)) {
+        std::cerr << name << ": frames don't round trip" << '\n';
+        return false;
+    }
+
+    const double megabytes = static_cast<double>(payload.size()) / (1024 * 1024);
+    std::cout << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(2) << "ratio "
+              << std::setw(6) << static_cast<double>(payload.size()) / static_cast<double>(wire) << "  sent raw "
+              << std::setw(6) << 100.0 * static_cast<double>(raw) / static_cast<double>(frames) << "%  compress "
+              << std::setw(8) << compress_time * 1e3 / megabytes << " ms/MB  decompress " << std::setw(8)
+              << decompress_time * 1e3 / megabytes << " ms/MB" << '\n';
+    return true;
+}
+
+std::size_t parse_size(const char* text, std::size_t fallback) {
+    std::size_t value{};
+    const std::string_view view{text};
+    const auto [end, error] = std::from_chars(view.data(), view.data() + view.size(), value);
+    return error == std::errc{} && end == view.data() + view.size() && value > 0 ? value : fallback;
+}
+
+} // namespace
+
+int main(int argn, char* argv[]) {
+    if (argn > 3) {
+        std::cerr << "Usage: " << argv[0] << " [frame-size] [megabytes]" << '\n';
+        return EXIT_FAILURE;
+    }
+
+    if (!zportal::compression::is_available()) {
+        std::cerr << "Built without liblz4, nothing is compressed." << '\n';
+        return EXIT_FAILURE;
+    }
+
+    const std::size_t frame_size = argn > 1 ? parse_size(argv[1], 1400) : 1400;
+    const std::size_t total = (argn > 2 ? parse_size(argv[2], 64) : 64) * 1024 * 1024;
+
+    std::cout << "Frames of " << frame_size << " bytes, " << total / (1024 * 1024) << " MB per payload" << '\n';
+    const auto text = text_payload(total);
+    const auto random = random_payload(total);
+    if (!run("text", text, frame_size) || !run("random", random, frame_size)) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
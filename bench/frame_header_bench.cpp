@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <zportal/session/frame_header.hpp>
+#include <zportal/tools/crc.hpp>
+
+namespace {
+
+double cpu_seconds() {
+    timespec ts{};
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+struct Pass {
+    std::size_t stream_size{};
+    double encode_time{};
+    double decode_time{};
+};
+
+// Frames `count` packets of `size` bytes into one stream like the transmitter, each with its header and
+// full CRC, then parses them back like the receiver. False when a frame doesn't come back intact.
+bool run(std::size_t size, std::size_t count, bool compact, Pass& pass) {
+    std::vector<std::byte> packet(size);
+    std::ranges::generate(packet, [i = 0U]() mutable { return static_cast<std::byte>(i++ * 31); });
+
+    const std::size_t header_room =
+        compact ? zportal::FrameHeader::max_compact_size : zportal::FrameHeader::wire_size;
+    std::vector<std::byte> stream(count * (header_room + size));
+
+    auto start = cpu_seconds();
+    std::size_t offset{};
+    for (std::size_t i = 0; i < count; i++) {
+        packet[0] = static_cast<std::byte>(i);
+
+        zportal::FrameHeader header;
+        header.set_size(static_cast<std::uint32_t>(size));
+        header.set_crc(zportal::crc32c(packet));
+        if (compact) {
+            offset += header.encode_compact(
+                std::span<std::byte, zportal::FrameHeader::max_compact_size>{stream.data() + offset, header_room});
+        } else {
+            std::memcpy(stream.data() + offset, header.data().data(), zportal::FrameHeader::wire_size);
+            offset += zportal::FrameHeader::wire_size;
+        }
+        std::memcpy(stream.data() + offset, packet.data(), size);
+        offset += size;
+    }
+    pass.encode_time = cpu_seconds() - start;
+    pass.stream_size = offset;
+
+    start = cpu_seconds();
+    const std::uint32_t mask = compact ? zportal::FrameHeader::compact_crc_mask : 0xFFFFFFFF;
+    std::size_t received{};
+    for (offset = 0; offset < pass.stream_size; received++) {
+        zportal::FrameHeader header;
+        if (compact) {
+            const auto length = header.decode_compact(std::span<const std::byte>{stream}.subspan(offset));
+            if (!length || *length == 0) {
+                return false;
+            }
+            offset += *length;
+        } else {
+            std::memcpy(header.data().data(), stream.data() + offset, zportal::FrameHeader::wire_size);
+            if (!header.is_magic_valid()) {
+                return false;
+            }
+            offset += zportal::FrameHeader::wire_size;
+        }
+
+        const auto payload = std::span<const std::byte>{stream}.subspan(offset, header.get_size());
+        if (header.get_size() != size || (zportal::crc32c(payload) & mask) != header.get_crc()) {
+            return false;
+        }
+        offset += header.get_size();
+    }
+    pass.decode_time = cpu_seconds() - start;
+
+    return received == count;
+}
+
+std::size_t parse_count(const char* text, std::size_t fallback) {
+    std::size_t value{};
+    const std::string_view view{text};
+    const auto [end, error] = std::from_chars(view.data(), view.data() + view.size(), value);
+    return error == std::errc{} && end == view.data() + view.size() && value > 0 ? value : fallback;
+}
+
+} // namespace
+
+int main(int argn, char* argv[]) {
+    if (argn > 2) {
+        std::cerr << "Usage: " << argv[0] << " [packets]" << '\n';
+        return EXIT_FAILURE;
+    }
+
+    const std::size_t count = argn > 1 ? parse_count(argv[1], 1'000'000) : 1'000'000;
+
+    // Pure ACKs, VoIP and game traffic, DNS, then a mid-sized packet for contrast.
+    constexpr std::array<std::size_t, 5> sizes{40, 64, 128, 256, 1400};
+    std::cout << count << " packets per run, Mpps of the framing and parsing CPU, payload share of the stream"
+              << '\n';
+    for (const auto size : sizes) {
+        std::cout << std::setw(5) << size << " B";
+        for (const bool compact : {false, true}) {
+            Pass pass;
+            if (!run(size, count, compact, pass)) {
+                std::cerr << '\n' << (compact ? "compact" : "full") << " frames don't round trip" << '\n';
+                return EXIT_FAILURE;
+            }
+
+            const double packets = static_cast<double>(count);
+            std::cout << std::fixed << std::setprecision(2) << "  " << (compact ? "compact" : "full") << ' '
+                      << std::setw(5) << static_cast<double>(pass.stream_size - size * count) / packets
+                      << " B/header  send " << std::setw(6) << packets / pass.encode_time / 1e6 << "  recv "
+                      << std::setw(6) << packets / pass.decode_time / 1e6 << "  payload " << std::setw(6)
+                      << 100.0 * static_cast<double>(size * count) / static_cast<double>(pass.stream_size) << '%';
+        }
+        std::cout << '\n';
+    }
+
+    return EXIT_SUCCESS;
+}
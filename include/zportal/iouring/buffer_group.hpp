@@ -10,6 +10,7 @@
 #include <liburing.h>
 
 #include <zportal/tools/error.hpp>
+#include <zportal/tools/memory.hpp>
 
 namespace zportal {
 
@@ -22,10 +23,20 @@ class BufferGroup {
     Result<std::span<std::byte>> get_buffer(std::uint16_t bid, std::optional<std::uint32_t> size = {}) noexcept;
     Result<void> return_buffer(std::uint16_t bid) noexcept;
 
+    // Provided groups: account a buffer picked by the kernel for a completed operation.
+    Result<std::span<std::byte>> take_buffer(std::uint16_t bid, std::optional<std::uint32_t> size = {}) noexcept;
+
+    // Local groups: hand out a free buffer without kernel involvement.
+    Result<std::uint16_t> acquire_buffer() noexcept;
+
     std::size_t get_buffer_count() const noexcept;
+    std::size_t get_used_count() const noexcept;
+    std::size_t get_free_count() const noexcept;
     std::uint32_t get_buffer_size() const noexcept;
     std::uint16_t get_bgid() const noexcept;
 
+    bool is_provided() const noexcept;
+
     bool is_valid() const noexcept;
     explicit operator bool() const noexcept;
 
@@ -36,17 +47,24 @@ class BufferGroup {
 
   private:
     friend class IoUring;
-    explicit BufferGroup(io_uring* ring) noexcept;
+    explicit BufferGroup(io_uring* ring, bool provided) noexcept;
 
     io_uring* const ring_;
-    io_uring_buf_ring* br_;
-    int mask_;
+    const bool provided_;
+    io_uring_buf_ring* br_{};
+    int mask_{};
 
-    std::vector<std::byte> data_;
+    // Non zero when the ring was allocated by the kernel (IOU_PBUF_RING_MMAP) and mapped by us.
+    std::size_t ring_mapping_size_{};
+
+    MappedMemory data_;
     std::size_t size_;
 
     std::uint16_t bgid_, buffer_count_;
     std::uint32_t buffer_size_;
+
+    std::size_t used_{};
+    std::vector<std::uint16_t> free_bids_;
 };
 
 }; // namespace zportal
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <zportal/iouring/buffer_group.hpp>
+#include <zportal/tools/error.hpp>
+
+namespace zportal {
+
+class IoUring;
+
+struct BufferClass {
+    std::uint32_t buffer_size;
+    std::uint16_t buffer_count;
+};
+
+struct BufferId {
+    std::uint16_t bgid;
+    std::uint16_t bid;
+};
+
+/*
+  Set of buffer groups with different buffer sizes (size classes), each with its own bgid.
+  Classes are kept sorted from the smallest to the largest buffer size.
+*/
+class BufferPool {
+  public:
+    BufferPool() noexcept = default;
+    static Result<BufferPool> create_buffer_pool(IoUring& ring, std::span<const BufferClass> classes,
+                                                 bool provided = true) noexcept;
+
+    BufferPool(BufferPool&& /*other*/) noexcept = default;
+    BufferPool& operator=(BufferPool&& /*other*/) noexcept = default;
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Another handle on the same buffer groups, the groups stay owned by the ring.
+    Result<BufferPool> share() const noexcept;
+
+    // Smallest class fitting `size_hint` that still has free buffers. Falls back to any class with free buffers.
+    BufferGroup* select(std::size_t size_hint) const noexcept;
+
+    // Smallest class fitting `size` with a free buffer, no fallback to smaller classes.
+    BufferGroup* select_fitting(std::size_t size) const noexcept;
+
+    Result<BufferGroup*> get_buffer_group(std::uint16_t bgid) const noexcept;
+    std::optional<std::size_t> index_of(std::uint16_t bgid) const noexcept;
+
+    Result<std::span<std::byte>> get_buffer(BufferId id, std::optional<std::uint32_t> size = {}) const noexcept;
+    Result<void> return_buffer(BufferId id) const noexcept;
+
+    std::span<BufferGroup* const> get_classes() const noexcept;
+    BufferGroup* smallest() const noexcept;
+    BufferGroup* largest() const noexcept;
+
+    std::size_t get_buffer_count() const noexcept;
+    std::size_t get_used_count() const noexcept;
+    std::size_t get_memory_size() const noexcept;
+
+    bool is_valid() const noexcept;
+    explicit operator bool() const noexcept;
+
+  private:
+    std::vector<BufferGroup*> classes_;
+};
+
+} // namespace zportal
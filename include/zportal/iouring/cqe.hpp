@@ -14,6 +14,8 @@ class IoUring;
 
 class Cqe {
   public:
+    Cqe() noexcept = default;
+
     std::int32_t result() const noexcept;
     std::uint32_t flags() const noexcept;
     Operation operation() const noexcept;
@@ -31,8 +33,8 @@ class Cqe {
     explicit Cqe(const io_uring_cqe& cqe) noexcept;
 
     Operation operation_;
-    std::int32_t result_;
-    std::uint32_t flags_;
+    std::int32_t result_{};
+    std::uint32_t flags_{};
 };
 
 } // namespace zportal
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+namespace zportal {
+
+/*
+  Per thread recycling allocator for coroutine frames. Frames are rounded up to `granularity`
+  and kept on free lists after release, so steady state coroutine calls don't touch the heap.
+  Frames larger than `max_pooled_size` go straight to the global allocator.
+*/
+class FrameAllocator {
+  public:
+    static constexpr std::size_t granularity = 64;
+    static constexpr std::size_t max_pooled_size = 4096;
+
+    static void* allocate(std::size_t size) noexcept;
+    static void deallocate(void* frame, std::size_t size) noexcept;
+
+    // Frames currently parked on the calling thread's free lists.
+    static std::size_t get_cached_count() noexcept;
+};
+
+} // namespace zportal
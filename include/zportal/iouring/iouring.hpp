@@ -1,8 +1,13 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <optional>
+#include <span>
 #include <vector>
 
+#include <cstddef>
+
 #include <liburing.h>
 
 #include <zportal/iouring/cqe.hpp>
@@ -12,6 +17,14 @@ namespace zportal {
 
 class BufferGroup;
 
+struct BufferRingOptions {
+    // Let the kernel allocate provided buffer rings and mmap them (IOU_PBUF_RING_MMAP).
+    bool kernel_allocated{false};
+
+    // Preferred NUMA node for buffer rings and buffer memory.
+    std::optional<int> numa_node;
+};
+
 class IoUring {
   public:
     IoUring() noexcept = default;
@@ -30,9 +43,19 @@ class IoUring {
 
     Result<Cqe> wait() noexcept;
 
-    Result<BufferGroup*> create_buffer_group(std::uint16_t length, std::uint32_t buf_size) noexcept;
+    // Waits for at least one completion and copies up to `cqes.size()` ready ones, returns how many.
+    Result<std::size_t> wait_batch(std::span<Cqe> cqes) noexcept;
+
+    Result<BufferGroup*> create_buffer_group(std::uint16_t length, std::uint32_t buf_size,
+                                             bool provided = true) noexcept;
     Result<BufferGroup*> get_buffer_group(std::uint16_t bgid) noexcept;
 
+    void set_buffer_ring_options(const BufferRingOptions& options) noexcept;
+
+    // Busy-poll the NAPI contexts of polled sockets while waiting for completions.
+    // False when the kernel or liburing doesn't support it.
+    Result<bool> register_napi(std::chrono::microseconds busy_poll_timeout, bool prefer_busy_poll) noexcept;
+
     bool is_valid() const noexcept;
     explicit operator bool() const noexcept;
 
@@ -43,6 +66,10 @@ class IoUring {
     std::uint16_t next_bgid_{0};
     std::uint16_t get_next_bgid_() noexcept;
 
+    BufferRingOptions buffer_ring_options_;
+    Result<void> setup_buf_ring_(BufferGroup& bg) noexcept;
+    Result<bool> map_kernel_buf_ring_(BufferGroup& bg) noexcept;
+
     static constexpr io_uring invalid_ring_{.ring_fd = -1};
 };
 
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <memory>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <liburing.h>
+#include <sys/socket.h>
+
+#include <zportal/iouring/cqe.hpp>
+#include <zportal/iouring/iouring.hpp>
+#include <zportal/iouring/task.hpp>
+#include <zportal/tools/error.hpp>
+#include <zportal/tools/file_descriptor.hpp>
+
+namespace zportal {
+
+namespace detail {
+
+struct PendingOperation {
+    std::coroutine_handle<> handle;
+    std::int32_t result{};
+    std::uint32_t flags{};
+};
+
+// Lives on the heap so awaiters and detached tasks keep valid pointers when the Scheduler moves.
+class SchedulerState {
+  public:
+    IoUring* ring{};
+    std::uint16_t session{};
+
+    std::vector<PendingOperation*> slots;
+    std::vector<std::uint16_t> free_slots;
+
+    std::optional<Error> task_error;
+
+    Result<std::uint16_t> acquire_slot(PendingOperation* pending) noexcept;
+    void release_slot(std::uint16_t slot) noexcept;
+
+    // Flushes the submission queue once when it's full.
+    Result<io_uring_sqe*> get_sqe() noexcept;
+
+    std::uint64_t user_data(std::uint16_t slot) const noexcept;
+};
+
+} // namespace detail
+
+/*
+  Single shot io_uring operation awaited by a coroutine. `Prep` fills the SQE, `Complete` maps the
+  CQE result to Result<T>. The awaiter sits in the awaiting coroutine frame, so awaiting doesn't
+  allocate. The SQE is only queued, Scheduler::run_once() submits everything queued in one go.
+*/
+template <typename Prep, typename Complete> class OperationAwaiter {
+  public:
+    OperationAwaiter(detail::SchedulerState* state, Prep prep, Complete complete) noexcept;
+
+    bool await_ready() const noexcept;
+    bool await_suspend(std::coroutine_handle<> handle) noexcept;
+    std::invoke_result_t<Complete&, std::int32_t> await_resume() noexcept;
+
+  private:
+    detail::SchedulerState* state_;
+    Prep prep_;
+    Complete complete_;
+
+    detail::PendingOperation pending_;
+    std::optional<Error> error_;
+};
+
+/*
+  Drives coroutines on top of an IoUring. Completions of awaited operations are tagged with
+  OperationType::AWAIT and an in-flight slot index, and are dispatched in batches.
+  A coroutine must not be destroyed while it's suspended on an operation.
+*/
+class Scheduler {
+  public:
+    Scheduler() noexcept = default;
+    static Result<Scheduler> create_scheduler(IoUring& ring, std::uint16_t capacity = 256,
+                                              std::uint16_t session = 0) noexcept;
+
+    Scheduler(Scheduler&& /*other*/) noexcept = default;
+    Scheduler& operator=(Scheduler&& /*other*/) noexcept = default;
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Starts `task` detached, its frame is released when it finishes.
+    Result<void> spawn(Task<void>&& task) noexcept;
+
+    // Submits queued SQEs, waits and dispatches a batch of completions. Completions which don't belong
+    // to an awaited operation are passed to `fallback(const Cqe&) -> Result<void>`.
+    Result<void> run_once() noexcept;
+    template <typename Fallback> Result<void> run_once(Fallback&& fallback) noexcept;
+
+    // Resumes the awaiting coroutine, false when `cqe` isn't an awaited operation.
+    Result<bool> dispatch(const Cqe& cqe) noexcept;
+
+    std::size_t get_in_flight() const noexcept;
+
+    auto read(int fd, std::span<std::byte> buffer, std::uint64_t offset = 0) noexcept;
+    auto write(int fd, std::span<const std::byte> buffer, std::uint64_t offset = 0) noexcept;
+    auto recv(int fd, std::span<std::byte> buffer, int flags = 0) noexcept;
+    auto send(int fd, std::span<const std::byte> buffer, int flags = MSG_NOSIGNAL) noexcept;
+    auto timeout(std::chrono::nanoseconds duration) noexcept;
+    auto accept(int fd) noexcept;
+    auto connect(int fd, const sockaddr* address, socklen_t length) noexcept;
+
+    bool is_valid() const noexcept;
+    explicit operator bool() const noexcept;
+
+  private:
+    std::unique_ptr<detail::SchedulerState> state_;
+
+    static constexpr std::size_t batch_size = 64;
+};
+
+} // namespace zportal
+
+#include <zportal/iouring/scheduler.inl>
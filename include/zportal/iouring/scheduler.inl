@@ -0,0 +1,202 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <coroutine>
+#include <span>
+#include <utility>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include <liburing.h>
+#include <sys/socket.h>
+
+#include <zportal/iouring/cqe.hpp>
+#include <zportal/iouring/scheduler.hpp>
+#include <zportal/tools/error.hpp>
+#include <zportal/tools/file_descriptor.hpp>
+
+namespace zportal {
+
+template <typename Prep, typename Complete>
+inline OperationAwaiter<Prep, Complete>::OperationAwaiter(detail::SchedulerState* state, Prep prep,
+                                                          Complete complete) noexcept
+    : state_(state), prep_(std::move(prep)), complete_(std::move(complete)) {}
+
+template <typename Prep, typename Complete>
+inline bool OperationAwaiter<Prep, Complete>::await_ready() const noexcept {
+    return false;
+}
+
+template <typename Prep, typename Complete>
+inline bool OperationAwaiter<Prep, Complete>::await_suspend(std::coroutine_handle<> handle) noexcept {
+    if (state_ == nullptr) {
+        error_ = Error{ErrorCode::InvalidState};
+        return false;
+    }
+
+    pending_.handle = handle;
+
+    const auto slot = state_->acquire_slot(&pending_);
+    if (!slot) {
+        error_ = slot.error();
+        return false;
+    }
+
+    const auto sqe = state_->get_sqe();
+    if (!sqe) {
+        state_->release_slot(*slot);
+        error_ = sqe.error();
+        return false;
+    }
+
+    prep_(*sqe);
+    ::io_uring_sqe_set_data64(*sqe, state_->user_data(*slot));
+
+    return true;
+}
+
+template <typename Prep, typename Complete>
+inline std::invoke_result_t<Complete&, std::int32_t> OperationAwaiter<Prep, Complete>::await_resume() noexcept {
+    if (error_) {
+        return fail(*error_);
+    }
+
+    return complete_(pending_.result);
+}
+
+template <typename Fallback> inline Result<void> Scheduler::run_once(Fallback&& fallback) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    if (const auto submit_result = state_->ring->submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    // Copy the whole batch out of the CQ first, resumed coroutines may queue new SQEs right away.
+    std::array<Cqe, batch_size> cqes;
+    const auto count = state_->ring->wait_batch(cqes);
+    if (!count) {
+        return fail(count.error());
+    }
+
+    for (const auto& cqe : std::span(cqes).first(*count)) {
+        const auto dispatched = dispatch(cqe);
+        if (!dispatched) {
+            return fail(dispatched.error());
+        }
+
+        if (!*dispatched) {
+            if (const auto result = fallback(cqe); !result) {
+                return fail(result.error());
+            }
+        }
+    }
+
+    if (state_->task_error) {
+        return fail(*std::exchange(state_->task_error, std::nullopt));
+    }
+
+    return {};
+}
+
+inline auto Scheduler::read(int fd, std::span<std::byte> buffer, std::uint64_t offset) noexcept {
+    return OperationAwaiter{
+        state_.get(),
+        [fd, buffer, offset](io_uring_sqe* sqe) noexcept {
+            ::io_uring_prep_read(sqe, fd, buffer.data(), static_cast<unsigned>(buffer.size()), offset);
+        },
+        [](std::int32_t result) noexcept -> Result<std::size_t> {
+            if (result < 0) {
+                return fail({ErrorCode::RingReadFailed, -result});
+            }
+            return static_cast<std::size_t>(result);
+        }};
+}
+
+inline auto Scheduler::write(int fd, std::span<const std::byte> buffer, std::uint64_t offset) noexcept {
+    return OperationAwaiter{
+        state_.get(),
+        [fd, buffer, offset](io_uring_sqe* sqe) noexcept {
+            ::io_uring_prep_write(sqe, fd, buffer.data(), static_cast<unsigned>(buffer.size()), offset);
+        },
+        [](std::int32_t result) noexcept -> Result<std::size_t> {
+            if (result < 0) {
+                return fail({ErrorCode::RingWriteFailed, -result});
+            }
+            return static_cast<std::size_t>(result);
+        }};
+}
+
+inline auto Scheduler::recv(int fd, std::span<std::byte> buffer, int flags) noexcept {
+    return OperationAwaiter{
+        state_.get(),
+        [fd, buffer, flags](io_uring_sqe* sqe) noexcept {
+            ::io_uring_prep_recv(sqe, fd, buffer.data(), buffer.size(), flags);
+        },
+        [](std::int32_t result) noexcept -> Result<std::size_t> {
+            if (result < 0) {
+                return fail({ErrorCode::RecvFailed, -result});
+            }
+            return static_cast<std::size_t>(result);
+        }};
+}
+
+inline auto Scheduler::send(int fd, std::span<const std::byte> buffer, int flags) noexcept {
+    return OperationAwaiter{
+        state_.get(),
+        [fd, buffer, flags](io_uring_sqe* sqe) noexcept {
+            ::io_uring_prep_send(sqe, fd, buffer.data(), buffer.size(), flags);
+        },
+        [](std::int32_t result) noexcept -> Result<std::size_t> {
+            if (result < 0) {
+                return fail({ErrorCode::SendFailed, -result});
+            }
+            return static_cast<std::size_t>(result);
+        }};
+}
+
+inline auto Scheduler::timeout(std::chrono::nanoseconds duration) noexcept {
+    // The timespec is read at submission time, it lives in the awaiter until then.
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(duration);
+    return OperationAwaiter{
+        state_.get(),
+        [ts = __kernel_timespec{.tv_sec = seconds.count(), .tv_nsec = (duration - seconds).count()}](
+            io_uring_sqe* sqe) mutable noexcept { ::io_uring_prep_timeout(sqe, &ts, 0, 0); },
+        [](std::int32_t result) noexcept -> Result<void> {
+            if (result < 0 && result != -ETIME) {
+                return fail({ErrorCode::RingTimeoutFailed, -result});
+            }
+            return {};
+        }};
+}
+
+inline auto Scheduler::accept(int fd) noexcept {
+    return OperationAwaiter{
+        state_.get(),
+        [fd](io_uring_sqe* sqe) noexcept { ::io_uring_prep_accept(sqe, fd, nullptr, nullptr, SOCK_CLOEXEC); },
+        [](std::int32_t result) noexcept -> Result<FileDescriptor> {
+            if (result < 0) {
+                return fail({ErrorCode::AcceptFailed, -result});
+            }
+            return FileDescriptor{result};
+        }};
+}
+
+inline auto Scheduler::connect(int fd, const sockaddr* address, socklen_t length) noexcept {
+    return OperationAwaiter{
+        state_.get(), [fd, address, length](io_uring_sqe* sqe) noexcept {
+            ::io_uring_prep_connect(sqe, fd, address, length);
+        },
+        [](std::int32_t result) noexcept -> Result<void> {
+            if (result < 0) {
+                return fail({ErrorCode::ConnectFailed, -result});
+            }
+            return {};
+        }};
+}
+
+} // namespace zportal
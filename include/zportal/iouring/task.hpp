@@ -0,0 +1,83 @@
+#pragma once
+
+#include <coroutine>
+#include <optional>
+
+#include <cstddef>
+
+#include <zportal/tools/error.hpp>
+
+namespace zportal {
+
+/*
+  Lazily started coroutine producing Result<T>. Frames come from FrameAllocator, an allocation
+  failure yields an invalid Task which reports NotEnoughMemory when awaited. Awaiting a Task
+  starts it and resumes the awaiter through symmetric transfer when it finishes.
+*/
+template <typename T = void> class Task {
+  public:
+    struct promise_type;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    struct FinalAwaiter {
+        bool await_ready() const noexcept;
+        std::coroutine_handle<> await_suspend(handle_type handle) noexcept;
+        void await_resume() const noexcept;
+    };
+
+    struct promise_type {
+        static void* operator new(std::size_t size) noexcept;
+        static void operator delete(void* frame, std::size_t size) noexcept;
+        static Task get_return_object_on_allocation_failure() noexcept;
+
+        Task get_return_object() noexcept;
+        std::suspend_always initial_suspend() const noexcept;
+        FinalAwaiter final_suspend() const noexcept;
+        void return_value(Result<T> value) noexcept;
+        void unhandled_exception() const noexcept;
+
+        std::optional<Result<T>> result;
+        std::coroutine_handle<> continuation;
+
+        // Detached tasks destroy themselves when done and report their error here.
+        bool detached{false};
+        std::optional<Error>* error_sink{};
+    };
+
+    class Awaiter {
+      public:
+        explicit Awaiter(handle_type handle) noexcept;
+
+        bool await_ready() const noexcept;
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept;
+        Result<T> await_resume() noexcept;
+
+      private:
+        handle_type handle_;
+    };
+
+    Task() noexcept = default;
+    explicit Task(handle_type handle) noexcept;
+
+    Task(Task&& /*other*/) noexcept;
+    Task& operator=(Task&& /*other*/) noexcept;
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() noexcept;
+
+    Awaiter operator co_await() && noexcept;
+
+    // Gives up ownership of the frame, e.g. to run it detached.
+    handle_type release() noexcept;
+
+    bool is_valid() const noexcept;
+    explicit operator bool() const noexcept;
+
+  private:
+    handle_type handle_;
+};
+
+} // namespace zportal
+
+#include <zportal/iouring/task.inl>
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#include <cstddef>
+
+#include <zportal/iouring/frame_allocator.hpp>
+#include <zportal/iouring/task.hpp>
+#include <zportal/tools/error.hpp>
+
+namespace zportal {
+
+template <typename T> inline bool Task<T>::FinalAwaiter::await_ready() const noexcept {
+    return false;
+}
+
+template <typename T>
+inline std::coroutine_handle<> Task<T>::FinalAwaiter::await_suspend(handle_type handle) noexcept {
+    auto& promise = handle.promise();
+    if (promise.continuation) {
+        return promise.continuation;
+    }
+
+    if (promise.detached) {
+        if (promise.error_sink != nullptr && !*promise.error_sink && promise.result && !*promise.result) {
+            *promise.error_sink = promise.result->error();
+        }
+
+        handle.destroy();
+    }
+
+    return std::noop_coroutine();
+}
+
+template <typename T> inline void Task<T>::FinalAwaiter::await_resume() const noexcept {}
+
+template <typename T> inline void* Task<T>::promise_type::operator new(std::size_t size) noexcept {
+    return FrameAllocator::allocate(size);
+}
+
+template <typename T> inline void Task<T>::promise_type::operator delete(void* frame, std::size_t size) noexcept {
+    FrameAllocator::deallocate(frame, size);
+}
+
+template <typename T> inline Task<T> Task<T>::promise_type::get_return_object_on_allocation_failure() noexcept {
+    return Task{};
+}
+
+template <typename T> inline Task<T> Task<T>::promise_type::get_return_object() noexcept {
+    return Task{handle_type::from_promise(*this)};
+}
+
+template <typename T> inline std::suspend_always Task<T>::promise_type::initial_suspend() const noexcept {
+    return {};
+}
+
+template <typename T> inline typename Task<T>::FinalAwaiter Task<T>::promise_type::final_suspend() const noexcept {
+    return {};
+}
+
+template <typename T> inline void Task<T>::promise_type::return_value(Result<T> value) noexcept {
+    result.emplace(std::move(value));
+}
+
+template <typename T> inline void Task<T>::promise_type::unhandled_exception() const noexcept {
+    std::terminate();
+}
+
+template <typename T> inline Task<T>::Awaiter::Awaiter(handle_type handle) noexcept : handle_(handle) {}
+
+template <typename T> inline bool Task<T>::Awaiter::await_ready() const noexcept {
+    return !handle_;
+}
+
+template <typename T>
+inline std::coroutine_handle<> Task<T>::Awaiter::await_suspend(std::coroutine_handle<> continuation) noexcept {
+    handle_.promise().continuation = continuation;
+    return handle_;
+}
+
+template <typename T> inline Result<T> Task<T>::Awaiter::await_resume() noexcept {
+    if (!handle_) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    if (!handle_.promise().result) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    return std::move(*handle_.promise().result);
+}
+
+template <typename T> inline Task<T>::Task(handle_type handle) noexcept : handle_(handle) {}
+
+template <typename T> inline Task<T>::Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+template <typename T> inline Task<T>& Task<T>::operator=(Task&& other) noexcept {
+    if (&other == this) {
+        return *this;
+    }
+
+    if (handle_) {
+        handle_.destroy();
+    }
+    handle_ = std::exchange(other.handle_, {});
+
+    return *this;
+}
+
+template <typename T> inline Task<T>::~Task() noexcept {
+    if (handle_) {
+        handle_.destroy();
+    }
+}
+
+template <typename T> inline typename Task<T>::Awaiter Task<T>::operator co_await() && noexcept {
+    return Awaiter{handle_};
+}
+
+template <typename T> inline typename Task<T>::handle_type Task<T>::release() noexcept {
+    return std::exchange(handle_, {});
+}
+
+template <typename T> inline bool Task<T>::is_valid() const noexcept {
+    return static_cast<bool>(handle_);
+}
+
+template <typename T> inline Task<T>::operator bool() const noexcept {
+    return is_valid();
+}
+
+} // namespace zportal
@@ -2,16 +2,42 @@
 
 #include <vector>
 
+#include <cstddef>
+#include <cstdint>
+
 #include <zportal/net/address.hpp>
+#include <zportal/net/shm_ring.hpp>
 #include <zportal/net/socket.hpp>
 #include <zportal/tools/error.hpp>
 
 namespace zportal {
 
+// The first hop, `target` or the first proxy, is raced over all its resolved addresses.
 Result<Socket> connect_to(const Address& target, const std::vector<Address>& proxies = {}) noexcept;
-Result<Socket> create_listener(const Address& address) noexcept;
+// Listens over TCP, or SCTP; Unix addresses only take TCP.
+Result<Socket> create_listener(const Address& address, int backlog = 1, Transport transport = Transport::TCP) noexcept;
 Result<Socket> accept_from(const Socket& listener) noexcept;
 
+// `count` parallel connections to the same peer, each one through the whole proxy chain.
+Result<std::vector<Socket>> connect_to(const Address& target, const std::vector<Address>& proxies,
+                                       std::uint16_t count) noexcept;
+Result<std::vector<Socket>> accept_from(const Socket& listener, std::uint16_t count) noexcept;
+
+// Happy Eyeballs (RFC 8305): attempts start in order, staggered by 250 ms or as soon as one fails,
+// the first connected socket is returned in blocking mode and the others are closed.
+Result<Socket> connect_any(const std::vector<SockAddress>& candidates) noexcept;
+
+// UDP sockets connected to their peer. The bound side waits for the peer's first datagram and leaves
+// it queued for the session. Both receive with GRO.
+Result<Socket> connect_datagram(const Address& target) noexcept;
+Result<Socket> accept_datagram(const Address& address) noexcept;
+
+// Shared memory rings with a peer on the same host, set up over a Unix socket. Each side creates the
+// ring it writes to and maps the one the peer created.
+Result<ShmChannel> connect_shm(const Address& target, std::size_t capacity = ShmRing::default_capacity) noexcept;
+Result<ShmChannel> accept_shm(const Address& address, std::size_t capacity = ShmRing::default_capacity) noexcept;
+Result<ShmChannel> accept_shm(const Socket& listener, std::size_t capacity = ShmRing::default_capacity) noexcept;
+
 Result<void> socks5_connect(Socket& socket, const Address& address);
 
 } // namespace zportal
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <optional>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zportal {
+
+// Raw IP packet helpers working on the bytes read from TUN, no copies are made.
+std::uint8_t ip_version(std::span<const std::byte> packet) noexcept;
+
+// 4 bytes for IPv4, 16 bytes for IPv6, nullopt when the packet is too short or not IP.
+std::optional<std::span<const std::byte>> ip_source(std::span<const std::byte> packet) noexcept;
+std::optional<std::span<const std::byte>> ip_destination(std::span<const std::byte> packet) noexcept;
+
+// Hash of addresses, protocol and, for unfragmented TCP/UDP/SCTP/UDP-Lite packets, ports.
+// Packets of one flow always hash the same, non IP packets hash to 0.
+std::uint32_t flow_hash(std::span<const std::byte> packet) noexcept;
+
+// Packets worth sending ahead of bulk traffic: DSCP EF or CS5-CS7, TCP segments without payload and
+// anything of at most `small_packet_size` bytes, such as DNS queries or keystrokes.
+bool is_interactive(std::span<const std::byte> packet) noexcept;
+inline constexpr std::size_t small_packet_size = 128;
+
+} // namespace zportal
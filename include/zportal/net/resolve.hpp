@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include <zportal/net/address.hpp>
 #include <zportal/tools/error.hpp>
 
@@ -7,4 +9,8 @@ namespace zportal {
 
 Result<SockAddress> resolve(const Address& address);
 
+// Every stream address of `address`, ordered for racing connects (RFC 8305 section 4): the
+// families alternate, starting with the family getaddrinfo() preferred, usually IPv6.
+Result<std::vector<SockAddress>> resolve_all(const Address& address);
+
 }
\ No newline at end of file
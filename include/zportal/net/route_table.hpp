@@ -0,0 +1,70 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <zportal/net/address.hpp>
+#include <zportal/tools/error.hpp>
+
+namespace zportal {
+
+/*
+  Longest prefix match from inner IP addresses to a 16-bit value (e.g. peer index).
+  One hash map per prefix length and family; lookups probe only the lengths in use,
+  longest first, so a table of host routes costs a single hash lookup.
+*/
+class RouteTable {
+  public:
+    RouteTable() noexcept = default;
+
+    // Replaces the value of an already present prefix. Host bits of `cidr` are ignored.
+    Result<void> insert(const Cidr& cidr, std::uint16_t value) noexcept;
+    Result<void> insert(std::span<const std::byte> address, std::uint8_t prefix, std::uint16_t value) noexcept;
+    bool erase(const Cidr& cidr) noexcept;
+    std::size_t erase_value(std::uint16_t value) noexcept;
+    void clear() noexcept;
+
+    // `address` is a raw 4 byte IPv4 or 16 byte IPv6 address, as found in IP headers.
+    std::optional<std::uint16_t> lookup(std::span<const std::byte> address) const noexcept;
+    std::optional<std::uint16_t> lookup(const SockAddress& address) const noexcept;
+
+    std::size_t size() const noexcept;
+    bool empty() const noexcept;
+
+  private:
+    struct Key {
+        std::uint64_t high;
+        std::uint64_t low;
+
+        bool operator==(const Key&) const noexcept = default;
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const noexcept;
+    };
+
+    using Prefixes = std::unordered_map<Key, std::uint16_t, KeyHash>;
+
+    struct Family {
+        std::vector<Prefixes> by_length;
+        std::vector<std::uint8_t> lengths; // in use, longest first
+    };
+
+    Family ip4_;
+    Family ip6_;
+
+    // Addresses are left aligned 128-bit big-endian numbers, so IPv4 and IPv6 mask the same way.
+    static Key key_of_(std::span<const std::byte> address) noexcept;
+    static Key mask_(Key key, std::uint8_t prefix) noexcept;
+    static std::optional<std::span<const std::byte>> bytes_of_(const SockAddress& address) noexcept;
+
+    Family* family_of_(std::size_t address_size) noexcept;
+    const Family* family_of_(std::size_t address_size) const noexcept;
+};
+
+} // namespace zportal
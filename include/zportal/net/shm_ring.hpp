@@ -0,0 +1,92 @@
+#pragma once
+
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/uio.h>
+
+#include <zportal/net/socket.hpp>
+#include <zportal/tools/error.hpp>
+#include <zportal/tools/file_descriptor.hpp>
+
+namespace zportal {
+
+/*
+  Single producer, single consumer byte ring in a sealed memfd, shared by two processes on one host.
+  Each side maps the same pages, the writer only moves the tail and the reader only the head, each on
+  its own cache line. Nothing is a syscall: a side about to sleep raises its waiting flag and the other
+  one rings its eventfd only when it finds the flag raised.
+
+    | magic, capacity | tail, reader waiting | head, writer waiting | data (capacity) |
+*/
+class ShmRing {
+  public:
+    static constexpr std::size_t default_capacity = std::size_t{4} << 20;
+
+    ShmRing() noexcept = default;
+    // `capacity` is rounded up to a power of two.
+    static Result<ShmRing> create_shm_ring(std::size_t capacity = default_capacity) noexcept;
+    // Maps the ring the peer created, after checking its seals and header.
+    static Result<ShmRing> attach_shm_ring(FileDescriptor&& fd) noexcept;
+
+    ShmRing(ShmRing&& /*other*/) noexcept;
+    ShmRing& operator=(ShmRing&& /*other*/) noexcept;
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    ~ShmRing() noexcept;
+
+    [[nodiscard]] int get_fd() const noexcept;
+    [[nodiscard]] std::size_t get_capacity() const noexcept;
+
+    // Writer side. Copies as much of `segments` as fits and returns its size.
+    std::size_t write(std::span<const iovec> segments) noexcept;
+    // True when the ring is still full once the flag is raised, the reader rings when it made room.
+    bool wait_for_space() noexcept;
+    // Lowers the reader's flag, true when it was raised and the reader needs its doorbell rung.
+    bool take_reader_waiting() noexcept;
+
+    // Reader side. Readable bytes are those neither read nor acquired yet.
+    std::size_t get_readable() const noexcept;
+    // Copies out and frees at once, not to be mixed with acquire().
+    std::size_t read(std::span<std::byte> buffer) noexcept;
+    // Hands out the readable bytes in place, up to where the ring wraps. The writer only gets them back
+    // through release(), which frees the oldest acquired bytes first.
+    std::span<std::byte> acquire() noexcept;
+    void release(std::size_t size) noexcept;
+    // True when the ring is still empty once the flag is raised, the writer rings when it wrote.
+    bool wait_for_data() noexcept;
+    bool take_writer_waiting() noexcept;
+
+    [[nodiscard]] bool is_valid() const noexcept;
+    [[nodiscard]] explicit operator bool() const noexcept;
+
+  private:
+    struct Control;
+
+    FileDescriptor fd_;
+    Control* control_{};
+    std::byte* data_{};
+    // Kept apart from the shared header, a peer rewriting it can't make this side step out of the mapping.
+    std::size_t capacity_{};
+    std::size_t mapped_size_{};
+    // Acquired past the head, only this side knows.
+    std::size_t acquired_{};
+
+    void release_() noexcept;
+};
+
+// A ring per direction and an eventfd per side, handed over a connected Unix socket that stays open so
+// either side notices the other one going away.
+struct ShmChannel {
+    Socket socket;
+    ShmRing tx;
+    ShmRing rx;
+    // Rung by the peer for this side, and by this side for the peer.
+    FileDescriptor doorbell;
+    FileDescriptor peer_doorbell;
+};
+
+} // namespace zportal
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <chrono>
+
+#include <cstddef>
+#include <cstdint>
+
 #include <sys/socket.h>
 
 #include <zportal/net/address.hpp>
@@ -8,8 +13,15 @@
 
 namespace zportal {
 
+// Underlay carrying the frames: a byte stream, one datagram per frame, one SCTP message per frame, or
+// shared memory rings beside a Unix socket, see ShmRing.
+enum class Transport : std::uint8_t { TCP, UDP, SCTP, SHM };
+
 class Socket {
   public:
+    // Streams each way an SCTP socket asks for, the association may settle on fewer.
+    static constexpr std::uint16_t sctp_streams = 16;
+
     Socket() noexcept = default;
     explicit Socket(int fd, sa_family_t family = AF_UNSPEC);
 
@@ -32,9 +44,23 @@ class Socket {
 
     [[nodiscard]] sa_family_t get_family() const noexcept;
 
-    [[nodiscard]] static Result<Socket> create_socket(sa_family_t family, int flags = 0) noexcept;
+    // UDP and SCTP sockets need an IPv4 or IPv6 family. SCTP ones are one-to-one style, with
+    // `sctp_streams` streams and Nagle off. SHM has no socket of its own, its Unix socket is TCP's.
+    [[nodiscard]] static Result<Socket> create_socket(sa_family_t family, int flags = 0,
+                                                      Transport transport = Transport::TCP) noexcept;
 
     Result<sa_family_t> detect_family() const noexcept;
+    Result<Transport> detect_transport() const noexcept;
+    // Outbound SCTP streams of the connected association, 1 over any other transport.
+    Result<std::uint16_t> get_stream_count() const noexcept;
+
+    // Payload a datagram to the connected peer may carry without fragmenting, as far as the kernel knows.
+    Result<std::size_t> get_datagram_limit() const noexcept;
+    // Lets the kernel coalesce datagrams of one burst into a single receive, the largest up to 64 KiB.
+    Result<void> set_udp_gro() const noexcept;
+
+    // SO_BUSY_POLL and, where available, SO_PREFER_BUSY_POLL. Raising the timeout needs CAP_NET_ADMIN.
+    Result<void> set_busy_poll(std::chrono::microseconds timeout, bool prefer) const noexcept;
 
   private:
     FileDescriptor fd_;
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <zportal/net/address.hpp>
+#include <zportal/tools/error.hpp>
+
+namespace zportal {
+
+/*
+  One SOCKS5 hop without authentication. The greeting and the CONNECT request go out in one
+  write, the proxy answers both back to back, so a hop costs one round trip instead of two.
+  Replies are read through reply_buffer() and commit(), which never ask for more bytes than
+  the reply has left, bytes after it already belong to the next hop or to the tunnel.
+*/
+class Socks5Handshake {
+  public:
+    Socks5Handshake() noexcept = default;
+    static Result<Socks5Handshake> create_socks5_handshake(const Address& destination) noexcept;
+
+    std::span<const std::uint8_t> request() const noexcept;
+
+    std::span<std::uint8_t> reply_buffer() noexcept;
+    Result<void> commit(std::size_t length) noexcept;
+
+    bool is_done() const noexcept;
+
+  private:
+    enum class Stage : std::uint8_t { METHOD, REPLY, ADDRESS, DONE };
+
+    // Greeting, then CONNECT with the longest destination, a domain name.
+    std::array<std::uint8_t, 3 + 4 + 1 + 255 + 2> request_{};
+    std::size_t request_length_{};
+
+    // Method selection, then the CONNECT reply with the longest bound address.
+    std::array<std::uint8_t, 2 + 4 + 1 + 255 + 2> reply_{};
+    std::size_t received_{};
+    std::size_t needed_{};
+    Stage stage_{Stage::DONE};
+};
+
+} // namespace zportal
@@ -26,10 +26,15 @@ struct TunDeviceStats {
 
 class TunDevice {
   public:
-    static Result<TunDevice> create_tun_device(const std::string& name, const Cidr& address,
-                                               std::uint32_t mtu) noexcept;
+    // With `multi_queue` further queues of the same device can be attached with open_queue().
+    static Result<TunDevice> create_tun_device(const std::string& name, const Cidr& address, std::uint32_t mtu,
+                                               bool multi_queue = false) noexcept;
     TunDevice() noexcept = default;
 
+    // Another queue of a multi-queue device. It only reads and writes packets, device configuration
+    // and statistics stay with the device it was opened from.
+    Result<TunDevice> open_queue() const noexcept;
+
     TunDevice(TunDevice&& /*other*/) noexcept;
     TunDevice& operator=(TunDevice&& /*other*/) noexcept;
 
@@ -41,6 +46,10 @@ class TunDevice {
     Result<void> set_up() noexcept;
     Result<void> set_down() noexcept;
 
+    // Replaces the address the device was created with.
+    Result<void> set_address(const Cidr& address) noexcept;
+    const Cidr& get_address() const noexcept;
+
     Result<TunDeviceStats> get_stats() const noexcept;
 
     int get_fd() const noexcept;
@@ -58,9 +67,14 @@ class TunDevice {
     int index_{};
     std::string name_;
     std::uint32_t mtu_;
+    bool multi_queue_{false};
+    Cidr cidr_;
+
+    static Result<FileDescriptor> attach_(std::string& name, short flags) noexcept;
 
     Result<void> set_mtu_(std::uint32_t mtu) noexcept;
     Result<void> set_cidr_(const Cidr& cidr) noexcept;
+    Result<void> change_cidr_(const Cidr& cidr, std::uint16_t type, std::uint16_t flags) noexcept;
 
     static std::uint32_t nl_next_seq_() noexcept;
     static Result<void> nl_add_attr_(nlmsghdr& nlh, std::size_t maxlen, std::uint16_t type, const void* data,
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <zportal/tools/error.hpp>
+
+namespace zportal {
+
+/*
+  Starts the payload of a frame flagged Hello::BATCHED_FRAMES, the packets it lists follow back to
+  back. The frame's size and CRC cover the table and every packet. Big-endian:
+
+    | count (2) | length (2) x count | packets |
+*/
+class BatchTable {
+  public:
+    static constexpr std::size_t max_count = 64;
+    static constexpr std::size_t max_wire_size = 2 + 2 * max_count;
+    // Largest batched frame a receiver takes, its buffers stay pinned until every packet is written.
+    static constexpr std::uint32_t max_frame_size = 64 * 1024;
+
+    BatchTable() noexcept = default;
+    static Result<BatchTable> parse(std::span<const std::byte> payload) noexcept;
+
+    static constexpr std::size_t wire_size(std::size_t count) noexcept {
+        return 2 + 2 * count;
+    }
+
+    // False once max_count packets are listed.
+    bool add(std::uint16_t length) noexcept;
+
+    std::size_t get_count() const noexcept;
+    std::uint16_t get_length(std::size_t index) const noexcept;
+
+    std::span<std::byte> data() noexcept;
+    std::span<const std::byte> data() const noexcept;
+
+  private:
+    std::array<std::byte, max_wire_size> data_{};
+    std::size_t count_{};
+};
+
+} // namespace zportal
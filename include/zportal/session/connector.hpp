@@ -0,0 +1,103 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <zportal/iouring/cqe.hpp>
+#include <zportal/iouring/iouring.hpp>
+#include <zportal/net/address.hpp>
+#include <zportal/net/socket.hpp>
+#include <zportal/net/socks5.hpp>
+#include <zportal/tools/error.hpp>
+
+namespace zportal {
+
+/*
+  Opens connections to one target on the ring. Every CONNECT is linked to a timeout and carries
+  its connection index in the CQE slot. Each connection races all resolved addresses of its first
+  hop, Happy Eyeballs style, and cancels the losers. With proxies the first hop is the first proxy,
+  then each hop sends its SOCKS5 greeting and CONNECT in one SEND, linked to the RECV of the reply
+  and its timeout, one round trip per hop. SCTP connections take no proxies.
+*/
+class Connector {
+  public:
+    Connector() noexcept = default;
+    static Result<Connector> create_connector(IoUring& ring, const Address& target,
+                                              const std::vector<Address>& proxies, std::chrono::milliseconds timeout,
+                                              std::uint16_t session_index = 0,
+                                              Transport transport = Transport::TCP) noexcept;
+
+    Connector(Connector&& /*other*/) noexcept;
+    Connector& operator=(Connector&& /*other*/) noexcept;
+    Connector(const Connector&) = delete;
+    Connector& operator=(const Connector&) = delete;
+
+    // Starts `count` connections at once, the previous attempt must be taken. An attempt failing
+    // to resolve or to create its sockets may already be finished on return.
+    Result<void> start(std::uint16_t count) noexcept;
+    Result<void> handle_cqe(const Cqe& cqe) noexcept;
+
+    // Every CONNECT and its timeout completed.
+    bool is_finished() const noexcept;
+
+    // The sockets of a finished attempt, or its first error.
+    Result<std::vector<Socket>> take() noexcept;
+
+    bool is_valid() const noexcept;
+    explicit operator bool() const noexcept;
+
+    friend class Session;
+
+  private:
+    IoUring* ring_{};
+
+    Address target_;
+    std::vector<Address> proxies_;
+    std::chrono::milliseconds timeout_{};
+    std::uint16_t session_index_{};
+    Transport transport_{Transport::TCP};
+
+    static constexpr std::size_t max_connections = 256;
+    static constexpr std::size_t max_candidates = 256;
+
+    struct Attempt {
+        Socket socket;
+        std::uint64_t user_data{};
+    };
+
+    struct Race {
+        std::size_t next{};
+        std::size_t in_flight{};
+        std::uint64_t delay_user_data{};
+        bool delay_armed{false};
+        bool won{false};
+        Error error{ErrorCode::ConnectFailed};
+    };
+
+    // CONNECT reads its address at submission, they're kept anyway until the attempt finished.
+    std::vector<SockAddress> candidates_;
+    // Candidate `c` of connection `i` at i * candidates_.size() + c.
+    std::vector<Attempt> attempts_;
+    std::vector<Race> races_;
+    std::vector<Socket> sockets_;
+    std::vector<Socks5Handshake> handshakes_;
+    std::vector<std::size_t> hops_;
+    std::size_t pending_{};
+    Error error_{};
+
+    Result<void> handle_connect_cqe_(const Cqe& cqe) noexcept;
+    Result<void> handle_connect_delay_cqe_(const Cqe& cqe) noexcept;
+    Result<void> handle_socks_send_cqe_(const Cqe& cqe) noexcept;
+    Result<void> handle_socks_recv_cqe_(const Cqe& cqe) noexcept;
+
+    Result<void> start_attempt_(std::uint16_t index) noexcept;
+    Result<void> arm_connect_delay_(std::uint16_t index) noexcept;
+    Result<void> cancel_race_(std::uint16_t index) noexcept;
+    Result<void> start_hop_(std::uint16_t index) noexcept;
+    Result<void> arm_socks_recv_(std::uint16_t index) noexcept;
+};
+
+} // namespace zportal
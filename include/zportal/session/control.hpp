@@ -0,0 +1,133 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <zportal/net/address.hpp>
+#include <zportal/net/socket.hpp>
+#include <zportal/tools/error.hpp>
+
+namespace zportal {
+
+// First payload byte of frames flagged FrameHeader::control_flag. Unknown types are skipped.
+enum class ControlType : std::uint8_t { HELLO = 1, PING = 2, PONG = 3, ADDRESS = 4 };
+
+// What the frame CRC covers: the payload too, only the header, or nothing at all.
+enum class Integrity : std::uint8_t { FULL, HEADER, NONE };
+
+/*
+  First frame on every connection. Both sides send theirs without waiting for the other one, so it
+  costs no round trip: frames before the peer's hello use no feature, frames after it those both
+  sides offered. Unknown feature bits and trailing bytes of newer versions are ignored.
+*/
+class Hello {
+  public:
+    static constexpr std::uint8_t version = 2;
+    static constexpr std::size_t wire_size = 12;
+
+    // Frames using a feature carry its bit in FrameHeader flags.
+    enum Feature : std::uint32_t {
+        BATCHED_FRAMES = 0x1,
+        COMPRESSION = 0x2,
+        HEADER_CHECKSUM = 0x4,
+        GSO_PASSTHROUGH = 0x8,
+        COMPACT_HEADER = 0x10,
+        INNER_HEADERS = 0x20,
+        KEEPALIVE = 0x40,
+        NO_CHECKSUM = 0x80,
+    };
+    // Features this build implements, COMPRESSION also needs liblz4.
+    static constexpr std::uint32_t supported_features = BATCHED_FRAMES | COMPACT_HEADER | INNER_HEADERS | KEEPALIVE;
+    // Those that keep no state across frames, the only ones a lost or reordered frame can't break.
+    static constexpr std::uint32_t datagram_features = BATCHED_FRAMES | COMPRESSION | KEEPALIVE;
+
+    Hello() noexcept = default;
+    Hello(std::uint32_t features, std::uint32_t max_frame_size) noexcept;
+
+    // What this build offers over a TUN device with `mtu`, accepting frames checked as little as `integrity`.
+    // Over UDP and SCTP only datagram_features, over UDP also frames no larger than one packet's.
+    static Hello offer(std::uint32_t mtu, Integrity integrity = Integrity::FULL,
+                       Transport transport = Transport::TCP) noexcept;
+
+    static Result<Hello> parse(std::span<const std::byte> payload) noexcept;
+    std::array<std::byte, wire_size> serialize() const noexcept;
+
+    // What both sides offered, either direction may use it.
+    Hello negotiate(const Hello& peer) const noexcept;
+
+    std::uint32_t get_features() const noexcept;
+    bool has(Feature feature) const noexcept;
+    // The weakest check both sides accept.
+    Integrity get_integrity() const noexcept;
+    std::uint32_t get_max_frame_size() const noexcept;
+
+  private:
+    std::uint32_t features_{};
+    std::uint32_t max_frame_size_{};
+};
+
+/*
+  Sent every keepalive interval once the peer took KEEPALIVE, which answers with a PONG echoing the
+  timestamp. Only the sender reads it, as nanoseconds of its own steady clock.
+
+    | type (1) | reserved (3) | timestamp (8) |
+*/
+class Ping {
+  public:
+    static constexpr std::size_t wire_size = 12;
+
+    Ping() noexcept = default;
+    Ping(ControlType type, std::uint64_t timestamp) noexcept;
+
+    // A PING stamped with the current time.
+    static Ping now() noexcept;
+
+    static Result<Ping> parse(std::span<const std::byte> payload) noexcept;
+    std::array<std::byte, wire_size> serialize() const noexcept;
+
+    // The PONG answering this PING.
+    Ping pong() const noexcept;
+    // Time since the PING this PONG answers was stamped.
+    std::chrono::nanoseconds elapsed() const noexcept;
+
+    ControlType get_type() const noexcept;
+    std::uint64_t get_timestamp() const noexcept;
+
+  private:
+    ControlType type_{ControlType::PING};
+    std::uint64_t timestamp_{};
+};
+
+/*
+  Sent by a multi-peer server after its hello: the inner address it assigned to the peer, the only
+  source it accepts packets from. The prefix is the server's network, the peer configures its TUN
+  device with both. An IPv4 address takes the first 4 bytes.
+
+    | type (1) | prefix (1) | length (1) | reserved (1) | address (16) |
+*/
+class InnerAddress {
+  public:
+    static constexpr std::size_t wire_size = 20;
+
+    InnerAddress() noexcept = default;
+    // `address` is a raw 4 byte IPv4 or 16 byte IPv6 address.
+    InnerAddress(std::span<const std::byte> address, std::uint8_t prefix) noexcept;
+
+    static Result<InnerAddress> parse(std::span<const std::byte> payload) noexcept;
+    std::array<std::byte, wire_size> serialize() const noexcept;
+
+    std::span<const std::byte> get_address() const noexcept;
+    std::uint8_t get_prefix() const noexcept;
+    Result<Cidr> get_cidr() const noexcept;
+
+  private:
+    std::array<std::byte, 16> address_{};
+    std::uint8_t length_{};
+    std::uint8_t prefix_{};
+};
+
+} // namespace zportal
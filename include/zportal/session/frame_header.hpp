@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <optional>
 #include <span>
 
 #include <cstddef>
@@ -12,30 +13,56 @@ class FrameHeader {
   public:
     static constexpr std::uint32_t magic_number = 0x5A505254;
     static constexpr std::size_t wire_size = 16;
+    // Control frames carry a message from control.hpp instead of a packet, the other bits are Hello features.
+    static constexpr std::uint32_t control_flag = 0x80000000;
 
-    FrameHeader() noexcept;
+    /*
+      Compact form, once the peer took Hello::COMPACT_HEADER. Drops the magic and the upper CRC half,
+      flags only follow when there are any, rotated so the control flag takes the lowest bit:
 
-    std::uint32_t get_flags() const noexcept;
-    void set_flags(std::uint32_t flags) noexcept;
+        | varint(size << 1 | flagged) | varint(flags) if flagged | CRC32C low half (2) |
 
-    std::uint32_t get_size() const noexcept;
-    void set_size(std::uint32_t size) noexcept;
+      Varints are LEB128, at most 5 bytes each.
+    */
+    static constexpr std::size_t max_compact_size = 5 + 5 + 2;
+    static constexpr std::uint32_t compact_crc_mask = 0xFFFF;
 
-    std::uint32_t get_crc() const noexcept;
-    void set_crc(std::uint32_t crc) noexcept;
+    constexpr FrameHeader() noexcept;
 
-    std::span<std::byte, wire_size> data() noexcept;
-    std::span<const std::byte, wire_size> data() const noexcept;
+    constexpr std::uint32_t get_flags() const noexcept;
+    constexpr void set_flags(std::uint32_t flags) noexcept;
 
-    bool is_magic_valid() const noexcept;
+    constexpr std::uint32_t get_size() const noexcept;
+    constexpr void set_size(std::uint32_t size) noexcept;
+
+    constexpr std::uint32_t get_crc() const noexcept;
+    constexpr void set_crc(std::uint32_t crc) noexcept;
+    // CRC32C of the flags and size, what the CRC carries under Integrity::HEADER.
+    std::uint32_t header_crc() const noexcept;
+
+    constexpr std::span<std::byte, wire_size> data() noexcept;
+    constexpr std::span<const std::byte, wire_size> data() const noexcept;
+
+    constexpr bool is_magic_valid() const noexcept;
+
+    // Returns the compact header's length in `out`.
+    constexpr std::size_t encode_compact(std::span<std::byte, max_compact_size> out) const noexcept;
+    // Returns the compact header's length taken from `in`, 0 while `in` doesn't hold all of it yet.
+    // Fails on varints longer than 5 bytes or sizes over 32 bits. The CRC keeps only its low half.
+    constexpr std::optional<std::size_t> decode_compact(std::span<const std::byte> in) noexcept;
 
   private:
-    std::uint32_t get_u32_(std::size_t offset) const noexcept;
-    void set_u32_(std::size_t offset, std::uint32_t value) noexcept;
+    // Both return the varint's length, read_varint_() 0 while incomplete and nullopt past 5 bytes.
+    static constexpr std::size_t write_varint_(std::span<std::byte> out, std::uint64_t value) noexcept;
+    static constexpr std::optional<std::size_t> read_varint_(std::span<const std::byte> in,
+                                                             std::uint64_t& value) noexcept;
+
+    constexpr std::uint32_t get_u32_(std::size_t offset) const noexcept;
+    constexpr void set_u32_(std::size_t offset, std::uint32_t value) noexcept;
 
     std::array<std::byte, wire_size> data_{};
 };
 
 } // namespace zportal
 
-#include <zportal/session/frame_header.inl>
\ No newline at end of file
+#include <zportal/session/frame_header.inl>
@@ -1,72 +1,159 @@
 #pragma once
 
 #include <array>
+#include <bit>
+#include <limits>
+#include <optional>
 #include <span>
 
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
-#include <cstring>
-
-#include <endian.h>
 
 #include <zportal/session/frame_header.hpp>
+#include <zportal/tools/crc.hpp>
 
 namespace zportal {
 
-inline FrameHeader::FrameHeader() noexcept {
+constexpr FrameHeader::FrameHeader() noexcept {
     set_u32_(0, magic_number);
 }
 
-inline bool FrameHeader::is_magic_valid() const noexcept {
+constexpr bool FrameHeader::is_magic_valid() const noexcept {
     return get_u32_(0) == magic_number;
 }
 
-inline std::uint32_t FrameHeader::get_flags() const noexcept {
+constexpr std::uint32_t FrameHeader::get_flags() const noexcept {
     return get_u32_(4);
 }
 
-inline void FrameHeader::set_flags(std::uint32_t flags) noexcept {
+constexpr void FrameHeader::set_flags(std::uint32_t flags) noexcept {
     set_u32_(4, flags);
 }
 
-inline std::uint32_t FrameHeader::get_size() const noexcept {
+constexpr std::uint32_t FrameHeader::get_size() const noexcept {
     return get_u32_(8);
 }
 
-inline void FrameHeader::set_size(std::uint32_t size) noexcept {
+constexpr void FrameHeader::set_size(std::uint32_t size) noexcept {
     set_u32_(8, size);
 }
 
-inline std::uint32_t FrameHeader::get_crc() const noexcept {
+constexpr std::uint32_t FrameHeader::get_crc() const noexcept {
     return get_u32_(12);
 }
 
-inline void FrameHeader::set_crc(std::uint32_t crc) noexcept {
+constexpr void FrameHeader::set_crc(std::uint32_t crc) noexcept {
     set_u32_(12, crc);
 }
 
-inline std::span<std::byte, FrameHeader::wire_size> FrameHeader::data() noexcept {
+inline std::uint32_t FrameHeader::header_crc() const noexcept {
+    return crc32c(std::span<const std::byte>{data_}.subspan(4, 8));
+}
+
+constexpr std::span<std::byte, FrameHeader::wire_size> FrameHeader::data() noexcept {
     return data_;
 }
 
-inline std::span<const std::byte, FrameHeader::wire_size> FrameHeader::data() const noexcept {
+constexpr std::span<const std::byte, FrameHeader::wire_size> FrameHeader::data() const noexcept {
     return data_;
 }
 
-inline std::uint32_t FrameHeader::get_u32_(std::size_t offset) const noexcept {
+constexpr std::size_t FrameHeader::encode_compact(std::span<std::byte, max_compact_size> out) const noexcept {
+    const auto flags = get_flags();
+    std::size_t length = write_varint_(out, (std::uint64_t{get_size()} << 1) | (flags != 0 ? 1 : 0));
+    if (flags != 0) {
+        length += write_varint_(out.subspan(length), std::rotl(flags, 1));
+    }
+
+    const auto crc = get_crc();
+    out[length++] = static_cast<std::byte>(crc >> 8);
+    out[length++] = static_cast<std::byte>(crc);
+
+    return length;
+}
+
+constexpr std::optional<std::size_t> FrameHeader::decode_compact(std::span<const std::byte> in) noexcept {
+    std::uint64_t first{};
+    const auto first_length = read_varint_(in, first);
+    if (!first_length || *first_length == 0) {
+        return first_length;
+    }
+    if ((first >> 1) > std::numeric_limits<std::uint32_t>::max()) {
+        return std::nullopt;
+    }
+    std::size_t length = *first_length;
+
+    std::uint64_t flags{};
+    if ((first & 1) != 0) {
+        const auto flags_length = read_varint_(in.subspan(length), flags);
+        if (!flags_length || *flags_length == 0) {
+            return flags_length;
+        }
+        if (flags > std::numeric_limits<std::uint32_t>::max()) {
+            return std::nullopt;
+        }
+        length += *flags_length;
+    }
+
+    if (in.size() < length + 2) {
+        return 0;
+    }
+    const auto crc = (std::to_integer<std::uint32_t>(in[length]) << 8) | std::to_integer<std::uint32_t>(in[length + 1]);
+    length += 2;
+
+    set_u32_(0, magic_number);
+    set_flags(std::rotr(static_cast<std::uint32_t>(flags), 1));
+    set_size(static_cast<std::uint32_t>(first >> 1));
+    set_crc(crc);
+
+    return length;
+}
+
+constexpr std::size_t FrameHeader::write_varint_(std::span<std::byte> out, std::uint64_t value) noexcept {
+    std::size_t length{};
+    while (value >= 0x80) {
+        out[length++] = static_cast<std::byte>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out[length++] = static_cast<std::byte>(value);
+
+    return length;
+}
+
+constexpr std::optional<std::size_t> FrameHeader::read_varint_(std::span<const std::byte> in,
+                                                              std::uint64_t& value) noexcept {
+    value = 0;
+    for (std::size_t i = 0; i < 5; i++) {
+        if (i == in.size()) {
+            return 0;
+        }
+
+        const auto byte = std::to_integer<std::uint64_t>(in[i]);
+        value |= (byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0) {
+            return i + 1;
+        }
+    }
+
+    return std::nullopt;
+}
+
+constexpr std::uint32_t FrameHeader::get_u32_(std::size_t offset) const noexcept {
     assert(offset + 4 <= wire_size);
 
-    std::uint32_t value;
-    std::memcpy(&value, data_.data() + offset, 4);
-    return ::be32toh(value);
+    return (std::to_integer<std::uint32_t>(data_[offset]) << 24) |
+           (std::to_integer<std::uint32_t>(data_[offset + 1]) << 16) |
+           (std::to_integer<std::uint32_t>(data_[offset + 2]) << 8) | std::to_integer<std::uint32_t>(data_[offset + 3]);
 }
 
-inline void FrameHeader::set_u32_(std::size_t offset, std::uint32_t value) noexcept {
+constexpr void FrameHeader::set_u32_(std::size_t offset, std::uint32_t value) noexcept {
     assert(offset + 4 <= wire_size);
 
-    value = ::htobe32(value);
-    std::memcpy(data_.data() + offset, &value, 4);
+    data_[offset] = static_cast<std::byte>(value >> 24);
+    data_[offset + 1] = static_cast<std::byte>(value >> 16);
+    data_[offset + 2] = static_cast<std::byte>(value >> 8);
+    data_[offset + 3] = static_cast<std::byte>(value);
 }
 
-} // namespace zportal
\ No newline at end of file
+} // namespace zportal
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <zportal/tools/error.hpp>
+
+namespace zportal {
+
+/*
+  ROHC-like compression of the IPv4/IPv6 and TCP headers of tunneled packets, for frames flagged
+  Hello::INNER_HEADERS. Both sides keep the last headers of each flow in a context picked by its
+  flow hash, and every packet of such a frame starts with one of:
+
+    | 0x4_ or 0x6_ ...            | IP packet as read from TUN
+    | 0x10 | context (1)          | IP packet whose headers become the context's
+    | 0x20 | context (1) | changes (1) | TCP flags (1) | TCP checksum (2) | changed fields | payload |
+
+  Changed fields follow in the order of the `changes` bits, deltas as LEB128 varints, the rest as
+  sent. Lengths and the IPv4 checksum are restored from the packet. The stream keeps packets in
+  order and the receiver restores every one before it may drop it, so contexts never go out of sync.
+*/
+class InnerHeaderContexts {
+  public:
+    static constexpr std::size_t count = 256;
+    // IPv6 and a TCP header with 40 bytes of options.
+    static constexpr std::size_t max_header_size = 40 + 60;
+    // Fixed part, three 5 byte deltas, window, urgent pointer and options.
+    static constexpr std::size_t max_compressed_size = 6 + 3 * 5 + 2 + 2 + 40;
+    // A packet grows by at most the prefix in front of its full headers.
+    static constexpr std::size_t max_growth = 2;
+    // Bytes of a packet restore() needs to see.
+    static constexpr std::size_t max_prefix_size = max_growth + max_header_size;
+
+    enum Change : std::uint8_t {
+        // Absent, the IPv4 ID grew by one.
+        IP_ID = 0x01,
+        SEQUENCE = 0x02,
+        ACKNOWLEDGMENT = 0x04,
+        WINDOW = 0x08,
+        URGENT = 0x10,
+        OPTIONS = 0x20,
+    };
+
+    // `replaced` leading bytes of the packet give way to `size` bytes.
+    struct Prefix {
+        std::size_t size;
+        std::size_t replaced;
+    };
+
+    InnerHeaderContexts() noexcept = default;
+
+    // Forgets every context, allocating them on first use. Both sides do it once per connection.
+    Result<void> reset() noexcept;
+
+    // Sender side. Writes into `out` what replaces the start of `packet`, none when it isn't TCP
+    // over IPv4/IPv6 without fragments, IP options or extension headers.
+    std::optional<Prefix> compress(std::span<const std::byte> packet,
+                                   std::span<std::byte, max_compressed_size> out) noexcept;
+
+    // Receiver side. `head` holds the first bytes of a packet of `size` bytes, `out` receives its
+    // restored headers. Packets sent as read from TUN replace nothing.
+    Result<Prefix> restore(std::span<const std::byte> head, std::size_t size,
+                           std::span<std::byte, max_header_size> out) noexcept;
+
+  private:
+    struct Context {
+        std::array<std::byte, max_header_size> header{};
+        std::size_t size{};
+    };
+    std::vector<Context> contexts_;
+};
+
+} // namespace zportal
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+
 #include <cstdint>
 
 namespace zportal {
@@ -8,28 +10,82 @@ namespace zportal {
 
   |                         UserData64 Datagram                        |
   |                                 8B                                 |
-  |   1B   |                            7B                             |
-  | optype |                         NOT USED                          |
+  |   1B   | 4b  | 4b  |      2B      |      2B      |       2B       |
+  | optype | ver | --- |   session    |     slot     |     stamp      |
+
+  optype  - OperationType, kept in the low byte so version 0 values still parse.
+  ver     - encoding version, 0 means only optype is meaningful.
+  session - index of the session (tunnel) that submitted the operation.
+  slot    - per operation index, e.g. bgid of the buffer group or in-flight slot.
+  stamp   - submission time truncated to 16 bits of `stamp_tick` units.
 
 */
 
-enum class OperationType : std::uint8_t { NONE, RECV, SEND, READ, WRITE, SIGNAL, TIMEOUT };
+enum class OperationType : std::uint8_t {
+    NONE,
+    RECV,
+    SEND,
+    READ,
+    WRITE,
+    SIGNAL,
+    TIMEOUT,
+    SEND_TIMEOUT,
+    RECV_TIMEOUT,
+    AWAIT,
+    ACCEPT,
+    CONNECT,
+    CONNECT_TIMEOUT,
+    BACKOFF,
+    SOCKS_SEND,
+    SOCKS_RECV,
+    CONNECT_DELAY,
+    DRAIN_TIMEOUT,
+    KEEPALIVE,
+    DOORBELL,
+    CANDIDATE_READ,
+    CANDIDATE_TIMEOUT
+};
 
 class Operation {
   public:
+    static constexpr std::uint8_t current_version = 1;
+    using stamp_tick = std::chrono::duration<std::int64_t, std::ratio<16, 1000000>>;
+
     Operation() noexcept = default;
     explicit Operation(std::uint64_t serialized) noexcept;
+    static Operation make(OperationType type, std::uint16_t session = 0, std::uint16_t slot = 0) noexcept;
 
     OperationType get_type() const noexcept;
     void set_type(OperationType type) noexcept;
 
+    std::uint8_t get_version() const noexcept;
+
+    std::uint16_t get_session() const noexcept;
+    void set_session(std::uint16_t session) noexcept;
+
+    std::uint16_t get_slot() const noexcept;
+    void set_slot(std::uint16_t slot) noexcept;
+
+    std::uint16_t get_stamp() const noexcept;
+    void set_stamp(std::uint16_t stamp) noexcept;
+    void stamp_now() noexcept;
+
+    // Time since stamp_now(), exact while the operation completes within ~1 s (16 bits of 16 us ticks).
+    std::chrono::microseconds elapsed() const noexcept;
+    std::chrono::microseconds elapsed(std::uint16_t now_stamp) const noexcept;
+    static std::uint16_t now_stamp() noexcept;
+
     void parse(std::uint64_t serialized) noexcept;
     std::uint64_t serialize() const noexcept;
 
   private:
     OperationType type_{OperationType::NONE};
+    std::uint8_t version_{current_version};
+    std::uint16_t session_{};
+    std::uint16_t slot_{};
+    std::uint16_t stamp_{};
 };
 
 } // namespace zportal
 
-#include <zportal/session/operation.inl>
\ No newline at end of file
+#include <zportal/session/operation.inl>
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+
 #include <cstdint>
 
 #include <zportal/session/operation.hpp>
@@ -10,6 +12,16 @@ inline Operation::Operation(std::uint64_t serialized) noexcept {
     parse(serialized);
 }
 
+inline Operation Operation::make(OperationType type, std::uint16_t session, std::uint16_t slot) noexcept {
+    Operation operation;
+    operation.set_type(type);
+    operation.set_session(session);
+    operation.set_slot(slot);
+    operation.stamp_now();
+
+    return operation;
+}
+
 inline OperationType Operation::get_type() const noexcept {
     return type_;
 }
@@ -18,12 +30,72 @@ inline void Operation::set_type(OperationType type) noexcept {
     type_ = type;
 }
 
+inline std::uint8_t Operation::get_version() const noexcept {
+    return version_;
+}
+
+inline std::uint16_t Operation::get_session() const noexcept {
+    return session_;
+}
+
+inline void Operation::set_session(std::uint16_t session) noexcept {
+    session_ = session;
+}
+
+inline std::uint16_t Operation::get_slot() const noexcept {
+    return slot_;
+}
+
+inline void Operation::set_slot(std::uint16_t slot) noexcept {
+    slot_ = slot;
+}
+
+inline std::uint16_t Operation::get_stamp() const noexcept {
+    return stamp_;
+}
+
+inline void Operation::set_stamp(std::uint16_t stamp) noexcept {
+    stamp_ = stamp;
+}
+
+inline void Operation::stamp_now() noexcept {
+    stamp_ = now_stamp();
+}
+
+inline std::chrono::microseconds Operation::elapsed() const noexcept {
+    return elapsed(now_stamp());
+}
+
+inline std::chrono::microseconds Operation::elapsed(std::uint16_t now_stamp) const noexcept {
+    const auto ticks = static_cast<std::uint16_t>(now_stamp - stamp_);
+    return std::chrono::duration_cast<std::chrono::microseconds>(stamp_tick(ticks));
+}
+
+inline std::uint16_t Operation::now_stamp() noexcept {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<std::uint16_t>(std::chrono::duration_cast<stamp_tick>(now).count());
+}
+
 inline void Operation::parse(std::uint64_t serialized) noexcept {
     type_ = static_cast<OperationType>(serialized & 0xFFU);
+    version_ = static_cast<std::uint8_t>((serialized >> 8) & 0x0FU);
+
+    if (version_ == 0) {
+        session_ = 0;
+        slot_ = 0;
+        stamp_ = 0;
+        return;
+    }
+
+    session_ = static_cast<std::uint16_t>(serialized >> 16);
+    slot_ = static_cast<std::uint16_t>(serialized >> 32);
+    stamp_ = static_cast<std::uint16_t>(serialized >> 48);
 }
 
 inline std::uint64_t Operation::serialize() const noexcept {
-    return static_cast<std::uint64_t>(static_cast<std::uint8_t>(type_));
+    return static_cast<std::uint64_t>(static_cast<std::uint8_t>(type_)) |
+           (static_cast<std::uint64_t>(version_ & 0x0FU) << 8) | (static_cast<std::uint64_t>(session_) << 16) |
+           (static_cast<std::uint64_t>(slot_) << 32) | (static_cast<std::uint64_t>(stamp_) << 48);
 }
 
 } // namespace zportal
@@ -1,30 +1,52 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <optional>
 #include <queue>
+#include <span>
 #include <vector>
 
 #include <cstddef>
 #include <cstdint>
 
+#include <sys/socket.h>
 #include <sys/uio.h>
 
 #include <zportal/iouring/buffer_group.hpp>
+#include <zportal/iouring/buffer_pool.hpp>
 #include <zportal/iouring/cqe.hpp>
 #include <zportal/iouring/iouring.hpp>
+#include <zportal/net/route_table.hpp>
+#include <zportal/net/shm_ring.hpp>
 #include <zportal/net/socket.hpp>
 #include <zportal/net/tun.hpp>
+#include <zportal/session/batch.hpp>
+#include <zportal/session/control.hpp>
 #include <zportal/session/frame_header.hpp>
+#include <zportal/session/inner_header.hpp>
 #include <zportal/tools/error.hpp>
 
 namespace zportal {
 
+class Server;
 class Session;
 
 class Receiver {
   public:
     Receiver() noexcept = default;
-    static Result<Receiver> create_receiver(IoUring& ring, TunDevice& tun, Socket& socket, std::uint16_t queue_length,
-                                            std::uint32_t buffer_size) noexcept;
+    static Result<Receiver> create_receiver(IoUring& ring, TunDevice& tun, Socket& socket,
+                                            std::span<const BufferClass> classes) noexcept;
+
+    // Receives into `pool` shared with other receivers on the same ring.
+    static Result<Receiver> create_receiver(IoUring& ring, TunDevice& tun, Socket& socket,
+                                            const BufferPool& pool) noexcept;
+
+    // Writes frames to TUN straight out of `shm`, ringing `peer_doorbell` when the peer waits for the
+    // room they took. The socket only tells when the peer went away, nothing lands in the buffers of
+    // `classes` but the smallest one keeps the receiver valid.
+    static Result<Receiver> create_receiver(IoUring& ring, TunDevice& tun, Socket& socket, ShmRing&& shm,
+                                            int peer_doorbell, std::span<const BufferClass> classes) noexcept;
 
     Receiver(Receiver&& /*other*/) noexcept;
     Receiver& operator=(Receiver&& /*other*/) noexcept;
@@ -34,36 +56,134 @@ class Receiver {
     Result<void> arm_recv() noexcept;
     Result<void> handle_cqe(const Cqe& cqe) noexcept;
 
+    // Takes what the peer wrote to the ring in place, until it's empty and the doorbell is expected or
+    // max_shm_chunks pieces of it wait for their TUN writes. Fails with PeerClosed once the peer closed
+    // the socket and the ring ran empty.
+    Result<void> drain_ring() noexcept;
+
+    // Fails the session with RecvTimeout when no bytes arrive for `timeout`, zero disables.
+    Result<void> arm_recv_deadline(std::chrono::milliseconds timeout) noexcept;
+
+    // Only lets through packets whose source address routes back to this receiver's session.
+    void set_source_routes(const RouteTable* routes) noexcept;
+
+    // Offered to the peer, frames may use the features its hello has in common with this one.
+    void set_hello(const Hello& hello) noexcept;
+    // Negotiated from a hello that arrived since the last call.
+    std::optional<Hello> take_hello() noexcept;
+    // The latest PING that arrived since the last call, for the transmitter to answer.
+    std::optional<Ping> take_ping() noexcept;
+    // The inner address a multi-peer server assigned to this side, once it arrived.
+    std::optional<InnerAddress> take_address() noexcept;
+    // Smoothed over the PONGs answering this side's PINGs, zero before the first one.
+    std::chrono::nanoseconds get_rtt() const noexcept;
+
+    // Re-arms a receiver that ran out of shared buffers, once other receivers returned enough of them.
+    Result<void> resume() noexcept;
+    bool is_cooling_down() const noexcept;
+
+    // Stops arming receives and writes. Once idle, nothing is in flight and release_buffers()
+    // hands every held buffer back to the pool.
+    void stop() noexcept;
+    bool is_idle() const noexcept;
+    Result<void> release_buffers() noexcept;
+
+    // No parsed frame waits for its TUN write and none is in flight.
+    bool is_flushed() const noexcept;
+
+    // Receives from `socket` with a fresh parser, after stop() and release_buffers(). Call arm_recv()
+    // and arm_recv_deadline() again to start.
+    Result<void> restart(Socket& socket) noexcept;
+
     bool is_valid() const noexcept;
     explicit operator bool() const noexcept;
 
+    friend class Server;
     friend class Session;
 
   private:
     IoUring* ring_{};
     TunDevice* tun_{};
     Socket* socket_{};
-    BufferGroup* bg_{};
+
+    // Stream receives may land in any size class, the armed one follows the recent receive sizes.
+    BufferPool pool_;
+    BufferGroup* armed_bg_{};
+    std::size_t size_hint_{};
+    bool switching_class_{false};
+    std::uint64_t recv_user_data_{};
+    bool recv_armed_{false};
+    bool stopping_{false};
+    // Datagram sockets receive one or more whole frames per buffer through multishot RECVMSG, behind
+    // the io_uring_recvmsg_out header. The kernel reads recv_header_ while submitting.
+    bool datagram_{false};
+    msghdr recv_header_{};
+    // Over UDP and SCTP frames may overtake the peer's hello, they use only features this side offered.
+    bool unordered_{false};
+    // Over SHM the only RECV reads probe_, completing when the peer closes the socket.
+    ShmRing shm_;
+    int peer_doorbell_{-1};
+    bool shm_closed_{false};
+    std::array<std::byte, 1> probe_{};
+    // Each piece acquired from the ring is a chunk whose id carries shm_bgid and its slot. Chunks go
+    // back once parsed and written like any buffer, the ring's head passes them in order.
+    static constexpr std::uint16_t shm_bgid = 0xFFFE;
+    static constexpr std::size_t max_shm_chunks = 1024;
+    struct ShmChunk {
+        std::span<std::byte> data;
+        std::int32_t refcount{};
+        bool returned{false};
+    };
+    std::vector<ShmChunk> shm_chunks_;
+    std::size_t shm_first_chunk_{};
+    std::size_t shm_chunk_count_{};
+
+    std::uint16_t session_index_{};
+
+    const RouteTable* source_routes_{};
+
+    static constexpr std::size_t max_control_size = 64;
+    Hello hello_;
+    Hello negotiated_;
+    std::optional<Hello> pending_hello_;
+    std::optional<Ping> pending_ping_;
+    std::optional<InnerAddress> pending_address_;
+    std::chrono::nanoseconds rtt_{};
+    InnerHeaderContexts inner_contexts_;
 
     bool cooling_down_{false};
-    std::size_t used_buffers_{};
+
+    // One timer per deadline period, re-armed lazily for the remaining time since the last receive.
+    std::chrono::milliseconds recv_timeout_{};
+    std::chrono::steady_clock::time_point last_recv_{};
+    // Carried in the timer's CQE slot, timers armed before a restart() expire unnoticed.
+    std::uint16_t timer_generation_{};
 
     struct InputBuffer {
-        std::uint16_t bid;
+        BufferId id;
         std::size_t size;
         std::size_t offset{};
     };
     std::queue<InputBuffer> input_buffer_queue_;
-    std::vector<std::int32_t> buffer_refcounts_;
+    std::vector<std::vector<std::int32_t>> buffer_refcounts_;
 
     enum class ParseState : std::uint8_t { PARSING_HEADER, PARSING_PAYLOAD } state_{ParseState::PARSING_HEADER};
 
     FrameHeader header_;
     std::size_t header_progress_{};
-
+    // Set by the full header announcing Hello::COMPACT_HEADER, for every header after it.
+    bool compact_{false};
+    std::array<std::byte, FrameHeader::max_compact_size> compact_header_{};
+    // Set by the header announcing Hello::HEADER_CHECKSUM or Hello::NO_CHECKSUM, for it and every header after it.
+    Integrity integrity_{Integrity::FULL};
+
+    // Segments follow the buffers they point into, until restored headers take the first segment.
+    // These live in the frame itself, queue_frame_() points at them once it stopped moving.
     struct OutputFrame {
-        std::vector<std::uint16_t> bid;
+        std::vector<BufferId> buffers;
         std::vector<iovec> segments;
+        std::array<std::byte, InnerHeaderContexts::max_header_size> header{};
+        std::size_t header_size{};
     };
     OutputFrame frame_;
     std::size_t payload_progress_{};
@@ -71,8 +191,50 @@ class Receiver {
     std::queue<OutputFrame> output_frame_queue_;
     bool write_in_progress_{false};
 
+    // Decompressed frames until their packets are written, their ids carry staging_bgid.
+    static constexpr std::uint16_t staging_bgid = 0xFFFF;
+    static constexpr std::size_t max_staging_buffers = 32;
+    std::vector<std::vector<std::byte>> staging_;
+    std::vector<std::int32_t> staging_refcounts_;
+    std::vector<std::uint16_t> free_staging_;
+    std::vector<std::byte> compressed_;
+    // Set while the frame_ lives in discarded_, its packets only update the inner header contexts.
+    bool discarding_{false};
+    std::vector<std::byte> discarded_;
+
     Result<void> handle_write_cqe_(const Cqe& cqe) noexcept;
     Result<void> handle_recv_cqe_(const Cqe& cqe) noexcept;
+    Result<void> handle_recv_timeout_cqe_(const Cqe& cqe) noexcept;
+    Result<void> arm_probe_() noexcept;
+    Result<void> handle_probe_cqe_(const Cqe& cqe) noexcept;
+    Result<void> detect_transport_() noexcept;
+    // Narrows `input` to the datagram's payload, false when it was cut short and its buffer went back.
+    Result<bool> unwrap_datagram_(InputBuffer& input) noexcept;
+    Result<void> arm_recv_timer_(std::chrono::milliseconds timeout) noexcept;
+
+    Result<std::int32_t*> refcount_(BufferId id) noexcept;
+    Result<std::span<std::byte>> input_span_(const InputBuffer& input) noexcept;
+    Result<void> return_buffer_(BufferId id) noexcept;
+    // Moves the ring's head past the chunks returned in a row, waking the peer waiting for the room.
+    Result<void> release_shm_chunks_() noexcept;
+    // Largest packet of the current frame, those restarting a flow context grow past the MTU.
+    std::size_t packet_limit_() const noexcept;
+    // What frames are checked against, the offered hello over UDP and SCTP, the negotiated one otherwise.
+    const Hello& accepted_hello_() const noexcept;
+    // Largest payload of the current frame, decompressed or not.
+    std::size_t frame_limit_() const noexcept;
+    Result<void> restore_headers_(OutputFrame& packet) noexcept;
+    Result<void> queue_frame_(OutputFrame&& frame) noexcept;
+    Result<bool> accept_source_(const OutputFrame& frame) noexcept;
+    Result<void> handle_control_(const OutputFrame& frame) noexcept;
+    // Negotiates with the peer's hello, also for one the session read off the connection before restart().
+    Result<void> accept_hello_(const Hello& peer) noexcept;
+    // Replaces frame_ by its decompressed payload, discarded when no staging buffer is free.
+    Result<void> decompress_frame_(BufferId current) noexcept;
+    // Queues each packet of a batched frame as its own TUN write, holding its own buffer references.
+    Result<void> split_batch_(const OutputFrame& frame) noexcept;
+    Result<void> drop_frame_(const OutputFrame& frame, BufferId current) noexcept;
+    Result<void> update_size_hint_(const BufferGroup& bg, std::size_t received, bool still_armed) noexcept;
 
     Result<void> kick_parse_() noexcept;
     Result<void> kick_write_() noexcept;
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <zportal/iouring/buffer_pool.hpp>
+#include <zportal/iouring/cqe.hpp>
+#include <zportal/iouring/iouring.hpp>
+#include <zportal/net/route_table.hpp>
+#include <zportal/net/socket.hpp>
+#include <zportal/net/tun.hpp>
+#include <zportal/session/receiver.hpp>
+#include <zportal/session/transmitter.hpp>
+#include <zportal/tools/config.hpp>
+#include <zportal/tools/error.hpp>
+
+namespace zportal {
+
+/*
+  Serves many peers over one ring and one TUN device. Every accepted connection takes a peer slot,
+  whose index is both its session index in CQE user_data and its transmitter lane.
+  Each slot owns a fixed address of the server's inner network, told to the peer after the hello:
+  the peer's packets must come from it and packets read from TUN for it go to that peer.
+*/
+class Server {
+  public:
+    Server() noexcept = default;
+    static Result<Server> create_server(IoUring&& ring, TunDevice&& tun, Socket&& listener,
+                                        std::span<const BufferClass> tx_classes,
+                                        std::span<const BufferClass> rx_classes, const Config& cfg,
+                                        std::uint16_t max_peers) noexcept;
+
+    Server(Server&& /*other*/) noexcept;
+    Server& operator=(Server&& /*other*/) noexcept;
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    Result<void> run() noexcept;
+
+    std::size_t get_peer_count() const noexcept;
+
+    bool is_valid() const noexcept;
+    explicit operator bool() const noexcept;
+
+  private:
+    IoUring ring_;
+    TunDevice tun_;
+    Socket listener_;
+
+    const Config* cfg_{};
+
+    RouteTable routes_;
+
+    // All peers receive into one pool, so memory doesn't grow with the peer count.
+    BufferPool rx_pool_;
+    Transmitter transmitter_;
+
+    enum class PeerState : std::uint8_t { FREE, ACTIVE, CLOSING };
+
+    struct Peer {
+        Socket socket;
+        Receiver receiver;
+        PeerState state{PeerState::FREE};
+        bool waiting_for_buffers{false};
+        // Advanced for each receiver of the slot, a deadline left by the one before is ignored.
+        std::uint16_t timer_generation{};
+    };
+
+    // Receivers and transmitter lanes point at the peer sockets, so peers_ never reallocates.
+    std::vector<Peer> peers_;
+    std::vector<std::uint16_t> free_peers_;
+    std::vector<std::uint16_t> waiting_peers_;
+
+    void rebind_() noexcept;
+
+    Result<void> arm_accept_() noexcept;
+    Result<void> handle_accept_cqe_(const Cqe& cqe) noexcept;
+    Result<void> handle_peer_cqe_(const Cqe& cqe) noexcept;
+
+    Result<void> open_peer_(Socket&& socket) noexcept;
+    Result<void> close_peer_(std::uint16_t index, const Error& reason) noexcept;
+    Result<void> reap_peer_(std::uint16_t index) noexcept;
+    Result<void> resume_receivers_() noexcept;
+};
+
+} // namespace zportal
@@ -1,12 +1,30 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/signalfd.h>
+
+#include <zportal/iouring/buffer_pool.hpp>
+#include <zportal/iouring/cqe.hpp>
 #include <zportal/iouring/iouring.hpp>
+#include <zportal/net/shm_ring.hpp>
 #include <zportal/net/socket.hpp>
 #include <zportal/net/tun.hpp>
+#include <zportal/session/connector.hpp>
+#include <zportal/session/control.hpp>
+#include <zportal/session/frame_header.hpp>
 #include <zportal/session/receiver.hpp>
 #include <zportal/session/transmitter.hpp>
 #include <zportal/tools/config.hpp>
 #include <zportal/tools/error.hpp>
+#include <zportal/tools/file_descriptor.hpp>
 
 namespace zportal {
 
@@ -14,25 +32,123 @@ class Session {
   public:
     Session() noexcept = default;
     static Result<Session> create_session(IoUring&& ring, TunDevice&& tun, Socket&& socket,
-                                          std::uint16_t tx_queue_length, std::uint16_t rx_queue_length,
-                                          std::uint32_t rx_buffer_size, const Config& cfg) noexcept;
+                                          std::span<const BufferClass> tx_classes,
+                                          std::span<const BufferClass> rx_classes, const Config& cfg,
+                                          std::uint16_t index = 0) noexcept;
+
+    // Stripes inner flows over all `sockets` by flow hash. Each socket has its own receiver,
+    // submitting as session index `index` + its position in `sockets`.
+    static Result<Session> create_session(IoUring&& ring, TunDevice&& tun, std::vector<Socket>&& sockets,
+                                          std::span<const BufferClass> tx_classes,
+                                          std::span<const BufferClass> rx_classes, const Config& cfg,
+                                          std::uint16_t index = 0) noexcept;
+
+    // Establishes its `connections` on the ring once running: accepting them on `listener` when it's
+    // valid, connecting to Config::connect_address otherwise. TUN reads queue up until then.
+    static Result<Session> create_session(IoUring&& ring, TunDevice&& tun, Socket&& listener,
+                                          std::uint16_t connections, std::span<const BufferClass> tx_classes,
+                                          std::span<const BufferClass> rx_classes, const Config& cfg,
+                                          std::uint16_t index = 0) noexcept;
+
+    // Exchanges frames through the rings of `channel`, woken by its doorbell whenever either side slept.
+    static Result<Session> create_session(IoUring&& ring, TunDevice&& tun, ShmChannel&& channel,
+                                          std::span<const BufferClass> tx_classes,
+                                          std::span<const BufferClass> rx_classes, const Config& cfg,
+                                          std::uint16_t index = 0) noexcept;
 
     Session(Session&& /*other*/) noexcept;
     Session& operator=(Session&& /*other*/) noexcept;
     Session(const Session&) = delete;
     Session& operator=(const Session&) = delete;
 
+    // After a signal from `signal_fd`, run() stops reading TUN, sends the frames already read, shuts
+    // the connections down and returns once the peer closed them, within Config::drain_timeout.
+    void set_signal_fd(FileDescriptor&& signal_fd) noexcept;
+
     Result<void> run() noexcept;
 
   private:
     IoUring ring_;
     TunDevice tun_;
-    Socket socket_;
+    // Receivers and transmitter lanes point into sockets_, which is never resized after creation.
+    std::vector<Socket> sockets_;
 
-    const Config* cfg_;
+    const Config* cfg_{};
+    std::uint16_t index_{};
 
-    Receiver receiver_;
+    std::vector<Receiver> receivers_;
     Transmitter transmitter_;
+
+    // CONNECTING waits for new connections, DRAINING for the operations still in flight on broken ones.
+    enum class State : std::uint8_t { CONNECTING, RUNNING, DRAINING };
+    State state_{State::RUNNING};
+
+    Socket listener_;
+    bool accept_armed_{false};
+
+    // Accepted connections wait in a slot per stripe until their hello arrived, so a stray connect can
+    // neither take a stripe nor replace the running connections. The hello is consumed here and handed
+    // to the receiver. A set still incomplete after Config::connect_timeout is dropped.
+    static constexpr std::size_t max_hello_size = 64;
+    struct Candidate {
+        Socket socket;
+        std::array<std::byte, FrameHeader::wire_size + max_hello_size> frame{};
+        std::size_t received{};
+        bool reading{false};
+        bool dropped{false};
+        std::optional<Hello> hello;
+    };
+    std::vector<Candidate> candidates_;
+    std::uint16_t candidates_generation_{};
+
+    Connector connector_;
+    std::chrono::milliseconds backoff_{};
+
+    // FLUSHING sends the frames already read, CLOSING waits for the peer to close its side, CLOSED
+    // for the last TUN writes. EXPIRED returns at once.
+    enum class Stop : std::uint8_t { NONE, FLUSHING, CLOSING, CLOSED, EXPIRED };
+    Stop stop_{Stop::NONE};
+    FileDescriptor signal_fd_;
+    signalfd_siginfo signal_info_{};
+
+    // SHM only: this side's eventfd, read into doorbell_value_ whenever the peer rang it, and the peer's.
+    FileDescriptor doorbell_;
+    FileDescriptor peer_doorbell_;
+    std::uint64_t doorbell_value_{};
+
+    void rebind_() noexcept;
+
+    Result<void> handle_cqe_(const Cqe& cqe) noexcept;
+    Result<void> handle_accept_cqe_(const Cqe& cqe) noexcept;
+    Result<void> handle_connect_cqe_(const Cqe& cqe) noexcept;
+    // Hands the hello and PING the stripe's receiver took from the peer to the transmitter.
+    Result<void> forward_control_(std::uint16_t stripe) noexcept;
+
+    // Shuts the broken connections down and keeps frames read from TUN queued until new ones are up.
+    Result<void> disconnect_(const Error& reason) noexcept;
+    bool is_drained_() const noexcept;
+    Result<void> establish_() noexcept;
+    Result<void> arm_accept_() noexcept;
+    Result<void> arm_candidate_read_(std::uint16_t slot) noexcept;
+    Result<void> handle_candidate_cqe_(const Cqe& cqe) noexcept;
+    Result<void> arm_candidates_timeout_() noexcept;
+    Result<void> handle_candidates_timeout_cqe_(const Cqe& cqe) noexcept;
+    // Closes the slot's socket, or shuts it down while a read is in flight and lets its CQE close it.
+    void drop_candidate_(Candidate& candidate) noexcept;
+    bool is_candidate_set_complete_() const noexcept;
+    Result<void> attach_candidates_() noexcept;
+    Result<void> arm_backoff_() noexcept;
+    Result<void> attach_(std::vector<Socket>&& sockets) noexcept;
+
+    Result<void> arm_signal_() noexcept;
+    Result<void> handle_signal_cqe_(const Cqe& cqe) noexcept;
+    Result<void> handle_drain_timeout_cqe_(const Cqe& cqe) noexcept;
+
+    Result<void> arm_doorbell_() noexcept;
+    // The peer read or wrote after this side slept, both rings get another look.
+    Result<void> handle_doorbell_cqe_(const Cqe& cqe) noexcept;
+    // Moves the stop along, true once run() may return.
+    bool advance_stop_() noexcept;
 };
 
-} // namespace zportal
\ No newline at end of file
+} // namespace zportal
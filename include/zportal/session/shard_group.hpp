@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+
+#include <zportal/net/socket.hpp>
+#include <zportal/net/tun.hpp>
+#include <zportal/session/session.hpp>
+#include <zportal/tools/config.hpp>
+#include <zportal/tools/error.hpp>
+
+namespace zportal {
+
+/*
+  Runs one Session per worker thread, each pinned to its own CPU. Shards share nothing on the data path:
+  every shard has its own ring, TUN queue, connection and buffer groups, and the kernel spreads inner flows
+  over the TUN queues by their flow hash. Only shard 0 runs the monitor.
+*/
+class ShardGroup {
+  public:
+    ShardGroup() noexcept = default;
+
+    // Shard i runs on `tuns[i]` and `sockets[i]`. `tuns[0]` is the device the other queues were opened from.
+    static Result<ShardGroup> create_shard_group(std::vector<TunDevice>&& tuns, std::vector<Socket>&& sockets,
+                                                 const Config& cfg) noexcept;
+
+    ShardGroup(ShardGroup&& /*other*/) noexcept = default;
+    ShardGroup& operator=(ShardGroup&& /*other*/) noexcept = default;
+    ShardGroup(const ShardGroup&) = delete;
+    ShardGroup& operator=(const ShardGroup&) = delete;
+
+    // Blocks until every shard stopped. The first shard to fail shuts the others' connections down,
+    // its error is the one returned.
+    Result<void> run() noexcept;
+
+    std::size_t size() const noexcept;
+
+  private:
+    // Sessions point at their config, so configs_ is reserved once and never reallocates.
+    std::vector<Config> configs_;
+    std::vector<Session> sessions_;
+    std::vector<int> socket_fds_;
+
+    static Result<std::vector<int>> get_cpus_() noexcept;
+};
+
+} // namespace zportal
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
 #include <optional>
-#include <queue>
+#include <span>
 #include <vector>
 
 #include <cstddef>
@@ -11,22 +15,46 @@
 #include <sys/uio.h>
 
 #include <zportal/iouring/buffer_group.hpp>
+#include <zportal/iouring/buffer_pool.hpp>
 #include <zportal/iouring/cqe.hpp>
 #include <zportal/iouring/iouring.hpp>
+#include <zportal/net/route_table.hpp>
+#include <zportal/net/shm_ring.hpp>
 #include <zportal/net/socket.hpp>
 #include <zportal/net/tun.hpp>
+#include <zportal/session/batch.hpp>
+#include <zportal/session/control.hpp>
 #include <zportal/session/frame_header.hpp>
+#include <zportal/session/inner_header.hpp>
 #include <zportal/tools/error.hpp>
 
 namespace zportal {
 
+class Server;
 class Session;
 
+/*
+  Reads packets from TUN and sends them as frames over one or more sockets (lanes).
+  Each lane has its own frame queue and at most one SEND in flight, whose CQE slot is the lane index.
+  Once the peer took BATCHED_FRAMES, packets queued behind a SEND in flight go out as one frame.
+  With COMPRESSION frames are compressed, unless the last one of the same flow didn't shrink.
+  With INNER_HEADERS the TCP/IP headers of each packet shrink to what changed since its flow's last one.
+  Interactive packets skip ahead of queued bulk ones, a bounded number of them per bulk frame sent.
+  Over UDP every frame is a datagram, and runs of equal sized packets leave in one GSO send.
+  Over SCTP every frame is a message on the stream its first packet's flow hashes to.
+  Over SHM frames are copied into the peer's ring back to back, with no SEND at all.
+*/
 class Transmitter {
   public:
     Transmitter() noexcept = default;
+
+    // Single lane 0 sending over `sock`.
     static Result<Transmitter> create_transmitter(IoUring& ring, TunDevice& tun, Socket& sock,
-                                                  std::uint16_t queue_length) noexcept;
+                                                  std::span<const BufferClass> classes) noexcept;
+
+    // `lanes` closed lanes, opened later with open_lane().
+    static Result<Transmitter> create_transmitter(IoUring& ring, TunDevice& tun, std::span<const BufferClass> classes,
+                                                  std::uint16_t lanes) noexcept;
 
     Transmitter(Transmitter&& /*other*/) noexcept;
     Transmitter& operator=(Transmitter&& /*other*/) noexcept;
@@ -36,40 +64,183 @@ class Transmitter {
     Result<void> arm_read() noexcept;
     Result<void> handle_cqe(const Cqe& cqe) noexcept;
 
+    // Cancels the TUN read for good, packets already read are still sent.
+    Result<void> stop_read() noexcept;
+
+    // Links every SEND to a timeout, zero disables.
+    void set_send_timeout(std::chrono::milliseconds timeout) noexcept;
+
+    // Pings every open lane whose peer took KEEPALIVE each `interval` once armed, zero disables.
+    // Control frames go out ahead of queued packets. Pings stop with stop_read().
+    void set_keepalive(std::chrono::milliseconds interval) noexcept;
+    Result<void> arm_keepalive() noexcept;
+    // Answers a PING that arrived over the lane's current socket.
+    Result<void> send_pong(std::uint16_t lane, const Ping& ping) noexcept;
+    // Tells the lane's peer which inner address it was assigned, right after the hello.
+    Result<void> send_address(std::uint16_t lane, const InnerAddress& address) noexcept;
+
+    // Picks the lane of each packet by its destination address, packets without a route are dropped.
+    // Without routes packets are striped over the lanes by flow hash, so every flow keeps its order.
+    void set_routes(const RouteTable* routes) noexcept;
+
+    // Sent first on every lane opened afterwards, whose frames use no feature until set_lane_features().
+    void set_hello(const Hello& hello) noexcept;
+    // Negotiated from the hellos exchanged over the lane's current socket.
+    Result<void> set_lane_features(std::uint16_t lane, const Hello& negotiated) noexcept;
+
+    // Opens a closed lane, or resumes a suspended one over a new socket.
+    Result<void> open_lane(std::uint16_t lane, Socket& sock) noexcept;
+    // Opens a closed lane whose frames go into `shm`, ringing `peer_doorbell` when the peer sleeps.
+    // `sock` stays the lane's socket, shut down once drained.
+    Result<void> open_lane(std::uint16_t lane, Socket& sock, ShmRing&& shm, int peer_doorbell) noexcept;
+    // Writes what waited for room in the lanes' rings, once the peer read from them.
+    Result<void> resume_rings() noexcept;
+
+    // Keeps queueing the lane's frames but stops sending them until open_lane(). A partly sent frame
+    // is sent again from its start, the peer's parser restarts with the new socket. A closed lane
+    // starts queueing before it ever had a socket.
+    Result<void> suspend_lane(std::uint16_t lane) noexcept;
+
+    // Drops the queued frames. A SEND still in flight keeps its frame until its CQE arrives.
+    Result<void> close_lane(std::uint16_t lane) noexcept;
+    bool is_lane_idle(std::uint16_t lane) const noexcept;
+
+    // Every queued frame of every lane was handed to its socket.
+    bool is_drained() const noexcept;
+
     bool is_valid() const noexcept;
     explicit operator bool() const noexcept;
 
+    friend class Server;
     friend class Session;
 
   private:
     IoUring* ring_{};
     TunDevice* tun_{};
-    BufferGroup* bg_{};
-    Socket* sock_{};
+
+    // TUN reads need room for a whole packet, so they always use the MTU sized provided group.
+    // Packets fitting a smaller class are copied there and the MTU buffer goes back to the kernel.
+    BufferGroup* read_bg_{};
+    BufferPool copy_pool_;
+
+    std::uint16_t session_index_{};
 
     struct OutFrame {
-        std::uint16_t bid;
+        BufferId id;
         std::uint32_t size;
+        // SCTP stream of the packet's flow, batches never mix streams.
+        std::uint16_t stream{};
+        std::uint32_t flow{};
+        // Queued behind the interactive frames, counted in its lane's bulk_flows until it leaves the queue.
+        bool bulk{false};
     };
-    std::queue<OutFrame> frame_queue_;
+    // Buckets of flow hashes counting queued bulk frames, a collision only keeps a frame from jumping ahead.
+    static constexpr std::size_t flow_buckets = 256;
     bool cooling_down_{false};
+    std::uint64_t read_user_data_{};
+    bool reading_{false};
+    bool read_stopped_{false};
 
+    // Built in place, payload points into the state itself.
     struct CurrentFrameState {
-        OutFrame frame;
+        // Queued frames sent in this one, none for a control frame whose payload lives here instead.
+        std::size_t frames{};
         FrameHeader header;
+        // Sent instead of the full header once the lane switched to compact headers.
+        bool compact{false};
+        std::size_t header_size{FrameHeader::wire_size};
+        std::array<std::byte, FrameHeader::max_compact_size> compact_header{};
+        BatchTable table;
+        std::array<std::byte, std::max({Hello::wire_size, Ping::wire_size, InnerAddress::wire_size})> control_payload{};
+        std::vector<iovec> payload;
+        // Frames of equal size sent behind this one in the same datagram send, split by UDP GSO.
+        std::vector<FrameHeader> train;
+        std::size_t train_size{};
+        std::uint16_t segment_size{};
+        std::uint16_t stream{};
+        // Room for UDP_SEGMENT's segment size or the 16 bytes of SCTP's sctp_sndinfo.
+        alignas(cmsghdr) std::array<std::byte, CMSG_SPACE(16)> control{};
 
         std::size_t bytes_sent{};
         std::vector<iovec> segments;
         msghdr message_header{};
     };
-    bool send_in_progress_{false};
-    std::optional<CurrentFrameState> current_frame_state_;
+
+    enum class LaneState : std::uint8_t { CLOSED, OPEN, CLOSING, SUSPENDED };
+
+    // In flight SENDs point into the lane, so lanes_ is reserved once and never reallocates.
+    struct Lane {
+        Socket* sock{};
+        LaneState state{LaneState::CLOSED};
+        // Datagram lanes send each frame as its own datagram, none larger than `datagram_limit` in a train.
+        bool datagram{false};
+        std::size_t datagram_limit{};
+        // SCTP streams of the association, control frames go on stream 0.
+        std::uint16_t streams{1};
+        // Set for SHM lanes, whose frames never have a SEND in flight.
+        ShmRing shm;
+        int peer_doorbell{-1};
+        std::deque<OutFrame> frame_queue;
+        // Queued frames before this index are in flight or interactive, each class in FIFO order.
+        std::size_t priority_end{};
+        // Interactive frames queued ahead of bulk ones since the last bulk frame went out.
+        std::size_t priority_burst{};
+        std::array<std::uint32_t, flow_buckets> bulk_flows{};
+        bool send_in_progress{false};
+        std::optional<CurrentFrameState> current_frame_state;
+        bool hello_pending{false};
+        bool ping_pending{false};
+        std::optional<Ping> pong;
+        std::optional<InnerAddress> address;
+        Hello negotiated;
+        // The frame announcing the switch still has a full header, all after it a compact one.
+        bool compact{false};
+        // Likewise the frame switching to the negotiated check and all after it.
+        Integrity integrity{Integrity::FULL};
+        // Payload of the compressed frame in flight, and the batch gathered to compress it.
+        std::vector<std::byte> compressed;
+        std::vector<std::byte> gathered;
+        // Per flow headers last sent, and what replaces the headers of each packet of the frame in flight.
+        InnerHeaderContexts inner_contexts;
+        std::vector<std::array<std::byte, InnerHeaderContexts::max_compressed_size>> inner_headers;
+    };
+    std::vector<Lane> lanes_;
+
+    const RouteTable* routes_{};
+    // A slow peer must not pin the whole read group, routed lanes drop packets beyond this.
+    std::size_t lane_queue_limit_{};
+
+    std::chrono::milliseconds send_timeout_{};
+    std::chrono::milliseconds keepalive_interval_{};
+    std::optional<Hello> hello_;
+    // Frames left to send uncompressed per flow hash bucket, after one of them didn't shrink.
+    std::array<std::uint8_t, 256> incompressible_{};
 
     Result<void> handle_read_cqe_(const Cqe& cqe) noexcept;
     Result<void> handle_send_cqe_(const Cqe& cqe) noexcept;
-
-    Result<FrameHeader> create_frame_header_(const OutFrame& frame) noexcept;
-    Result<void> kick_send_() noexcept;
+    Result<void> handle_send_timeout_cqe_(const Cqe& cqe) noexcept;
+    Result<void> handle_keepalive_cqe_(const Cqe& cqe) noexcept;
+
+    Result<OutFrame> copy_break_(const OutFrame& frame) noexcept;
+    Result<std::span<std::byte>> get_frame_buffer_(const OutFrame& frame) noexcept;
+    Result<void> return_frame_buffer_(const OutFrame& frame) noexcept;
+
+    std::size_t batch_size_(const Lane& lane) const noexcept;
+    Result<void> build_frame_(Lane& lane, CurrentFrameState& state) noexcept;
+    Result<void> compress_frame_(Lane& lane, CurrentFrameState& state, std::size_t size) noexcept;
+    // Appends the queued packets of the same size as the plain frame just built, one frame each.
+    Result<void> build_train_(Lane& lane, CurrentFrameState& state) noexcept;
+    // Points the segments at what is left of the frame after `bytes_sent`.
+    Result<void> prepare_segments_(CurrentFrameState& state) noexcept;
+    Result<void> kick_send_(Lane& lane) noexcept;
+    // Loops instead of recursing through completions, the ring takes frames until it fills up.
+    Result<void> kick_ring_(Lane& lane) noexcept;
+    // Accounts `sent` bytes of the lane's current frame, popping its packets once all of it went out.
+    Result<void> complete_send_(Lane& lane, std::size_t sent) noexcept;
+    Result<void> resume_read_() noexcept;
+
+    Result<Lane*> route_(const OutFrame& frame) noexcept;
+    Result<void> drop_queued_(Lane& lane, std::size_t keep) noexcept;
 };
 
 } // namespace zportal
\ No newline at end of file
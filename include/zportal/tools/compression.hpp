@@ -0,0 +1,26 @@
+#pragma once
+
+#include <span>
+
+#include <cstddef>
+
+#include <zportal/tools/error.hpp>
+
+/*
+  LZ4 block compression, available when built with liblz4. Without it nothing is ever
+  compressed and Hello::COMPRESSION isn't offered.
+*/
+namespace zportal::compression {
+
+bool is_available() noexcept;
+
+// Largest compressed size of `size` bytes.
+std::size_t bound(std::size_t size) noexcept;
+
+// Size of `input` compressed into `output`, 0 when it doesn't fit.
+std::size_t compress(std::span<const std::byte> input, std::span<std::byte> output) noexcept;
+
+// Fails when `input` is malformed or doesn't decompress into `output`.
+Result<std::size_t> decompress(std::span<const std::byte> input, std::span<std::byte> output) noexcept;
+
+} // namespace zportal::compression
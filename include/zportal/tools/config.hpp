@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <exception>
 #include <optional>
 #include <string>
@@ -7,7 +8,10 @@
 
 #include <cstdint>
 
+#include <zportal/iouring/buffer_pool.hpp>
 #include <zportal/net/address.hpp>
+#include <zportal/net/socket.hpp>
+#include <zportal/session/control.hpp>
 
 namespace zportal {
 
@@ -25,6 +29,59 @@ struct Config {
     // Client config
     std::vector<zportal::Address> proxies;
 
+    // UDP sends every frame as its own datagram, so a lost one holds back nothing behind it. The bound
+    // side serves the first peer that sends to it, one session without proxies or reconnects. SCTP
+    // sends every frame as a message on its flow's stream, so loss on one stream holds back no other.
+    // SHM copies frames through memory shared with a peer on the same host, meeting it on a Unix socket.
+    zportal::Transport transport{zportal::Transport::TCP};
+
+    // Server config, zero serves a single peer. More peers share the TUN device and are picked
+    // by the destination address of each packet.
+    std::uint16_t max_peers{0};
+
+    // Buffer size classes, one buffer group each. TX classes at least MTU sized back TUN reads,
+    // smaller ones receive copies of small packets so they don't pin MTU sized buffers.
+    std::vector<zportal::BufferClass> tx_buffer_classes{{256, 4096}, {2048, 1024}, {65535, 1024}};
+    std::vector<zportal::BufferClass> rx_buffer_classes{{512, 2048}, {4096, 2048}, {16384, 256}};
+
+    // Buffer memory placement
+    bool kernel_buffer_rings{false};
+    std::optional<int> numa_node;
+
+    // Stall detection, zero disables. A SEND not completing within `send_timeout` or no bytes received
+    // for `recv_timeout` ends the session with SendTimeout / RecvTimeout.
+    std::chrono::milliseconds send_timeout{0};
+    std::chrono::milliseconds recv_timeout{0};
+
+    // Pings the peer this often to measure the tunnel RTT, zero disables. Its PONGs keep an idle
+    // connection within `recv_timeout`, so a silent peer is detected without traffic.
+    std::chrono::milliseconds keepalive_interval{0};
+
+    // Weakest frame check accepted from the peer, the session uses the weakest both sides accept. Header
+    // checks still catch a desynced stream, trusted transports can skip the payload CRC.
+    zportal::Integrity integrity{zportal::Integrity::FULL};
+
+    // Reconnect after a broken connection instead of exiting, backing off up to `reconnect_backoff`
+    // between attempts. The TUN device, ring and buffer groups are kept. Zero disables.
+    std::chrono::milliseconds reconnect_backoff{0};
+
+    // Outgoing connects run on the ring, each CONNECT is linked to this timeout.
+    std::chrono::milliseconds connect_timeout{5000};
+
+    // After SIGTERM or SIGINT, how long a session may keep sending what it already read from TUN
+    // before it exits anyway. Zero exits at once.
+    std::chrono::milliseconds drain_timeout{5000};
+
+    // Sharded mode, one thread with its own ring, TUN queue and connection per shard.
+    std::uint16_t shards{1};
+
+    // Parallel connections to the peer, inner flows are spread over them by flow hash.
+    std::uint16_t stripes{1};
+
+    // NAPI busy polling, zero keeps the default interrupt driven mode.
+    std::chrono::microseconds busy_poll{0};
+    bool prefer_busy_poll{false};
+
     unsigned io_uring_entries{32};
     bool monitor_mode{true};
 };
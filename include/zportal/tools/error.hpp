@@ -17,6 +17,15 @@ enum class ErrorCode : std::uint16_t {
     InvalidMagic = 0x100,
     InvalidSize = 257,
     FrameCrcMismatch = 258,
+    InvalidHello = 259,
+    UnsupportedFlags = 260,
+    InvalidBatch = 261,
+    InvalidCompactHeader = 262,
+    DecompressFailed = 263,
+    InvalidInnerHeader = 264,
+    InvalidPing = 265,
+    InvalidShmRing = 266,
+    InvalidInnerAddress = 267,
 
     // Socket errors
     PeerClosed = 0x200,
@@ -35,6 +44,10 @@ enum class ErrorCode : std::uint16_t {
     SocketPairFailed = 525,
     InetPtonFailed = 526,
     InetNtopFailed = 527,
+    SendTimeout = 528,
+    RecvTimeout = 529,
+    GetSockOptFailed = 530,
+    ShmExchangeFailed = 531,
 
     // TUN errors
     TunOpenFailed = 0x300,
@@ -53,12 +66,27 @@ enum class ErrorCode : std::uint16_t {
     RingBufferRingSetupFailed = 1027,
     RingProbeNotSupported = 1028,
     RingRegisterBufRingFailed = 1029,
+    RingRegisterNapiFailed = 1030,
+    RingReadFailed = 1031,
+    RingWriteFailed = 1032,
+    RingTimeoutFailed = 1033,
+    RingNoFreeSlot = 1034,
 
     // Resource errors
     NotEnoughMemory = 0x500,
     NotEnoughSqe = 1281,
     PosixMemalignFailed = 1282,
     SysConfFailed = 1283,
+    NoFreeBuffer = 1284,
+    MmapFailed = 1285,
+    MbindFailed = 1286,
+    SetMempolicyFailed = 1287,
+    NumaNodeUnknown = 1288,
+    ThreadCreateFailed = 1289,
+    SetAffinityFailed = 1290,
+    SignalFdFailed = 1291,
+    MemfdCreateFailed = 1292,
+    EventFdFailed = 1293,
 
     // Internal errors
     RecvParserError = 0x600,
@@ -78,6 +106,8 @@ enum class ErrorCode : std::uint16_t {
     InvalidReceiver = 1550,
     InvalidState = 1551,
     InvalidEnumValue = 1552,
+    ForeignSession = 1553,
+    InvalidServer = 1554,
 
     // SOCKS5 errors
     SocksHostnameTooLong = 0x700,
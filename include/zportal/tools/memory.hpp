@@ -0,0 +1,54 @@
+#pragma once
+
+#include <optional>
+#include <span>
+
+#include <cstddef>
+
+#include <zportal/tools/error.hpp>
+
+namespace zportal {
+
+class MappedMemory {
+  public:
+    MappedMemory() noexcept = default;
+    static Result<MappedMemory> allocate(std::size_t size, std::optional<int> numa_node = {}) noexcept;
+
+    MappedMemory(MappedMemory&& /*other*/) noexcept;
+    MappedMemory& operator=(MappedMemory&& /*other*/) noexcept;
+    MappedMemory(const MappedMemory&) = delete;
+    MappedMemory& operator=(const MappedMemory&) = delete;
+
+    ~MappedMemory() noexcept;
+    void release() noexcept;
+
+    std::byte* data() const noexcept;
+    std::size_t size() const noexcept;
+    bool empty() const noexcept;
+
+  private:
+    std::byte* data_{};
+    std::size_t size_{};
+};
+
+// Makes kernel allocations done by the calling thread prefer `numa_node` until destroyed.
+class PreferredNodeScope {
+  public:
+    static Result<PreferredNodeScope> enter(std::optional<int> numa_node) noexcept;
+
+    PreferredNodeScope(PreferredNodeScope&& /*other*/) noexcept;
+    PreferredNodeScope& operator=(PreferredNodeScope&&) = delete;
+    PreferredNodeScope(const PreferredNodeScope&) = delete;
+    PreferredNodeScope& operator=(const PreferredNodeScope&) = delete;
+
+    ~PreferredNodeScope() noexcept;
+
+  private:
+    PreferredNodeScope() noexcept = default;
+
+    bool active_{false};
+    int saved_mode_{};
+    unsigned long saved_mask_{};
+};
+
+} // namespace zportal
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <array>
 #include <chrono>
 
+#include <cstdint>
+
 #include <zportal/iouring/cqe.hpp>
 #include <zportal/iouring/iouring.hpp>
 #include <zportal/net/tun.hpp>
+#include <zportal/session/operation.hpp>
 #include <zportal/tools/error.hpp>
 
 namespace zportal {
@@ -18,8 +22,18 @@ class Monitor {
 
     static void set_tun_device(const TunDevice& tun_device) noexcept;
 
+    // Submission to completion latency, aggregated per monitor interval and per thread.
+    static void record_latency(OperationType type, std::chrono::microseconds latency) noexcept;
+
   private:
+    struct LatencyStats {
+        std::uint64_t count;
+        std::uint64_t total_us;
+        std::uint64_t max_us;
+    };
+
     static const TunDevice* tun_device_;
+    static thread_local std::array<LatencyStats, 8> latency_;
 };
 
 } // namespace zportal
\ No newline at end of file
@@ -6,6 +6,7 @@ namespace zportal::support_check {
 
 Result<bool> recv_multishot() noexcept;
 Result<bool> read_multishot() noexcept;
+Result<bool> accept_multishot() noexcept;
 
 bool sse4() noexcept;
 
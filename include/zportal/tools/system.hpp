@@ -1,11 +1,20 @@
 #pragma once
 
+#include <span>
+#include <string>
+
 #include <cstddef>
 
 #include <zportal/tools/error.hpp>
+#include <zportal/tools/file_descriptor.hpp>
 
 namespace zportal::system {
 
 Result<std::size_t> get_page_size() noexcept;
+Result<int> get_interface_numa_node(const std::string& ifname) noexcept;
+
+// Blocks `signals` in the calling thread, threads created afterwards inherit the mask, and returns
+// a signalfd reporting them instead.
+Result<FileDescriptor> create_signal_fd(std::span<const int> signals) noexcept;
 
 }
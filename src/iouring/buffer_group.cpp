@@ -1,16 +1,31 @@
+#include <new>
 #include <optional>
 
+#include <cerrno>
 #include <cstddef>
 #include <cstdlib>
 
 #include <liburing.h>
+#include <sys/mman.h>
 
 #include <zportal/iouring/buffer_group.hpp>
 #include <zportal/tools/debug.hpp>
 #include <zportal/tools/error.hpp>
 
 zportal::BufferGroup::~BufferGroup() noexcept {
-    if (!is_valid()) {
+    if (!provided_ || br_ == nullptr) {
+        return;
+    }
+
+    if (ring_mapping_size_ != 0) {
+        if (const int result = ::io_uring_unregister_buf_ring(ring_, bgid_); result < 0) {
+            DEBUG_ERRNO(-result, "io_uring_unregister_buf_ring()");
+        }
+        if (::munmap(br_, ring_mapping_size_) != 0) {
+            DEBUG_ERRNO(errno, "munmap()");
+        }
+
+        br_ = nullptr;
         return;
     }
 
@@ -62,16 +77,68 @@ zportal::Result<void> zportal::BufferGroup::return_buffer(std::uint16_t bid) noe
         return fail(buffer.error());
     }
 
-    ::io_uring_buf_ring_add(br_, buffer->data(), buffer->size(), bid, mask_, 0);
-    ::io_uring_buf_ring_advance(br_, 1);
+    if (provided_) {
+        ::io_uring_buf_ring_add(br_, buffer->data(), buffer->size(), bid, mask_, 0);
+        ::io_uring_buf_ring_advance(br_, 1);
+    } else {
+        try {
+            free_bids_.push_back(bid);
+        } catch (const std::bad_alloc&) {
+            return fail(ErrorCode::NotEnoughMemory);
+        }
+    }
+
+    if (used_ > 0) {
+        used_--;
+    }
 
     return {};
 }
 
+zportal::Result<std::span<std::byte>> zportal::BufferGroup::take_buffer(std::uint16_t bid,
+                                                                        std::optional<std::uint32_t> size) noexcept {
+    if (!provided_) {
+        return fail(ErrorCode::InvalidBufferGroup);
+    }
+
+    auto buffer = get_buffer(bid, size);
+    if (!buffer) {
+        return fail(buffer.error());
+    }
+
+    used_++;
+
+    return buffer;
+}
+
+zportal::Result<std::uint16_t> zportal::BufferGroup::acquire_buffer() noexcept {
+    if (!is_valid() || provided_) {
+        return fail(ErrorCode::InvalidBufferGroup);
+    }
+
+    if (free_bids_.empty()) {
+        return fail(ErrorCode::NoFreeBuffer);
+    }
+
+    const std::uint16_t bid = free_bids_.back();
+    free_bids_.pop_back();
+    used_++;
+
+    return bid;
+}
+
 std::size_t zportal::BufferGroup::get_buffer_count() const noexcept {
     return buffer_count_;
 }
 
+std::size_t zportal::BufferGroup::get_used_count() const noexcept {
+    return used_;
+}
+
+std::size_t zportal::BufferGroup::get_free_count() const noexcept {
+    return static_cast<std::size_t>(buffer_count_) - used_;
+}
+
 std::uint32_t zportal::BufferGroup::get_buffer_size() const noexcept {
     return buffer_size_;
 }
@@ -80,12 +147,16 @@ std::uint16_t zportal::BufferGroup::get_bgid() const noexcept {
     return bgid_;
 }
 
+bool zportal::BufferGroup::is_provided() const noexcept {
+    return provided_;
+}
+
 bool zportal::BufferGroup::is_valid() const noexcept {
-    return br_ != nullptr;
+    return provided_ ? br_ != nullptr : !data_.empty();
 }
 
 zportal::BufferGroup::operator bool() const noexcept {
     return is_valid();
 }
 
-zportal::BufferGroup::BufferGroup(io_uring* ring) noexcept : ring_(ring) {}
\ No newline at end of file
+zportal::BufferGroup::BufferGroup(io_uring* ring, bool provided) noexcept : ring_(ring), provided_(provided) {}
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <new>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <zportal/iouring/buffer_group.hpp>
+#include <zportal/iouring/buffer_pool.hpp>
+#include <zportal/iouring/iouring.hpp>
+#include <zportal/tools/error.hpp>
+
+zportal::Result<zportal::BufferPool> zportal::BufferPool::create_buffer_pool(IoUring& ring,
+                                                                             std::span<const BufferClass> classes,
+                                                                             bool provided) noexcept {
+    if (classes.empty()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    std::vector<BufferClass> sorted;
+    try {
+        sorted.assign(classes.begin(), classes.end());
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+    std::ranges::sort(sorted, {}, &BufferClass::buffer_size);
+
+    BufferPool pool;
+    try {
+        pool.classes_.reserve(sorted.size());
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    for (const auto& buffer_class : sorted) {
+        if (!pool.classes_.empty() && pool.classes_.back()->get_buffer_size() == buffer_class.buffer_size) {
+            return fail({ErrorCode::InvalidArgument, 0, "duplicated buffer size class"});
+        }
+
+        auto bg = ring.create_buffer_group(buffer_class.buffer_count, buffer_class.buffer_size, provided);
+        if (!bg) {
+            return fail(bg.error());
+        }
+
+        pool.classes_.push_back(*bg);
+    }
+
+    return pool;
+}
+
+zportal::Result<zportal::BufferPool> zportal::BufferPool::share() const noexcept {
+    BufferPool pool;
+    try {
+        pool.classes_ = classes_;
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    return pool;
+}
+
+zportal::BufferGroup* zportal::BufferPool::select(std::size_t size_hint) const noexcept {
+    if (auto* bg = select_fitting(size_hint); bg != nullptr) {
+        return bg;
+    }
+
+    for (auto it = classes_.rbegin(); it != classes_.rend(); it++) {
+        if ((*it)->get_free_count() > 0) {
+            return *it;
+        }
+    }
+
+    return nullptr;
+}
+
+zportal::BufferGroup* zportal::BufferPool::select_fitting(std::size_t size) const noexcept {
+    for (auto* bg : classes_) {
+        if (bg->get_buffer_size() >= size && bg->get_free_count() > 0) {
+            return bg;
+        }
+    }
+
+    return nullptr;
+}
+
+zportal::Result<zportal::BufferGroup*> zportal::BufferPool::get_buffer_group(std::uint16_t bgid) const noexcept {
+    for (auto* bg : classes_) {
+        if (bg->get_bgid() == bgid) {
+            return bg;
+        }
+    }
+
+    return fail(ErrorCode::InvalidBgid);
+}
+
+std::optional<std::size_t> zportal::BufferPool::index_of(std::uint16_t bgid) const noexcept {
+    for (std::size_t i = 0; i < classes_.size(); i++) {
+        if (classes_[i]->get_bgid() == bgid) {
+            return i;
+        }
+    }
+
+    return std::nullopt;
+}
+
+zportal::Result<std::span<std::byte>> zportal::BufferPool::get_buffer(BufferId id,
+                                                                      std::optional<std::uint32_t> size) const noexcept {
+    const auto bg = get_buffer_group(id.bgid);
+    if (!bg) {
+        return fail(bg.error());
+    }
+
+    return (*bg)->get_buffer(id.bid, size);
+}
+
+zportal::Result<void> zportal::BufferPool::return_buffer(BufferId id) const noexcept {
+    const auto bg = get_buffer_group(id.bgid);
+    if (!bg) {
+        return fail(bg.error());
+    }
+
+    return (*bg)->return_buffer(id.bid);
+}
+
+std::span<zportal::BufferGroup* const> zportal::BufferPool::get_classes() const noexcept {
+    return classes_;
+}
+
+zportal::BufferGroup* zportal::BufferPool::smallest() const noexcept {
+    return classes_.empty() ? nullptr : classes_.front();
+}
+
+zportal::BufferGroup* zportal::BufferPool::largest() const noexcept {
+    return classes_.empty() ? nullptr : classes_.back();
+}
+
+std::size_t zportal::BufferPool::get_buffer_count() const noexcept {
+    std::size_t count{};
+    for (const auto* bg : classes_) {
+        count += bg->get_buffer_count();
+    }
+
+    return count;
+}
+
+std::size_t zportal::BufferPool::get_used_count() const noexcept {
+    std::size_t count{};
+    for (const auto* bg : classes_) {
+        count += bg->get_used_count();
+    }
+
+    return count;
+}
+
+std::size_t zportal::BufferPool::get_memory_size() const noexcept {
+    std::size_t size{};
+    for (const auto* bg : classes_) {
+        size += bg->get_buffer_count() * static_cast<std::size_t>(bg->get_buffer_size());
+    }
+
+    return size;
+}
+
+bool zportal::BufferPool::is_valid() const noexcept {
+    return !classes_.empty();
+}
+
+zportal::BufferPool::operator bool() const noexcept {
+    return is_valid();
+}
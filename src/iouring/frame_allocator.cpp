@@ -0,0 +1,74 @@
+#include <array>
+#include <new>
+#include <utility>
+
+#include <cstddef>
+
+#include <zportal/iouring/frame_allocator.hpp>
+
+namespace {
+
+struct FreeFrame {
+    FreeFrame* next;
+};
+
+constexpr std::size_t bucket_count = zportal::FrameAllocator::max_pooled_size / zportal::FrameAllocator::granularity;
+
+struct FreeLists {
+    std::array<FreeFrame*, bucket_count> heads{};
+    std::size_t cached{};
+
+    FreeLists() noexcept = default;
+    FreeLists(const FreeLists&) = delete;
+    FreeLists& operator=(const FreeLists&) = delete;
+
+    ~FreeLists() noexcept {
+        for (auto*& head : heads) {
+            while (head != nullptr) {
+                ::operator delete(std::exchange(head, head->next));
+            }
+        }
+    }
+};
+
+thread_local FreeLists free_lists;
+
+constexpr std::size_t bucket_of(std::size_t size) noexcept {
+    return (size + zportal::FrameAllocator::granularity - 1) / zportal::FrameAllocator::granularity - 1;
+}
+
+} // namespace
+
+void* zportal::FrameAllocator::allocate(std::size_t size) noexcept {
+    if (size == 0 || size > max_pooled_size) {
+        return ::operator new(size, std::nothrow);
+    }
+
+    const std::size_t bucket = bucket_of(size);
+    if (auto* frame = free_lists.heads[bucket]; frame != nullptr) {
+        free_lists.heads[bucket] = frame->next;
+        free_lists.cached--;
+        return frame;
+    }
+
+    return ::operator new((bucket + 1) * granularity, std::nothrow);
+}
+
+void zportal::FrameAllocator::deallocate(void* frame, std::size_t size) noexcept {
+    if (frame == nullptr) {
+        return;
+    }
+
+    if (size == 0 || size > max_pooled_size) {
+        ::operator delete(frame);
+        return;
+    }
+
+    const std::size_t bucket = bucket_of(size);
+    free_lists.heads[bucket] = new (frame) FreeFrame{free_lists.heads[bucket]};
+    free_lists.cached++;
+}
+
+std::size_t zportal::FrameAllocator::get_cached_count() noexcept {
+    return free_lists.cached;
+}
@@ -1,19 +1,27 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <memory>
+#include <span>
 #include <new>
 #include <utility>
 #include <vector>
 
+#include <cerrno>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 
 #include <liburing.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include <zportal/iouring/buffer_group.hpp>
 #include <zportal/iouring/iouring.hpp>
+#include <zportal/tools/debug.hpp>
 #include <zportal/tools/error.hpp>
+#include <zportal/tools/memory.hpp>
 #include <zportal/tools/system.hpp>
 
 zportal::Result<zportal::IoUring> zportal::IoUring::create_queue(unsigned entries) noexcept {
@@ -27,7 +35,8 @@ zportal::Result<zportal::IoUring> zportal::IoUring::create_queue(unsigned entrie
 
 zportal::IoUring::IoUring(IoUring&& other) noexcept
     : ring_(std::exchange(other.ring_, invalid_ring_)), buffer_groups_(std::move(other.buffer_groups_)),
-      next_bgid_(std::exchange(other.next_bgid_, 0)) {}
+      next_bgid_(std::exchange(other.next_bgid_, 0)),
+      buffer_ring_options_(std::exchange(other.buffer_ring_options_, {})) {}
 zportal::IoUring& zportal::IoUring::operator=(IoUring&& other) noexcept {
     if (&other == this) {
         return *this;
@@ -37,6 +46,7 @@ zportal::IoUring& zportal::IoUring::operator=(IoUring&& other) noexcept {
     ring_ = std::exchange(other.ring_, invalid_ring_);
     buffer_groups_ = std::move(other.buffer_groups_);
     next_bgid_ = std::exchange(other.next_bgid_, 0);
+    buffer_ring_options_ = std::exchange(other.buffer_ring_options_, {});
 
     return *this;
 }
@@ -99,6 +109,60 @@ zportal::Result<zportal::Cqe> zportal::IoUring::wait() noexcept {
     return cqe_copy;
 }
 
+zportal::Result<std::size_t> zportal::IoUring::wait_batch(std::span<Cqe> cqes) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::RingInvalid);
+    }
+
+    if (cqes.empty()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    io_uring_cqe* cqe = nullptr;
+    if (const int result = ::io_uring_wait_cqe(&ring_, &cqe); result < 0) {
+        return fail({ErrorCode::RingWaitFailed, -result});
+    }
+
+    std::array<io_uring_cqe*, 64> ready{};
+    const auto limit = static_cast<unsigned>(std::min(cqes.size(), ready.size()));
+    const unsigned count = ::io_uring_peek_batch_cqe(&ring_, ready.data(), limit);
+
+    for (unsigned i = 0; i < count; i++) {
+        cqes[i] = Cqe{*ready[i]};
+    }
+    ::io_uring_cq_advance(&ring_, count);
+
+    return static_cast<std::size_t>(count);
+}
+
+zportal::Result<bool> zportal::IoUring::register_napi(std::chrono::microseconds busy_poll_timeout,
+                                                      bool prefer_busy_poll) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::RingInvalid);
+    }
+
+#if HAVE_IO_URING_REGISTER_NAPI
+    io_uring_napi napi{};
+    napi.busy_poll_to = static_cast<std::uint32_t>(busy_poll_timeout.count());
+    napi.prefer_busy_poll = prefer_busy_poll ? 1 : 0;
+
+    if (const int result = ::io_uring_register_napi(&ring_, &napi); result < 0) {
+        if (result == -EINVAL || result == -EOPNOTSUPP) {
+            return false;
+        }
+
+        return fail({ErrorCode::RingRegisterNapiFailed, -result});
+    }
+
+    return true;
+#else
+    (void)busy_poll_timeout;
+    (void)prefer_busy_poll;
+
+    return false;
+#endif
+}
+
 bool zportal::IoUring::is_valid() const noexcept {
     return ring_.ring_fd >= 0;
 }
@@ -108,7 +172,8 @@ zportal::IoUring::operator bool() const noexcept {
 }
 
 zportal::Result<zportal::BufferGroup*> zportal::IoUring::create_buffer_group(std::uint16_t length,
-                                                                             std::uint32_t buf_size) noexcept {
+                                                                             std::uint32_t buf_size,
+                                                                             bool provided) noexcept {
     if (!is_valid()) {
         return fail(ErrorCode::RingInvalid);
     }
@@ -117,7 +182,7 @@ zportal::Result<zportal::BufferGroup*> zportal::IoUring::create_buffer_group(std
         return fail(ErrorCode::InvalidArgument);
     }
 
-    auto bg = std::unique_ptr<BufferGroup>(new (std::nothrow) BufferGroup(&ring_));
+    auto bg = std::unique_ptr<BufferGroup>(new (std::nothrow) BufferGroup(&ring_, provided));
     if (!bg) {
         return fail(ErrorCode::NotEnoughMemory);
     }
@@ -126,20 +191,85 @@ zportal::Result<zportal::BufferGroup*> zportal::IoUring::create_buffer_group(std
     bg->buffer_size_ = buf_size;
     bg->size_ = static_cast<std::size_t>(bg->buffer_count_) * static_cast<std::size_t>(bg->buffer_size_);
 
-    try {
-        bg->data_ = std::vector<std::byte>(bg->size_);
-    } catch (const std::bad_alloc&) {
-        return fail(ErrorCode::NotEnoughMemory);
+    auto data = MappedMemory::allocate(bg->size_, buffer_ring_options_.numa_node);
+    if (!data) {
+        return fail(data.error());
     }
+    bg->data_ = std::move(*data);
 
     bg->bgid_ = get_next_bgid_();
 
+    if (!provided) {
+        // Local groups never reach the kernel, their buffers are handed out by acquire_buffer().
+        try {
+            bg->free_bids_.reserve(bg->buffer_count_);
+        } catch (const std::bad_alloc&) {
+            return fail(ErrorCode::NotEnoughMemory);
+        }
+
+        for (std::uint16_t bid = bg->buffer_count_; bid > 0; bid--) {
+            bg->free_bids_.push_back(static_cast<std::uint16_t>(bid - 1));
+        }
+
+        return buffer_groups_.emplace_back(std::move(bg)).get();
+    }
+
+    bool ring_ready = false;
+    if (buffer_ring_options_.kernel_allocated) {
+        const auto mapped = map_kernel_buf_ring_(*bg);
+        if (!mapped) {
+            return fail(mapped.error());
+        }
+
+        ring_ready = *mapped;
+    }
+
+    if (!ring_ready) {
+        const auto node_scope = PreferredNodeScope::enter(buffer_ring_options_.numa_node);
+        if (!node_scope) {
+            return fail(node_scope.error());
+        }
+
+        if (const auto result = setup_buf_ring_(*bg); !result) {
+            return fail(result.error());
+        }
+    }
+
+    bg->mask_ = ::io_uring_buf_ring_mask(static_cast<std::uint32_t>(bg->buffer_count_));
+    for (std::uint16_t bid = 0; bid < bg->buffer_count_; bid++) {
+        auto buffer = bg->get_buffer(bid);
+        if (!buffer) {
+            return fail(buffer.error());
+        }
+
+        ::io_uring_buf_ring_add(bg->br_, buffer->data(), buffer->size(), bid, bg->mask_, static_cast<int>(bid));
+    }
+
+    ::io_uring_buf_ring_advance(bg->br_, static_cast<int>(bg->buffer_count_));
+
+    return buffer_groups_.emplace_back(std::move(bg)).get();
+}
+
+zportal::Result<zportal::BufferGroup*> zportal::IoUring::get_buffer_group(std::uint16_t bgid) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::RingInvalid);
+    }
+
+    for (auto& bg : buffer_groups_) {
+        if (bg->get_bgid() == bgid) {
+            return bg.get();
+        }
+    }
+
+    return fail(ErrorCode::InvalidBgid);
+}
+
+zportal::Result<void> zportal::IoUring::setup_buf_ring_(BufferGroup& bg) noexcept {
 #if HAVE_IO_URING_SETUP_BUF_RING
     int setup_error{};
-    bg->br_ =
-        ::io_uring_setup_buf_ring(&ring_, static_cast<unsigned int>(bg->buffer_count_), bg->bgid_, 0, &setup_error);
+    bg.br_ = ::io_uring_setup_buf_ring(&ring_, static_cast<unsigned int>(bg.buffer_count_), bg.bgid_, 0, &setup_error);
 
-    if (bg->br_ == nullptr) {
+    if (bg.br_ == nullptr) {
         int error = setup_error;
 
         if (error == 0) {
@@ -155,58 +285,88 @@ zportal::Result<zportal::BufferGroup*> zportal::IoUring::create_buffer_group(std
     if (!page_size)
         return fail(page_size.error());
 
-    const std::size_t ring_bytes_raw = std::size_t(bg->buffer_count_) * sizeof(io_uring_buf);
+    const std::size_t ring_bytes_raw = std::size_t(bg.buffer_count_) * sizeof(io_uring_buf);
     const std::size_t ring_bytes = ((ring_bytes_raw + *page_size - 1) / *page_size) * *page_size;
 
-    if (const int result = ::posix_memalign(reinterpret_cast<void**>(&bg->br_), *page_size, ring_bytes); result != 0)
+    if (const int result = ::posix_memalign(reinterpret_cast<void**>(&bg.br_), *page_size, ring_bytes); result != 0)
         return fail({ErrorCode::PosixMemalignFailed, result});
 
     #if HAVE_IO_URING_BUF_RING_INIT
-    ::io_uring_buf_ring_init(bg->br_);
+    ::io_uring_buf_ring_init(bg.br_);
     #else
-    std::memset(bg->br_, 0, ring_bytes);
+    std::memset(bg.br_, 0, ring_bytes);
     #endif
 
     io_uring_buf_reg reg{};
-    reg.ring_addr = reinterpret_cast<unsigned long>(bg->br_);
-    reg.ring_entries = static_cast<std::uint32_t>(bg->buffer_count_);
-    reg.bgid = bg->bgid_;
+    reg.ring_addr = reinterpret_cast<unsigned long>(bg.br_);
+    reg.ring_entries = static_cast<std::uint32_t>(bg.buffer_count_);
+    reg.bgid = bg.bgid_;
 
     if (const int result = ::io_uring_register_buf_ring(&ring_, &reg, 0); result < 0) {
-        std::free(bg->br_);
-        bg->br_ = nullptr;
+        std::free(bg.br_);
+        bg.br_ = nullptr;
 
         return fail({ErrorCode::RingRegisterBufRingFailed, -result});
     }
 #endif
 
-    bg->mask_ = ::io_uring_buf_ring_mask(static_cast<std::uint32_t>(bg->buffer_count_));
-    for (std::uint16_t bid = 0; bid < bg->buffer_count_; bid++) {
-        auto buffer = bg->get_buffer(bid);
-        if (!buffer) {
-            return fail(buffer.error());
-        }
+    return {};
+}
 
-        ::io_uring_buf_ring_add(bg->br_, buffer->data(), buffer->size(), bid, bg->mask_, static_cast<int>(bid));
+zportal::Result<bool> zportal::IoUring::map_kernel_buf_ring_(BufferGroup& bg) noexcept {
+#if HAVE_IOU_PBUF_RING_MMAP
+    const auto page_size = system::get_page_size();
+    if (!page_size) {
+        return fail(page_size.error());
     }
 
-    ::io_uring_buf_ring_advance(bg->br_, static_cast<int>(bg->buffer_count_));
+    const std::size_t ring_bytes_raw = std::size_t(bg.buffer_count_) * sizeof(io_uring_buf);
+    const std::size_t ring_bytes = ((ring_bytes_raw + *page_size - 1) / *page_size) * *page_size;
 
-    return buffer_groups_.emplace_back(std::move(bg)).get();
-}
+    // The ring pages are allocated by the kernel during registration, following the thread memory policy.
+    const auto node_scope = PreferredNodeScope::enter(buffer_ring_options_.numa_node);
+    if (!node_scope) {
+        return fail(node_scope.error());
+    }
 
-zportal::Result<zportal::BufferGroup*> zportal::IoUring::get_buffer_group(std::uint16_t bgid) noexcept {
-    if (!is_valid()) {
-        return fail(ErrorCode::RingInvalid);
+    io_uring_buf_reg reg{};
+    reg.ring_entries = static_cast<std::uint32_t>(bg.buffer_count_);
+    reg.bgid = bg.bgid_;
+    reg.flags = IOU_PBUF_RING_MMAP;
+
+    if (const int result = ::io_uring_register_buf_ring(&ring_, &reg, 0); result < 0) {
+        // Kernels before 6.4 reject the flag, the caller falls back to a user allocated ring.
+        if (result == -EINVAL) {
+            return false;
+        }
+
+        return fail({ErrorCode::RingRegisterBufRingFailed, -result});
     }
 
-    for (auto& bg : buffer_groups_) {
-        if (bg->get_bgid() == bgid) {
-            return bg.get();
+    const auto offset =
+        static_cast<off_t>(IORING_OFF_PBUF_RING | (static_cast<std::uint64_t>(bg.bgid_) << IORING_OFF_PBUF_SHIFT));
+    void* ptr = ::mmap(nullptr, ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_.ring_fd, offset);
+    if (ptr == MAP_FAILED) {
+        const int error = errno;
+        if (const int result = ::io_uring_unregister_buf_ring(&ring_, bg.bgid_); result < 0) {
+            DEBUG_ERRNO(-result, "io_uring_unregister_buf_ring()");
         }
+
+        return fail({ErrorCode::MmapFailed, error});
     }
 
-    return fail(ErrorCode::InvalidBgid);
+    bg.br_ = static_cast<io_uring_buf_ring*>(ptr);
+    bg.ring_mapping_size_ = ring_bytes;
+
+    return true;
+#else
+    (void)bg;
+    return false;
+#endif
+}
+
+void zportal::IoUring::set_buffer_ring_options(const BufferRingOptions& options) noexcept {
+    buffer_ring_options_ = options;
 }
 
 std::uint16_t zportal::IoUring::get_next_bgid_() noexcept {
@@ -0,0 +1,145 @@
+#include <memory>
+#include <new>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <liburing.h>
+
+#include <zportal/iouring/cqe.hpp>
+#include <zportal/iouring/iouring.hpp>
+#include <zportal/iouring/scheduler.hpp>
+#include <zportal/iouring/task.hpp>
+#include <zportal/session/operation.hpp>
+#include <zportal/tools/error.hpp>
+
+zportal::Result<std::uint16_t> zportal::detail::SchedulerState::acquire_slot(PendingOperation* pending) noexcept {
+    if (free_slots.empty()) {
+        return fail(ErrorCode::RingNoFreeSlot);
+    }
+
+    const std::uint16_t slot = free_slots.back();
+    free_slots.pop_back();
+    slots[slot] = pending;
+
+    return slot;
+}
+
+void zportal::detail::SchedulerState::release_slot(std::uint16_t slot) noexcept {
+    slots[slot] = nullptr;
+    free_slots.push_back(slot);
+}
+
+zportal::Result<io_uring_sqe*> zportal::detail::SchedulerState::get_sqe() noexcept {
+    if (auto sqe = ring->get_sqe(); sqe) {
+        return *sqe;
+    }
+
+    if (const auto submit_result = ring->submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    return ring->get_sqe();
+}
+
+std::uint64_t zportal::detail::SchedulerState::user_data(std::uint16_t slot) const noexcept {
+    return Operation::make(OperationType::AWAIT, session, slot).serialize();
+}
+
+zportal::Result<zportal::Scheduler> zportal::Scheduler::create_scheduler(IoUring& ring, std::uint16_t capacity,
+                                                                         std::uint16_t session) noexcept {
+    if (!ring) {
+        return fail(ErrorCode::RingInvalid);
+    }
+
+    if (capacity == 0) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    Scheduler scheduler;
+    scheduler.state_.reset(new (std::nothrow) detail::SchedulerState{});
+    if (!scheduler.state_) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    auto& state = *scheduler.state_;
+    state.ring = &ring;
+    state.session = session;
+
+    // Both are sized once here, the free list never grows past `capacity` afterwards.
+    try {
+        state.slots.assign(capacity, nullptr);
+        state.free_slots.reserve(capacity);
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    for (std::size_t slot = capacity; slot > 0; slot--) {
+        state.free_slots.push_back(static_cast<std::uint16_t>(slot - 1));
+    }
+
+    return scheduler;
+}
+
+zportal::Result<void> zportal::Scheduler::spawn(Task<void>&& task) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    if (!task) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    const auto handle = task.release();
+    handle.promise().detached = true;
+    handle.promise().error_sink = &state_->task_error;
+    handle.resume();
+
+    return {};
+}
+
+zportal::Result<void> zportal::Scheduler::run_once() noexcept {
+    return run_once([](const Cqe& /*cqe*/) -> Result<void> { return fail(ErrorCode::WrongOperationType); });
+}
+
+zportal::Result<bool> zportal::Scheduler::dispatch(const Cqe& cqe) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    const auto operation = cqe.operation();
+    if (operation.get_type() != OperationType::AWAIT || operation.get_session() != state_->session) {
+        return false;
+    }
+
+    const std::uint16_t slot = operation.get_slot();
+    if (slot >= state_->slots.size() || state_->slots[slot] == nullptr) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    auto* pending = state_->slots[slot];
+    state_->release_slot(slot);
+
+    pending->result = cqe.result();
+    pending->flags = cqe.flags();
+    pending->handle.resume();
+
+    return true;
+}
+
+std::size_t zportal::Scheduler::get_in_flight() const noexcept {
+    if (!is_valid()) {
+        return 0;
+    }
+
+    return state_->slots.size() - state_->free_slots.size();
+}
+
+bool zportal::Scheduler::is_valid() const noexcept {
+    return state_ != nullptr && state_->ring != nullptr;
+}
+
+zportal::Scheduler::operator bool() const noexcept {
+    return is_valid();
+}
@@ -1,5 +1,16 @@
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <optional>
+#include <utility>
 #include <vector>
 
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
 
 #include <zportal/net/connection.hpp>
@@ -7,25 +18,27 @@
 #include <zportal/net/socket.hpp>
 #include <zportal/tools/error.hpp>
 
+namespace {
+
+// RFC 8305 section 5 recommends 250 ms between the starts of two connection attempts.
+constexpr std::chrono::milliseconds connection_attempt_delay{250};
+
+} // namespace
+
 zportal::Result<zportal::Socket> zportal::connect_to(const Address& target,
                                                      const std::vector<Address>& proxies) noexcept {
 
     const Address& first = proxies.empty() ? target : proxies.front();
-    const auto result = resolve(first);
-    if (!result) {
-        return fail(result.error());
+    const auto candidates = resolve_all(first);
+    if (!candidates) {
+        return fail(candidates.error());
     }
 
-    const auto& address = *result;
-    auto sock = Socket::create_socket(address.family(), SOCK_CLOEXEC);
+    auto sock = connect_any(*candidates);
     if (!sock) {
         return fail(sock.error());
     }
 
-    if (::connect((*sock).get(), address.get(), address.length()) != 0) {
-        return fail({ErrorCode::ConnectFailed, errno});
-    }
-
     if (proxies.empty()) {
         return sock;
     }
@@ -38,4 +51,136 @@ zportal::Result<zportal::Socket> zportal::connect_to(const Address& target,
     }
 
     return sock;
+}
+
+zportal::Result<zportal::Socket> zportal::connect_any(const std::vector<SockAddress>& candidates) noexcept {
+    if (candidates.empty()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    if (candidates.size() == 1) {
+        auto sock = Socket::create_socket(candidates.front().family(), SOCK_CLOEXEC);
+        if (!sock) {
+            return fail(sock.error());
+        }
+
+        if (::connect(sock->get(), candidates.front().get(), candidates.front().length()) != 0) {
+            return fail({ErrorCode::ConnectFailed, errno});
+        }
+
+        return sock;
+    }
+
+    std::vector<Socket> attempts;
+    std::vector<pollfd> pfds;
+    try {
+        attempts.reserve(candidates.size());
+        pfds.reserve(candidates.size());
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    Error last_error(ErrorCode::ConnectFailed);
+    std::size_t in_flight = 0;
+    auto next_attempt = std::chrono::steady_clock::now();
+    std::optional<std::size_t> winner;
+    while (!winner) {
+        const auto now = std::chrono::steady_clock::now();
+        if (attempts.size() < candidates.size() && (in_flight == 0 || now >= next_attempt)) {
+            const auto& candidate = candidates[attempts.size()];
+            auto sock = Socket::create_socket(candidate.family(), SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (!sock) {
+                return fail(sock.error());
+            }
+
+            const bool connected = ::connect(sock->get(), candidate.get(), candidate.length()) == 0;
+            const int connect_errno = errno;
+            attempts.push_back(std::move(*sock));
+            pfds.push_back({.fd = attempts.back().get(), .events = POLLOUT, .revents = 0});
+
+            if (connected) {
+                winner = attempts.size() - 1;
+                break;
+            }
+
+            if (connect_errno != EINPROGRESS) {
+                last_error = Error(ErrorCode::ConnectFailed, connect_errno);
+                pfds.back().fd = -1;
+                next_attempt = now;
+                continue;
+            }
+
+            in_flight++;
+            next_attempt = now + connection_attempt_delay;
+        }
+
+        if (in_flight == 0) {
+            return fail(last_error);
+        }
+
+        int timeout = -1;
+        if (attempts.size() < candidates.size()) {
+            const auto left = std::chrono::ceil<std::chrono::milliseconds>(next_attempt - now);
+            timeout = static_cast<int>(std::max(left.count(), std::chrono::milliseconds::rep{0}));
+        }
+
+        const int ready = ::poll(pfds.data(), pfds.size(), timeout);
+        if (ready < 0 && errno != EINTR) {
+            return fail({ErrorCode::ConnectFailed, errno});
+        }
+
+        for (std::size_t i = 0; ready > 0 && i < pfds.size(); i++) {
+            if (pfds[i].fd < 0 || pfds[i].revents == 0) {
+                continue;
+            }
+
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (::getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0) {
+                error = errno;
+            }
+
+            if (error == 0) {
+                winner = i;
+                break;
+            }
+
+            // A failed attempt lets the next candidate start at once.
+            last_error = Error(ErrorCode::ConnectFailed, error);
+            pfds[i].fd = -1;
+            attempts[i].close();
+            in_flight--;
+            next_attempt = std::chrono::steady_clock::now();
+        }
+    }
+
+    // The other attempts are closed with `attempts`, the winner goes back to blocking mode.
+    auto sock = std::move(attempts[*winner]);
+    const int flags = ::fcntl(sock.get(), F_GETFL);
+    if (flags < 0 || ::fcntl(sock.get(), F_SETFL, flags & ~O_NONBLOCK) != 0) {
+        return fail({ErrorCode::SetSockOptFailed, errno});
+    }
+
+    return sock;
+}
+
+zportal::Result<std::vector<zportal::Socket>> zportal::connect_to(const Address& target,
+                                                                  const std::vector<Address>& proxies,
+                                                                  std::uint16_t count) noexcept {
+    std::vector<Socket> sockets;
+    try {
+        sockets.reserve(count);
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    for (std::uint16_t i = 0; i < count; i++) {
+        auto sock = connect_to(target, proxies);
+        if (!sock) {
+            return fail(sock.error());
+        }
+        sockets.push_back(std::move(*sock));
+    }
+
+    return sockets;
 }
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include <cerrno>
+
+#include <sys/socket.h>
+
+#include <zportal/net/address.hpp>
+#include <zportal/net/connection.hpp>
+#include <zportal/net/resolve.hpp>
+#include <zportal/net/socket.hpp>
+#include <zportal/tools/error.hpp>
+
+zportal::Result<zportal::Socket> zportal::connect_datagram(const Address& target) noexcept {
+    const auto resolved = resolve(target);
+    if (!resolved) {
+        return fail(resolved.error());
+    }
+
+    auto sock = Socket::create_socket(resolved->family(), SOCK_CLOEXEC, Transport::UDP);
+    if (!sock) {
+        return fail(sock.error());
+    }
+
+    if (::connect(sock->get(), resolved->get(), resolved->length()) != 0) {
+        return fail({ErrorCode::ConnectFailed, errno});
+    }
+
+    if (const auto result = sock->set_udp_gro(); !result) {
+        return fail(result.error());
+    }
+
+    return sock;
+}
+
+zportal::Result<zportal::Socket> zportal::accept_datagram(const Address& address) noexcept {
+    const auto resolved = resolve(address);
+    if (!resolved) {
+        return fail(resolved.error());
+    }
+
+    auto sock = Socket::create_socket(resolved->family(), SOCK_CLOEXEC, Transport::UDP);
+    if (!sock) {
+        return fail(sock.error());
+    }
+
+    const int yes = 1;
+    if (::setsockopt(sock->get(), SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) != 0) {
+        return fail({ErrorCode::SetSockOptFailed, errno});
+    }
+
+    if (::bind(sock->get(), resolved->get(), resolved->length()) != 0) {
+        return fail({ErrorCode::BindFailed, errno});
+    }
+
+    // The peer's hello comes first, peeking at it tells where from without taking it.
+    sockaddr_storage peer{};
+    socklen_t length = sizeof(peer);
+    if (::recvfrom(sock->get(), nullptr, 0, MSG_PEEK | MSG_TRUNC, reinterpret_cast<sockaddr*>(&peer), &length) < 0) {
+        return fail({ErrorCode::AcceptFailed, errno});
+    }
+
+    if (::connect(sock->get(), reinterpret_cast<const sockaddr*>(&peer), length) != 0) {
+        return fail({ErrorCode::ConnectFailed, errno});
+    }
+
+    if (const auto result = sock->set_udp_gro(); !result) {
+        return fail(result.error());
+    }
+
+    return sock;
+}
@@ -1,3 +1,9 @@
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <cstdint>
+
 #include <sys/socket.h>
 
 #include <zportal/net/connection.hpp>
@@ -5,14 +11,15 @@
 #include <zportal/net/socket.hpp>
 #include <zportal/tools/error.hpp>
 
-zportal::Result<zportal::Socket> zportal::create_listener(const Address& address) noexcept {
+zportal::Result<zportal::Socket> zportal::create_listener(const Address& address, int backlog,
+                                                          Transport transport) noexcept {
     const auto result = resolve(address);
     if (!result) {
         return fail(result.error());
     }
 
     const auto& resolved = *result;
-    auto sock = Socket::create_socket(resolved.family(), SOCK_CLOEXEC);
+    auto sock = Socket::create_socket(resolved.family(), SOCK_CLOEXEC, transport);
     if (!sock) {
         return fail(sock.error());
     }
@@ -26,7 +33,7 @@ zportal::Result<zportal::Socket> zportal::create_listener(const Address& address
         return fail({ErrorCode::BindFailed, errno});
     }
 
-    if (::listen((*sock).get(), 1) != 0) {
+    if (::listen((*sock).get(), backlog) != 0) {
         return fail({ErrorCode::ListenFailed, errno});
     }
 
@@ -47,4 +54,24 @@ std::expected<zportal::Socket, zportal::Error> zportal::accept_from(const Socket
     }
 
     return Socket(clientfd);
+}
+
+zportal::Result<std::vector<zportal::Socket>> zportal::accept_from(const Socket& listener,
+                                                                   std::uint16_t count) noexcept {
+    std::vector<Socket> sockets;
+    try {
+        sockets.reserve(count);
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    for (std::uint16_t i = 0; i < count; i++) {
+        auto sock = accept_from(listener);
+        if (!sock) {
+            return fail(sock.error());
+        }
+        sockets.push_back(std::move(*sock));
+    }
+
+    return sockets;
 }
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <zportal/net/address.hpp>
+#include <zportal/net/connection.hpp>
+#include <zportal/net/shm_ring.hpp>
+#include <zportal/net/socket.hpp>
+#include <zportal/tools/error.hpp>
+#include <zportal/tools/file_descriptor.hpp>
+
+namespace {
+
+// A ring memfd and an eventfd, each way.
+constexpr std::size_t exchanged_fds = 2;
+
+// Both sides send theirs first, a socket buffer holds the other side's until it's read.
+zportal::Result<zportal::ShmChannel> exchange_channel(zportal::Socket&& socket, std::size_t capacity) noexcept {
+    if (const auto family = socket.detect_family(); !family || *family != AF_UNIX) {
+        return zportal::fail(family ? zportal::Error(zportal::ErrorCode::InvalidSocketFamily) : family.error());
+    }
+
+    zportal::ShmChannel channel;
+    channel.socket = std::move(socket);
+
+    auto tx = zportal::ShmRing::create_shm_ring(capacity);
+    if (!tx) {
+        return zportal::fail(tx.error());
+    }
+    channel.tx = std::move(*tx);
+
+    channel.doorbell.reset(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (!channel.doorbell) {
+        return zportal::fail({zportal::ErrorCode::EventFdFailed, errno});
+    }
+
+    std::byte marker{'Z'};
+    iovec payload{.iov_base = &marker, .iov_len = 1};
+    alignas(cmsghdr) std::array<std::byte, CMSG_SPACE(exchanged_fds * sizeof(int))> control{};
+
+    msghdr message{};
+    message.msg_iov = &payload;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    auto* rights = CMSG_FIRSTHDR(&message);
+    rights->cmsg_level = SOL_SOCKET;
+    rights->cmsg_type = SCM_RIGHTS;
+    rights->cmsg_len = CMSG_LEN(exchanged_fds * sizeof(int));
+    const std::array<int, exchanged_fds> sent{channel.tx.get_fd(), channel.doorbell.get()};
+    std::memcpy(CMSG_DATA(rights), sent.data(), sizeof(sent));
+
+    if (::sendmsg(channel.socket.get(), &message, MSG_NOSIGNAL) != 1) {
+        return zportal::fail({zportal::ErrorCode::SendFailed, errno});
+    }
+
+    control.fill(std::byte{});
+    message.msg_controllen = control.size();
+    message.msg_flags = 0;
+
+    const auto received = ::recvmsg(channel.socket.get(), &message, MSG_CMSG_CLOEXEC);
+    if (received < 0) {
+        return zportal::fail({zportal::ErrorCode::RecvFailed, errno});
+    }
+    if (received == 0) {
+        return zportal::fail(zportal::ErrorCode::PeerClosed);
+    }
+
+    // Descriptors that did arrive are closed along with the error.
+    std::array<zportal::FileDescriptor, exchanged_fds> fds;
+    rights = CMSG_FIRSTHDR(&message);
+    if (rights != nullptr && rights->cmsg_level == SOL_SOCKET && rights->cmsg_type == SCM_RIGHTS) {
+        std::array<int, exchanged_fds> raw{};
+        const std::size_t count = std::min((rights->cmsg_len - CMSG_LEN(0)) / sizeof(int), exchanged_fds);
+        std::memcpy(raw.data(), CMSG_DATA(rights), count * sizeof(int));
+        for (std::size_t i = 0; i < count; i++) {
+            fds[i].reset(raw[i]);
+        }
+    }
+
+    if ((message.msg_flags & MSG_CTRUNC) != 0 || !fds[0] || !fds[1]) {
+        return zportal::fail(zportal::ErrorCode::ShmExchangeFailed);
+    }
+
+    auto rx = zportal::ShmRing::attach_shm_ring(std::move(fds[0]));
+    if (!rx) {
+        return zportal::fail(rx.error());
+    }
+    channel.rx = std::move(*rx);
+    channel.peer_doorbell = std::move(fds[1]);
+
+    return channel;
+}
+
+} // namespace
+
+zportal::Result<zportal::ShmChannel> zportal::connect_shm(const Address& target, std::size_t capacity) noexcept {
+    auto sock = connect_to(target);
+    if (!sock) {
+        return fail(sock.error());
+    }
+
+    return exchange_channel(std::move(*sock), capacity);
+}
+
+zportal::Result<zportal::ShmChannel> zportal::accept_shm(const Address& address, std::size_t capacity) noexcept {
+    const auto listener = create_listener(address);
+    if (!listener) {
+        return fail(listener.error());
+    }
+
+    return accept_shm(*listener, capacity);
+}
+
+zportal::Result<zportal::ShmChannel> zportal::accept_shm(const Socket& listener, std::size_t capacity) noexcept {
+    if (const auto family = listener.detect_family(); !family || *family != AF_UNIX) {
+        return fail(family ? Error(ErrorCode::InvalidSocketFamily) : family.error());
+    }
+
+    auto sock = accept_from(listener);
+    if (!sock) {
+        return fail(sock.error());
+    }
+
+    return exchange_channel(std::move(*sock), capacity);
+}
@@ -1,40 +1,17 @@
+#include <span>
 #include <variant>
 
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 
 #include <netinet/in.h>
 
 #include <zportal/net/connection.hpp>
+#include <zportal/net/socks5.hpp>
 #include <zportal/tools/error.hpp>
 
-static constexpr auto socket_recv = [](zportal::Socket& socket, std::span<std::uint8_t> data) -> zportal::Result<void> {
-    if (data.empty()) {
-        return {};
-    }
-
-    if (!socket) {
-        return zportal::fail(zportal::ErrorCode::InvalidSocket);
-    }
-
-    std::size_t processed{};
-    while (processed < data.size()) {
-        const ssize_t n = ::recv(socket.get(), data.data() + processed, data.size() - processed, 0);
-        if (n == 0) {
-            socket.close();
-            return zportal::fail(zportal::ErrorCode::PeerClosed);
-        }
-        if (n < 0) {
-            // const auto err = errno;
-            // socket.close();
-            return zportal::fail({zportal::ErrorCode::RecvFailed, errno});
-        }
-
-        processed += static_cast<std::size_t>(n);
-    }
-
-    return {};
-};
-
 static constexpr auto socket_send = [](zportal::Socket& socket,
                                        std::span<const std::uint8_t> data) -> zportal::Result<void> {
     if (data.empty()) {
@@ -63,108 +40,142 @@ static constexpr auto socket_send = [](zportal::Socket& socket,
     return {};
 };
 
-zportal::Result<void> zportal::socks5_connect(Socket& socket, const Address& address) {
-    if (std::holds_alternative<HostPair>(address) && std::get<HostPair>(address).hostname.size() > 255) {
+zportal::Result<zportal::Socks5Handshake>
+zportal::Socks5Handshake::create_socks5_handshake(const Address& destination) noexcept {
+    if (std::holds_alternative<HostPair>(destination) && std::get<HostPair>(destination).hostname.size() > 255) {
         return fail(ErrorCode::SocksHostnameTooLong);
     }
 
-    // Auth method negotiation
-    static const std::array<std::uint8_t, 3> method_request = {0x05, 0x01, 0x00}; // "no auth" only
-    std::array<std::uint8_t, 2> method_response;
-
-    Result<void> io_result;
-    io_result = socket_send(socket, method_request);
-    if (!io_result) {
-        return io_result;
-    }
-
-    io_result = socket_recv(socket, method_response);
-    if (!io_result) {
-        return io_result;
-    }
+    Socks5Handshake handshake;
+    auto& request = handshake.request_;
 
-    if (method_response[1] == 0xFF) {
-        return fail(ErrorCode::SocksAuthMethodUnsupported);
-    }
-    if (method_response[1] != 0x00) {
-        return fail(ErrorCode::SocksAuthMethodUnsupported);
-    }
+    // Auth method negotiation, "no auth" only, then the CONNECT command
+    request[0] = 0x05;
+    request[1] = 0x01;
+    request[2] = 0x00;
+    request[3] = 0x05;
+    request[4] = 0x01;
+    request[5] = 0x00;
 
-    // CONNECT command
-    std::size_t connect_request_length{};
-    std::array<std::uint8_t, 4 /* header */ + 1 + 255 /* domain length */ + 2 /* port */> connect_request = {0x05, 0x01,
-                                                                                                             0x00};
-    if (std::holds_alternative<HostPair>(address)) {
-        connect_request[3] = 0x03; // DOMAIN
-        const auto& domain = std::get<HostPair>(address);
+    constexpr std::size_t header_length = 3 + 4;
+    if (std::holds_alternative<HostPair>(destination)) {
+        request[6] = 0x03; // DOMAIN
+        const auto& domain = std::get<HostPair>(destination);
 
-        connect_request[4] = static_cast<std::uint8_t>(domain.hostname.size());
-        std::memcpy(connect_request.data() + 4 + 1, domain.hostname.data(), domain.hostname.size());
+        request[header_length] = static_cast<std::uint8_t>(domain.hostname.size());
+        std::memcpy(request.data() + header_length + 1, domain.hostname.data(), domain.hostname.size());
 
         const std::uint16_t nport = ::htons(domain.port);
-        std::memcpy(connect_request.data() + 4 + 1 + domain.hostname.size(), &nport, sizeof(nport));
+        std::memcpy(request.data() + header_length + 1 + domain.hostname.size(), &nport, sizeof(nport));
 
-        connect_request_length = 4 + 1 + domain.hostname.size() + sizeof(nport);
+        handshake.request_length_ = header_length + 1 + domain.hostname.size() + sizeof(nport);
     } else {
-        const auto& sa = std::get<SockAddress>(address);
+        const auto& sa = std::get<SockAddress>(destination);
         if (sa.family() == AF_INET) {
-            connect_request[3] = 0x01; // IP4
+            request[6] = 0x01; // IP4
             const auto* sa_in = reinterpret_cast<const sockaddr_in*>(sa.get());
 
-            std::memcpy(connect_request.data() + 4, &sa_in->sin_addr.s_addr, 4);
-            std::memcpy(connect_request.data() + 4 + 4, &sa_in->sin_port, 2);
+            std::memcpy(request.data() + header_length, &sa_in->sin_addr.s_addr, 4);
+            std::memcpy(request.data() + header_length + 4, &sa_in->sin_port, 2);
 
-            connect_request_length = 4 + 4 + 2;
+            handshake.request_length_ = header_length + 4 + 2;
         } else if (sa.family() == AF_INET6) {
-            connect_request[3] = 0x04; // IP6
+            request[6] = 0x04; // IP6
             const auto* sa_in6 = reinterpret_cast<const sockaddr_in6*>(sa.get());
 
-            std::memcpy(connect_request.data() + 4, &sa_in6->sin6_addr, 16);
-            std::memcpy(connect_request.data() + 4 + 16, &sa_in6->sin6_port, 2);
+            std::memcpy(request.data() + header_length, &sa_in6->sin6_addr, 16);
+            std::memcpy(request.data() + header_length + 16, &sa_in6->sin6_port, 2);
 
-            connect_request_length = 4 + 16 + 2;
+            handshake.request_length_ = header_length + 16 + 2;
         } else {
             return fail(ErrorCode::SocksUnsupportedTargetFamily);
         }
     }
 
-    io_result = socket_send(socket, {connect_request.data(), connect_request_length});
-    if (!io_result) {
-        return io_result;
-    }
+    // Method selection and the start of the CONNECT reply come back to back, a domain's length
+    // is the first address byte.
+    handshake.needed_ = 2 + 4 + 1;
+    handshake.stage_ = Stage::METHOD;
 
-    std::array<std::uint8_t, 4> command_response;
-    std::array<std::uint8_t, 1 + 255 + 2> hole_for_response_address;
-    io_result = socket_recv(socket, command_response);
-    if (!io_result) {
-        return io_result;
+    return handshake;
+}
+
+std::span<const std::uint8_t> zportal::Socks5Handshake::request() const noexcept {
+    return {request_.data(), request_length_};
+}
+
+std::span<std::uint8_t> zportal::Socks5Handshake::reply_buffer() noexcept {
+    return {reply_.data() + received_, needed_ - received_};
+}
+
+zportal::Result<void> zportal::Socks5Handshake::commit(std::size_t length) noexcept {
+    if (stage_ == Stage::DONE || length > needed_ - received_) {
+        return fail(ErrorCode::InvalidArgument);
     }
+    received_ += length;
 
-    if (command_response[1] != 0x00) {
-        return fail(ErrorCode::SocksConnectFailed);
+    if (stage_ == Stage::METHOD && received_ >= 2) {
+        if (reply_[1] != 0x00) {
+            return fail(ErrorCode::SocksAuthMethodUnsupported);
+        }
+        stage_ = Stage::REPLY;
     }
 
-    std::size_t response_address_length{};
-    if (command_response[3] == 0x01) {
-        response_address_length = 4 + 2;
-    } else if (command_response[3] == 0x04) {
-        response_address_length = 16 + 2;
-    } else if (command_response[3] == 0x03) {
-        std::uint8_t len;
-        io_result = socket_recv(socket, {&len, sizeof(len)});
-        if (!io_result) {
-            return io_result;
+    if (stage_ == Stage::REPLY && received_ >= 2 + 4 + 1) {
+        if (reply_[3] != 0x00) {
+            return fail(ErrorCode::SocksConnectFailed);
         }
 
-        response_address_length = len + 2;
-    } else {
-        return fail(ErrorCode::SocksUnsupportedTargetFamily);
+        if (reply_[5] == 0x01) {
+            needed_ = 2 + 4 + 4 + 2;
+        } else if (reply_[5] == 0x04) {
+            needed_ = 2 + 4 + 16 + 2;
+        } else if (reply_[5] == 0x03) {
+            needed_ = 2 + 4 + 1 + reply_[6] + 2;
+        } else {
+            return fail(ErrorCode::SocksUnsupportedTargetFamily);
+        }
+        stage_ = Stage::ADDRESS;
+    }
+
+    if (stage_ == Stage::ADDRESS && received_ == needed_) {
+        stage_ = Stage::DONE;
     }
 
-    io_result = socket_recv(socket, {hole_for_response_address.data(), response_address_length});
+    return {};
+}
+
+bool zportal::Socks5Handshake::is_done() const noexcept {
+    return stage_ == Stage::DONE;
+}
+
+zportal::Result<void> zportal::socks5_connect(Socket& socket, const Address& address) {
+    auto handshake = Socks5Handshake::create_socks5_handshake(address);
+    if (!handshake) {
+        return fail(handshake.error());
+    }
+
+    Result<void> io_result;
+    io_result = socket_send(socket, handshake->request());
     if (!io_result) {
         return io_result;
     }
 
+    while (!handshake->is_done()) {
+        const auto buffer = handshake->reply_buffer();
+        const ssize_t n = ::recv(socket.get(), buffer.data(), buffer.size(), 0);
+        if (n == 0) {
+            socket.close();
+            return fail(ErrorCode::PeerClosed);
+        }
+        if (n < 0) {
+            return fail({ErrorCode::RecvFailed, errno});
+        }
+
+        if (const auto commit_result = handshake->commit(static_cast<std::size_t>(n)); !commit_result) {
+            return commit_result;
+        }
+    }
+
     return {};
-};
\ No newline at end of file
+}
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <zportal/net/packet.hpp>
+
+namespace {
+
+constexpr std::size_t ip4_header_size = 20;
+constexpr std::size_t ip4_source_offset = 12;
+constexpr std::size_t ip4_destination_offset = 16;
+constexpr std::size_t ip4_address_size = 4;
+
+constexpr std::size_t ip6_header_size = 40;
+constexpr std::size_t ip6_source_offset = 8;
+constexpr std::size_t ip6_destination_offset = 24;
+constexpr std::size_t ip6_address_size = 16;
+
+constexpr std::size_t ip4_fragment_offset = 6;
+constexpr std::size_t ip4_protocol_offset = 9;
+constexpr std::size_t ip6_next_header_offset = 6;
+constexpr std::size_t ports_size = 4;
+
+constexpr std::uint8_t tcp_protocol = 6;
+constexpr std::size_t tcp_data_offset = 12;
+constexpr std::size_t tcp_header_size = 20;
+
+// Expedited forwarding, then class selectors 5-7: voice signaling and network control.
+constexpr std::array<std::uint8_t, 4> interactive_dscp{46, 40, 48, 56};
+
+constexpr std::uint32_t fnv_offset_basis = 2166136261U;
+constexpr std::uint32_t fnv_prime = 16777619U;
+
+std::uint32_t fnv1a(std::uint32_t hash, std::span<const std::byte> data) noexcept {
+    for (const auto byte : data) {
+        hash = (hash ^ std::to_integer<std::uint32_t>(byte)) * fnv_prime;
+    }
+
+    return hash;
+}
+
+bool has_ports(std::uint8_t protocol) noexcept {
+    // TCP, UDP, SCTP and UDP-Lite all start with 16 bit source and destination ports.
+    return protocol == 6 || protocol == 17 || protocol == 132 || protocol == 136;
+}
+
+std::optional<std::span<const std::byte>> ip_address_at(std::span<const std::byte> packet, bool source) noexcept {
+    switch (zportal::ip_version(packet)) {
+    case 4:
+        if (packet.size() < ip4_header_size) {
+            return std::nullopt;
+        }
+        return packet.subspan(source ? ip4_source_offset : ip4_destination_offset, ip4_address_size);
+
+    case 6:
+        if (packet.size() < ip6_header_size) {
+            return std::nullopt;
+        }
+        return packet.subspan(source ? ip6_source_offset : ip6_destination_offset, ip6_address_size);
+
+    default:
+        return std::nullopt;
+    }
+}
+
+} // namespace
+
+std::uint8_t zportal::ip_version(std::span<const std::byte> packet) noexcept {
+    if (packet.empty()) {
+        return 0;
+    }
+
+    return static_cast<std::uint8_t>(std::to_integer<std::uint8_t>(packet[0]) >> 4);
+}
+
+std::optional<std::span<const std::byte>> zportal::ip_source(std::span<const std::byte> packet) noexcept {
+    return ip_address_at(packet, true);
+}
+
+std::optional<std::span<const std::byte>> zportal::ip_destination(std::span<const std::byte> packet) noexcept {
+    return ip_address_at(packet, false);
+}
+
+std::uint32_t zportal::flow_hash(std::span<const std::byte> packet) noexcept {
+    const auto source = ip_address_at(packet, true);
+    const auto destination = ip_address_at(packet, false);
+    if (!source || !destination) {
+        return 0;
+    }
+
+    const bool ip4 = ip_version(packet) == 4;
+    const auto protocol = packet[ip4 ? ip4_protocol_offset : ip6_next_header_offset];
+
+    // Extension headers aren't walked, such IPv6 packets hash on addresses and the next header only.
+    std::size_t transport_offset = ip6_header_size;
+    if (ip4) {
+        transport_offset = static_cast<std::size_t>(std::to_integer<std::uint8_t>(packet[0]) & 0x0f) * 4;
+
+        // Only the first fragment carries the ports, so every fragment hashes without them.
+        const auto fragment = (std::to_integer<std::uint16_t>(packet[ip4_fragment_offset]) << 8) |
+                              std::to_integer<std::uint16_t>(packet[ip4_fragment_offset + 1]);
+        if ((fragment & 0x3fff) != 0 || transport_offset < ip4_header_size) {
+            transport_offset = 0;
+        }
+    }
+
+    auto hash = fnv1a(fnv_offset_basis, *source);
+    hash = fnv1a(hash, *destination);
+    hash = fnv1a(hash, std::span(&protocol, 1));
+
+    if (transport_offset != 0 && has_ports(std::to_integer<std::uint8_t>(protocol)) &&
+        packet.size() >= transport_offset + ports_size) {
+        hash = fnv1a(hash, packet.subspan(transport_offset, ports_size));
+    }
+
+    return hash;
+}
+
+bool zportal::is_interactive(std::span<const std::byte> packet) noexcept {
+    const auto version = ip_version(packet);
+    if (version != 4 && version != 6) {
+        return false;
+    }
+
+    if (packet.size() <= small_packet_size) {
+        return true;
+    }
+
+    const bool ip4 = version == 4;
+    if (packet.size() < (ip4 ? ip4_header_size : ip6_header_size)) {
+        return false;
+    }
+
+    const auto first = std::to_integer<std::uint8_t>(packet[0]);
+    const auto second = std::to_integer<std::uint8_t>(packet[1]);
+    const auto dscp = static_cast<std::uint8_t>(ip4 ? second >> 2 : ((first & 0x0f) << 2) | (second >> 6));
+    if (std::ranges::find(interactive_dscp, dscp) != interactive_dscp.end()) {
+        return true;
+    }
+
+    const auto protocol = std::to_integer<std::uint8_t>(packet[ip4 ? ip4_protocol_offset : ip6_next_header_offset]);
+    if (protocol != tcp_protocol) {
+        return false;
+    }
+
+    const std::size_t tcp_offset = ip4 ? static_cast<std::size_t>(first & 0x0f) * 4 : ip6_header_size;
+    const auto fragment = ip4 ? (std::to_integer<std::uint16_t>(packet[ip4_fragment_offset]) << 8) |
+                                    std::to_integer<std::uint16_t>(packet[ip4_fragment_offset + 1])
+                              : 0;
+    if ((fragment & 0x3fff) != 0 || tcp_offset < ip4_header_size || packet.size() < tcp_offset + tcp_header_size) {
+        return false;
+    }
+
+    // Pure ACKs and other segments whose options fill the rest of the packet carry no data.
+    const auto data_offset = std::to_integer<std::size_t>(packet[tcp_offset + tcp_data_offset]) >> 4;
+    return packet.size() == tcp_offset + data_offset * 4;
+}
@@ -1,4 +1,11 @@
+#include <algorithm>
+#include <new>
+#include <utility>
 #include <variant>
+#include <vector>
+
+#include <cstddef>
+#include <cstring>
 
 #include <netdb.h>
 #include <sys/socket.h>
@@ -7,9 +14,33 @@
 #include <zportal/net/resolve.hpp>
 #include <zportal/tools/error.hpp>
 
+namespace {
+
+bool same_address(const zportal::SockAddress& a, const zportal::SockAddress& b) noexcept {
+    return a.length() == b.length() && std::memcmp(a.get(), b.get(), a.length()) == 0;
+}
+
+} // namespace
+
 zportal::Result<zportal::SockAddress> zportal::resolve(const Address& address) {
+    const auto resolved = resolve_all(address);
+    if (!resolved) {
+        return fail(resolved.error());
+    }
+
+    return resolved->front();
+}
+
+zportal::Result<std::vector<zportal::SockAddress>> zportal::resolve_all(const Address& address) {
+    std::vector<SockAddress> resolved;
     if (std::holds_alternative<SockAddress>(address)) {
-        return std::get<SockAddress>(address);
+        try {
+            resolved.push_back(std::get<SockAddress>(address));
+        } catch (const std::bad_alloc&) {
+            return fail(ErrorCode::NotEnoughMemory);
+        }
+
+        return resolved;
     }
 
     const auto& hostpair = std::get<HostPair>(address);
@@ -50,14 +81,44 @@ zportal::Result<zportal::SockAddress> zportal::resolve(const Address& address) {
         }
     }
 
-    SockAddress resolved;
+    std::vector<SockAddress> preferred;
+    std::vector<SockAddress> other;
     try {
-        resolved = SockAddress::from_sockaddr(result->ai_addr, result->ai_addrlen);
+        for (const addrinfo* it = result; it != nullptr; it = it->ai_next) {
+            auto candidate = SockAddress::from_sockaddr(it->ai_addr, it->ai_addrlen);
+            if (std::ranges::any_of(preferred, [&](const auto& known) { return same_address(known, candidate); }) ||
+                std::ranges::any_of(other, [&](const auto& known) { return same_address(known, candidate); })) {
+                continue;
+            }
+
+            if (preferred.empty() || candidate.family() == preferred.front().family()) {
+                preferred.push_back(std::move(candidate));
+            } else {
+                other.push_back(std::move(candidate));
+            }
+        }
+
+        resolved.reserve(preferred.size() + other.size());
+        for (std::size_t i = 0; i < std::max(preferred.size(), other.size()); i++) {
+            if (i < preferred.size()) {
+                resolved.push_back(std::move(preferred[i]));
+            }
+            if (i < other.size()) {
+                resolved.push_back(std::move(other[i]));
+            }
+        }
+    } catch (const std::bad_alloc&) {
+        ::freeaddrinfo(result);
+        return fail(ErrorCode::NotEnoughMemory);
     } catch (...) {
         ::freeaddrinfo(result);
         return fail(ErrorCode::AddressParseFailed);
     }
 
     ::freeaddrinfo(result);
+    if (resolved.empty()) {
+        return fail(ErrorCode::ResolveNotFound);
+    }
+
     return resolved;
-}
\ No newline at end of file
+}
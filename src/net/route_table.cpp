@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <optional>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <zportal/net/address.hpp>
+#include <zportal/net/route_table.hpp>
+#include <zportal/tools/error.hpp>
+
+zportal::Result<void> zportal::RouteTable::insert(const Cidr& cidr, std::uint16_t value) noexcept {
+    if (!cidr) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    const auto bytes = bytes_of_(cidr.get_address());
+    if (!bytes) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    return insert(*bytes, cidr.get_prefix(), value);
+}
+
+zportal::Result<void> zportal::RouteTable::insert(std::span<const std::byte> address, std::uint8_t prefix,
+                                                  std::uint16_t value) noexcept {
+    auto* family = family_of_(address.size());
+    if (family == nullptr || prefix > address.size() * 8) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    try {
+        if (family->by_length.empty()) {
+            family->by_length.resize(address.size() * 8 + 1);
+        }
+
+        family->by_length[prefix].insert_or_assign(mask_(key_of_(address), prefix), value);
+
+        if (std::ranges::find(family->lengths, prefix) == family->lengths.end()) {
+            family->lengths.push_back(prefix);
+            std::ranges::sort(family->lengths, std::greater{});
+        }
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    return {};
+}
+
+bool zportal::RouteTable::erase(const Cidr& cidr) noexcept {
+    const auto bytes = bytes_of_(cidr.get_address());
+    if (!bytes) {
+        return false;
+    }
+
+    auto* family = family_of_(bytes->size());
+    const std::uint8_t prefix = cidr.get_prefix();
+    if (family == nullptr || family->by_length.size() <= prefix) {
+        return false;
+    }
+
+    auto& prefixes = family->by_length[prefix];
+    if (prefixes.erase(mask_(key_of_(*bytes), prefix)) == 0) {
+        return false;
+    }
+
+    if (prefixes.empty()) {
+        std::erase(family->lengths, prefix);
+    }
+
+    return true;
+}
+
+std::size_t zportal::RouteTable::erase_value(std::uint16_t value) noexcept {
+    std::size_t erased{};
+    for (auto* family : {&ip4_, &ip6_}) {
+        for (std::size_t i = family->lengths.size(); i > 0; i--) {
+            auto& prefixes = family->by_length[family->lengths[i - 1]];
+            erased += std::erase_if(prefixes, [value](const auto& entry) { return entry.second == value; });
+
+            if (prefixes.empty()) {
+                family->lengths.erase(family->lengths.begin() + static_cast<std::ptrdiff_t>(i - 1));
+            }
+        }
+    }
+
+    return erased;
+}
+
+void zportal::RouteTable::clear() noexcept {
+    ip4_ = {};
+    ip6_ = {};
+}
+
+std::optional<std::uint16_t> zportal::RouteTable::lookup(std::span<const std::byte> address) const noexcept {
+    const auto* family = family_of_(address.size());
+    if (family == nullptr) {
+        return std::nullopt;
+    }
+
+    const Key key = key_of_(address);
+    for (const std::uint8_t prefix : family->lengths) {
+        const auto& prefixes = family->by_length[prefix];
+        if (const auto it = prefixes.find(mask_(key, prefix)); it != prefixes.end()) {
+            return it->second;
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::optional<std::uint16_t> zportal::RouteTable::lookup(const SockAddress& address) const noexcept {
+    const auto bytes = bytes_of_(address);
+    if (!bytes) {
+        return std::nullopt;
+    }
+
+    return lookup(*bytes);
+}
+
+std::size_t zportal::RouteTable::size() const noexcept {
+    std::size_t count{};
+    for (const auto* family : {&ip4_, &ip6_}) {
+        for (const auto prefix : family->lengths) {
+            count += family->by_length[prefix].size();
+        }
+    }
+
+    return count;
+}
+
+bool zportal::RouteTable::empty() const noexcept {
+    return ip4_.lengths.empty() && ip6_.lengths.empty();
+}
+
+std::size_t zportal::RouteTable::KeyHash::operator()(const Key& key) const noexcept {
+    // Inner addresses mostly differ in the low bits, mix both halves so neighbours spread over buckets.
+    std::uint64_t hash = key.high * 0x9E3779B97F4A7C15ULL ^ key.low;
+    hash ^= hash >> 32;
+    hash *= 0xD6E8FEB86659FD93ULL;
+    hash ^= hash >> 32;
+
+    return static_cast<std::size_t>(hash);
+}
+
+zportal::RouteTable::Key zportal::RouteTable::key_of_(std::span<const std::byte> address) noexcept {
+    Key key{};
+    for (std::size_t i = 0; i < address.size() && i < 16; i++) {
+        const auto byte = std::to_integer<std::uint64_t>(address[i]);
+        if (i < 8) {
+            key.high |= byte << (56 - i * 8);
+        } else {
+            key.low |= byte << (56 - (i - 8) * 8);
+        }
+    }
+
+    return key;
+}
+
+zportal::RouteTable::Key zportal::RouteTable::mask_(Key key, std::uint8_t prefix) noexcept {
+    if (prefix == 0) {
+        return {};
+    }
+
+    if (prefix <= 64) {
+        return {.high = key.high & (~0ULL << (64 - prefix)), .low = 0};
+    }
+
+    return {.high = key.high, .low = key.low & (~0ULL << (128 - prefix))};
+}
+
+std::optional<std::span<const std::byte>> zportal::RouteTable::bytes_of_(const SockAddress& address) noexcept {
+    if (!address.is_ip()) {
+        return std::nullopt;
+    }
+
+    const sockaddr* sa = address.get();
+
+    if (address.family() == AF_INET) {
+        const auto* in = reinterpret_cast<const sockaddr_in*>(sa);
+        return std::as_bytes(std::span(&in->sin_addr.s_addr, 1));
+    }
+
+    if (address.family() == AF_INET6) {
+        const auto* in6 = reinterpret_cast<const sockaddr_in6*>(sa);
+        return std::as_bytes(std::span(in6->sin6_addr.s6_addr));
+    }
+
+    return std::nullopt;
+}
+
+zportal::RouteTable::Family* zportal::RouteTable::family_of_(std::size_t address_size) noexcept {
+    if (address_size == 4) {
+        return &ip4_;
+    }
+
+    if (address_size == 16) {
+        return &ip6_;
+    }
+
+    return nullptr;
+}
+
+const zportal::RouteTable::Family* zportal::RouteTable::family_of_(std::size_t address_size) const noexcept {
+    if (address_size == 4) {
+        return &ip4_;
+    }
+
+    if (address_size == 16) {
+        return &ip6_;
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <span>
+#include <utility>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <zportal/net/shm_ring.hpp>
+#include <zportal/tools/debug.hpp>
+#include <zportal/tools/error.hpp>
+#include <zportal/tools/file_descriptor.hpp>
+
+// Each index lives on its own cache line, so the two sides never write to the same one.
+struct zportal::ShmRing::Control {
+    alignas(64) std::uint64_t magic;
+    std::uint64_t capacity;
+    alignas(64) std::uint64_t tail;
+    std::uint32_t reader_waiting;
+    alignas(64) std::uint64_t head;
+    std::uint32_t writer_waiting;
+};
+
+namespace {
+
+constexpr std::uint64_t ring_magic = 0x5A50'4F52'5452'4E47;
+constexpr std::size_t header_size = 4096;
+constexpr std::size_t max_capacity = std::size_t{1} << 30;
+
+// Both processes map the same words, a lock would live in only one of them.
+static_assert(std::atomic_ref<std::uint64_t>::is_always_lock_free);
+static_assert(std::atomic_ref<std::uint32_t>::is_always_lock_free);
+
+zportal::Result<void*> map_shared(int fd, std::size_t size) noexcept {
+    void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        return zportal::fail({zportal::ErrorCode::MmapFailed, errno});
+    }
+
+    return ptr;
+}
+
+void copy_in(std::byte* data, std::size_t capacity, std::uint64_t position, const void* source,
+             std::size_t size) noexcept {
+    const std::size_t offset = position & (capacity - 1);
+    const std::size_t first = std::min(size, capacity - offset);
+    std::memcpy(data + offset, source, first);
+    std::memcpy(data, static_cast<const std::byte*>(source) + first, size - first);
+}
+
+void copy_out(const std::byte* data, std::size_t capacity, std::uint64_t position, std::byte* destination,
+              std::size_t size) noexcept {
+    const std::size_t offset = position & (capacity - 1);
+    const std::size_t first = std::min(size, capacity - offset);
+    std::memcpy(destination, data + offset, first);
+    std::memcpy(destination + first, data, size - first);
+}
+
+} // namespace
+
+zportal::Result<zportal::ShmRing> zportal::ShmRing::create_shm_ring(std::size_t capacity) noexcept {
+    static_assert(sizeof(Control) <= header_size);
+
+    if (capacity == 0 || capacity > max_capacity) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+    capacity = std::bit_ceil(capacity);
+
+    const int fd = ::memfd_create("zportal-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return fail({ErrorCode::MemfdCreateFailed, errno});
+    }
+
+    ShmRing ring;
+    ring.fd_.reset(fd);
+
+    const std::size_t size = header_size + capacity;
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        return fail({ErrorCode::MemfdCreateFailed, errno});
+    }
+
+    // A peer shrinking the file would turn this side's accesses into SIGBUS.
+    if (::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        return fail({ErrorCode::MemfdCreateFailed, errno});
+    }
+
+    const auto mapped = map_shared(fd, size);
+    if (!mapped) {
+        return fail(mapped.error());
+    }
+
+    ring.control_ = static_cast<Control*>(*mapped);
+    ring.data_ = static_cast<std::byte*>(*mapped) + header_size;
+    ring.capacity_ = capacity;
+    ring.mapped_size_ = size;
+
+    // Fresh memfd pages are zeroed, both indexes start at 0.
+    ring.control_->capacity = capacity;
+    std::atomic_ref(ring.control_->magic).store(ring_magic, std::memory_order_release);
+
+    return ring;
+}
+
+zportal::Result<zportal::ShmRing> zportal::ShmRing::attach_shm_ring(FileDescriptor&& fd) noexcept {
+    if (!fd) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    const int seals = ::fcntl(fd.get(), F_GET_SEALS);
+    if (seals < 0) {
+        return fail({ErrorCode::InvalidShmRing, errno});
+    }
+    if ((seals & F_SEAL_SHRINK) == 0) {
+        return fail(ErrorCode::InvalidShmRing);
+    }
+
+    struct stat info{};
+    if (::fstat(fd.get(), &info) != 0) {
+        return fail({ErrorCode::InvalidShmRing, errno});
+    }
+
+    const auto size = static_cast<std::size_t>(info.st_size);
+    if (size <= header_size || size - header_size > max_capacity || !std::has_single_bit(size - header_size)) {
+        return fail(ErrorCode::InvalidShmRing);
+    }
+
+    const auto mapped = map_shared(fd.get(), size);
+    if (!mapped) {
+        return fail(mapped.error());
+    }
+
+    ShmRing ring;
+    ring.fd_ = std::move(fd);
+    ring.control_ = static_cast<Control*>(*mapped);
+    ring.data_ = static_cast<std::byte*>(*mapped) + header_size;
+    ring.capacity_ = size - header_size;
+    ring.mapped_size_ = size;
+
+    if (std::atomic_ref(ring.control_->magic).load(std::memory_order_acquire) != ring_magic ||
+        ring.control_->capacity != ring.capacity_) {
+        return fail(ErrorCode::InvalidShmRing);
+    }
+
+    return ring;
+}
+
+zportal::ShmRing::ShmRing(ShmRing&& other) noexcept
+    : fd_(std::move(other.fd_)), control_(std::exchange(other.control_, nullptr)),
+      data_(std::exchange(other.data_, nullptr)), capacity_(std::exchange(other.capacity_, 0)),
+      mapped_size_(std::exchange(other.mapped_size_, 0)), acquired_(std::exchange(other.acquired_, 0)) {}
+
+zportal::ShmRing& zportal::ShmRing::operator=(ShmRing&& other) noexcept {
+    if (&other == this) {
+        return *this;
+    }
+
+    release_();
+    fd_ = std::move(other.fd_);
+    control_ = std::exchange(other.control_, nullptr);
+    data_ = std::exchange(other.data_, nullptr);
+    capacity_ = std::exchange(other.capacity_, 0);
+    mapped_size_ = std::exchange(other.mapped_size_, 0);
+    acquired_ = std::exchange(other.acquired_, 0);
+
+    return *this;
+}
+
+zportal::ShmRing::~ShmRing() noexcept {
+    release_();
+}
+
+void zportal::ShmRing::release_() noexcept {
+    if (control_ == nullptr) {
+        return;
+    }
+
+    if (::munmap(control_, mapped_size_) != 0) {
+        DEBUG_ERRNO(errno, "munmap()");
+    }
+
+    control_ = nullptr;
+    data_ = nullptr;
+    capacity_ = 0;
+    mapped_size_ = 0;
+    acquired_ = 0;
+}
+
+int zportal::ShmRing::get_fd() const noexcept {
+    return fd_.get();
+}
+
+std::size_t zportal::ShmRing::get_capacity() const noexcept {
+    return capacity_;
+}
+
+std::size_t zportal::ShmRing::write(std::span<const iovec> segments) noexcept {
+    const auto tail = std::atomic_ref(control_->tail).load(std::memory_order_relaxed);
+    const auto head = std::atomic_ref(control_->head).load(std::memory_order_acquire);
+    const std::size_t room = capacity_ - std::min<std::uint64_t>(tail - head, capacity_);
+
+    std::size_t written{};
+    for (const auto& segment : segments) {
+        const std::size_t take = std::min(segment.iov_len, room - written);
+        if (take > 0) {
+            copy_in(data_, capacity_, tail + written, segment.iov_base, take);
+        }
+
+        written += take;
+        if (take < segment.iov_len) {
+            break;
+        }
+    }
+
+    // Sequentially consistent against the reader raising its flag, one of the two sees the other.
+    if (written > 0) {
+        std::atomic_ref(control_->tail).store(tail + written, std::memory_order_seq_cst);
+    }
+
+    return written;
+}
+
+bool zportal::ShmRing::wait_for_space() noexcept {
+    std::atomic_ref(control_->writer_waiting).store(1, std::memory_order_seq_cst);
+
+    const auto head = std::atomic_ref(control_->head).load(std::memory_order_seq_cst);
+    const auto tail = std::atomic_ref(control_->tail).load(std::memory_order_relaxed);
+    if (tail - head < capacity_) {
+        std::atomic_ref(control_->writer_waiting).store(0, std::memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
+
+bool zportal::ShmRing::take_reader_waiting() noexcept {
+    auto waiting = std::atomic_ref(control_->reader_waiting);
+    return waiting.load(std::memory_order_seq_cst) != 0 && waiting.exchange(0, std::memory_order_seq_cst) != 0;
+}
+
+std::size_t zportal::ShmRing::get_readable() const noexcept {
+    const auto head = std::atomic_ref(control_->head).load(std::memory_order_relaxed);
+    const auto tail = std::atomic_ref(control_->tail).load(std::memory_order_acquire);
+
+    // A peer moving the tail back can't make acquired bytes count twice.
+    const std::size_t published = std::min<std::uint64_t>(tail - head, capacity_);
+    return published > acquired_ ? published - acquired_ : 0;
+}
+
+std::size_t zportal::ShmRing::read(std::span<std::byte> buffer) noexcept {
+    const auto head = std::atomic_ref(control_->head).load(std::memory_order_relaxed);
+    const auto tail = std::atomic_ref(control_->tail).load(std::memory_order_acquire);
+    const std::size_t take = std::min<std::uint64_t>({tail - head, capacity_, buffer.size()});
+    if (take == 0) {
+        return 0;
+    }
+
+    copy_out(data_, capacity_, head, buffer.data(), take);
+    std::atomic_ref(control_->head).store(head + take, std::memory_order_seq_cst);
+
+    return take;
+}
+
+std::span<std::byte> zportal::ShmRing::acquire() noexcept {
+    const auto head = std::atomic_ref(control_->head).load(std::memory_order_relaxed);
+    const std::size_t offset = (head + acquired_) & (capacity_ - 1);
+    const std::size_t take = std::min(get_readable(), capacity_ - offset);
+
+    acquired_ += take;
+
+    return {data_ + offset, take};
+}
+
+void zportal::ShmRing::release(std::size_t size) noexcept {
+    size = std::min(size, acquired_);
+    if (size == 0) {
+        return;
+    }
+
+    const auto head = std::atomic_ref(control_->head).load(std::memory_order_relaxed);
+    acquired_ -= size;
+    std::atomic_ref(control_->head).store(head + size, std::memory_order_seq_cst);
+}
+
+bool zportal::ShmRing::wait_for_data() noexcept {
+    std::atomic_ref(control_->reader_waiting).store(1, std::memory_order_seq_cst);
+
+    const auto tail = std::atomic_ref(control_->tail).load(std::memory_order_seq_cst);
+    const auto head = std::atomic_ref(control_->head).load(std::memory_order_relaxed);
+    if (tail != head + acquired_) {
+        std::atomic_ref(control_->reader_waiting).store(0, std::memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
+
+bool zportal::ShmRing::take_writer_waiting() noexcept {
+    auto waiting = std::atomic_ref(control_->writer_waiting);
+    return waiting.load(std::memory_order_seq_cst) != 0 && waiting.exchange(0, std::memory_order_seq_cst) != 0;
+}
+
+bool zportal::ShmRing::is_valid() const noexcept {
+    return control_ != nullptr;
+}
+
+zportal::ShmRing::operator bool() const noexcept {
+    return is_valid();
+}
@@ -1,14 +1,53 @@
+#include <algorithm>
+#include <chrono>
 #include <utility>
 
 #include <cerrno>
+#include <cstddef>
+#include <cstdint>
 
+#include <netinet/in.h>
+#include <netinet/udp.h>
 #include <sys/socket.h>
 
+#if HAVE_LINUX_SCTP_H
+    #include <linux/sctp.h>
+#endif
+
 #include <zportal/net/address.hpp>
 #include <zportal/net/socket.hpp>
 #include <zportal/tools/error.hpp>
 #include <zportal/tools/file_descriptor.hpp>
 
+namespace {
+
+#if HAVE_LINUX_SCTP_H
+// Set before connect() or listen(), accepted sockets inherit them.
+zportal::Result<void> set_sctp_options(int fd) noexcept {
+    sctp_initmsg init{};
+    init.sinit_num_ostreams = zportal::Socket::sctp_streams;
+    init.sinit_max_instreams = zportal::Socket::sctp_streams;
+    if (::setsockopt(fd, IPPROTO_SCTP, SCTP_INITMSG, &init, sizeof(init)) != 0) {
+        return zportal::fail({zportal::ErrorCode::SetSockOptFailed, errno});
+    }
+
+    const int yes = 1;
+    if (::setsockopt(fd, IPPROTO_SCTP, SCTP_NODELAY, &yes, sizeof(yes)) != 0) {
+        return zportal::fail({zportal::ErrorCode::SetSockOptFailed, errno});
+    }
+
+    // Level 0 never interleaves parts of messages, so a receive buffer holds whole frames back to back.
+    const int level = 0;
+    if (::setsockopt(fd, IPPROTO_SCTP, SCTP_FRAGMENT_INTERLEAVE, &level, sizeof(level)) != 0) {
+        return zportal::fail({zportal::ErrorCode::SetSockOptFailed, errno});
+    }
+
+    return {};
+}
+#endif
+
+} // namespace
+
 zportal::Socket::Socket(Socket&& other) noexcept
     : fd_(std::move(other.fd_)), family_(std::exchange(other.family_, AF_UNSPEC)) {}
 
@@ -49,17 +88,39 @@ zportal::Socket::operator bool() const noexcept {
     return is_valid();
 }
 
-zportal::Result<zportal::Socket> zportal::Socket::create_socket(sa_family_t family, int flags) noexcept {
-    if (family != AF_INET && family != AF_INET6 && family != AF_UNIX) {
+zportal::Result<zportal::Socket> zportal::Socket::create_socket(sa_family_t family, int flags,
+                                                               Transport transport) noexcept {
+    if (transport == Transport::SHM) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    if (family != AF_INET && family != AF_INET6 && (family != AF_UNIX || transport != Transport::TCP)) {
         return fail(ErrorCode::InvalidSocketFamily);
     }
 
-    const int fd = ::socket(family, SOCK_STREAM | flags, 0);
+#if !HAVE_LINUX_SCTP_H
+    if (transport == Transport::SCTP) {
+        return fail({ErrorCode::SocketCreateFailed, EPROTONOSUPPORT});
+    }
+#endif
+
+    const int type = transport == Transport::UDP ? SOCK_DGRAM : SOCK_STREAM;
+    const int protocol = transport == Transport::SCTP ? IPPROTO_SCTP : 0;
+    const int fd = ::socket(family, type | flags, protocol);
     if (fd < 0) {
         return fail({ErrorCode::SocketCreateFailed, errno});
     }
 
-    return Socket(fd, family);
+    Socket sock(fd, family);
+#if HAVE_LINUX_SCTP_H
+    if (transport == Transport::SCTP) {
+        if (const auto result = set_sctp_options(fd); !result) {
+            return fail(result.error());
+        }
+    }
+#endif
+
+    return sock;
 }
 
 zportal::Socket::Socket(int fd, sa_family_t family) : fd_(fd), family_(family) {}
@@ -110,4 +171,111 @@ zportal::Result<sa_family_t> zportal::Socket::detect_family() const noexcept {
 
     family_ = (*result).family();
     return family_;
+}
+
+zportal::Result<zportal::Transport> zportal::Socket::detect_transport() const noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidSocket);
+    }
+
+    int type{};
+    socklen_t len = sizeof(type);
+    if (::getsockopt(get(), SOL_SOCKET, SO_TYPE, &type, &len) != 0) {
+        return fail({ErrorCode::GetSockOptFailed, errno});
+    }
+
+    if (type == SOCK_DGRAM) {
+        return Transport::UDP;
+    }
+
+    int protocol{};
+    len = sizeof(protocol);
+    if (::getsockopt(get(), SOL_SOCKET, SO_PROTOCOL, &protocol, &len) != 0) {
+        return fail({ErrorCode::GetSockOptFailed, errno});
+    }
+
+    return protocol == IPPROTO_SCTP ? Transport::SCTP : Transport::TCP;
+}
+
+zportal::Result<std::uint16_t> zportal::Socket::get_stream_count() const noexcept {
+    const auto transport = detect_transport();
+    if (!transport) {
+        return fail(transport.error());
+    }
+
+    if (*transport != Transport::SCTP) {
+        return 1;
+    }
+
+#if HAVE_LINUX_SCTP_H
+    // The smaller of what this side asked for and what the peer accepts, known once connected.
+    sctp_status status{};
+    socklen_t len = sizeof(status);
+    if (::getsockopt(get(), IPPROTO_SCTP, SCTP_STATUS, &status, &len) != 0) {
+        return fail({ErrorCode::GetSockOptFailed, errno});
+    }
+
+    return std::max<std::uint16_t>(status.sstat_outstrms, 1);
+#else
+    return 1;
+#endif
+}
+
+zportal::Result<std::size_t> zportal::Socket::get_datagram_limit() const noexcept {
+    const auto family = detect_family();
+    if (!family) {
+        return fail(family.error());
+    }
+
+    if (*family != AF_INET && *family != AF_INET6) {
+        return fail(ErrorCode::InvalidSocketFamily);
+    }
+
+    // Known once connected, the route's MTU or what path MTU discovery lowered it to.
+    const bool ip4 = *family == AF_INET;
+    int mtu{};
+    socklen_t len = sizeof(mtu);
+    if (::getsockopt(get(), ip4 ? IPPROTO_IP : IPPROTO_IPV6, ip4 ? IP_MTU : IPV6_MTU, &mtu, &len) != 0) {
+        return fail({ErrorCode::GetSockOptFailed, errno});
+    }
+
+    const std::size_t headers = (ip4 ? 20 : 40) + 8;
+    return mtu > static_cast<int>(headers) ? static_cast<std::size_t>(mtu) - headers : 0;
+}
+
+zportal::Result<void> zportal::Socket::set_udp_gro() const noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidSocket);
+    }
+
+#if defined(UDP_GRO)
+    const int yes = 1;
+    if (::setsockopt(get(), IPPROTO_UDP, UDP_GRO, &yes, sizeof(yes)) != 0) {
+        return fail({ErrorCode::SetSockOptFailed, errno});
+    }
+#endif
+
+    return {};
+}
+
+zportal::Result<void> zportal::Socket::set_busy_poll(std::chrono::microseconds timeout, bool prefer) const noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidSocket);
+    }
+
+    const int usecs = static_cast<int>(timeout.count());
+    if (::setsockopt(get(), SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) != 0) {
+        return fail({ErrorCode::SetSockOptFailed, errno});
+    }
+
+#if defined(SO_PREFER_BUSY_POLL)
+    const int prefer_value = prefer ? 1 : 0;
+    if (::setsockopt(get(), SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer_value, sizeof(prefer_value)) != 0) {
+        return fail({ErrorCode::SetSockOptFailed, errno});
+    }
+#else
+    (void)prefer;
+#endif
+
+    return {};
 }
\ No newline at end of file
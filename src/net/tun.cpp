@@ -1,3 +1,4 @@
+#include <new>
 #include <string>
 #include <utility>
 
@@ -19,25 +20,24 @@
 #include <zportal/tools/error.hpp>
 #include <zportal/tools/file_descriptor.hpp>
 
-zportal::Result<zportal::TunDevice> zportal::TunDevice::create_tun_device(const std::string& name, const Cidr& address,
-                                                                          std::uint32_t mtu) noexcept {
+zportal::Result<zportal::TunDevice> zportal::TunDevice::create_tun_device(const std::string& name,
+                                                                          const Cidr& address, std::uint32_t mtu,
+                                                                          bool multi_queue) noexcept {
     TunDevice tun;
-    tun.fd_ = FileDescriptor(::open("/dev/net/tun", O_RDWR));
-    if (!tun.fd_) {
-        return fail({ErrorCode::TunOpenFailed, errno});
-    }
+    tun.multi_queue_ = multi_queue;
 
-    ifreq ifr{};
-    ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
-    std::strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+    try {
+        tun.name_ = name;
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
 
-    if (::ioctl(tun.get_fd(), TUNSETIFF, &ifr) < 0) {
-        const int err = errno;
-        tun.close();
-        return fail({ErrorCode::TunIoctlFailed, err});
+    auto fd = attach_(tun.name_, multi_queue ? IFF_MULTI_QUEUE : 0);
+    if (!fd) {
+        return fail(fd.error());
     }
+    tun.fd_ = std::move(*fd);
 
-    tun.name_ = ifr.ifr_name;
     tun.index_ = static_cast<int>(::if_nametoindex(tun.name_.c_str()));
     if (tun.index_ == 0) {
         const int err = errno;
@@ -65,13 +65,64 @@ zportal::Result<zportal::TunDevice> zportal::TunDevice::create_tun_device(const
     if (!result) {
         return fail(result.error());
     }
+    tun.cidr_ = address;
 
     return tun;
 }
 
+zportal::Result<zportal::TunDevice> zportal::TunDevice::open_queue() const noexcept {
+    if (!fd_ || !multi_queue_) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    TunDevice queue;
+    queue.multi_queue_ = true;
+    queue.index_ = index_;
+    queue.mtu_ = mtu_;
+
+    try {
+        queue.name_ = name_;
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    auto fd = attach_(queue.name_, IFF_MULTI_QUEUE);
+    if (!fd) {
+        return fail(fd.error());
+    }
+    queue.fd_ = std::move(*fd);
+
+    return queue;
+}
+
+zportal::Result<zportal::FileDescriptor> zportal::TunDevice::attach_(std::string& name, short flags) noexcept {
+    FileDescriptor fd(::open("/dev/net/tun", O_RDWR | O_CLOEXEC));
+    if (!fd) {
+        return fail({ErrorCode::TunOpenFailed, errno});
+    }
+
+    ifreq ifr{};
+    ifr.ifr_flags = static_cast<short>(IFF_TUN | IFF_NO_PI | flags);
+    std::strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+
+    if (::ioctl(fd.get(), TUNSETIFF, &ifr) < 0) {
+        return fail({ErrorCode::TunIoctlFailed, errno});
+    }
+
+    // The kernel resolves patterns like "tun%d" to the actual name.
+    try {
+        name = ifr.ifr_name;
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    return fd;
+}
+
 zportal::TunDevice::TunDevice(TunDevice&& other) noexcept
     : fd_(std::move(other.fd_)), mtu_(std::exchange(other.mtu_, 0)), index_(std::exchange(other.index_, 0)),
-      name_(std::exchange(other.name_, "")), nl_(std::move(other.nl_)) {}
+      name_(std::exchange(other.name_, "")), nl_(std::move(other.nl_)),
+      multi_queue_(std::exchange(other.multi_queue_, false)), cidr_(std::exchange(other.cidr_, {})) {}
 
 zportal::TunDevice& zportal::TunDevice::operator=(TunDevice&& other) noexcept {
     if (this == &other) {
@@ -84,6 +135,8 @@ zportal::TunDevice& zportal::TunDevice::operator=(TunDevice&& other) noexcept {
     index_ = std::exchange(other.index_, 0);
     name_ = std::exchange(other.name_, "");
     nl_ = std::move(other.nl_);
+    multi_queue_ = std::exchange(other.multi_queue_, false);
+    cidr_ = std::exchange(other.cidr_, {});
 
     return *this;
 }
@@ -92,7 +145,37 @@ zportal::TunDevice::~TunDevice() noexcept {
     close();
 }
 
+zportal::Result<void> zportal::TunDevice::set_address(const Cidr& address) noexcept {
+    if (!nl_ || !address) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    // Removed first, so an unchanged address is simply added back.
+    if (cidr_) {
+        if (const auto result = change_cidr_(cidr_, RTM_DELADDR, 0); !result) {
+            return fail(result.error());
+        }
+        cidr_ = Cidr{};
+    }
+
+    if (const auto result = set_cidr_(address); !result) {
+        return fail(result.error());
+    }
+    cidr_ = address;
+
+    return {};
+}
+
+const zportal::Cidr& zportal::TunDevice::get_address() const noexcept {
+    return cidr_;
+}
+
 zportal::Result<void> zportal::TunDevice::set_cidr_(const Cidr& cidr) noexcept {
+    return change_cidr_(cidr, RTM_NEWADDR, NLM_F_CREATE | NLM_F_REPLACE);
+}
+
+zportal::Result<void> zportal::TunDevice::change_cidr_(const Cidr& cidr, std::uint16_t type,
+                                                       std::uint16_t flags) noexcept {
     struct {
         nlmsghdr nlh;
         ifaddrmsg ifa;
@@ -117,8 +200,8 @@ zportal::Result<void> zportal::TunDevice::set_cidr_(const Cidr& cidr) noexcept {
     }
 
     req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(ifaddrmsg));
-    req.nlh.nlmsg_type = RTM_NEWADDR;
-    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_REPLACE;
+    req.nlh.nlmsg_type = type;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
     req.nlh.nlmsg_seq = nl_next_seq_();
 
     req.ifa.ifa_family = family;
@@ -0,0 +1,73 @@
+#include <span>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <endian.h>
+
+#include <zportal/session/batch.hpp>
+#include <zportal/tools/error.hpp>
+
+namespace {
+
+std::uint16_t load_u16(std::span<const std::byte> data, std::size_t offset) noexcept {
+    std::uint16_t value;
+    std::memcpy(&value, data.data() + offset, 2);
+    return ::be16toh(value);
+}
+
+void store_u16(std::span<std::byte> data, std::size_t offset, std::uint16_t value) noexcept {
+    value = ::htobe16(value);
+    std::memcpy(data.data() + offset, &value, 2);
+}
+
+} // namespace
+
+zportal::Result<zportal::BatchTable> zportal::BatchTable::parse(std::span<const std::byte> payload) noexcept {
+    if (payload.size() < wire_size(0)) {
+        return fail(ErrorCode::InvalidBatch);
+    }
+
+    const std::size_t count = load_u16(payload, 0);
+    if (count == 0 || count > max_count || payload.size() < wire_size(count)) {
+        return fail(ErrorCode::InvalidBatch);
+    }
+
+    BatchTable table;
+    std::memcpy(table.data_.data(), payload.data(), wire_size(count));
+    table.count_ = count;
+
+    return table;
+}
+
+bool zportal::BatchTable::add(std::uint16_t length) noexcept {
+    if (count_ == max_count) {
+        return false;
+    }
+
+    store_u16(data_, wire_size(count_), length);
+    count_++;
+    store_u16(data_, 0, static_cast<std::uint16_t>(count_));
+
+    return true;
+}
+
+std::size_t zportal::BatchTable::get_count() const noexcept {
+    return count_;
+}
+
+std::uint16_t zportal::BatchTable::get_length(std::size_t index) const noexcept {
+    assert(index < count_);
+
+    return load_u16(data_, wire_size(index));
+}
+
+std::span<std::byte> zportal::BatchTable::data() noexcept {
+    return std::span<std::byte>{data_}.first(wire_size(count_));
+}
+
+std::span<const std::byte> zportal::BatchTable::data() const noexcept {
+    return std::span<const std::byte>{data_}.first(wire_size(count_));
+}
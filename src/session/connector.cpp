@@ -0,0 +1,455 @@
+#include <chrono>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include <liburing.h>
+#include <sys/socket.h>
+
+#include <zportal/iouring/iouring.hpp>
+#include <zportal/net/resolve.hpp>
+#include <zportal/net/socket.hpp>
+#include <zportal/net/socks5.hpp>
+#include <zportal/session/connector.hpp>
+#include <zportal/session/operation.hpp>
+#include <zportal/tools/error.hpp>
+
+namespace {
+
+// RFC 8305 section 5 recommends 250 ms between the starts of two connection attempts.
+constexpr std::chrono::milliseconds connection_attempt_delay{250};
+
+// CONNECT and its timeout carry the candidate in the high byte of the slot, the other
+// operations only the connection index.
+constexpr std::uint16_t make_slot(std::uint16_t index, std::size_t candidate) noexcept {
+    return static_cast<std::uint16_t>(index | candidate << 8);
+}
+
+constexpr std::uint16_t slot_index(std::uint16_t slot) noexcept {
+    return slot & 0xff;
+}
+
+constexpr std::size_t slot_candidate(std::uint16_t slot) noexcept {
+    return slot >> 8;
+}
+
+} // namespace
+
+zportal::Result<zportal::Connector> zportal::Connector::create_connector(IoUring& ring, const Address& target,
+                                                                         const std::vector<Address>& proxies,
+                                                                         std::chrono::milliseconds timeout,
+                                                                         std::uint16_t session_index,
+                                                                         Transport transport) noexcept {
+    if (timeout.count() <= 0 || (transport == Transport::SCTP && !proxies.empty()) || transport == Transport::UDP) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    Connector connector;
+    connector.ring_ = &ring;
+    connector.timeout_ = timeout;
+    connector.session_index_ = session_index;
+    connector.transport_ = transport;
+    try {
+        connector.target_ = target;
+        connector.proxies_ = proxies;
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    return connector;
+}
+
+zportal::Connector::Connector(Connector&& other) noexcept
+    : ring_(std::exchange(other.ring_, nullptr)), target_(std::move(other.target_)),
+      proxies_(std::move(other.proxies_)), timeout_(std::exchange(other.timeout_, {})),
+      session_index_(std::exchange(other.session_index_, 0)),
+      transport_(std::exchange(other.transport_, Transport::TCP)), candidates_(std::move(other.candidates_)),
+      attempts_(std::move(other.attempts_)), races_(std::move(other.races_)), sockets_(std::move(other.sockets_)),
+      handshakes_(std::move(other.handshakes_)), hops_(std::move(other.hops_)),
+      pending_(std::exchange(other.pending_, 0)), error_(std::exchange(other.error_, {})) {}
+
+zportal::Connector& zportal::Connector::operator=(Connector&& other) noexcept {
+    if (&other == this) {
+        return *this;
+    }
+
+    ring_ = std::exchange(other.ring_, nullptr);
+    target_ = std::move(other.target_);
+    proxies_ = std::move(other.proxies_);
+    timeout_ = std::exchange(other.timeout_, {});
+    session_index_ = std::exchange(other.session_index_, 0);
+    transport_ = std::exchange(other.transport_, Transport::TCP);
+    candidates_ = std::move(other.candidates_);
+    attempts_ = std::move(other.attempts_);
+    races_ = std::move(other.races_);
+    sockets_ = std::move(other.sockets_);
+    handshakes_ = std::move(other.handshakes_);
+    hops_ = std::move(other.hops_);
+    pending_ = std::exchange(other.pending_, 0);
+    error_ = std::exchange(other.error_, {});
+
+    return *this;
+}
+
+zportal::Result<void> zportal::Connector::start(std::uint16_t count) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    if (!is_finished() || !sockets_.empty() || count == 0 || count > max_connections) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    // Failures to reach the peer end the attempt through take(), only ring failures are returned here.
+    auto resolved = resolve_all(proxies_.empty() ? target_ : proxies_.front());
+    if (!resolved) {
+        error_ = resolved.error();
+        return {};
+    }
+    candidates_ = std::move(*resolved);
+    if (candidates_.size() > max_candidates) {
+        candidates_.resize(max_candidates);
+    }
+
+    // Sized up front, addresses, attempts and handshakes in flight must not move.
+    try {
+        sockets_.resize(count);
+        attempts_.resize(std::size_t{count} * candidates_.size());
+        races_.assign(count, Race{});
+        handshakes_.assign(count, Socks5Handshake{});
+        hops_.assign(count, 0);
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    for (std::uint16_t i = 0; i < count; i++) {
+        if (const auto result = start_attempt_(i); !result) {
+            return fail(result.error());
+        }
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Connector::handle_cqe(const Cqe& cqe) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    const auto type = cqe.operation().get_type();
+    if (type != OperationType::CONNECT && type != OperationType::CONNECT_TIMEOUT &&
+        type != OperationType::CONNECT_DELAY && type != OperationType::SOCKS_SEND &&
+        type != OperationType::SOCKS_RECV) {
+        return fail(ErrorCode::WrongOperationType);
+    }
+
+    const auto slot = cqe.operation().get_slot();
+    if (pending_ == 0 || slot_index(slot) >= sockets_.size() || slot_candidate(slot) >= candidates_.size()) {
+        return fail(ErrorCode::InvalidState);
+    }
+    pending_--;
+
+    // The operation a timeout is linked to reports it itself, it completes with -ECANCELED. Only
+    // the first failure of an attempt is kept, the other connections are dropped with it.
+    if (type == OperationType::CONNECT_TIMEOUT || !error_.ok()) {
+        return {};
+    }
+
+    switch (type) {
+    case OperationType::CONNECT:
+        return handle_connect_cqe_(cqe);
+    case OperationType::CONNECT_DELAY:
+        return handle_connect_delay_cqe_(cqe);
+    case OperationType::SOCKS_SEND:
+        return handle_socks_send_cqe_(cqe);
+    case OperationType::SOCKS_RECV:
+        return handle_socks_recv_cqe_(cqe);
+    default:
+        break;
+    }
+
+    return fail(ErrorCode::InvalidEnumValue);
+}
+
+bool zportal::Connector::is_finished() const noexcept {
+    return pending_ == 0;
+}
+
+zportal::Result<std::vector<zportal::Socket>> zportal::Connector::take() noexcept {
+    if (!is_finished()) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    // Attempts that lost their race are closed here, none of them is in flight anymore.
+    attempts_.clear();
+    auto sockets = std::exchange(sockets_, {});
+    if (!error_.ok()) {
+        return fail(std::exchange(error_, {}));
+    }
+
+    return sockets;
+}
+
+bool zportal::Connector::is_valid() const noexcept {
+    return ring_ != nullptr;
+}
+
+zportal::Connector::operator bool() const noexcept {
+    return is_valid();
+}
+
+zportal::Result<void> zportal::Connector::handle_connect_cqe_(const Cqe& cqe) noexcept {
+    const auto slot = cqe.operation().get_slot();
+    const auto index = slot_index(slot);
+    auto& race = races_[index];
+    auto& attempt = attempts_[index * candidates_.size() + slot_candidate(slot)];
+    race.in_flight--;
+
+    if (race.won) {
+        attempt.socket.close();
+        return {};
+    }
+
+    if (!cqe.ok()) {
+        race.error = Error(ErrorCode::ConnectFailed, cqe.error() == ECANCELED ? ETIMEDOUT : cqe.error());
+        attempt.socket.close();
+        return start_attempt_(index);
+    }
+
+    race.won = true;
+    sockets_[index] = std::move(attempt.socket);
+    if (const auto result = cancel_race_(index); !result) {
+        return fail(result.error());
+    }
+
+    if (proxies_.empty()) {
+        return {};
+    }
+
+    return start_hop_(index);
+}
+
+zportal::Result<void> zportal::Connector::handle_connect_delay_cqe_(const Cqe& cqe) noexcept {
+    auto& race = races_[slot_index(cqe.operation().get_slot())];
+    race.delay_armed = false;
+    if (race.won) {
+        return {};
+    }
+
+    return start_attempt_(slot_index(cqe.operation().get_slot()));
+}
+
+zportal::Result<void> zportal::Connector::handle_socks_send_cqe_(const Cqe& cqe) noexcept {
+    const auto index = cqe.operation().get_slot();
+    if (!cqe.ok()) {
+        error_ = Error(ErrorCode::SendFailed, cqe.error());
+    } else if (static_cast<std::size_t>(cqe.result()) != handshakes_[index].request().size()) {
+        error_ = Error(ErrorCode::SendFailed);
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Connector::handle_socks_recv_cqe_(const Cqe& cqe) noexcept {
+    const auto index = cqe.operation().get_slot();
+    if (!cqe.ok()) {
+        error_ = Error(ErrorCode::RecvFailed, cqe.error() == ECANCELED ? ETIMEDOUT : cqe.error());
+        return {};
+    }
+
+    if (cqe.result() == 0) {
+        error_ = Error(ErrorCode::PeerClosed);
+        return {};
+    }
+
+    auto& handshake = handshakes_[index];
+    if (const auto result = handshake.commit(static_cast<std::size_t>(cqe.result())); !result) {
+        error_ = result.error();
+        return {};
+    }
+
+    if (!handshake.is_done()) {
+        return arm_socks_recv_(index);
+    }
+
+    if (++hops_[index] == proxies_.size()) {
+        return {};
+    }
+
+    return start_hop_(index);
+}
+
+// Happy Eyeballs (RFC 8305): the next candidate starts when the attempt delay elapsed or as soon as
+// an attempt failed, earlier attempts keep running until one of them connects.
+zportal::Result<void> zportal::Connector::start_attempt_(std::uint16_t index) noexcept {
+    auto& race = races_[index];
+    while (race.next < candidates_.size()) {
+        const auto candidate = race.next++;
+        const auto& address = candidates_[candidate];
+        auto& attempt = attempts_[index * candidates_.size() + candidate];
+
+        auto sock = Socket::create_socket(address.family(), SOCK_CLOEXEC, transport_);
+        if (!sock) {
+            race.error = sock.error();
+            continue;
+        }
+        attempt.socket = std::move(*sock);
+
+        auto sqe = ring_->get_sqe();
+        if (!sqe) {
+            return fail(sqe.error());
+        }
+        auto timeout_sqe = ring_->get_sqe();
+        if (!timeout_sqe) {
+            return fail(timeout_sqe.error());
+        }
+
+        const auto operation = Operation::make(OperationType::CONNECT, session_index_, make_slot(index, candidate));
+        attempt.user_data = operation.serialize();
+        ::io_uring_prep_connect(*sqe, attempt.socket.get(), address.get(), address.length());
+        ::io_uring_sqe_set_data64(*sqe, attempt.user_data);
+        (*sqe)->flags |= IOSQE_IO_LINK;
+
+        __kernel_timespec ts{.tv_sec = timeout_.count() / 1000, .tv_nsec = (timeout_.count() % 1000) * 1000000};
+        ::io_uring_prep_link_timeout(*timeout_sqe, &ts, 0);
+        const auto timeout_operation =
+            Operation::make(OperationType::CONNECT_TIMEOUT, session_index_, make_slot(index, candidate));
+        ::io_uring_sqe_set_data64(*timeout_sqe, timeout_operation.serialize());
+
+        if (const auto submit_result = ring_->submit(); !submit_result) {
+            return fail(submit_result.error());
+        }
+
+        // A linked timeout always completes too, with -ETIME or -ECANCELED.
+        pending_ += 2;
+        race.in_flight++;
+
+        if (race.next == candidates_.size() || race.delay_armed) {
+            return {};
+        }
+
+        return arm_connect_delay_(index);
+    }
+
+    if (race.in_flight == 0) {
+        error_ = race.error;
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Connector::arm_connect_delay_(std::uint16_t index) noexcept {
+    auto& race = races_[index];
+
+    auto sqe = ring_->get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    const auto delay = connection_attempt_delay.count();
+    __kernel_timespec ts{.tv_sec = delay / 1000, .tv_nsec = (delay % 1000) * 1000000};
+    ::io_uring_prep_timeout(*sqe, &ts, 0, 0);
+    race.delay_user_data = Operation::make(OperationType::CONNECT_DELAY, session_index_, index).serialize();
+    ::io_uring_sqe_set_data64(*sqe, race.delay_user_data);
+
+    if (const auto submit_result = ring_->submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    pending_++;
+    race.delay_armed = true;
+
+    return {};
+}
+
+// The cancelled CONNECTs and the removed delay still complete and are counted in pending_, the
+// cancel requests themselves complete as NONE.
+zportal::Result<void> zportal::Connector::cancel_race_(std::uint16_t index) noexcept {
+    auto& race = races_[index];
+    for (std::size_t candidate = 0; candidate < race.next; candidate++) {
+        const auto& attempt = attempts_[index * candidates_.size() + candidate];
+        if (!attempt.socket) {
+            continue;
+        }
+
+        auto sqe = ring_->get_sqe();
+        if (!sqe) {
+            return fail(sqe.error());
+        }
+        ::io_uring_prep_cancel64(*sqe, attempt.user_data, 0);
+        ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::NONE, session_index_).serialize());
+    }
+
+    if (race.delay_armed) {
+        auto sqe = ring_->get_sqe();
+        if (!sqe) {
+            return fail(sqe.error());
+        }
+        ::io_uring_prep_timeout_remove(*sqe, race.delay_user_data, 0);
+        ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::NONE, session_index_).serialize());
+    }
+
+    if (const auto submit_result = ring_->submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Connector::start_hop_(std::uint16_t index) noexcept {
+    const auto hop = hops_[index];
+    const auto& next = hop + 1 == proxies_.size() ? target_ : proxies_[hop + 1];
+    auto handshake = Socks5Handshake::create_socks5_handshake(next);
+    if (!handshake) {
+        error_ = handshake.error();
+        return {};
+    }
+    handshakes_[index] = *handshake;
+
+    auto sqe = ring_->get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    const auto request = handshakes_[index].request();
+    ::io_uring_prep_send(*sqe, sockets_[index].get(), request.data(), request.size(), MSG_NOSIGNAL);
+    ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::SOCKS_SEND, session_index_, index).serialize());
+    (*sqe)->flags |= IOSQE_IO_LINK;
+    pending_++;
+
+    return arm_socks_recv_(index);
+}
+
+// A failed SEND cancels the RECV linked to it, the RECV's timeout bounds the whole hop.
+zportal::Result<void> zportal::Connector::arm_socks_recv_(std::uint16_t index) noexcept {
+    auto sqe = ring_->get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+    auto timeout_sqe = ring_->get_sqe();
+    if (!timeout_sqe) {
+        return fail(timeout_sqe.error());
+    }
+
+    const auto buffer = handshakes_[index].reply_buffer();
+    ::io_uring_prep_recv(*sqe, sockets_[index].get(), buffer.data(), buffer.size(), 0);
+    ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::SOCKS_RECV, session_index_, index).serialize());
+    (*sqe)->flags |= IOSQE_IO_LINK;
+
+    __kernel_timespec ts{.tv_sec = timeout_.count() / 1000, .tv_nsec = (timeout_.count() % 1000) * 1000000};
+    ::io_uring_prep_link_timeout(*timeout_sqe, &ts, 0);
+    const auto timeout_operation = Operation::make(OperationType::CONNECT_TIMEOUT, session_index_, index);
+    ::io_uring_sqe_set_data64(*timeout_sqe, timeout_operation.serialize());
+
+    if (const auto submit_result = ring_->submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    pending_ += 2;
+
+    return {};
+}
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <exception>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <endian.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <zportal/net/address.hpp>
+#include <zportal/session/batch.hpp>
+#include <zportal/session/control.hpp>
+#include <zportal/tools/compression.hpp>
+#include <zportal/tools/error.hpp>
+
+namespace {
+
+/*
+  Hello payload, integers big-endian:
+
+    | type (1) | version (1) | reserved (2) | features (4) | max frame size (4) |
+*/
+std::uint32_t load_u32(std::span<const std::byte> payload, std::size_t offset) noexcept {
+    std::uint32_t value;
+    std::memcpy(&value, payload.data() + offset, 4);
+    return ::be32toh(value);
+}
+
+void store_u32(std::span<std::byte> payload, std::size_t offset, std::uint32_t value) noexcept {
+    value = ::htobe32(value);
+    std::memcpy(payload.data() + offset, &value, 4);
+}
+
+std::uint64_t load_u64(std::span<const std::byte> payload, std::size_t offset) noexcept {
+    std::uint64_t value;
+    std::memcpy(&value, payload.data() + offset, 8);
+    return ::be64toh(value);
+}
+
+void store_u64(std::span<std::byte> payload, std::size_t offset, std::uint64_t value) noexcept {
+    value = ::htobe64(value);
+    std::memcpy(payload.data() + offset, &value, 8);
+}
+
+std::uint64_t steady_now() noexcept {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+} // namespace
+
+zportal::Hello::Hello(std::uint32_t features, std::uint32_t max_frame_size) noexcept
+    : features_(features), max_frame_size_(max_frame_size) {}
+
+zportal::Hello zportal::Hello::offer(std::uint32_t mtu, Integrity integrity, Transport transport) noexcept {
+    std::uint32_t features = supported_features | (compression::is_available() ? std::uint32_t{COMPRESSION} : 0);
+    // Accepting no check means accepting a header check too, so a peer asking for more meets halfway.
+    if (integrity != Integrity::FULL) {
+        features |= HEADER_CHECKSUM;
+    }
+    if (integrity == Integrity::NONE) {
+        features |= NO_CHECKSUM;
+    }
+
+    // SCTP streams deliver in order only within themselves, the hello may be overtaken too. The rings
+    // of SHM are a byte stream like TCP.
+    if (transport == Transport::UDP || transport == Transport::SCTP) {
+        features &= datagram_features;
+    }
+
+    return Hello{features, transport == Transport::UDP ? mtu : std::max(mtu, BatchTable::max_frame_size)};
+}
+
+zportal::Result<zportal::Hello> zportal::Hello::parse(std::span<const std::byte> payload) noexcept {
+    if (payload.size() < wire_size || payload[0] != static_cast<std::byte>(ControlType::HELLO)) {
+        return fail(ErrorCode::InvalidHello);
+    }
+
+    // Every later version keeps this layout as its prefix.
+    if (std::to_integer<std::uint8_t>(payload[1]) < version) {
+        return fail(ErrorCode::InvalidHello);
+    }
+
+    const auto max_frame_size = load_u32(payload, 8);
+    if (max_frame_size == 0) {
+        return fail(ErrorCode::InvalidHello);
+    }
+
+    return Hello{load_u32(payload, 4), max_frame_size};
+}
+
+std::array<std::byte, zportal::Hello::wire_size> zportal::Hello::serialize() const noexcept {
+    std::array<std::byte, wire_size> payload{};
+    payload[0] = static_cast<std::byte>(ControlType::HELLO);
+    payload[1] = static_cast<std::byte>(version);
+    store_u32(payload, 4, features_);
+    store_u32(payload, 8, max_frame_size_);
+
+    return payload;
+}
+
+zportal::Hello zportal::Hello::negotiate(const Hello& peer) const noexcept {
+    return Hello{features_ & peer.features_, std::min(max_frame_size_, peer.max_frame_size_)};
+}
+
+std::uint32_t zportal::Hello::get_features() const noexcept {
+    return features_;
+}
+
+bool zportal::Hello::has(Feature feature) const noexcept {
+    return (features_ & feature) != 0;
+}
+
+zportal::Integrity zportal::Hello::get_integrity() const noexcept {
+    if (has(NO_CHECKSUM)) {
+        return Integrity::NONE;
+    }
+
+    return has(HEADER_CHECKSUM) ? Integrity::HEADER : Integrity::FULL;
+}
+
+std::uint32_t zportal::Hello::get_max_frame_size() const noexcept {
+    return max_frame_size_;
+}
+
+zportal::Ping::Ping(ControlType type, std::uint64_t timestamp) noexcept : type_(type), timestamp_(timestamp) {}
+
+zportal::Ping zportal::Ping::now() noexcept {
+    return Ping{ControlType::PING, steady_now()};
+}
+
+zportal::Result<zportal::Ping> zportal::Ping::parse(std::span<const std::byte> payload) noexcept {
+    if (payload.size() < wire_size) {
+        return fail(ErrorCode::InvalidPing);
+    }
+
+    const auto type = static_cast<ControlType>(payload[0]);
+    if (type != ControlType::PING && type != ControlType::PONG) {
+        return fail(ErrorCode::InvalidPing);
+    }
+
+    return Ping{type, load_u64(payload, 4)};
+}
+
+std::array<std::byte, zportal::Ping::wire_size> zportal::Ping::serialize() const noexcept {
+    std::array<std::byte, wire_size> payload{};
+    payload[0] = static_cast<std::byte>(type_);
+    store_u64(payload, 4, timestamp_);
+
+    return payload;
+}
+
+zportal::Ping zportal::Ping::pong() const noexcept {
+    return Ping{ControlType::PONG, timestamp_};
+}
+
+std::chrono::nanoseconds zportal::Ping::elapsed() const noexcept {
+    return std::chrono::nanoseconds(static_cast<std::int64_t>(steady_now() - timestamp_));
+}
+
+zportal::ControlType zportal::Ping::get_type() const noexcept {
+    return type_;
+}
+
+std::uint64_t zportal::Ping::get_timestamp() const noexcept {
+    return timestamp_;
+}
+
+zportal::InnerAddress::InnerAddress(std::span<const std::byte> address, std::uint8_t prefix) noexcept
+    : length_(static_cast<std::uint8_t>(std::min(address.size(), address_.size()))), prefix_(prefix) {
+    std::memcpy(address_.data(), address.data(), length_);
+}
+
+zportal::Result<zportal::InnerAddress> zportal::InnerAddress::parse(std::span<const std::byte> payload) noexcept {
+    if (payload.size() < wire_size || payload[0] != static_cast<std::byte>(ControlType::ADDRESS)) {
+        return fail(ErrorCode::InvalidInnerAddress);
+    }
+
+    const auto prefix = std::to_integer<std::uint8_t>(payload[1]);
+    const auto length = std::to_integer<std::size_t>(payload[2]);
+    if ((length != 4 && length != 16) || prefix > length * 8) {
+        return fail(ErrorCode::InvalidInnerAddress);
+    }
+
+    return InnerAddress{payload.subspan(4, length), prefix};
+}
+
+std::array<std::byte, zportal::InnerAddress::wire_size> zportal::InnerAddress::serialize() const noexcept {
+    std::array<std::byte, wire_size> payload{};
+    payload[0] = static_cast<std::byte>(ControlType::ADDRESS);
+    payload[1] = static_cast<std::byte>(prefix_);
+    payload[2] = static_cast<std::byte>(length_);
+    std::memcpy(payload.data() + 4, address_.data(), length_);
+
+    return payload;
+}
+
+std::span<const std::byte> zportal::InnerAddress::get_address() const noexcept {
+    return std::span<const std::byte>(address_).first(length_);
+}
+
+std::uint8_t zportal::InnerAddress::get_prefix() const noexcept {
+    return prefix_;
+}
+
+zportal::Result<zportal::Cidr> zportal::InnerAddress::get_cidr() const noexcept {
+    try {
+        if (length_ == 4) {
+            sockaddr_in sin{};
+            sin.sin_family = AF_INET;
+            std::memcpy(&sin.sin_addr, address_.data(), 4);
+            return Cidr{SockAddress::from_sockaddr(reinterpret_cast<const sockaddr*>(&sin), sizeof(sin)), prefix_};
+        }
+
+        sockaddr_in6 sin6{};
+        sin6.sin6_family = AF_INET6;
+        std::memcpy(&sin6.sin6_addr, address_.data(), 16);
+        return Cidr{SockAddress::from_sockaddr(reinterpret_cast<const sockaddr*>(&sin6), sizeof(sin6)), prefix_};
+    } catch (const std::exception&) {
+        return fail(ErrorCode::InvalidInnerAddress);
+    }
+}
@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <new>
+#include <optional>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <endian.h>
+
+#include <zportal/net/packet.hpp>
+#include <zportal/session/inner_header.hpp>
+#include <zportal/tools/error.hpp>
+
+namespace {
+
+constexpr std::byte full_type{0x10};
+constexpr std::byte compressed_type{0x20};
+constexpr std::size_t compressed_fixed_size = 6;
+
+constexpr std::size_t ip4_header_size = 20;
+constexpr std::size_t ip6_header_size = 40;
+constexpr std::size_t tcp_header_size = 20;
+constexpr std::uint8_t tcp_protocol = 6;
+
+// Offsets into the TCP header.
+constexpr std::size_t tcp_sequence = 4;
+constexpr std::size_t tcp_acknowledgment = 8;
+constexpr std::size_t tcp_data_offset = 12;
+constexpr std::size_t tcp_flags = 13;
+constexpr std::size_t tcp_window = 14;
+constexpr std::size_t tcp_checksum = 16;
+constexpr std::size_t tcp_urgent = 18;
+
+struct Range {
+    std::size_t begin;
+    std::size_t end;
+};
+
+// Fields that never change within a flow, any difference starts a new context.
+constexpr std::array<Range, 3> ip4_static{{{0, 2}, {6, 10}, {12, 20}}};
+constexpr std::array<Range, 2> ip6_static{{{0, 4}, {6, 40}}};
+constexpr std::array<Range, 2> tcp_static{{{0, 4}, {tcp_data_offset, tcp_flags}}};
+
+using Contexts = zportal::InnerHeaderContexts;
+
+struct Field {
+    std::size_t offset;
+    Contexts::Change change;
+};
+
+// Sent as deltas, then as they are.
+constexpr std::array<Field, 2> tcp_deltas{{{tcp_sequence, Contexts::SEQUENCE},
+                                           {tcp_acknowledgment, Contexts::ACKNOWLEDGMENT}}};
+constexpr std::array<Field, 2> tcp_values{{{tcp_window, Contexts::WINDOW}, {tcp_urgent, Contexts::URGENT}}};
+
+std::uint16_t load_u16(std::span<const std::byte> data, std::size_t offset) noexcept {
+    std::uint16_t value;
+    std::memcpy(&value, data.data() + offset, 2);
+    return ::be16toh(value);
+}
+
+void store_u16(std::span<std::byte> data, std::size_t offset, std::uint16_t value) noexcept {
+    value = ::htobe16(value);
+    std::memcpy(data.data() + offset, &value, 2);
+}
+
+std::uint32_t load_u32(std::span<const std::byte> data, std::size_t offset) noexcept {
+    std::uint32_t value;
+    std::memcpy(&value, data.data() + offset, 4);
+    return ::be32toh(value);
+}
+
+void store_u32(std::span<std::byte> data, std::size_t offset, std::uint32_t value) noexcept {
+    value = ::htobe32(value);
+    std::memcpy(data.data() + offset, &value, 4);
+}
+
+std::size_t write_varint(std::span<std::byte> out, std::uint32_t value) noexcept {
+    std::size_t length{};
+    while (value >= 0x80) {
+        out[length++] = static_cast<std::byte>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out[length++] = static_cast<std::byte>(value);
+
+    return length;
+}
+
+std::optional<std::uint32_t> read_varint(std::span<const std::byte> in, std::size_t& offset) noexcept {
+    std::uint64_t value{};
+    for (std::size_t shift = 0; shift < 35 && offset < in.size(); shift += 7) {
+        const auto byte = std::to_integer<std::uint64_t>(in[offset++]);
+        value |= (byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0) {
+            if (value > UINT32_MAX) {
+                return std::nullopt;
+            }
+            return static_cast<std::uint32_t>(value);
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::uint16_t ip4_checksum(std::span<const std::byte> header) noexcept {
+    std::uint32_t sum{};
+    for (std::size_t offset = 0; offset < ip4_header_size; offset += 2) {
+        sum += load_u16(header, offset);
+    }
+    while (sum > 0xFFFF) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    return static_cast<std::uint16_t>(~sum);
+}
+
+std::size_t tcp_offset(std::span<const std::byte> header) noexcept {
+    return zportal::ip_version(header) == 4 ? ip4_header_size : ip6_header_size;
+}
+
+// Length of the IP and TCP headers `head` starts with, when they can be compressed.
+std::optional<std::size_t> header_size(std::span<const std::byte> head, std::size_t size) noexcept {
+    std::size_t ip_size{};
+    switch (zportal::ip_version(head)) {
+    case 4:
+        // IHL 5, TCP, neither fragment offset nor more fragments, the length TUN read.
+        if (head.size() < ip4_header_size || head[0] != std::byte{0x45} ||
+            std::to_integer<std::uint8_t>(head[9]) != tcp_protocol || (load_u16(head, 6) & 0x3FFF) != 0 ||
+            load_u16(head, 2) != size || ip4_checksum(head) != 0) {
+            return std::nullopt;
+        }
+        ip_size = ip4_header_size;
+        break;
+
+    case 6:
+        if (head.size() < ip6_header_size || std::to_integer<std::uint8_t>(head[6]) != tcp_protocol ||
+            load_u16(head, 4) + ip6_header_size != size) {
+            return std::nullopt;
+        }
+        ip_size = ip6_header_size;
+        break;
+
+    default:
+        return std::nullopt;
+    }
+
+    if (head.size() < ip_size + tcp_header_size) {
+        return std::nullopt;
+    }
+
+    const std::size_t tcp_size = (std::to_integer<std::size_t>(head[ip_size + tcp_data_offset]) >> 4) * 4;
+    const std::size_t total = ip_size + tcp_size;
+    if (tcp_size < tcp_header_size || total > head.size() || total > size) {
+        return std::nullopt;
+    }
+
+    return total;
+}
+
+template <std::size_t N>
+bool same_ranges(std::span<const std::byte> a, std::span<const std::byte> b, std::size_t base,
+                 const std::array<Range, N>& ranges) noexcept {
+    return std::ranges::all_of(ranges, [&](const Range& range) {
+        const std::size_t begin = base + range.begin;
+        return std::memcmp(a.data() + begin, b.data() + begin, range.end - range.begin) == 0;
+    });
+}
+
+bool same_flow(std::span<const std::byte> context, std::span<const std::byte> header) noexcept {
+    if (context.size() != header.size() || zportal::ip_version(context) != zportal::ip_version(header)) {
+        return false;
+    }
+
+    const bool ip_same = zportal::ip_version(header) == 4 ? same_ranges(context, header, 0, ip4_static)
+                                                          : same_ranges(context, header, 0, ip6_static);
+
+    return ip_same && same_ranges(context, header, tcp_offset(header), tcp_static);
+}
+
+} // namespace
+
+zportal::Result<void> zportal::InnerHeaderContexts::reset() noexcept {
+    try {
+        contexts_.assign(count, Context{});
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    return {};
+}
+
+std::optional<zportal::InnerHeaderContexts::Prefix>
+zportal::InnerHeaderContexts::compress(std::span<const std::byte> packet,
+                                       std::span<std::byte, max_compressed_size> out) noexcept {
+    if (contexts_.empty()) {
+        return std::nullopt;
+    }
+
+    const auto size = header_size(packet, packet.size());
+    if (!size) {
+        return std::nullopt;
+    }
+
+    const auto id = static_cast<std::uint8_t>(flow_hash(packet));
+    auto& context = contexts_[id];
+    const auto header = packet.first(*size);
+    const auto previous = std::span<const std::byte>{context.header}.first(context.size);
+
+    if (!same_flow(previous, header)) {
+        std::ranges::copy(header, context.header.begin());
+        context.size = *size;
+
+        out[0] = full_type;
+        out[1] = std::byte{id};
+        return Prefix{.size = 2, .replaced = 0};
+    }
+
+    const std::size_t tcp = tcp_offset(header);
+    std::uint8_t changes{};
+    std::size_t length = compressed_fixed_size;
+
+    out[0] = compressed_type;
+    out[1] = std::byte{id};
+    out[3] = header[tcp + tcp_flags];
+    std::memcpy(out.data() + 4, header.data() + tcp + tcp_checksum, 2);
+
+    if (ip_version(header) == 4) {
+        const auto delta = static_cast<std::uint16_t>(load_u16(header, 4) - load_u16(previous, 4));
+        if (delta != 1) {
+            changes |= IP_ID;
+            length += write_varint(out.subspan(length), delta);
+        }
+    }
+
+    for (const auto& [offset, change] : tcp_deltas) {
+        const std::uint32_t delta = load_u32(header, tcp + offset) - load_u32(previous, tcp + offset);
+        if (delta != 0) {
+            changes |= change;
+            length += write_varint(out.subspan(length), delta);
+        }
+    }
+
+    for (const auto& [offset, change] : tcp_values) {
+        if (load_u16(header, tcp + offset) != load_u16(previous, tcp + offset)) {
+            changes |= change;
+            std::memcpy(out.data() + length, header.data() + tcp + offset, 2);
+            length += 2;
+        }
+    }
+
+    const auto options = header.subspan(tcp + tcp_header_size);
+    if (!std::ranges::equal(options, previous.subspan(tcp + tcp_header_size))) {
+        changes |= OPTIONS;
+        std::ranges::copy(options, out.begin() + static_cast<std::ptrdiff_t>(length));
+        length += options.size();
+    }
+
+    out[2] = std::byte{changes};
+    std::ranges::copy(header, context.header.begin());
+
+    return Prefix{.size = length, .replaced = *size};
+}
+
+zportal::Result<zportal::InnerHeaderContexts::Prefix>
+zportal::InnerHeaderContexts::restore(std::span<const std::byte> head, std::size_t size,
+                                      std::span<std::byte, max_header_size> out) noexcept {
+    const auto version = ip_version(head);
+    if (version == 4 || version == 6) {
+        return Prefix{.size = 0, .replaced = 0};
+    }
+
+    if (head.size() < 2 || head.size() > size || contexts_.empty()) {
+        return fail(ErrorCode::InvalidInnerHeader);
+    }
+
+    auto& context = contexts_[std::to_integer<std::uint8_t>(head[1])];
+
+    if (head[0] == full_type) {
+        const auto header_length = header_size(head.subspan(2), size - 2);
+        if (!header_length) {
+            return fail(ErrorCode::InvalidInnerHeader);
+        }
+
+        std::memcpy(context.header.data(), head.data() + 2, *header_length);
+        context.size = *header_length;
+        return Prefix{.size = 0, .replaced = 2};
+    }
+
+    if (head[0] != compressed_type || context.size == 0 || head.size() < compressed_fixed_size) {
+        return fail(ErrorCode::InvalidInnerHeader);
+    }
+
+    const auto changes = std::to_integer<std::uint8_t>(head[2]);
+    if ((changes & ~(IP_ID | SEQUENCE | ACKNOWLEDGMENT | WINDOW | URGENT | OPTIONS)) != 0) {
+        return fail(ErrorCode::InvalidInnerHeader);
+    }
+
+    const auto header = out.first(context.size);
+    std::memcpy(header.data(), context.header.data(), context.size);
+
+    const std::size_t tcp = tcp_offset(header);
+    std::size_t offset = compressed_fixed_size;
+    header[tcp + tcp_flags] = head[3];
+    std::memcpy(header.data() + tcp + tcp_checksum, head.data() + 4, 2);
+
+    if (ip_version(header) == 4) {
+        std::uint32_t delta = 1;
+        if ((changes & IP_ID) != 0) {
+            const auto value = read_varint(head, offset);
+            if (!value || *value > UINT16_MAX) {
+                return fail(ErrorCode::InvalidInnerHeader);
+            }
+            delta = *value;
+        }
+        store_u16(header, 4, static_cast<std::uint16_t>(load_u16(header, 4) + delta));
+    }
+
+    for (const auto& [field, change] : tcp_deltas) {
+        if ((changes & change) != 0) {
+            const auto delta = read_varint(head, offset);
+            if (!delta) {
+                return fail(ErrorCode::InvalidInnerHeader);
+            }
+            store_u32(header, tcp + field, load_u32(header, tcp + field) + *delta);
+        }
+    }
+
+    for (const auto& [field, change] : tcp_values) {
+        if ((changes & change) != 0) {
+            if (head.size() - offset < 2) {
+                return fail(ErrorCode::InvalidInnerHeader);
+            }
+            std::memcpy(header.data() + tcp + field, head.data() + offset, 2);
+            offset += 2;
+        }
+    }
+
+    if ((changes & OPTIONS) != 0) {
+        const std::size_t options = context.size - tcp - tcp_header_size;
+        if (head.size() - offset < options) {
+            return fail(ErrorCode::InvalidInnerHeader);
+        }
+        std::memcpy(header.data() + tcp + tcp_header_size, head.data() + offset, options);
+        offset += options;
+    }
+
+    const std::size_t total = context.size + size - offset;
+    if (total > UINT16_MAX + (ip_version(header) == 6 ? ip6_header_size : 0)) {
+        return fail(ErrorCode::InvalidInnerHeader);
+    }
+
+    if (ip_version(header) == 4) {
+        store_u16(header, 2, static_cast<std::uint16_t>(total));
+        store_u16(header, 10, 0);
+        store_u16(header, 10, ip4_checksum(header));
+    } else {
+        store_u16(header, 4, static_cast<std::uint16_t>(total - ip6_header_size));
+    }
+
+    std::memcpy(context.header.data(), header.data(), context.size);
+
+    return Prefix{.size = context.size, .replaced = offset};
+}
@@ -1,57 +1,156 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <new>
+#include <optional>
+#include <span>
 #include <utility>
 
 #include <cassert>
 #include <cerrno>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #include <liburing.h>
-
+#include <sys/eventfd.h>
+
+#include <zportal/iouring/buffer_pool.hpp>
+#include <zportal/net/packet.hpp>
+#include <zportal/net/route_table.hpp>
+#include <zportal/net/shm_ring.hpp>
+#include <zportal/session/batch.hpp>
+#include <zportal/session/control.hpp>
 #include <zportal/session/frame_header.hpp>
+#include <zportal/session/inner_header.hpp>
 #include <zportal/session/operation.hpp>
 #include <zportal/session/receiver.hpp>
+#include <zportal/tools/compression.hpp>
 #include <zportal/tools/crc.hpp>
 #include <zportal/tools/error.hpp>
+#include <zportal/tools/monitor.hpp>
 #include <zportal/tools/support_check.hpp>
 
 zportal::Result<zportal::Receiver> zportal::Receiver::create_receiver(IoUring& ring, TunDevice& tun, Socket& socket,
-                                                                      std::uint16_t queue_length,
-                                                                      std::uint32_t buffer_size) noexcept {
+                                                                      std::span<const BufferClass> classes) noexcept {
+    if (classes.empty()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    for (const auto& buffer_class : classes) {
+        if (buffer_class.buffer_count == 0 || buffer_class.buffer_size == 0) {
+            return fail(ErrorCode::InvalidArgument);
+        }
+    }
+
+    auto pool = BufferPool::create_buffer_pool(ring, classes);
+    if (!pool) {
+        return fail(pool.error());
+    }
+
+    return create_receiver(ring, tun, socket, *pool);
+}
+
+zportal::Result<zportal::Receiver> zportal::Receiver::create_receiver(IoUring& ring, TunDevice& tun, Socket& socket,
+                                                                      const BufferPool& pool) noexcept {
+    if (!pool) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
     Receiver receiver;
     receiver.ring_ = &ring;
     receiver.tun_ = &tun;
     receiver.socket_ = &socket;
+    if (const auto result = receiver.detect_transport_(); !result) {
+        return fail(result.error());
+    }
 
-    if (queue_length == 0 || buffer_size == 0) {
-        return fail(ErrorCode::InvalidArgument);
+    auto shared = pool.share();
+    if (!shared) {
+        return fail(shared.error());
     }
+    receiver.pool_ = std::move(*shared);
 
     try {
-        receiver.buffer_refcounts_.resize(queue_length, 0);
+        for (const auto* bg : receiver.pool_.get_classes()) {
+            receiver.buffer_refcounts_.emplace_back(bg->get_buffer_count(), 0);
+        }
     } catch (const std::bad_alloc&) {
         return fail(ErrorCode::NotEnoughMemory);
     }
 
-    auto bg = receiver.ring_->create_buffer_group(queue_length, buffer_size);
-    if (!bg) {
-        receiver.buffer_refcounts_.clear();
-        return fail(bg.error());
+    // Start from the largest class, the hint shrinks once the real traffic mix is known.
+    receiver.size_hint_ = receiver.pool_.largest()->get_buffer_size();
+
+    return receiver;
+}
+
+zportal::Result<zportal::Receiver> zportal::Receiver::create_receiver(IoUring& ring, TunDevice& tun, Socket& socket,
+                                                                      ShmRing&& shm, int peer_doorbell,
+                                                                      std::span<const BufferClass> classes) noexcept {
+    if (!shm || peer_doorbell < 0) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    if (classes.empty()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    // Frames stay in the ring until written, no buffer is ever handed out.
+    const std::array<BufferClass, 1> unused{{{.buffer_size = classes.front().buffer_size, .buffer_count = 1}}};
+    auto pool = BufferPool::create_buffer_pool(ring, unused, false);
+    if (!pool) {
+        return fail(pool.error());
+    }
+
+    auto receiver = create_receiver(ring, tun, socket, *pool);
+    if (!receiver) {
+        return fail(receiver.error());
+    }
+    receiver->shm_ = std::move(shm);
+    receiver->peer_doorbell_ = peer_doorbell;
+
+    try {
+        receiver->shm_chunks_.resize(max_shm_chunks);
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
     }
-    receiver.bg_ = *bg;
 
     return receiver;
 }
 
 zportal::Receiver::Receiver(Receiver&& other) noexcept
     : ring_(std::exchange(other.ring_, nullptr)), tun_(std::exchange(other.tun_, nullptr)),
-      bg_(std::exchange(other.bg_, nullptr)), socket_(std::exchange(other.socket_, nullptr)),
-      cooling_down_(std::exchange(other.cooling_down_, false)), used_buffers_(std::exchange(other.used_buffers_, 0)),
+      socket_(std::exchange(other.socket_, nullptr)), pool_(std::move(other.pool_)),
+      armed_bg_(std::exchange(other.armed_bg_, nullptr)), size_hint_(std::exchange(other.size_hint_, 0)),
+      switching_class_(std::exchange(other.switching_class_, false)),
+      recv_user_data_(std::exchange(other.recv_user_data_, 0)), recv_armed_(std::exchange(other.recv_armed_, false)),
+      stopping_(std::exchange(other.stopping_, false)), datagram_(std::exchange(other.datagram_, false)),
+      unordered_(std::exchange(other.unordered_, false)), shm_(std::move(other.shm_)),
+      peer_doorbell_(std::exchange(other.peer_doorbell_, -1)), shm_closed_(std::exchange(other.shm_closed_, false)),
+      probe_(other.probe_), shm_chunks_(std::move(other.shm_chunks_)),
+      shm_first_chunk_(std::exchange(other.shm_first_chunk_, 0)),
+      shm_chunk_count_(std::exchange(other.shm_chunk_count_, 0)),
+      session_index_(std::exchange(other.session_index_, 0)),
+      source_routes_(std::exchange(other.source_routes_, nullptr)),
+      hello_(std::exchange(other.hello_, {})), negotiated_(std::exchange(other.negotiated_, {})),
+      pending_hello_(std::exchange(other.pending_hello_, std::nullopt)),
+      pending_ping_(std::exchange(other.pending_ping_, std::nullopt)),
+      pending_address_(std::exchange(other.pending_address_, std::nullopt)), rtt_(std::exchange(other.rtt_, {})),
+      inner_contexts_(std::move(other.inner_contexts_)), cooling_down_(std::exchange(other.cooling_down_, false)),
+      recv_timeout_(std::exchange(other.recv_timeout_, {})), last_recv_(std::exchange(other.last_recv_, {})),
+      timer_generation_(std::exchange(other.timer_generation_, 0)),
       input_buffer_queue_(std::move(other.input_buffer_queue_)), buffer_refcounts_(std::move(other.buffer_refcounts_)),
       state_(std::exchange(other.state_, {})), header_(std::exchange(other.header_, {})),
-      header_progress_(std::exchange(other.header_progress_, 0)), frame_(std::move(other.frame_)),
+      header_progress_(std::exchange(other.header_progress_, 0)), compact_(std::exchange(other.compact_, false)),
+      compact_header_(other.compact_header_), integrity_(std::exchange(other.integrity_, Integrity::FULL)),
+      frame_(std::move(other.frame_)),
       payload_progress_(std::exchange(other.payload_progress_, 0)),
       output_frame_queue_(std::move(other.output_frame_queue_)),
-      write_in_progress_(std::exchange(other.write_in_progress_, false)) {}
+      write_in_progress_(std::exchange(other.write_in_progress_, false)), staging_(std::move(other.staging_)),
+      staging_refcounts_(std::move(other.staging_refcounts_)), free_staging_(std::move(other.free_staging_)),
+      compressed_(std::move(other.compressed_)), discarding_(std::exchange(other.discarding_, false)),
+      discarded_(std::move(other.discarded_)) {}
 
 zportal::Receiver& zportal::Receiver::operator=(Receiver&& other) noexcept {
     if (&other == this) {
@@ -60,19 +159,54 @@ zportal::Receiver& zportal::Receiver::operator=(Receiver&& other) noexcept {
 
     ring_ = std::exchange(other.ring_, nullptr);
     tun_ = std::exchange(other.tun_, nullptr);
-    bg_ = std::exchange(other.bg_, nullptr);
     socket_ = std::exchange(other.socket_, nullptr);
+    pool_ = std::move(other.pool_);
+    armed_bg_ = std::exchange(other.armed_bg_, nullptr);
+    size_hint_ = std::exchange(other.size_hint_, 0);
+    switching_class_ = std::exchange(other.switching_class_, false);
+    recv_user_data_ = std::exchange(other.recv_user_data_, 0);
+    recv_armed_ = std::exchange(other.recv_armed_, false);
+    stopping_ = std::exchange(other.stopping_, false);
+    datagram_ = std::exchange(other.datagram_, false);
+    unordered_ = std::exchange(other.unordered_, false);
+    shm_ = std::move(other.shm_);
+    peer_doorbell_ = std::exchange(other.peer_doorbell_, -1);
+    shm_closed_ = std::exchange(other.shm_closed_, false);
+    probe_ = other.probe_;
+    shm_chunks_ = std::move(other.shm_chunks_);
+    shm_first_chunk_ = std::exchange(other.shm_first_chunk_, 0);
+    shm_chunk_count_ = std::exchange(other.shm_chunk_count_, 0);
+    session_index_ = std::exchange(other.session_index_, 0);
+    source_routes_ = std::exchange(other.source_routes_, nullptr);
+    hello_ = std::exchange(other.hello_, {});
+    negotiated_ = std::exchange(other.negotiated_, {});
+    pending_hello_ = std::exchange(other.pending_hello_, std::nullopt);
+    pending_ping_ = std::exchange(other.pending_ping_, std::nullopt);
+    pending_address_ = std::exchange(other.pending_address_, std::nullopt);
+    rtt_ = std::exchange(other.rtt_, {});
+    inner_contexts_ = std::move(other.inner_contexts_);
+    recv_timeout_ = std::exchange(other.recv_timeout_, {});
+    last_recv_ = std::exchange(other.last_recv_, {});
+    timer_generation_ = std::exchange(other.timer_generation_, 0);
     cooling_down_ = std::exchange(other.cooling_down_, false);
-    used_buffers_ = std::exchange(other.used_buffers_, 0);
     input_buffer_queue_ = std::move(other.input_buffer_queue_);
     buffer_refcounts_ = std::move(other.buffer_refcounts_);
     state_ = std::exchange(other.state_, {});
     header_ = std::exchange(other.header_, {});
     header_progress_ = std::exchange(other.header_progress_, 0);
+    compact_ = std::exchange(other.compact_, false);
+    compact_header_ = other.compact_header_;
+    integrity_ = std::exchange(other.integrity_, Integrity::FULL);
     frame_ = std::move(other.frame_);
     payload_progress_ = std::exchange(other.payload_progress_, 0);
     output_frame_queue_ = std::move(other.output_frame_queue_);
     write_in_progress_ = std::exchange(other.write_in_progress_, false);
+    staging_ = std::move(other.staging_);
+    staging_refcounts_ = std::move(other.staging_refcounts_);
+    free_staging_ = std::move(other.free_staging_);
+    compressed_ = std::move(other.compressed_);
+    discarding_ = std::exchange(other.discarding_, false);
+    discarded_ = std::move(other.discarded_);
 
     return *this;
 }
@@ -82,14 +216,30 @@ zportal::Result<void> zportal::Receiver::arm_recv() noexcept {
         return fail(ErrorCode::InvalidReceiver);
     }
 
+    if (stopping_) {
+        return {};
+    }
+
+    if (shm_) {
+        return arm_probe_();
+    }
+
+    auto* bg = pool_.select(size_hint_);
+    if (bg == nullptr) {
+        cooling_down_ = true;
+        return {};
+    }
+    armed_bg_ = bg;
+    switching_class_ = false;
+
     auto sqe = ring_->get_sqe();
     if (!sqe) {
         return fail(sqe.error());
     }
 
-    Operation operation;
-    operation.set_type(OperationType::RECV);
-    ::io_uring_sqe_set_data64(*sqe, operation.serialize());
+    // The slot carries the bgid, so completions find their buffer group even across class switches.
+    recv_user_data_ = Operation::make(OperationType::RECV, session_index_, armed_bg_->get_bgid()).serialize();
+    ::io_uring_sqe_set_data64(*sqe, recv_user_data_);
 
 #if HAVE_IO_URING_PREP_RECV_MULTISHOT
     const auto check_result = support_check::recv_multishot();
@@ -97,7 +247,9 @@ zportal::Result<void> zportal::Receiver::arm_recv() noexcept {
         return fail(check_result.error());
     }
 
-    if (*check_result) {
+    if (datagram_) {
+        ::io_uring_prep_recvmsg_multishot(*sqe, socket_->get(), &recv_header_, 0);
+    } else if (*check_result) {
         ::io_uring_prep_recv_multishot(*sqe, socket_->get(), nullptr, 0, 0);
     } else {
         ::io_uring_prep_recv(*sqe, socket_->get(), nullptr, 0, 0);
@@ -107,13 +259,15 @@ zportal::Result<void> zportal::Receiver::arm_recv() noexcept {
 #endif
 
     (*sqe)->flags |= IOSQE_BUFFER_SELECT;
-    (*sqe)->buf_group = bg_->get_bgid();
+    (*sqe)->buf_group = armed_bg_->get_bgid();
 
     const auto submit_result = ring_->submit();
     if (!submit_result) {
         return fail(submit_result.error());
     }
 
+    recv_armed_ = true;
+
     return {};
 }
 
@@ -123,18 +277,239 @@ zportal::Result<void> zportal::Receiver::handle_cqe(const Cqe& cqe) noexcept {
     }
 
     const auto type = cqe.operation().get_type();
-    if (type != OperationType::RECV && type != OperationType::WRITE) {
+    if (type != OperationType::RECV && type != OperationType::WRITE && type != OperationType::RECV_TIMEOUT) {
         return fail(ErrorCode::WrongOperationType);
     }
 
     if (type == OperationType::RECV) {
         return handle_recv_cqe_(cqe);
     }
+    if (type == OperationType::RECV_TIMEOUT) {
+        return handle_recv_timeout_cqe_(cqe);
+    }
     return handle_write_cqe_(cqe);
 }
 
+zportal::Result<void> zportal::Receiver::drain_ring() noexcept {
+    if (!is_valid() || !shm_) {
+        return fail(ErrorCode::InvalidReceiver);
+    }
+
+    while (!stopping_ && !cooling_down_) {
+        const std::size_t readable = shm_.get_readable();
+        if (readable == 0) {
+            // The peer wrote its last frames before closing, nothing more is coming.
+            if (shm_closed_) {
+                if (const auto result = kick_write_(); !result) {
+                    return fail(result.error());
+                }
+
+                return fail(ErrorCode::PeerClosed);
+            }
+
+            // The flag goes up before the last look, a peer writing in between would otherwise never ring.
+            if (shm_.wait_for_data()) {
+                break;
+            }
+            continue;
+        }
+
+        // Written frames give their chunks back, a frame still being parsed holding all of them never will.
+        if (shm_chunk_count_ == shm_chunks_.size()) {
+            if (!write_in_progress_ && output_frame_queue_.empty()) {
+                return fail(ErrorCode::InvalidSize);
+            }
+
+            cooling_down_ = true;
+            break;
+        }
+
+        const auto slot = static_cast<std::uint16_t>((shm_first_chunk_ + shm_chunk_count_) % shm_chunks_.size());
+        const auto data = shm_.acquire();
+        shm_chunks_[slot] = ShmChunk{.data = data};
+        shm_chunk_count_++;
+
+        try {
+            input_buffer_queue_.push({.id = {.bgid = shm_bgid, .bid = slot}, .size = data.size()});
+        } catch (const std::bad_alloc&) {
+            return fail(ErrorCode::NotEnoughMemory);
+        }
+
+        if (recv_timeout_.count() > 0) {
+            last_recv_ = std::chrono::steady_clock::now();
+        }
+
+        if (const auto kick_parse_result = kick_parse_(); !kick_parse_result) {
+            return fail(kick_parse_result.error());
+        }
+    }
+
+    return kick_write_();
+}
+
+zportal::Result<void> zportal::Receiver::arm_recv_deadline(std::chrono::milliseconds timeout) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidReceiver);
+    }
+
+    recv_timeout_ = timeout;
+    if (recv_timeout_.count() <= 0) {
+        return {};
+    }
+
+    last_recv_ = std::chrono::steady_clock::now();
+    return arm_recv_timer_(recv_timeout_);
+}
+
+void zportal::Receiver::set_source_routes(const RouteTable* routes) noexcept {
+    source_routes_ = routes;
+}
+
+void zportal::Receiver::set_hello(const Hello& hello) noexcept {
+    hello_ = hello;
+}
+
+std::optional<zportal::Hello> zportal::Receiver::take_hello() noexcept {
+    return std::exchange(pending_hello_, std::nullopt);
+}
+
+std::optional<zportal::Ping> zportal::Receiver::take_ping() noexcept {
+    return std::exchange(pending_ping_, std::nullopt);
+}
+
+std::optional<zportal::InnerAddress> zportal::Receiver::take_address() noexcept {
+    return std::exchange(pending_address_, std::nullopt);
+}
+
+std::chrono::nanoseconds zportal::Receiver::get_rtt() const noexcept {
+    return rtt_;
+}
+
+zportal::Result<void> zportal::Receiver::resume() noexcept {
+    if (!cooling_down_ || stopping_) {
+        return {};
+    }
+
+    const bool exhausted =
+        shm_ ? shm_chunk_count_ == shm_chunks_.size() : pool_.get_used_count() >= pool_.get_buffer_count() / 2;
+    if (exhausted) {
+        return {};
+    }
+
+    // arm_recv() enters the cooldown again if the pool ran dry in the meantime.
+    cooling_down_ = false;
+    return arm_recv();
+}
+
+bool zportal::Receiver::is_cooling_down() const noexcept {
+    return cooling_down_;
+}
+
+void zportal::Receiver::stop() noexcept {
+    stopping_ = true;
+}
+
+bool zportal::Receiver::is_idle() const noexcept {
+    return !recv_armed_ && !write_in_progress_;
+}
+
+bool zportal::Receiver::is_flushed() const noexcept {
+    return !write_in_progress_ && output_frame_queue_.empty();
+}
+
+zportal::Result<void> zportal::Receiver::release_buffers() noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidReceiver);
+    }
+
+    if (!is_idle()) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    // A buffer may be both queued for parsing and part of frames, -1 marks it as already returned.
+    const auto release = [this](BufferId id) -> Result<void> {
+        const auto refcount = refcount_(id);
+        if (!refcount) {
+            return fail(refcount.error());
+        }
+
+        if (**refcount < 0) {
+            return {};
+        }
+        **refcount = -1;
+
+        return return_buffer_(id);
+    };
+
+    for (; !input_buffer_queue_.empty(); input_buffer_queue_.pop()) {
+        if (const auto result = release(input_buffer_queue_.front().id); !result) {
+            return fail(result.error());
+        }
+    }
+
+    for (; !output_frame_queue_.empty(); output_frame_queue_.pop()) {
+        for (const BufferId id : output_frame_queue_.front().buffers) {
+            if (const auto result = release(id); !result) {
+                return fail(result.error());
+            }
+        }
+    }
+
+    for (const BufferId id : frame_.buffers) {
+        if (const auto result = release(id); !result) {
+            return fail(result.error());
+        }
+    }
+    frame_ = OutputFrame{};
+
+    for (auto& refcounts : buffer_refcounts_) {
+        std::ranges::fill(refcounts, 0);
+    }
+    std::ranges::fill(staging_refcounts_, 0);
+    free_staging_.clear();
+    for (std::size_t bid = 0; bid < staging_.size(); ++bid) {
+        free_staging_.push_back(static_cast<std::uint16_t>(bid));
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Receiver::restart(Socket& socket) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidReceiver);
+    }
+
+    if (!stopping_ || !is_idle() || !input_buffer_queue_.empty() || !output_frame_queue_.empty()) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    socket_ = &socket;
+    if (const auto result = detect_transport_(); !result) {
+        return fail(result.error());
+    }
+    stopping_ = false;
+    cooling_down_ = false;
+    switching_class_ = false;
+    timer_generation_++;
+
+    state_ = ParseState::PARSING_HEADER;
+    header_ = FrameHeader{};
+    header_progress_ = 0;
+    frame_ = OutputFrame{};
+    payload_progress_ = 0;
+    negotiated_ = Hello{};
+    pending_hello_ = std::nullopt;
+    pending_ping_ = std::nullopt;
+    pending_address_ = std::nullopt;
+    rtt_ = {};
+    compact_ = false;
+    integrity_ = Integrity::FULL;
+
+    return {};
+}
+
 bool zportal::Receiver::is_valid() const noexcept {
-    return (ring_ != nullptr) && (tun_ != nullptr) && (socket_ != nullptr) && (bg_ != nullptr);
+    return (ring_ != nullptr) && (tun_ != nullptr) && (socket_ != nullptr) && pool_.is_valid();
 }
 
 zportal::Receiver::operator bool() const noexcept {
@@ -160,6 +535,8 @@ zportal::Result<void> zportal::Receiver::handle_write_cqe_(const Cqe& cqe) noexc
         return fail({ErrorCode::TunWriteFailed, cqe.error()});
     }
 
+    Monitor::record_latency(OperationType::WRITE, cqe.operation().elapsed());
+
     const auto& frame = output_frame_queue_.front();
     const std::size_t frame_size = ([&]() {
         std::size_t size{};
@@ -175,27 +552,30 @@ zportal::Result<void> zportal::Receiver::handle_write_cqe_(const Cqe& cqe) noexc
         return fail(ErrorCode::TunPartialWrite);
     }
 
-    for (std::uint16_t bid : frame.bid) {
-        buffer_refcounts_[bid]--;
-        if (buffer_refcounts_[bid] <= 0) {
-            assert(buffer_refcounts_[bid] == 0);
+    for (const BufferId id : frame.buffers) {
+        const auto refcount = refcount_(id);
+        if (!refcount) {
+            return fail(refcount.error());
+        }
+
+        (**refcount)--;
+        if (**refcount <= 0) {
+            assert(**refcount == 0);
 
-            if (const auto result = bg_->return_buffer(bid); !result) {
+            if (const auto result = return_buffer_(id); !result) {
                 return fail(result.error());
             }
-
-            used_buffers_--;
         }
     }
 
     output_frame_queue_.pop();
 
-    if (cooling_down_ && (used_buffers_ < bg_->get_buffer_count() / 2)) {
-        if (const auto arm_recv_result = arm_recv(); !arm_recv_result) {
-            return fail(arm_recv_result.error());
-        }
+    if (stopping_) {
+        return {};
+    }
 
-        cooling_down_ = false;
+    if (const auto resume_result = resume(); !resume_result) {
+        return fail(resume_result.error());
     }
 
     return kick_write_();
@@ -210,30 +590,91 @@ zportal::Result<void> zportal::Receiver::handle_recv_cqe_(const Cqe& cqe) noexce
         return fail(ErrorCode::WrongOperationType);
     }
 
+    recv_armed_ = cqe.more();
+
+    if (shm_) {
+        return handle_probe_cqe_(cqe);
+    }
+
+    // Stopped receivers drain their last completions, buffers picked by the kernel go straight back.
+    if (stopping_) {
+        const auto bid = cqe.bid();
+        if (!cqe.ok() || !bid) {
+            return {};
+        }
+
+        const auto bg = pool_.get_buffer_group(cqe.operation().get_slot());
+        if (!bg) {
+            return fail(bg.error());
+        }
+
+        if (const auto take_result = (*bg)->take_buffer(*bid, static_cast<std::uint32_t>(cqe.result())); !take_result) {
+            return fail(take_result.error());
+        }
+
+        return (*bg)->return_buffer(*bid);
+    }
+
     if (!cqe.ok()) {
         if (cqe.error() == ENOBUFS && !cqe.more()) {
-            cooling_down_ = true;
+            // The armed class ran dry, arm_recv() moves to another one or enters the cooldown.
+            if (const auto arm_recv_result = arm_recv(); !arm_recv_result) {
+                return fail(arm_recv_result.error());
+            }
+
+            return kick_write_();
+        }
+
+        if (cqe.error() == ECANCELED) {
+            if (const auto arm_recv_result = arm_recv(); !arm_recv_result) {
+                return fail(arm_recv_result.error());
+            }
+
             return kick_write_();
         }
+
         return fail({ErrorCode::RecvFailed, cqe.error()});
     }
 
-    used_buffers_++;
-
     const std::uint32_t readen = cqe.result();
     if (readen == 0) {
         return fail(ErrorCode::PeerClosed);
     }
 
+    if (recv_timeout_.count() > 0) {
+        last_recv_ = std::chrono::steady_clock::now();
+    }
+
     const auto bid = cqe.bid();
     if (!bid) {
         return fail(ErrorCode::RecvCqeMissingBid);
     }
 
-    try {
-        input_buffer_queue_.push({.bid = *bid, .size = static_cast<std::size_t>(readen)});
-    } catch (const std::bad_alloc&) {
-        return fail(ErrorCode::NotEnoughMemory);
+    const auto bg = pool_.get_buffer_group(cqe.operation().get_slot());
+    if (!bg) {
+        return fail(bg.error());
+    }
+
+    if (const auto take_result = (*bg)->take_buffer(*bid, readen); !take_result) {
+        return fail(take_result.error());
+    }
+
+    InputBuffer input{.id = {.bgid = (*bg)->get_bgid(), .bid = *bid}, .size = static_cast<std::size_t>(readen)};
+    const auto complete = datagram_ ? unwrap_datagram_(input) : Result<bool>{true};
+    if (!complete) {
+        return fail(complete.error());
+    }
+
+    if (*complete) {
+        try {
+            input_buffer_queue_.push(input);
+        } catch (const std::bad_alloc&) {
+            return fail(ErrorCode::NotEnoughMemory);
+        }
+    }
+
+    if (const auto update_result = update_size_hint_(**bg, readen, cqe.more()); !update_result) {
+        return fail(update_result.error());
     }
 
     if (const auto kick_parse_result = kick_parse_(); !kick_parse_result) {
@@ -249,68 +690,681 @@ zportal::Result<void> zportal::Receiver::handle_recv_cqe_(const Cqe& cqe) noexce
     return kick_write_();
 }
 
-zportal::Result<void> zportal::Receiver::kick_parse_() noexcept {
-    if (!is_valid()) {
-        return fail(ErrorCode::InvalidReceiver);
-    }
+zportal::Result<void> zportal::Receiver::arm_probe_() noexcept {
+    if (!recv_armed_) {
+        auto sqe = ring_->get_sqe();
+        if (!sqe) {
+            return fail(sqe.error());
+        }
 
-    while (!input_buffer_queue_.empty()) {
-        InputBuffer& input_buffer = input_buffer_queue_.front();
+        recv_user_data_ = Operation::make(OperationType::RECV, session_index_).serialize();
+        ::io_uring_prep_recv(*sqe, socket_->get(), probe_.data(), probe_.size(), 0);
+        ::io_uring_sqe_set_data64(*sqe, recv_user_data_);
 
-        if (input_buffer.offset >= input_buffer.size) {
-            return fail(ErrorCode::InvalidState);
+        if (const auto submit_result = ring_->submit(); !submit_result) {
+            return fail(submit_result.error());
         }
 
-        if (state_ == ParseState::PARSING_HEADER) {
-            if (header_progress_ >= FrameHeader::wire_size) {
-                return fail(ErrorCode::InvalidState);
-            }
+        recv_armed_ = true;
+    }
 
-            auto buffer_span = bg_->get_buffer(input_buffer.bid, static_cast<std::uint32_t>(input_buffer.size));
-            if (!buffer_span) {
-                return fail(buffer_span.error());
-            }
+    // Frames written before the session started wait in the ring, nobody rang for them.
+    return drain_ring();
+}
 
-            const std::size_t take =
-                std::min(input_buffer.size - input_buffer.offset, FrameHeader::wire_size - header_progress_);
-            std::memcpy(header_.data().data() + header_progress_, buffer_span->data() + input_buffer.offset, take);
+zportal::Result<void> zportal::Receiver::handle_probe_cqe_(const Cqe& cqe) noexcept {
+    if (stopping_) {
+        return {};
+    }
 
-            input_buffer.offset += take;
-            header_progress_ += take;
+    if (!cqe.ok()) {
+        if (cqe.error() == ECANCELED) {
+            return arm_recv();
+        }
 
-            if (header_progress_ == FrameHeader::wire_size) {
-                header_progress_ = 0;
+        return fail({ErrorCode::RecvFailed, cqe.error()});
+    }
 
-                if (!header_.is_magic_valid()) {
-                    return fail(ErrorCode::InvalidMagic);
-                }
+    // Frames only travel through the ring, a peer writing to the socket isn't speaking SHM.
+    if (cqe.result() > 0) {
+        return fail(ErrorCode::ShmExchangeFailed);
+    }
 
-                if (header_.get_size() == 0 || header_.get_size() > tun_->get_mtu()) {
-                    return fail(ErrorCode::InvalidSize);
-                }
+    shm_closed_ = true;
 
-                state_ = ParseState::PARSING_PAYLOAD;
-            }
+    return drain_ring();
+}
 
-        } else if (state_ == ParseState::PARSING_PAYLOAD) {
-            const auto payload_size = static_cast<std::size_t>(header_.get_size());
-            if (payload_progress_ >= payload_size) {
-                return fail(ErrorCode::InvalidState);
-            }
+zportal::Result<void> zportal::Receiver::detect_transport_() noexcept {
+    datagram_ = false;
+    unordered_ = false;
+    if (!*socket_) {
+        return {};
+    }
 
-            auto buffer_span = bg_->get_buffer(input_buffer.bid, static_cast<std::uint32_t>(input_buffer.size));
-            if (!buffer_span) {
-                return fail(buffer_span.error());
-            }
+    const auto transport = socket_->detect_transport();
+    if (!transport) {
+        return fail(transport.error());
+    }
 
-            const std::size_t take =
-                std::min(input_buffer.size - input_buffer.offset, payload_size - payload_progress_);
+    // SCTP keeps each message whole and never interleaves two, so its receives parse like a stream.
+    unordered_ = *transport != Transport::TCP;
+    if (*transport != Transport::UDP) {
+        return {};
+    }
 
-            buffer_refcounts_[input_buffer.bid]++;
+    // Without multishot RECVMSG a datagram cut short would go unnoticed.
+    const auto check_result = support_check::recv_multishot();
+    if (!check_result) {
+        return fail(check_result.error());
+    }
+    if (!HAVE_IO_URING_PREP_RECV_MULTISHOT || !*check_result) {
+        return fail(ErrorCode::RingProbeNotSupported);
+    }
 
-            try {
-                frame_.bid.push_back(input_buffer.bid);
-                frame_.segments.push_back({.iov_base = buffer_span->data() + input_buffer.offset, .iov_len = take});
+    datagram_ = true;
+
+    return {};
+}
+
+zportal::Result<bool> zportal::Receiver::unwrap_datagram_(InputBuffer& input) noexcept {
+    const auto buffer = pool_.get_buffer(input.id, static_cast<std::uint32_t>(input.size));
+    if (!buffer) {
+        return fail(buffer.error());
+    }
+
+    auto* out = ::io_uring_recvmsg_validate(buffer->data(), static_cast<int>(buffer->size()), &recv_header_);
+    if (out == nullptr) {
+        return fail(ErrorCode::RecvParserError);
+    }
+
+    const auto payload = static_cast<const std::byte*>(::io_uring_recvmsg_payload(out, &recv_header_));
+    const auto length = ::io_uring_recvmsg_payload_length(out, static_cast<int>(buffer->size()), &recv_header_);
+    if ((out->flags & MSG_TRUNC) != 0 || length == 0) {
+        if (const auto result = pool_.return_buffer(input.id); !result) {
+            return fail(result.error());
+        }
+
+        return false;
+    }
+
+    input.offset = static_cast<std::size_t>(payload - buffer->data());
+    input.size = input.offset + length;
+
+    return true;
+}
+
+zportal::Result<std::int32_t*> zportal::Receiver::refcount_(BufferId id) noexcept {
+    if (id.bgid == shm_bgid) {
+        if (id.bid >= shm_chunks_.size()) {
+            return fail(ErrorCode::InvalidBid);
+        }
+
+        return &shm_chunks_[id.bid].refcount;
+    }
+
+    if (id.bgid == staging_bgid) {
+        if (id.bid >= staging_refcounts_.size()) {
+            return fail(ErrorCode::InvalidBid);
+        }
+
+        return &staging_refcounts_[id.bid];
+    }
+
+    const auto index = pool_.index_of(id.bgid);
+    if (!index) {
+        return fail(ErrorCode::InvalidBgid);
+    }
+
+    auto& refcounts = buffer_refcounts_[*index];
+    if (id.bid >= refcounts.size()) {
+        return fail(ErrorCode::InvalidBid);
+    }
+
+    return &refcounts[id.bid];
+}
+
+zportal::Result<std::span<std::byte>> zportal::Receiver::input_span_(const InputBuffer& input) noexcept {
+    if (input.id.bgid != shm_bgid) {
+        return pool_.get_buffer(input.id, static_cast<std::uint32_t>(input.size));
+    }
+
+    if (input.id.bid >= shm_chunks_.size()) {
+        return fail(ErrorCode::InvalidBid);
+    }
+
+    return shm_chunks_[input.id.bid].data;
+}
+
+zportal::Result<void> zportal::Receiver::return_buffer_(BufferId id) noexcept {
+    if (id.bgid == shm_bgid) {
+        if (id.bid >= shm_chunks_.size()) {
+            return fail(ErrorCode::InvalidBid);
+        }
+
+        shm_chunks_[id.bid].returned = true;
+        return release_shm_chunks_();
+    }
+
+    if (id.bgid != staging_bgid) {
+        return pool_.return_buffer(id);
+    }
+
+    // Reserved for every staging buffer when the first one was made.
+    free_staging_.push_back(id.bid);
+
+    return {};
+}
+
+zportal::Result<void> zportal::Receiver::release_shm_chunks_() noexcept {
+    std::size_t released{};
+    for (; shm_chunk_count_ > 0 && shm_chunks_[shm_first_chunk_].returned; shm_chunk_count_--) {
+        auto& chunk = shm_chunks_[shm_first_chunk_];
+        released += chunk.data.size();
+        chunk = ShmChunk{};
+        shm_first_chunk_ = (shm_first_chunk_ + 1) % shm_chunks_.size();
+    }
+
+    if (released == 0) {
+        return {};
+    }
+
+    shm_.release(released);
+    if (shm_.take_writer_waiting() && ::eventfd_write(peer_doorbell_, 1) != 0) {
+        return fail({ErrorCode::EventFdFailed, errno});
+    }
+
+    return {};
+}
+
+std::size_t zportal::Receiver::packet_limit_() const noexcept {
+    const bool inner = (header_.get_flags() & Hello::INNER_HEADERS) != 0;
+    return tun_->get_mtu() + (inner ? InnerHeaderContexts::max_growth : 0);
+}
+
+const zportal::Hello& zportal::Receiver::accepted_hello_() const noexcept {
+    return unordered_ ? hello_ : negotiated_;
+}
+
+std::size_t zportal::Receiver::frame_limit_() const noexcept {
+    const bool batched = (header_.get_flags() & Hello::BATCHED_FRAMES) != 0;
+    return batched ? accepted_hello_().get_max_frame_size() : packet_limit_();
+}
+
+zportal::Result<void> zportal::Receiver::restore_headers_(OutputFrame& packet) noexcept {
+    std::array<std::byte, InnerHeaderContexts::max_prefix_size> head{};
+    std::size_t copied{};
+    std::size_t size{};
+    for (const auto& segment : packet.segments) {
+        const std::size_t take = std::min(static_cast<std::size_t>(segment.iov_len), head.size() - copied);
+        std::memcpy(head.data() + copied, segment.iov_base, take);
+        copied += take;
+        size += segment.iov_len;
+    }
+
+    const auto prefix = inner_contexts_.restore(std::span<const std::byte>(head).first(copied), size, packet.header);
+    if (!prefix) {
+        return fail(prefix.error());
+    }
+
+    // The replaced bytes may end anywhere inside the segments.
+    std::size_t replaced = prefix->replaced;
+    auto first = packet.segments.begin();
+    while (replaced > 0 && replaced >= first->iov_len) {
+        replaced -= first->iov_len;
+        ++first;
+    }
+    if (replaced > 0) {
+        first->iov_base = static_cast<std::byte*>(first->iov_base) + replaced;
+        first->iov_len -= replaced;
+    }
+    packet.segments.erase(packet.segments.begin(), first);
+
+    packet.header_size = prefix->size;
+    if (packet.header_size > 0) {
+        try {
+            packet.segments.insert(packet.segments.begin(),
+                                   {.iov_base = packet.header.data(), .iov_len = packet.header_size});
+        } catch (const std::bad_alloc&) {
+            return fail(ErrorCode::NotEnoughMemory);
+        }
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Receiver::queue_frame_(OutputFrame&& frame) noexcept {
+    try {
+        output_frame_queue_.push(std::move(frame));
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    // Queued frames stay where they are until written.
+    auto& queued = output_frame_queue_.back();
+    if (queued.header_size > 0) {
+        queued.segments.front().iov_base = queued.header.data();
+    }
+
+    return {};
+}
+
+zportal::Result<bool> zportal::Receiver::accept_source_(const OutputFrame& frame) noexcept {
+    if (source_routes_ == nullptr) {
+        return true;
+    }
+
+    // Large enough for the IPv6 source address, the segments may split it anywhere.
+    std::array<std::byte, 24> header{};
+    std::size_t copied{};
+    for (const auto& segment : frame.segments) {
+        const std::size_t take = std::min(static_cast<std::size_t>(segment.iov_len), header.size() - copied);
+        std::memcpy(header.data() + copied, segment.iov_base, take);
+        copied += take;
+
+        if (copied == header.size()) {
+            break;
+        }
+    }
+
+    const auto source = ip_source(std::span<const std::byte>(header).first(copied));
+    if (!source) {
+        return false;
+    }
+
+    const auto owner = source_routes_->lookup(*source);
+    return owner && *owner == session_index_;
+}
+
+zportal::Result<void> zportal::Receiver::handle_control_(const OutputFrame& frame) noexcept {
+    std::array<std::byte, max_control_size> message{};
+    std::size_t length{};
+    for (const auto& segment : frame.segments) {
+        const std::size_t take = std::min(segment.iov_len, message.size() - length);
+        std::memcpy(message.data() + length, segment.iov_base, take);
+        length += take;
+    }
+
+    const std::span<const std::byte> payload{message.data(), length};
+    if (payload.empty()) {
+        return {};
+    }
+
+    const auto type = static_cast<ControlType>(payload[0]);
+    if (type == ControlType::PING || type == ControlType::PONG) {
+        const auto ping = Ping::parse(payload);
+        if (!ping) {
+            return fail(ping.error());
+        }
+
+        if (type == ControlType::PING) {
+            pending_ping_ = *ping;
+            return {};
+        }
+
+        // Smoothed like TCP's SRTT, each sample moves it by an eighth.
+        const auto sample = ping->elapsed();
+        rtt_ = rtt_.count() == 0 ? sample : rtt_ + (sample - rtt_) / 8;
+        return {};
+    }
+
+    if (type == ControlType::ADDRESS) {
+        const auto address = InnerAddress::parse(payload);
+        if (!address) {
+            return fail(address.error());
+        }
+
+        pending_address_ = *address;
+        return {};
+    }
+
+    if (type != ControlType::HELLO) {
+        return {};
+    }
+
+    const auto peer = Hello::parse(payload);
+    if (!peer) {
+        return fail(peer.error());
+    }
+
+    return accept_hello_(*peer);
+}
+
+zportal::Result<void> zportal::Receiver::accept_hello_(const Hello& peer) noexcept {
+    negotiated_ = hello_.negotiate(peer);
+    pending_hello_ = negotiated_;
+
+    if (negotiated_.has(Hello::INNER_HEADERS)) {
+        return inner_contexts_.reset();
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Receiver::decompress_frame_(BufferId current) noexcept {
+    // A lone packet never grows past the MTU, a batch past the largest frame.
+    const std::size_t limit = frame_limit_();
+
+    try {
+        if (free_staging_.empty() && staging_.size() < max_staging_buffers) {
+            free_staging_.reserve(max_staging_buffers);
+            staging_.emplace_back();
+            staging_refcounts_.push_back(0);
+            free_staging_.push_back(static_cast<std::uint16_t>(staging_.size() - 1));
+        }
+
+        // Every staging buffer still waits for TUN, the frame is only decompressed for its headers.
+        discarding_ = free_staging_.empty();
+        auto& output = discarding_ ? discarded_ : staging_[free_staging_.back()];
+        if (output.size() < limit) {
+            output.resize(limit);
+        }
+
+        if (frame_.segments.size() > 1) {
+            compressed_.resize(header_.get_size());
+        }
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    std::span<const std::byte> input{static_cast<const std::byte*>(frame_.segments.front().iov_base),
+                                     frame_.segments.front().iov_len};
+    if (frame_.segments.size() > 1) {
+        std::size_t gathered{};
+        for (const auto& segment : frame_.segments) {
+            std::memcpy(compressed_.data() + gathered, segment.iov_base, segment.iov_len);
+            gathered += segment.iov_len;
+        }
+        input = std::span<const std::byte>{compressed_}.first(gathered);
+    }
+
+    auto& output = discarding_ ? discarded_ : staging_[free_staging_.back()];
+    const auto size = compression::decompress(input, std::span<std::byte>{output}.first(limit));
+    if (!size) {
+        return fail(size.error());
+    }
+
+    if (const auto result = drop_frame_(frame_, current); !result) {
+        return fail(result.error());
+    }
+
+    frame_ = OutputFrame{};
+    try {
+        if (!discarding_) {
+            frame_.buffers.push_back({.bgid = staging_bgid, .bid = free_staging_.back()});
+        }
+        frame_.segments.push_back({.iov_base = output.data(), .iov_len = *size});
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    if (!discarding_) {
+        staging_refcounts_[free_staging_.back()] = 1;
+        free_staging_.pop_back();
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Receiver::split_batch_(const OutputFrame& frame) noexcept {
+    std::array<std::byte, BatchTable::max_wire_size> head{};
+    std::size_t copied{};
+    for (const auto& segment : frame.segments) {
+        const std::size_t take = std::min(static_cast<std::size_t>(segment.iov_len), head.size() - copied);
+        std::memcpy(head.data() + copied, segment.iov_base, take);
+        copied += take;
+    }
+
+    const auto table = BatchTable::parse(std::span<const std::byte>(head).first(copied));
+    if (!table) {
+        return fail(table.error());
+    }
+
+    std::size_t size = table->data().size();
+    for (std::size_t i = 0; i < table->get_count(); i++) {
+        const std::size_t length = table->get_length(i);
+        if (length == 0 || length > packet_limit_()) {
+            return fail(ErrorCode::InvalidBatch);
+        }
+        size += length;
+    }
+
+    std::size_t frame_size{};
+    for (const auto& segment : frame.segments) {
+        frame_size += segment.iov_len;
+    }
+
+    if (size != frame_size) {
+        return fail(ErrorCode::InvalidBatch);
+    }
+
+    // Past the table, packets may start and end anywhere inside the frame's segments.
+    std::size_t segment{};
+    std::size_t offset = table->data().size();
+    while (offset >= frame.segments[segment].iov_len) {
+        offset -= frame.segments[segment].iov_len;
+        segment++;
+    }
+
+    for (std::size_t i = 0; i < table->get_count(); i++) {
+        OutputFrame packet;
+        std::size_t remaining = table->get_length(i);
+
+        try {
+            while (remaining > 0) {
+                const auto& source = frame.segments[segment];
+                const std::size_t take = std::min(remaining, source.iov_len - offset);
+
+                if (!discarding_) {
+                    packet.buffers.push_back(frame.buffers[segment]);
+                }
+                packet.segments.push_back(
+                    {.iov_base = static_cast<std::byte*>(source.iov_base) + offset, .iov_len = take});
+
+                remaining -= take;
+                offset += take;
+                if (offset == source.iov_len) {
+                    segment++;
+                    offset = 0;
+                }
+            }
+        } catch (const std::bad_alloc&) {
+            return fail(ErrorCode::NotEnoughMemory);
+        }
+
+        if ((header_.get_flags() & Hello::INNER_HEADERS) != 0) {
+            if (const auto result = restore_headers_(packet); !result) {
+                return fail(result.error());
+            }
+        }
+
+        if (discarding_) {
+            continue;
+        }
+
+        const auto accepted = accept_source_(packet);
+        if (!accepted) {
+            return fail(accepted.error());
+        }
+
+        if (!*accepted) {
+            continue;
+        }
+
+        for (const BufferId id : packet.buffers) {
+            const auto refcount = refcount_(id);
+            if (!refcount) {
+                return fail(refcount.error());
+            }
+            (**refcount)++;
+        }
+
+        if (const auto result = queue_frame_(std::move(packet)); !result) {
+            return fail(result.error());
+        }
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Receiver::drop_frame_(const OutputFrame& frame, BufferId current) noexcept {
+    for (const BufferId id : frame.buffers) {
+        const auto refcount = refcount_(id);
+        if (!refcount) {
+            return fail(refcount.error());
+        }
+
+        // The buffer still being parsed goes back once it is fully consumed.
+        (**refcount)--;
+        const bool consumed = id.bgid != current.bgid || id.bid != current.bid;
+        if (**refcount == 0 && consumed) {
+            if (const auto result = return_buffer_(id); !result) {
+                return fail(result.error());
+            }
+        }
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Receiver::update_size_hint_(const BufferGroup& bg, std::size_t received,
+                                                          bool still_armed) noexcept {
+    if (datagram_) {
+        // A datagram or GRO aggregate cut short is lost, so the largest class stays armed whatever the mix.
+        size_hint_ = pool_.largest()->get_buffer_size();
+    } else {
+        // A completely filled buffer means the stream had more queued, so ask for a bigger class.
+        const std::size_t observed = received >= bg.get_buffer_size() ? received + 1 : received;
+        size_hint_ = (size_hint_ * 7 + observed) / 8;
+    }
+
+    if (!still_armed || switching_class_) {
+        return {};
+    }
+
+    auto* preferred = pool_.select(size_hint_);
+    if (preferred == nullptr || preferred == armed_bg_) {
+        return {};
+    }
+
+    // Multishot receive keeps its group until it terminates, cancel it to re-arm on the preferred class.
+    auto sqe = ring_->get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    ::io_uring_prep_cancel64(*sqe, recv_user_data_, 0);
+    ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::NONE, session_index_).serialize());
+
+    if (const auto submit_result = ring_->submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    switching_class_ = true;
+
+    return {};
+}
+
+zportal::Result<void> zportal::Receiver::kick_parse_() noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidReceiver);
+    }
+
+    while (!input_buffer_queue_.empty()) {
+        InputBuffer& input_buffer = input_buffer_queue_.front();
+
+        if (input_buffer.offset >= input_buffer.size) {
+            return fail(ErrorCode::InvalidState);
+        }
+
+        if (state_ == ParseState::PARSING_HEADER) {
+            const std::size_t header_size = compact_ ? FrameHeader::max_compact_size : FrameHeader::wire_size;
+            if (header_progress_ >= header_size) {
+                return fail(ErrorCode::InvalidState);
+            }
+
+            auto buffer_span = input_span_(input_buffer);
+            if (!buffer_span) {
+                return fail(buffer_span.error());
+            }
+
+            const std::size_t take = std::min(input_buffer.size - input_buffer.offset, header_size - header_progress_);
+            auto* destination = compact_ ? compact_header_.data() : header_.data().data();
+            std::memcpy(destination + header_progress_, buffer_span->data() + input_buffer.offset, take);
+
+            input_buffer.offset += take;
+            header_progress_ += take;
+
+            bool complete = header_progress_ == header_size;
+            if (compact_) {
+                const auto length =
+                    header_.decode_compact(std::span<const std::byte>(compact_header_).first(header_progress_));
+                if (!length) {
+                    return fail(ErrorCode::InvalidCompactHeader);
+                }
+
+                // The header ends inside this take, the bytes copied past it belong to the payload.
+                complete = *length != 0;
+                if (complete) {
+                    input_buffer.offset -= header_progress_ - *length;
+                }
+            }
+
+            if (complete) {
+                header_progress_ = 0;
+
+                if (!header_.is_magic_valid()) {
+                    return fail(ErrorCode::InvalidMagic);
+                }
+
+                if ((header_.get_flags() & ~(FrameHeader::control_flag | accepted_hello_().get_features())) != 0) {
+                    return fail(ErrorCode::UnsupportedFlags);
+                }
+
+                if ((header_.get_flags() & Hello::NO_CHECKSUM) != 0) {
+                    integrity_ = Integrity::NONE;
+                } else if ((header_.get_flags() & Hello::HEADER_CHECKSUM) != 0) {
+                    integrity_ = Integrity::HEADER;
+                }
+
+                // Checked before the size is trusted, a desynced stream fails here.
+                if (integrity_ == Integrity::HEADER) {
+                    const auto crc = header_.header_crc();
+                    if (header_.get_crc() != (compact_ ? crc & FrameHeader::compact_crc_mask : crc)) {
+                        return fail(ErrorCode::FrameCrcMismatch);
+                    }
+                }
+
+                if (header_.get_size() == 0 || header_.get_size() > frame_limit_()) {
+                    return fail(ErrorCode::InvalidSize);
+                }
+
+                state_ = ParseState::PARSING_PAYLOAD;
+            }
+
+        } else if (state_ == ParseState::PARSING_PAYLOAD) {
+            const auto payload_size = static_cast<std::size_t>(header_.get_size());
+            if (payload_progress_ >= payload_size) {
+                return fail(ErrorCode::InvalidState);
+            }
+
+            auto buffer_span = input_span_(input_buffer);
+            if (!buffer_span) {
+                return fail(buffer_span.error());
+            }
+
+            const std::size_t take =
+                std::min(input_buffer.size - input_buffer.offset, payload_size - payload_progress_);
+
+            const auto refcount = refcount_(input_buffer.id);
+            if (!refcount) {
+                return fail(refcount.error());
+            }
+            (**refcount)++;
+
+            try {
+                frame_.buffers.push_back(input_buffer.id);
+                frame_.segments.push_back({.iov_base = buffer_span->data() + input_buffer.offset, .iov_len = take});
             } catch (const std::bad_alloc&) {
                 return fail(ErrorCode::NotEnoughMemory);
             }
@@ -321,17 +1375,59 @@ zportal::Result<void> zportal::Receiver::kick_parse_() noexcept {
             if (payload_progress_ == payload_size) {
                 payload_progress_ = 0;
 
-                if (header_.get_crc() != crc32c(frame_.segments)) {
-                    return fail(ErrorCode::FrameCrcMismatch);
+                if (integrity_ == Integrity::FULL) {
+                    const auto crc = crc32c(frame_.segments);
+                    if (header_.get_crc() != (compact_ ? crc & FrameHeader::compact_crc_mask : crc)) {
+                        return fail(ErrorCode::FrameCrcMismatch);
+                    }
+                }
+
+                // Headers after the one announcing the switch are compact.
+                if ((header_.get_flags() & Hello::COMPACT_HEADER) != 0) {
+                    compact_ = true;
+                }
+
+                if ((header_.get_flags() & Hello::COMPRESSION) != 0) {
+                    if (const auto result = decompress_frame_(input_buffer.id); !result) {
+                        return fail(result.error());
+                    }
+                }
+
+                // Control messages are consumed here, their buffers go back like those of a dropped packet.
+                // Batched packets hold their own references, the batch lets go of the frame's.
+                Result<bool> accepted{false};
+                if ((header_.get_flags() & FrameHeader::control_flag) != 0) {
+                    if (const auto result = handle_control_(frame_); !result) {
+                        return fail(result.error());
+                    }
+                } else if ((header_.get_flags() & Hello::BATCHED_FRAMES) != 0) {
+                    if (const auto result = split_batch_(frame_); !result) {
+                        return fail(result.error());
+                    }
+                } else {
+                    if ((header_.get_flags() & Hello::INNER_HEADERS) != 0) {
+                        if (const auto result = restore_headers_(frame_); !result) {
+                            return fail(result.error());
+                        }
+                    }
+                    if (!discarding_) {
+                        accepted = accept_source_(frame_);
+                    }
+                }
+                if (!accepted) {
+                    return fail(accepted.error());
                 }
 
-                try {
-                    output_frame_queue_.push(frame_);
-                } catch (const std::bad_alloc&) {
-                    return fail(ErrorCode::NotEnoughMemory);
+                if (*accepted) {
+                    if (const auto result = queue_frame_(std::move(frame_)); !result) {
+                        return fail(result.error());
+                    }
+                } else if (const auto drop_result = drop_frame_(frame_, input_buffer.id); !drop_result) {
+                    return fail(drop_result.error());
                 }
 
                 frame_ = OutputFrame{};
+                discarding_ = false;
                 state_ = ParseState::PARSING_HEADER;
             }
         } else {
@@ -339,12 +1435,20 @@ zportal::Result<void> zportal::Receiver::kick_parse_() noexcept {
         }
 
         if (input_buffer.offset == input_buffer.size) {
-            if (buffer_refcounts_[input_buffer.bid] == 0) {
-                if (const auto result = bg_->return_buffer(input_buffer.bid); !result) {
+            // Frames never span datagrams, one ending inside a frame was cut or forged.
+            if (datagram_ && (state_ != ParseState::PARSING_HEADER || header_progress_ != 0)) {
+                return fail(ErrorCode::InvalidSize);
+            }
+
+            const auto refcount = refcount_(input_buffer.id);
+            if (!refcount) {
+                return fail(refcount.error());
+            }
+
+            if (**refcount == 0) {
+                if (const auto result = return_buffer_(input_buffer.id); !result) {
                     return fail(result.error());
                 }
-
-                used_buffers_--;
             }
 
             input_buffer_queue_.pop();
@@ -374,8 +1478,7 @@ zportal::Result<void> zportal::Receiver::kick_write_() noexcept {
         return fail(sqe.error());
     }
 
-    Operation operation;
-    operation.set_type(OperationType::WRITE);
+    const auto operation = Operation::make(OperationType::WRITE, session_index_);
 
     ::io_uring_prep_writev(*sqe, tun_->get_fd(), frame.segments.data(),
                            static_cast<unsigned int>(frame.segments.size()), 0);
@@ -389,3 +1492,49 @@ zportal::Result<void> zportal::Receiver::kick_write_() noexcept {
 
     return {};
 }
+
+zportal::Result<void> zportal::Receiver::handle_recv_timeout_cqe_(const Cqe& cqe) noexcept {
+    if (cqe.operation().get_type() != OperationType::RECV_TIMEOUT) {
+        return fail(ErrorCode::WrongOperationType);
+    }
+
+    if (stopping_ || cqe.operation().get_slot() != timer_generation_) {
+        return {};
+    }
+
+    if (!cqe.ok() && cqe.error() != ETIME) {
+        return fail({ErrorCode::RecvFailed, cqe.error()});
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+
+    // While cooling down no RECV is armed, so the silence is ours and not the peer's.
+    if (cooling_down_) {
+        last_recv_ = now;
+    }
+
+    const auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_recv_);
+    if (idle >= recv_timeout_) {
+        return fail({ErrorCode::RecvTimeout, ETIMEDOUT});
+    }
+
+    return arm_recv_timer_(recv_timeout_ - idle);
+}
+
+zportal::Result<void> zportal::Receiver::arm_recv_timer_(std::chrono::milliseconds timeout) noexcept {
+    auto sqe = ring_->get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    __kernel_timespec ts{.tv_sec = timeout.count() / 1000, .tv_nsec = (timeout.count() % 1000) * 1000000};
+    ::io_uring_prep_timeout(*sqe, &ts, 0, 0);
+    const auto operation = Operation::make(OperationType::RECV_TIMEOUT, session_index_, timer_generation_);
+    ::io_uring_sqe_set_data64(*sqe, operation.serialize());
+
+    if (const auto submit_result = ring_->submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    return {};
+}
@@ -0,0 +1,491 @@
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <new>
+#include <span>
+#include <utility>
+
+#include <cerrno>
+#include <cstdint>
+
+#include <liburing.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <zportal/iouring/buffer_pool.hpp>
+#include <zportal/net/address.hpp>
+#include <zportal/net/socket.hpp>
+#include <zportal/session/control.hpp>
+#include <zportal/session/operation.hpp>
+#include <zportal/session/receiver.hpp>
+#include <zportal/session/server.hpp>
+#include <zportal/session/transmitter.hpp>
+#include <zportal/tools/config.hpp>
+#include <zportal/tools/error.hpp>
+#include <zportal/tools/monitor.hpp>
+#include <zportal/tools/support_check.hpp>
+
+namespace {
+
+// Host number index + 1 of the server's network, one further from the server's own address on. Config
+// checked that the network has room for every peer slot.
+zportal::InnerAddress peer_address(const zportal::Cidr& server, std::uint16_t index) noexcept {
+    std::array<std::byte, 16> own{};
+    std::size_t length = 4;
+    if (server.is_ip4()) {
+        const auto* in = reinterpret_cast<const sockaddr_in*>(server.get_address().get());
+        std::memcpy(own.data(), &in->sin_addr, length);
+    } else {
+        const auto* in6 = reinterpret_cast<const sockaddr_in6*>(server.get_address().get());
+        length = 16;
+        std::memcpy(own.data(), &in6->sin6_addr, length);
+    }
+
+    std::array<std::byte, 16> network = own;
+    for (std::size_t bit = server.get_prefix(); bit < length * 8; bit++) {
+        network[bit / 8] &= ~std::byte{static_cast<std::uint8_t>(0x80 >> (bit % 8))};
+    }
+
+    const auto add = [length](std::array<std::byte, 16>& address, std::uint32_t value) {
+        for (std::size_t i = length; i > 0 && value > 0; i--) {
+            value += std::to_integer<std::uint32_t>(address[i - 1]);
+            address[i - 1] = static_cast<std::byte>(value & 0xFF);
+            value >>= 8;
+        }
+    };
+
+    std::array<std::byte, 16> peer = network;
+    add(peer, static_cast<std::uint32_t>(index) + 1);
+    if (std::memcmp(peer.data(), own.data(), length) >= 0) {
+        add(peer, 1);
+    }
+
+    return zportal::InnerAddress{std::span<const std::byte>(peer).first(length), server.get_prefix()};
+}
+
+} // namespace
+
+zportal::Result<zportal::Server> zportal::Server::create_server(IoUring&& ring, TunDevice&& tun, Socket&& listener,
+                                                                std::span<const BufferClass> tx_classes,
+                                                                std::span<const BufferClass> rx_classes,
+                                                                const Config& cfg, std::uint16_t max_peers) noexcept {
+    if (!listener || max_peers == 0) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    Server server;
+    server.ring_ = std::move(ring);
+    server.tun_ = std::move(tun);
+    server.listener_ = std::move(listener);
+    server.cfg_ = &cfg;
+
+    auto pool = BufferPool::create_buffer_pool(server.ring_, rx_classes);
+    if (!pool) {
+        return fail(pool.error());
+    }
+    server.rx_pool_ = std::move(*pool);
+
+    auto transmitter = Transmitter::create_transmitter(server.ring_, server.tun_, tx_classes, max_peers);
+    if (!transmitter) {
+        return fail(transmitter.error());
+    }
+    server.transmitter_ = std::move(*transmitter);
+    server.transmitter_.set_send_timeout(cfg.send_timeout);
+    server.transmitter_.set_keepalive(cfg.keepalive_interval);
+    server.transmitter_.set_hello(Hello::offer(server.tun_.get_mtu(), cfg.integrity, cfg.transport));
+
+    try {
+        server.peers_.resize(max_peers);
+        server.free_peers_.reserve(max_peers);
+        server.waiting_peers_.reserve(max_peers);
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    // Lowest indexes are handed out first.
+    for (std::uint16_t i = max_peers; i > 0; i--) {
+        server.free_peers_.push_back(static_cast<std::uint16_t>(i - 1));
+    }
+
+    server.rebind_();
+
+    return server;
+}
+
+zportal::Server::Server(Server&& other) noexcept
+    : ring_(std::move(other.ring_)), tun_(std::move(other.tun_)), listener_(std::move(other.listener_)),
+      cfg_(std::exchange(other.cfg_, nullptr)), routes_(std::move(other.routes_)), rx_pool_(std::move(other.rx_pool_)),
+      transmitter_(std::move(other.transmitter_)), peers_(std::move(other.peers_)),
+      free_peers_(std::move(other.free_peers_)), waiting_peers_(std::move(other.waiting_peers_)) {
+    rebind_();
+}
+
+zportal::Server& zportal::Server::operator=(Server&& other) noexcept {
+    if (&other == this) {
+        return *this;
+    }
+
+    ring_ = std::move(other.ring_);
+    tun_ = std::move(other.tun_);
+    listener_ = std::move(other.listener_);
+    cfg_ = std::exchange(other.cfg_, nullptr);
+    routes_ = std::move(other.routes_);
+    rx_pool_ = std::move(other.rx_pool_);
+    transmitter_ = std::move(other.transmitter_);
+    peers_ = std::move(other.peers_);
+    free_peers_ = std::move(other.free_peers_);
+    waiting_peers_ = std::move(other.waiting_peers_);
+
+    rebind_();
+
+    return *this;
+}
+
+zportal::Result<void> zportal::Server::run() noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidServer);
+    }
+
+    if (const auto arm_accept_result = arm_accept_(); !arm_accept_result) {
+        return fail(arm_accept_result.error());
+    }
+
+    if (const auto arm_read_result = transmitter_.arm_read(); !arm_read_result) {
+        return fail(arm_read_result.error());
+    }
+
+    if (const auto keepalive_result = transmitter_.arm_keepalive(); !keepalive_result) {
+        return fail(keepalive_result.error());
+    }
+
+    if (cfg_->monitor_mode) {
+        Monitor::set_tun_device(tun_);
+        if (const auto first_print_result = Monitor::print(); !first_print_result) {
+            return fail(first_print_result.error());
+        }
+
+        if (const auto arm_timeout_result = Monitor::arm_timeout(ring_, std::chrono::milliseconds(1000));
+            !arm_timeout_result) {
+            return fail(arm_timeout_result.error());
+        }
+    }
+
+    for (;;) {
+        const auto cqe = ring_.wait();
+        if (!cqe) {
+            return fail(cqe.error());
+        }
+
+        const auto type = cqe->operation().get_type();
+        if (type == OperationType::NONE) {
+            continue;
+        }
+        if (type == OperationType::ACCEPT) {
+            if (const auto handle_cqe_result = handle_accept_cqe_(*cqe); !handle_cqe_result) {
+                return fail(handle_cqe_result.error());
+            }
+        } else if (type == OperationType::READ || type == OperationType::KEEPALIVE) {
+            if (const auto handle_cqe_result = transmitter_.handle_cqe(*cqe); !handle_cqe_result) {
+                return fail(handle_cqe_result.error());
+            }
+        } else if (type == OperationType::SEND || type == OperationType::SEND_TIMEOUT ||
+                   type == OperationType::RECV || type == OperationType::RECV_TIMEOUT ||
+                   type == OperationType::WRITE) {
+            if (const auto handle_cqe_result = handle_peer_cqe_(*cqe); !handle_cqe_result) {
+                return fail(handle_cqe_result.error());
+            }
+        } else if (type == OperationType::TIMEOUT && cfg_->monitor_mode) {
+            if (const auto handle_cqe_result = Monitor::handle_cqe(ring_, *cqe); !handle_cqe_result) {
+                return fail(handle_cqe_result.error());
+            }
+        } else {
+            return fail(ErrorCode::InvalidEnumValue);
+        }
+
+        if (const auto resume_result = resume_receivers_(); !resume_result) {
+            return fail(resume_result.error());
+        }
+    }
+
+    return {};
+}
+
+std::size_t zportal::Server::get_peer_count() const noexcept {
+    return peers_.size() - free_peers_.size();
+}
+
+bool zportal::Server::is_valid() const noexcept {
+    return ring_.is_valid() && listener_.is_valid() && cfg_ != nullptr && rx_pool_.is_valid() &&
+           transmitter_.is_valid() && !peers_.empty();
+}
+
+zportal::Server::operator bool() const noexcept {
+    return is_valid();
+}
+
+void zportal::Server::rebind_() noexcept {
+    transmitter_.ring_ = &ring_;
+    transmitter_.tun_ = &tun_;
+    transmitter_.set_routes(&routes_);
+
+    for (auto& peer : peers_) {
+        if (peer.state == PeerState::FREE) {
+            continue;
+        }
+
+        peer.receiver.ring_ = &ring_;
+        peer.receiver.tun_ = &tun_;
+        peer.receiver.set_source_routes(&routes_);
+    }
+}
+
+zportal::Result<void> zportal::Server::arm_accept_() noexcept {
+    auto sqe = ring_.get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    const auto multishot = support_check::accept_multishot();
+    if (!multishot) {
+        return fail(multishot.error());
+    }
+
+#if HAVE_IO_URING_PREP_MULTISHOT_ACCEPT
+    if (*multishot) {
+        ::io_uring_prep_multishot_accept(*sqe, listener_.get(), nullptr, nullptr, SOCK_CLOEXEC);
+    } else {
+        ::io_uring_prep_accept(*sqe, listener_.get(), nullptr, nullptr, SOCK_CLOEXEC);
+    }
+#else
+    ::io_uring_prep_accept(*sqe, listener_.get(), nullptr, nullptr, SOCK_CLOEXEC);
+#endif
+    ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::ACCEPT).serialize());
+
+    if (const auto submit_result = ring_.submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Server::handle_accept_cqe_(const Cqe& cqe) noexcept {
+    if (!cqe.ok()) {
+        // The listener itself is broken, anything else only lost this one connection.
+        if (cqe.error() == EBADF || cqe.error() == EINVAL || cqe.error() == ENOTSOCK) {
+            return fail({ErrorCode::AcceptFailed, cqe.error()});
+        }
+
+        std::cerr << Error(ErrorCode::AcceptFailed, cqe.error()).to_string() << '\n';
+        if (cqe.more()) {
+            return {};
+        }
+
+        return arm_accept_();
+    }
+
+    Socket socket(cqe.result());
+
+    if (free_peers_.empty()) {
+        std::cerr << "Rejected connection, all " << peers_.size() << " peer slots are taken" << '\n';
+    } else if (const auto open_result = open_peer_(std::move(socket)); !open_result) {
+        return fail(open_result.error());
+    }
+
+    // A multishot ACCEPT stays armed until it completes without IORING_CQE_F_MORE.
+    if (cqe.more()) {
+        return {};
+    }
+
+    return arm_accept_();
+}
+
+zportal::Result<void> zportal::Server::handle_peer_cqe_(const Cqe& cqe) noexcept {
+    const auto operation = cqe.operation();
+    const auto type = operation.get_type();
+    const bool transmitting = type == OperationType::SEND || type == OperationType::SEND_TIMEOUT;
+
+    // SENDs carry their lane in the slot, receiver operations their session.
+    const std::uint16_t index = transmitting ? operation.get_slot() : operation.get_session();
+    if (index >= peers_.size()) {
+        return fail(ErrorCode::ForeignSession);
+    }
+
+    // A linked timeout may complete after its SEND and a deadline after its receiver, when the peer slot
+    // is already freed.
+    if (peers_[index].state == PeerState::FREE) {
+        if (type == OperationType::SEND_TIMEOUT || type == OperationType::RECV_TIMEOUT) {
+            return {};
+        }
+
+        return fail(ErrorCode::ForeignSession);
+    }
+
+    auto& peer = peers_[index];
+    auto result = transmitting ? transmitter_.handle_cqe(cqe) : peer.receiver.handle_cqe(cqe);
+    if (result && !transmitting) {
+        if (const auto hello = peer.receiver.take_hello()) {
+            result = transmitter_.set_lane_features(index, *hello);
+        }
+        if (const auto ping = peer.receiver.take_ping(); result && ping) {
+            result = transmitter_.send_pong(index, *ping);
+        }
+    }
+    if (!result) {
+        if (const auto close_result = close_peer_(index, result.error()); !close_result) {
+            return fail(close_result.error());
+        }
+    }
+
+    if (peer.state == PeerState::CLOSING) {
+        return reap_peer_(index);
+    }
+
+    if (peer.receiver.is_cooling_down() && !peer.waiting_for_buffers) {
+        try {
+            waiting_peers_.push_back(index);
+        } catch (const std::bad_alloc&) {
+            return fail(ErrorCode::NotEnoughMemory);
+        }
+        peer.waiting_for_buffers = true;
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Server::open_peer_(Socket&& socket) noexcept {
+    const std::uint16_t index = free_peers_.back();
+    auto& peer = peers_[index];
+
+    // A connection that can't be set up is dropped, the server keeps serving the others.
+    if (cfg_->busy_poll.count() > 0) {
+        if (const auto result = socket.set_busy_poll(cfg_->busy_poll, cfg_->prefer_busy_poll); !result) {
+            std::cerr << "Rejected connection: " << result.error().to_string() << '\n';
+            return {};
+        }
+    }
+
+    peer.socket = std::move(socket);
+
+    auto receiver = Receiver::create_receiver(ring_, tun_, peer.socket, rx_pool_);
+    if (!receiver) {
+        peer.socket.close();
+        std::cerr << "Rejected connection: " << receiver.error().to_string() << '\n';
+        return {};
+    }
+    peer.receiver = std::move(*receiver);
+    peer.receiver.session_index_ = index;
+    peer.receiver.timer_generation_ = ++peer.timer_generation;
+    peer.receiver.set_source_routes(&routes_);
+    peer.receiver.set_hello(Hello::offer(tun_.get_mtu(), cfg_->integrity, cfg_->transport));
+
+    free_peers_.pop_back();
+    peer.state = PeerState::ACTIVE;
+
+    std::cout << "Accepted connection";
+    if (const auto remote_address = peer.socket.get_remote_address(); remote_address && *remote_address) {
+        try {
+            std::cout << " from " << remote_address->str();
+        } catch (const std::exception& e) {
+            std::cout << " from <unprintable: " << e.what() << '>';
+        }
+    }
+    std::cout << " as peer " << index << '\n';
+
+    // From here on the slot is torn down like any failing peer, a SEND may already be in flight.
+    auto result = transmitter_.open_lane(index, peer.socket);
+
+    // The peer sends from and is reached at this address only, whatever else it tries.
+    const auto address = peer_address(cfg_->inner_address, index);
+    const auto host_prefix = static_cast<std::uint8_t>(address.get_address().size() * 8);
+    if (result) {
+        result = routes_.insert(address.get_address(), host_prefix, index);
+    }
+    if (result) {
+        result = transmitter_.send_address(index, address);
+    }
+    if (result) {
+        result = peer.receiver.arm_recv();
+    }
+    if (result) {
+        result = peer.receiver.arm_recv_deadline(cfg_->recv_timeout);
+    }
+    if (!result) {
+        return close_peer_(index, result.error());
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Server::close_peer_(std::uint16_t index, const Error& reason) noexcept {
+    auto& peer = peers_[index];
+    if (peer.state != PeerState::ACTIVE) {
+        return {};
+    }
+
+    std::cerr << "Closing peer " << index << ": " << reason.to_string() << '\n';
+
+    peer.state = PeerState::CLOSING;
+    routes_.erase_value(index);
+
+    // Ends the peer's RECV and SEND in flight, their final CQEs let reap_peer_() free the slot.
+    ::shutdown(peer.socket.get(), SHUT_RDWR);
+
+    peer.receiver.stop();
+    if (const auto result = transmitter_.close_lane(index); !result) {
+        return fail(result.error());
+    }
+
+    return reap_peer_(index);
+}
+
+zportal::Result<void> zportal::Server::reap_peer_(std::uint16_t index) noexcept {
+    auto& peer = peers_[index];
+    if (peer.state != PeerState::CLOSING || !peer.receiver.is_idle() || !transmitter_.is_lane_idle(index)) {
+        return {};
+    }
+
+    if (const auto result = peer.receiver.release_buffers(); !result) {
+        return fail(result.error());
+    }
+
+    peer.receiver = Receiver{};
+    peer.socket.close();
+    peer.state = PeerState::FREE;
+
+    try {
+        free_peers_.push_back(index);
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Server::resume_receivers_() noexcept {
+    if (waiting_peers_.empty() || rx_pool_.get_used_count() >= rx_pool_.get_buffer_count() / 2) {
+        return {};
+    }
+
+    for (std::size_t i = waiting_peers_.size(); i > 0; i--) {
+        const std::uint16_t index = waiting_peers_[i - 1];
+        auto& peer = peers_[index];
+
+        if (peer.state == PeerState::ACTIVE) {
+            if (const auto result = peer.receiver.resume(); !result) {
+                if (const auto close_result = close_peer_(index, result.error()); !close_result) {
+                    return fail(close_result.error());
+                }
+            }
+        }
+
+        if (peer.state != PeerState::ACTIVE || !peer.receiver.is_cooling_down()) {
+            peer.waiting_for_buffers = false;
+            waiting_peers_[i - 1] = waiting_peers_.back();
+            waiting_peers_.pop_back();
+        }
+    }
+
+    return {};
+}
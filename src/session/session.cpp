@@ -1,52 +1,236 @@
+#include <algorithm>
 #include <chrono>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <optional>
+#include <span>
 #include <utility>
+#include <vector>
 
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <liburing.h>
+#include <sys/socket.h>
+
+#include <zportal/net/address.hpp>
+#include <zportal/net/shm_ring.hpp>
 #include <zportal/net/socket.hpp>
+#include <zportal/session/connector.hpp>
+#include <zportal/session/control.hpp>
+#include <zportal/session/frame_header.hpp>
 #include <zportal/session/operation.hpp>
 #include <zportal/session/receiver.hpp>
 #include <zportal/session/session.hpp>
 #include <zportal/session/transmitter.hpp>
 #include <zportal/tools/config.hpp>
+#include <zportal/tools/crc.hpp>
 #include <zportal/tools/error.hpp>
 #include <zportal/tools/monitor.hpp>
+#include <zportal/tools/support_check.hpp>
+
+namespace {
+
+constexpr std::chrono::milliseconds reconnect_initial_backoff{50};
+
+// Failures of the connection itself or of the byte stream on it, a new connection recovers from them.
+bool is_connection_error(const zportal::Error& error) noexcept {
+    return error.domain() == zportal::ErrorDomain::Socket || error.domain() == zportal::ErrorDomain::Protocol ||
+           error.domain() == zportal::ErrorDomain::Socks || error.domain() == zportal::ErrorDomain::Resolve;
+}
+
+} // namespace
 
 zportal::Result<zportal::Session> zportal::Session::create_session(IoUring&& ring, TunDevice&& tun, Socket&& socket,
-                                                                   std::uint16_t tx_queue_length,
-                                                                   std::uint16_t rx_queue_length,
-                                                                   std::uint32_t rx_buffer_size,
-                                                                   const Config& cfg) noexcept {
+                                                                   std::span<const BufferClass> tx_classes,
+                                                                   std::span<const BufferClass> rx_classes,
+                                                                   const Config& cfg, std::uint16_t index) noexcept {
+    std::vector<Socket> sockets;
+    try {
+        sockets.push_back(std::move(socket));
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    return create_session(std::move(ring), std::move(tun), std::move(sockets), tx_classes, rx_classes, cfg, index);
+}
+
+zportal::Result<zportal::Session> zportal::Session::create_session(IoUring&& ring, TunDevice&& tun,
+                                                                   std::vector<Socket>&& sockets,
+                                                                   std::span<const BufferClass> tx_classes,
+                                                                   std::span<const BufferClass> rx_classes,
+                                                                   const Config& cfg, std::uint16_t index) noexcept {
+    if (sockets.empty() || sockets.size() > std::size_t{std::numeric_limits<std::uint16_t>::max()} - index) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
     Session session;
     session.ring_ = std::move(ring);
     session.tun_ = std::move(tun);
-    session.socket_ = std::move(socket);
+    session.sockets_ = std::move(sockets);
     session.cfg_ = &cfg;
+    session.index_ = index;
+
+    const auto hello = Hello::offer(session.tun_.get_mtu(), cfg.integrity, cfg.transport);
+
+    try {
+        session.receivers_.reserve(session.sockets_.size());
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    for (std::size_t i = 0; i < session.sockets_.size(); i++) {
+        auto receiver = Receiver::create_receiver(session.ring_, session.tun_, session.sockets_[i], rx_classes);
+        if (!receiver) {
+            return fail(receiver.error());
+        }
+        receiver->session_index_ = static_cast<std::uint16_t>(index + i);
+        receiver->set_hello(hello);
+        session.receivers_.push_back(std::move(*receiver));
+    }
+
+    const auto lanes = static_cast<std::uint16_t>(session.sockets_.size());
+    auto transmitter = Transmitter::create_transmitter(session.ring_, session.tun_, tx_classes, lanes);
+    if (!transmitter) {
+        return fail(transmitter.error());
+    }
+    session.transmitter_ = std::move(*transmitter);
+    session.transmitter_.session_index_ = index;
+    session.transmitter_.set_send_timeout(cfg.send_timeout);
+    session.transmitter_.set_keepalive(cfg.keepalive_interval);
+    session.transmitter_.set_hello(hello);
 
-    auto receiver =
-        Receiver::create_receiver(session.ring_, session.tun_, session.socket_, rx_queue_length, rx_buffer_size);
+    for (std::uint16_t lane = 0; lane < lanes; lane++) {
+        if (!session.sockets_[lane]) {
+            continue;
+        }
+
+        if (const auto result = session.transmitter_.open_lane(lane, session.sockets_[lane]); !result) {
+            return fail(result.error());
+        }
+    }
+
+    return session;
+}
+
+zportal::Result<zportal::Session> zportal::Session::create_session(IoUring&& ring, TunDevice&& tun, Socket&& listener,
+                                                                   std::uint16_t connections,
+                                                                   std::span<const BufferClass> tx_classes,
+                                                                   std::span<const BufferClass> rx_classes,
+                                                                   const Config& cfg, std::uint16_t index) noexcept {
+    if (connections == 0 || (!listener && !cfg.connect_address)) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    std::vector<Socket> sockets;
+    try {
+        sockets.resize(connections);
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    // Lanes of unconnected sockets stay closed, they're suspended below so reads queue up.
+    auto session =
+        create_session(std::move(ring), std::move(tun), std::move(sockets), tx_classes, rx_classes, cfg, index);
+    if (!session) {
+        return fail(session.error());
+    }
+
+    session->state_ = State::CONNECTING;
+    session->listener_ = std::move(listener);
+    if (session->listener_) {
+        try {
+            session->candidates_.resize(connections);
+        } catch (const std::bad_alloc&) {
+            return fail(ErrorCode::NotEnoughMemory);
+        }
+    } else {
+        auto connector = Connector::create_connector(session->ring_, *cfg.connect_address, cfg.proxies,
+                                                     cfg.connect_timeout, index, cfg.transport);
+        if (!connector) {
+            return fail(connector.error());
+        }
+        session->connector_ = std::move(*connector);
+    }
+
+    for (std::uint16_t i = 0; i < connections; i++) {
+        session->receivers_[i].stop();
+        if (const auto result = session->transmitter_.suspend_lane(i); !result) {
+            return fail(result.error());
+        }
+    }
+
+    return session;
+}
+
+zportal::Result<zportal::Session> zportal::Session::create_session(IoUring&& ring, TunDevice&& tun,
+                                                                   ShmChannel&& channel,
+                                                                   std::span<const BufferClass> tx_classes,
+                                                                   std::span<const BufferClass> rx_classes,
+                                                                   const Config& cfg, std::uint16_t index) noexcept {
+    if (!channel.socket || !channel.doorbell || !channel.peer_doorbell) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    Session session;
+    session.ring_ = std::move(ring);
+    session.tun_ = std::move(tun);
+    session.cfg_ = &cfg;
+    session.index_ = index;
+    session.doorbell_ = std::move(channel.doorbell);
+    session.peer_doorbell_ = std::move(channel.peer_doorbell);
+    try {
+        session.sockets_.push_back(std::move(channel.socket));
+        session.receivers_.reserve(1);
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    const auto hello = Hello::offer(session.tun_.get_mtu(), cfg.integrity, cfg.transport);
+
+    auto receiver = Receiver::create_receiver(session.ring_, session.tun_, session.sockets_.front(),
+                                              std::move(channel.rx), session.peer_doorbell_.get(), rx_classes);
     if (!receiver) {
         return fail(receiver.error());
     }
-    session.receiver_ = std::move(*receiver);
+    receiver->session_index_ = index;
+    receiver->set_hello(hello);
+    session.receivers_.push_back(std::move(*receiver));
 
-    auto transmitter = Transmitter::create_transmitter(session.ring_, session.tun_, session.socket_, tx_queue_length);
+    auto transmitter = Transmitter::create_transmitter(session.ring_, session.tun_, tx_classes, 1);
     if (!transmitter) {
         return fail(transmitter.error());
     }
     session.transmitter_ = std::move(*transmitter);
+    session.transmitter_.session_index_ = index;
+    session.transmitter_.set_keepalive(cfg.keepalive_interval);
+    session.transmitter_.set_hello(hello);
+
+    if (const auto result = session.transmitter_.open_lane(0, session.sockets_.front(), std::move(channel.tx),
+                                                           session.peer_doorbell_.get());
+        !result) {
+        return fail(result.error());
+    }
 
     return session;
 }
 
 zportal::Session::Session(Session&& other) noexcept
-    : ring_(std::move(other.ring_)), tun_(std::move(other.tun_)), socket_(std::move(other.socket_)),
-      receiver_(std::move(other.receiver_)), transmitter_(std::move(other.transmitter_)),
-      cfg_(std::exchange(other.cfg_, nullptr)) {
-    receiver_.ring_ = &ring_;
-    receiver_.tun_ = &tun_;
-    receiver_.socket_ = &socket_;
-    transmitter_.ring_ = &ring_;
-    transmitter_.tun_ = &tun_;
-    transmitter_.sock_ = &socket_;
+    : ring_(std::move(other.ring_)), tun_(std::move(other.tun_)), sockets_(std::move(other.sockets_)),
+      cfg_(std::exchange(other.cfg_, nullptr)), index_(std::exchange(other.index_, 0)),
+      receivers_(std::move(other.receivers_)), transmitter_(std::move(other.transmitter_)),
+      state_(std::exchange(other.state_, State::RUNNING)), listener_(std::move(other.listener_)),
+      accept_armed_(std::exchange(other.accept_armed_, false)), candidates_(std::move(other.candidates_)),
+      candidates_generation_(std::exchange(other.candidates_generation_, 0)),
+      connector_(std::move(other.connector_)), backoff_(std::exchange(other.backoff_, {})),
+      stop_(std::exchange(other.stop_, Stop::NONE)), signal_fd_(std::move(other.signal_fd_)),
+      signal_info_(std::exchange(other.signal_info_, {})), doorbell_(std::move(other.doorbell_)),
+      peer_doorbell_(std::move(other.peer_doorbell_)), doorbell_value_(std::exchange(other.doorbell_value_, 0)) {
+    rebind_();
 }
 
 zportal::Session& zportal::Session::operator=(Session&& other) noexcept {
@@ -56,68 +240,802 @@ zportal::Session& zportal::Session::operator=(Session&& other) noexcept {
 
     ring_ = std::move(other.ring_);
     tun_ = std::move(other.tun_);
-    socket_ = std::move(other.socket_);
-    receiver_ = std::move(other.receiver_);
-    transmitter_ = std::move(other.transmitter_);
+    sockets_ = std::move(other.sockets_);
     cfg_ = std::exchange(other.cfg_, nullptr);
+    index_ = std::exchange(other.index_, 0);
+    receivers_ = std::move(other.receivers_);
+    transmitter_ = std::move(other.transmitter_);
+    state_ = std::exchange(other.state_, State::RUNNING);
+    listener_ = std::move(other.listener_);
+    accept_armed_ = std::exchange(other.accept_armed_, false);
+    candidates_ = std::move(other.candidates_);
+    candidates_generation_ = std::exchange(other.candidates_generation_, 0);
+    connector_ = std::move(other.connector_);
+    backoff_ = std::exchange(other.backoff_, {});
+    stop_ = std::exchange(other.stop_, Stop::NONE);
+    signal_fd_ = std::move(other.signal_fd_);
+    signal_info_ = std::exchange(other.signal_info_, {});
+    doorbell_ = std::move(other.doorbell_);
+    peer_doorbell_ = std::move(other.peer_doorbell_);
+    doorbell_value_ = std::exchange(other.doorbell_value_, 0);
+
+    rebind_();
 
-    receiver_.ring_ = &ring_;
-    receiver_.tun_ = &tun_;
-    receiver_.socket_ = &socket_;
+    return *this;
+}
+
+// Moving sockets_ keeps its elements in place, only the ring and the TUN device move.
+void zportal::Session::rebind_() noexcept {
+    for (auto& receiver : receivers_) {
+        receiver.ring_ = &ring_;
+        receiver.tun_ = &tun_;
+    }
     transmitter_.ring_ = &ring_;
     transmitter_.tun_ = &tun_;
-    transmitter_.sock_ = &socket_;
+    if (connector_) {
+        connector_.ring_ = &ring_;
+    }
+}
 
-    return *this;
+void zportal::Session::set_signal_fd(FileDescriptor&& signal_fd) noexcept {
+    signal_fd_ = std::move(signal_fd);
 }
 
 zportal::Result<void> zportal::Session::run() noexcept {
-    if (const auto arm_recv_result = receiver_.arm_recv(); !arm_recv_result) {
-        return fail(arm_recv_result.error());
+    if (state_ == State::RUNNING) {
+        for (std::uint16_t i = 0; i < receivers_.size(); i++) {
+            if (const auto arm_recv_result = receivers_[i].arm_recv(); !arm_recv_result) {
+                return fail(arm_recv_result.error());
+            }
+
+            // Over SHM arming already parsed what the peer wrote before this side ran.
+            if (const auto forward_result = forward_control_(i); !forward_result) {
+                return fail(forward_result.error());
+            }
+        }
     }
 
     if (const auto arm_read_result = transmitter_.arm_read(); !arm_read_result) {
         return fail(arm_read_result.error());
     }
 
-    Monitor::set_tun_device(tun_);
-    if (const auto first_print_result = Monitor::print(); !first_print_result) {
-        return fail(first_print_result.error());
+    if (const auto keepalive_result = transmitter_.arm_keepalive(); !keepalive_result) {
+        return fail(keepalive_result.error());
+    }
+
+    if (state_ == State::RUNNING) {
+        for (auto& receiver : receivers_) {
+            if (const auto deadline_result = receiver.arm_recv_deadline(cfg_->recv_timeout); !deadline_result) {
+                return fail(deadline_result.error());
+            }
+        }
     }
 
     if (cfg_->monitor_mode) {
+        Monitor::set_tun_device(tun_);
+        if (const auto first_print_result = Monitor::print(); !first_print_result) {
+            return fail(first_print_result.error());
+        }
+
         if (const auto arm_timeout_result = Monitor::arm_timeout(ring_, std::chrono::milliseconds(1000));
             !arm_timeout_result) {
             return fail(arm_timeout_result.error());
         }
     }
 
+    if (signal_fd_) {
+        if (const auto arm_signal_result = arm_signal_(); !arm_signal_result) {
+            return fail(arm_signal_result.error());
+        }
+    }
+
+    if (doorbell_) {
+        if (const auto arm_doorbell_result = arm_doorbell_(); !arm_doorbell_result) {
+            return fail(arm_doorbell_result.error());
+        }
+    }
+
+    if (state_ == State::CONNECTING) {
+        if (const auto establish_result = establish_(); !establish_result) {
+            return fail(establish_result.error());
+        }
+    }
+
     for (;;) {
         const auto cqe = ring_.wait();
         if (!cqe) {
             return fail(cqe.error());
         }
 
-        const auto type = cqe->operation().get_type();
-        if (type == OperationType::NONE) {
+        if (const auto handle_cqe_result = handle_cqe_(*cqe); !handle_cqe_result) {
+            // While stopping, the peer closing or breaking the connection only ends the drain early.
+            if (stop_ != Stop::NONE && is_connection_error(handle_cqe_result.error())) {
+                stop_ = Stop::CLOSED;
+            } else if (const auto disconnect_result = disconnect_(handle_cqe_result.error()); !disconnect_result) {
+                return fail(disconnect_result.error());
+            }
+        }
+
+        if (stop_ != Stop::NONE) {
+            if (advance_stop_()) {
+                return {};
+            }
+            continue;
+        }
+
+        if (state_ != State::DRAINING || !is_drained_()) {
             continue;
         }
-        if (type == OperationType::READ || type == OperationType::SEND) {
-            if (const auto handle_cqe_result = transmitter_.handle_cqe(*cqe); !handle_cqe_result) {
-                return fail(handle_cqe_result.error());
+
+        for (auto& receiver : receivers_) {
+            if (const auto result = receiver.release_buffers(); !result) {
+                return fail(result.error());
             }
-        } else if (type == OperationType::RECV || type == OperationType::WRITE) {
-            if (const auto handle_cqe_result = receiver_.handle_cqe(*cqe); !handle_cqe_result) {
-                return fail(handle_cqe_result.error());
+        }
+
+        state_ = State::CONNECTING;
+        if (const auto establish_result = establish_(); !establish_result) {
+            return fail(establish_result.error());
+        }
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Session::handle_cqe_(const Cqe& cqe) noexcept {
+    const auto operation = cqe.operation();
+    const auto type = operation.get_type();
+    if (type == OperationType::NONE) {
+        return {};
+    }
+
+    // Receivers submit as index_ + their stripe, everything else as index_.
+    const auto stripe = static_cast<std::uint16_t>(operation.get_session() - index_);
+    if (type != OperationType::TIMEOUT && stripe >= receivers_.size()) {
+        return fail(ErrorCode::ForeignSession);
+    }
+
+    switch (type) {
+    case OperationType::READ:
+    case OperationType::SEND:
+    case OperationType::SEND_TIMEOUT:
+    case OperationType::KEEPALIVE:
+        return transmitter_.handle_cqe(cqe);
+
+    case OperationType::RECV:
+    case OperationType::WRITE:
+    case OperationType::RECV_TIMEOUT:
+        if (const auto result = receivers_[stripe].handle_cqe(cqe); !result) {
+            return fail(result.error());
+        }
+        return forward_control_(stripe);
+
+    case OperationType::ACCEPT:
+        return handle_accept_cqe_(cqe);
+
+    case OperationType::CANDIDATE_READ:
+        return handle_candidate_cqe_(cqe);
+
+    case OperationType::CANDIDATE_TIMEOUT:
+        return handle_candidates_timeout_cqe_(cqe);
+
+    case OperationType::CONNECT:
+    case OperationType::CONNECT_TIMEOUT:
+    case OperationType::CONNECT_DELAY:
+    case OperationType::SOCKS_SEND:
+    case OperationType::SOCKS_RECV:
+        return handle_connect_cqe_(cqe);
+
+    case OperationType::BACKOFF:
+        return establish_();
+
+    case OperationType::SIGNAL:
+        return handle_signal_cqe_(cqe);
+
+    case OperationType::DRAIN_TIMEOUT:
+        return handle_drain_timeout_cqe_(cqe);
+
+    case OperationType::DOORBELL:
+        return handle_doorbell_cqe_(cqe);
+
+    case OperationType::TIMEOUT:
+        if (cfg_->monitor_mode) {
+            return Monitor::handle_cqe(ring_, cqe);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return fail(ErrorCode::InvalidEnumValue);
+}
+
+zportal::Result<void> zportal::Session::handle_accept_cqe_(const Cqe& cqe) noexcept {
+    const bool reconnecting = cfg_->reconnect_backoff.count() > 0;
+    if (!cqe.more()) {
+        accept_armed_ = false;
+    }
+
+    if (!cqe.ok()) {
+        // The listener itself is broken, anything else only lost this one connection.
+        if (cqe.error() == EBADF || cqe.error() == EINVAL || cqe.error() == ENOTSOCK) {
+            return fail({ErrorCode::AcceptFailed, cqe.error()});
+        }
+
+        std::cerr << Error(ErrorCode::AcceptFailed, cqe.error()).to_string() << '\n';
+    } else {
+        Socket socket(cqe.result());
+
+        const auto taken = [](const Candidate& candidate) { return static_cast<bool>(candidate.socket); };
+        const auto free = std::ranges::find_if_not(candidates_, taken);
+        if (free == candidates_.end() || (state_ == State::RUNNING && !reconnecting)) {
+            std::cerr << "Rejected connection, the session already has its peer" << '\n';
+        } else {
+            // The first connection of a set starts the clock for the whole set.
+            if (std::ranges::none_of(candidates_, taken)) {
+                if (const auto result = arm_candidates_timeout_(); !result) {
+                    return fail(result.error());
+                }
             }
-        } else if (type == OperationType::TIMEOUT && cfg_->monitor_mode) {
-            if (const auto handle_cqe_result = Monitor::handle_cqe(ring_, *cqe); !handle_cqe_result) {
-                return fail(handle_cqe_result.error());
+
+            free->socket = std::move(socket);
+            if (const auto result = arm_candidate_read_(static_cast<std::uint16_t>(free - candidates_.begin()));
+                !result) {
+                return fail(result.error());
+            }
+        }
+    }
+
+    if (!accept_armed_ && (state_ != State::RUNNING || reconnecting)) {
+        if (const auto result = arm_accept_(); !result) {
+            return fail(result.error());
+        }
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Session::arm_candidate_read_(std::uint16_t slot) noexcept {
+    auto& candidate = candidates_[slot];
+
+    // The header first, then the hello it announces.
+    std::size_t wanted = FrameHeader::wire_size;
+    if (candidate.received >= FrameHeader::wire_size) {
+        FrameHeader header;
+        std::memcpy(header.data().data(), candidate.frame.data(), FrameHeader::wire_size);
+        wanted += header.get_size();
+    }
+
+    auto sqe = ring_.get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    ::io_uring_prep_recv(*sqe, candidate.socket.get(), candidate.frame.data() + candidate.received,
+                         wanted - candidate.received, MSG_WAITALL);
+    ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::CANDIDATE_READ, index_, slot).serialize());
+
+    if (const auto submit_result = ring_.submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    candidate.reading = true;
+
+    return {};
+}
+
+// Nothing a candidate sends may fail the session, it's closed and its slot freed instead.
+zportal::Result<void> zportal::Session::handle_candidate_cqe_(const Cqe& cqe) noexcept {
+    const auto slot = cqe.operation().get_slot();
+    if (slot >= candidates_.size()) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    auto& candidate = candidates_[slot];
+    candidate.reading = false;
+
+    if (candidate.dropped || !cqe.ok() || cqe.result() == 0) {
+        candidate = Candidate{};
+        return {};
+    }
+
+    candidate.received += static_cast<std::size_t>(cqe.result());
+    if (candidate.received < FrameHeader::wire_size) {
+        return arm_candidate_read_(slot);
+    }
+
+    FrameHeader header;
+    std::memcpy(header.data().data(), candidate.frame.data(), FrameHeader::wire_size);
+    const std::size_t size = header.get_size();
+    if (!header.is_magic_valid() || header.get_flags() != FrameHeader::control_flag || size < Hello::wire_size ||
+        size > max_hello_size) {
+        std::cerr << "Rejected connection, its first frame isn't a hello" << '\n';
+        candidate = Candidate{};
+        return {};
+    }
+
+    if (candidate.received < FrameHeader::wire_size + size) {
+        return arm_candidate_read_(slot);
+    }
+
+    const std::span<const std::byte> payload{candidate.frame.data() + FrameHeader::wire_size, size};
+    const auto hello = Hello::parse(payload);
+    if (crc32c(payload) != header.get_crc() || !hello) {
+        std::cerr << "Rejected connection, its first frame isn't a hello" << '\n';
+        candidate = Candidate{};
+        return {};
+    }
+    candidate.hello = *hello;
+
+    if (!is_candidate_set_complete_()) {
+        return {};
+    }
+
+    // The set is taken, its timeout goes stale.
+    candidates_generation_++;
+
+    // A peer connecting again gave up on its old connections, so these are drained first.
+    if (state_ == State::RUNNING) {
+        return disconnect_(Error(ErrorCode::PeerClosed));
+    }
+
+    if (state_ == State::CONNECTING) {
+        return attach_candidates_();
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Session::arm_candidates_timeout_() noexcept {
+    auto sqe = ring_.get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    const auto timeout = cfg_->connect_timeout.count();
+    __kernel_timespec ts{.tv_sec = timeout / 1000, .tv_nsec = (timeout % 1000) * 1000000};
+    ::io_uring_prep_timeout(*sqe, &ts, 0, 0);
+    const auto operation = Operation::make(OperationType::CANDIDATE_TIMEOUT, index_, candidates_generation_);
+    ::io_uring_sqe_set_data64(*sqe, operation.serialize());
+
+    if (const auto submit_result = ring_.submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Session::handle_candidates_timeout_cqe_(const Cqe& cqe) noexcept {
+    if (cqe.operation().get_slot() != candidates_generation_ || is_candidate_set_complete_()) {
+        return {};
+    }
+
+    candidates_generation_++;
+
+    bool dropped = false;
+    for (auto& candidate : candidates_) {
+        if (candidate.socket && !candidate.dropped) {
+            drop_candidate_(candidate);
+            dropped = true;
+        }
+    }
+
+    if (dropped) {
+        std::cerr << "Dropped connections that didn't complete a session within the connect timeout" << '\n';
+    }
+
+    return {};
+}
+
+void zportal::Session::drop_candidate_(Candidate& candidate) noexcept {
+    if (!candidate.reading) {
+        candidate = Candidate{};
+        return;
+    }
+
+    // The slot stays taken until the read completes, a new connection can't be mistaken for this one.
+    candidate.dropped = true;
+    ::shutdown(candidate.socket.get(), SHUT_RDWR);
+}
+
+bool zportal::Session::is_candidate_set_complete_() const noexcept {
+    return !candidates_.empty() &&
+           std::ranges::all_of(candidates_, [](const Candidate& candidate) { return candidate.hello.has_value(); });
+}
+
+zportal::Result<void> zportal::Session::attach_candidates_() noexcept {
+    std::vector<Socket> sockets;
+    std::vector<Hello> hellos;
+    try {
+        sockets.reserve(candidates_.size());
+        hellos.reserve(candidates_.size());
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    for (auto& candidate : candidates_) {
+        sockets.push_back(std::move(candidate.socket));
+        hellos.push_back(*candidate.hello);
+        candidate = Candidate{};
+    }
+
+    if (const auto result = attach_(std::move(sockets)); !result) {
+        return fail(result.error());
+    }
+
+    // The hellos were the first frames on their connections, the restarted receivers take them from here.
+    for (std::uint16_t i = 0; i < hellos.size(); i++) {
+        if (const auto result = receivers_[i].accept_hello_(hellos[i]); !result) {
+            return fail(result.error());
+        }
+        if (const auto result = forward_control_(i); !result) {
+            return fail(result.error());
+        }
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Session::handle_connect_cqe_(const Cqe& cqe) noexcept {
+    if (const auto result = connector_.handle_cqe(cqe); !result) {
+        return fail(result.error());
+    }
+
+    if (!connector_.is_finished()) {
+        return {};
+    }
+
+    auto sockets = connector_.take();
+    if (sockets) {
+        return attach_(std::move(*sockets));
+    }
+
+    if (cfg_->reconnect_backoff.count() <= 0) {
+        return fail(sockets.error());
+    }
+
+    try {
+        std::cerr << "Connecting failed: " << sockets.error().to_string() << '\n';
+    } catch (const std::exception&) {
+    }
+
+    return arm_backoff_();
+}
+
+zportal::Result<void> zportal::Session::forward_control_(std::uint16_t stripe) noexcept {
+    if (const auto hello = receivers_[stripe].take_hello()) {
+        if (const auto result = transmitter_.set_lane_features(stripe, *hello); !result) {
+            return fail(result.error());
+        }
+    }
+    if (const auto address = receivers_[stripe].take_address()) {
+        const auto cidr = address->get_cidr();
+        if (!cidr) {
+            return fail(cidr.error());
+        }
+        if (const auto result = tun_.set_address(*cidr); !result) {
+            return fail(result.error());
+        }
+
+        try {
+            std::cout << "Server assigned inner address " << cidr->str() << '\n';
+        } catch (const std::exception&) {
+        }
+    }
+    if (const auto ping = receivers_[stripe].take_ping()) {
+        return transmitter_.send_pong(stripe, *ping);
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Session::disconnect_(const Error& reason) noexcept {
+    if (cfg_->reconnect_backoff.count() <= 0 || (!listener_ && !connector_) || !is_connection_error(reason)) {
+        return fail(reason);
+    }
+
+    // Late completions of connections that are already being replaced.
+    if (state_ != State::RUNNING) {
+        return {};
+    }
+
+    try {
+        std::cerr << "Connection lost: " << reason.to_string() << ", reconnecting" << '\n';
+    } catch (const std::exception&) {
+    }
+
+    // Shutting the sockets down completes every RECV and SEND still in flight on them.
+    for (std::uint16_t i = 0; i < sockets_.size(); i++) {
+        ::shutdown(sockets_[i].get(), SHUT_RDWR);
+        receivers_[i].stop();
+        if (const auto result = transmitter_.suspend_lane(i); !result) {
+            return fail(result.error());
+        }
+    }
+
+    state_ = State::DRAINING;
+
+    return {};
+}
+
+bool zportal::Session::is_drained_() const noexcept {
+    for (std::uint16_t i = 0; i < sockets_.size(); i++) {
+        if (!receivers_[i].is_idle() || !transmitter_.is_lane_idle(i)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+zportal::Result<void> zportal::Session::establish_() noexcept {
+    if (state_ != State::CONNECTING) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    if (listener_) {
+        if (is_candidate_set_complete_()) {
+            return attach_candidates_();
+        }
+
+        if (accept_armed_) {
+            return {};
+        }
+
+        return arm_accept_();
+    }
+
+    if (const auto result = connector_.start(static_cast<std::uint16_t>(sockets_.size())); !result) {
+        return fail(result.error());
+    }
+
+    // Resolving or creating the sockets may have failed already, no CQE reports it then.
+    if (!connector_.is_finished()) {
+        return {};
+    }
+
+    auto sockets = connector_.take();
+    if (sockets) {
+        return attach_(std::move(*sockets));
+    }
+
+    if (cfg_->reconnect_backoff.count() <= 0) {
+        return fail(sockets.error());
+    }
+
+    return arm_backoff_();
+}
+
+zportal::Result<void> zportal::Session::arm_accept_() noexcept {
+    const auto multishot = support_check::accept_multishot();
+    if (!multishot) {
+        return fail(multishot.error());
+    }
+
+    auto sqe = ring_.get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+#if HAVE_IO_URING_PREP_MULTISHOT_ACCEPT
+    if (*multishot) {
+        ::io_uring_prep_multishot_accept(*sqe, listener_.get(), nullptr, nullptr, SOCK_CLOEXEC);
+    } else {
+        ::io_uring_prep_accept(*sqe, listener_.get(), nullptr, nullptr, SOCK_CLOEXEC);
+    }
+#else
+    ::io_uring_prep_accept(*sqe, listener_.get(), nullptr, nullptr, SOCK_CLOEXEC);
+#endif
+    ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::ACCEPT, index_).serialize());
+
+    if (const auto submit_result = ring_.submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    accept_armed_ = true;
+
+    return {};
+}
+
+// The first attempt goes out at once, a peer that restarted is usually back within one RTT.
+zportal::Result<void> zportal::Session::arm_backoff_() noexcept {
+    backoff_ = std::min(std::max(backoff_ * 2, reconnect_initial_backoff), cfg_->reconnect_backoff);
+
+    auto sqe = ring_.get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    __kernel_timespec ts{.tv_sec = backoff_.count() / 1000, .tv_nsec = (backoff_.count() % 1000) * 1000000};
+    ::io_uring_prep_timeout(*sqe, &ts, 0, 0);
+    ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::BACKOFF, index_).serialize());
+
+    if (const auto submit_result = ring_.submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Session::attach_(std::vector<Socket>&& sockets) noexcept {
+    if (sockets.size() != sockets_.size()) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    // Failing half way through goes through disconnect_() like any broken connection.
+    state_ = State::RUNNING;
+    backoff_ = {};
+
+    // Assigning keeps every Socket in place, so receivers and lanes may point at them again.
+    for (std::uint16_t i = 0; i < sockets_.size(); i++) {
+        sockets_[i] = std::move(sockets[i]);
+
+        if (cfg_->busy_poll.count() > 0) {
+            if (const auto result = sockets_[i].set_busy_poll(cfg_->busy_poll, cfg_->prefer_busy_poll); !result) {
+                return fail(result.error());
+            }
+        }
+
+        if (const auto result = receivers_[i].restart(sockets_[i]); !result) {
+            return fail(result.error());
+        }
+        if (const auto result = receivers_[i].arm_recv(); !result) {
+            return fail(result.error());
+        }
+        if (const auto result = receivers_[i].arm_recv_deadline(cfg_->recv_timeout); !result) {
+            return fail(result.error());
+        }
+
+        if (const auto result = transmitter_.open_lane(i, sockets_[i]); !result) {
+            return fail(result.error());
+        }
+    }
+
+    try {
+        if (listener_) {
+            std::cout << "Accepted " << sockets_.size() << (sockets_.size() == 1 ? " connection" : " connections");
+            if (const auto remote_address = sockets_.front().get_remote_address(); remote_address && *remote_address) {
+                std::cout << " from " << to_string(*remote_address);
             }
         } else {
-            return fail(ErrorCode::InvalidEnumValue);
+            std::cout << "Connected to " << to_string(*cfg_->connect_address);
+            if (sockets_.size() > 1) {
+                std::cout << " over " << sockets_.size() << " connections";
+            }
         }
+        std::cout << '\n';
+    } catch (const std::exception&) {
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Session::arm_signal_() noexcept {
+    auto sqe = ring_.get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    ::io_uring_prep_read(*sqe, signal_fd_.get(), &signal_info_, sizeof(signal_info_), 0);
+    ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::SIGNAL, index_).serialize());
+
+    if (const auto submit_result = ring_.submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Session::handle_signal_cqe_(const Cqe& cqe) noexcept {
+    if (!cqe.ok()) {
+        return fail({ErrorCode::SignalFdFailed, cqe.error()});
+    }
+
+    const bool drain = stop_ == Stop::NONE && cfg_->drain_timeout.count() > 0 && state_ == State::RUNNING;
+    try {
+        std::cout << "Received " << ::strsignal(static_cast<int>(signal_info_.ssi_signo))
+                  << (drain ? ", draining" : ", exiting") << '\n';
+    } catch (const std::exception&) {
+    }
+
+    // A second signal gives up on the drain. Without a connection nothing can be sent, only the TUN
+    // writes still in flight finish.
+    if (!drain) {
+        stop_ = stop_ != Stop::NONE || cfg_->drain_timeout.count() <= 0 ? Stop::EXPIRED : Stop::CLOSED;
+        return {};
+    }
+
+    stop_ = Stop::FLUSHING;
+    if (const auto result = transmitter_.stop_read(); !result) {
+        return fail(result.error());
+    }
+
+    auto sqe = ring_.get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    const auto timeout = cfg_->drain_timeout.count();
+    __kernel_timespec ts{.tv_sec = timeout / 1000, .tv_nsec = (timeout % 1000) * 1000000};
+    ::io_uring_prep_timeout(*sqe, &ts, 0, 0);
+    ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::DRAIN_TIMEOUT, index_).serialize());
+
+    if (const auto submit_result = ring_.submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    return arm_signal_();
+}
+
+zportal::Result<void> zportal::Session::handle_drain_timeout_cqe_(const Cqe& cqe) noexcept {
+    if (!cqe.ok() && cqe.error() != ETIME) {
+        return fail({ErrorCode::RingTimeoutFailed, cqe.error()});
+    }
+
+    std::cerr << "Drain timeout passed, exiting" << '\n';
+    stop_ = Stop::EXPIRED;
+
+    return {};
+}
+
+zportal::Result<void> zportal::Session::arm_doorbell_() noexcept {
+    auto sqe = ring_.get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    ::io_uring_prep_read(*sqe, doorbell_.get(), &doorbell_value_, sizeof(doorbell_value_), 0);
+    ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::DOORBELL, index_).serialize());
+
+    if (const auto submit_result = ring_.submit(); !submit_result) {
+        return fail(submit_result.error());
     }
 
     return {};
-}
\ No newline at end of file
+}
+
+zportal::Result<void> zportal::Session::handle_doorbell_cqe_(const Cqe& cqe) noexcept {
+    if (!cqe.ok()) {
+        return fail({ErrorCode::EventFdFailed, cqe.error()});
+    }
+
+    // Reading resets the count, rings from here on complete the next read.
+    if (const auto result = arm_doorbell_(); !result) {
+        return fail(result.error());
+    }
+
+    if (const auto result = receivers_.front().drain_ring(); !result) {
+        return fail(result.error());
+    }
+    if (const auto result = forward_control_(0); !result) {
+        return fail(result.error());
+    }
+
+    return transmitter_.resume_rings();
+}
+
+bool zportal::Session::advance_stop_() noexcept {
+    if (stop_ == Stop::EXPIRED) {
+        return true;
+    }
+
+    // FIN goes out after the bytes already queued, the peer sees a clean end of the stream.
+    // Datagrams have no end to announce, nothing more is coming once the last one went out. Neither
+    // has SCTP: SHUT_WR starts its SHUTDOWN, after which the peer's own sends fail with EPIPE.
+    if (stop_ == Stop::FLUSHING && transmitter_.is_drained()) {
+        const bool messages = cfg_->transport == Transport::UDP || cfg_->transport == Transport::SCTP;
+        if (!messages) {
+            for (const auto& socket : sockets_) {
+                ::shutdown(socket.get(), SHUT_WR);
+            }
+        }
+        stop_ = messages ? Stop::CLOSED : Stop::CLOSING;
+    }
+
+    if (stop_ != Stop::CLOSED) {
+        return false;
+    }
+
+    return std::ranges::all_of(receivers_, [](const Receiver& receiver) { return receiver.is_flushed(); });
+}
@@ -0,0 +1,177 @@
+#include <atomic>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+#include <zportal/iouring/iouring.hpp>
+#include <zportal/net/socket.hpp>
+#include <zportal/net/tun.hpp>
+#include <zportal/session/session.hpp>
+#include <zportal/session/shard_group.hpp>
+#include <zportal/tools/config.hpp>
+#include <zportal/tools/error.hpp>
+#include <zportal/tools/support_check.hpp>
+
+zportal::Result<zportal::ShardGroup> zportal::ShardGroup::create_shard_group(std::vector<TunDevice>&& tuns,
+                                                                            std::vector<Socket>&& sockets,
+                                                                            const Config& cfg) noexcept {
+    if (tuns.empty() || tuns.size() != sockets.size()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    ShardGroup group;
+    try {
+        group.configs_.reserve(tuns.size());
+        group.sessions_.reserve(tuns.size());
+        group.socket_fds_.reserve(tuns.size());
+
+        for (std::size_t i = 0; i < tuns.size(); i++) {
+            group.configs_.push_back(cfg);
+            group.configs_.back().monitor_mode = cfg.monitor_mode && i == 0;
+        }
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    for (std::size_t i = 0; i < tuns.size(); i++) {
+        auto ring = IoUring::create_queue(64);
+        if (!ring) {
+            return fail(ring.error());
+        }
+        ring->set_buffer_ring_options({.kernel_allocated = cfg.kernel_buffer_rings, .numa_node = cfg.numa_node});
+
+        if (cfg.busy_poll.count() > 0) {
+            if (const auto result = sockets[i].set_busy_poll(cfg.busy_poll, cfg.prefer_busy_poll); !result) {
+                return fail(result.error());
+            }
+
+            if (const auto napi = ring->register_napi(cfg.busy_poll, cfg.prefer_busy_poll); !napi) {
+                return fail(napi.error());
+            }
+        }
+
+        group.socket_fds_.push_back(sockets[i].get());
+
+        auto session = Session::create_session(std::move(*ring), std::move(tuns[i]), std::move(sockets[i]),
+                                               cfg.tx_buffer_classes, cfg.rx_buffer_classes, group.configs_[i],
+                                               static_cast<std::uint16_t>(i));
+        if (!session) {
+            return fail(session.error());
+        }
+        group.sessions_.push_back(std::move(*session));
+    }
+
+    return group;
+}
+
+zportal::Result<void> zportal::ShardGroup::run() noexcept {
+    if (sessions_.empty()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    // Probe results are cached in plain statics, resolve them before the workers race on them.
+    if (const auto result = support_check::read_multishot(); !result) {
+        return fail(result.error());
+    }
+    if (const auto result = support_check::recv_multishot(); !result) {
+        return fail(result.error());
+    }
+
+    const auto cpus = get_cpus_();
+    if (!cpus) {
+        return fail(cpus.error());
+    }
+
+    std::vector<Result<void>> results;
+    std::vector<std::thread> threads;
+    try {
+        results.resize(sessions_.size());
+        threads.reserve(sessions_.size());
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    std::atomic<bool> stopping{false};
+    std::atomic<std::size_t> first_failed{0};
+
+    // Sessions only return on failure, the first one stops the rest by ending their connections.
+    const auto stop = [&](std::size_t index) noexcept {
+        if (stopping.exchange(true)) {
+            return;
+        }
+
+        first_failed = index;
+        for (const int fd : socket_fds_) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+    };
+
+    const auto work = [&](std::size_t index) noexcept {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((*cpus)[index % cpus->size()], &set);
+
+        if (const int error = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set); error != 0) {
+            results[index] = fail({ErrorCode::SetAffinityFailed, error});
+        } else {
+            results[index] = sessions_[index].run();
+        }
+
+        stop(index);
+    };
+
+    for (std::size_t i = 0; i < sessions_.size(); i++) {
+        try {
+            threads.emplace_back(work, i);
+        } catch (const std::system_error& e) {
+            results[i] = fail({ErrorCode::ThreadCreateFailed, e.code().value()});
+            stop(i);
+            break;
+        }
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return results[first_failed];
+}
+
+std::size_t zportal::ShardGroup::size() const noexcept {
+    return sessions_.size();
+}
+
+zportal::Result<std::vector<int>> zportal::ShardGroup::get_cpus_() noexcept {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (::sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return fail({ErrorCode::SetAffinityFailed, errno});
+    }
+
+    std::vector<int> cpus;
+    try {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    if (cpus.empty()) {
+        return fail(ErrorCode::SetAffinityFailed);
+    }
+
+    return cpus;
+}
@@ -1,44 +1,142 @@
+#include <algorithm>
+#include <chrono>
 #include <new>
+#include <optional>
+#include <span>
 #include <utility>
+#include <vector>
 
 #include <cerrno>
+#include <cstring>
 
 #include <liburing.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 
+#if HAVE_LINUX_SCTP_H
+    #include <linux/sctp.h>
+#endif
+
+#include <zportal/iouring/buffer_pool.hpp>
 #include <zportal/iouring/iouring.hpp>
+#include <zportal/net/packet.hpp>
+#include <zportal/net/route_table.hpp>
+#include <zportal/net/shm_ring.hpp>
 #include <zportal/net/socket.hpp>
 #include <zportal/session/frame_header.hpp>
 #include <zportal/session/operation.hpp>
 #include <zportal/session/transmitter.hpp>
+#include <zportal/tools/compression.hpp>
 #include <zportal/tools/crc.hpp>
 #include <zportal/tools/error.hpp>
+#include <zportal/tools/monitor.hpp>
 #include <zportal/tools/support_check.hpp>
 
+namespace {
+
+// Smaller frames, mostly ACKs, barely shrink.
+constexpr std::size_t min_compress_size = 128;
+// Saving less than this share isn't worth the peer's copy.
+constexpr std::size_t min_compress_saving = 8;
+constexpr std::uint8_t incompressible_backoff = 64;
+// Interactive packets jumping ahead before a bulk one gets its turn.
+constexpr std::size_t max_priority_burst = 32;
+
+// UDP_MAX_SEGMENTS of older kernels, and the largest UDP payload over IPv4.
+constexpr std::size_t max_gso_segments = 64;
+constexpr std::size_t max_gso_size = 65507;
+
+#if HAVE_LINUX_SCTP_H
+static_assert(CMSG_SPACE(sizeof(sctp_sndinfo)) <= CMSG_SPACE(16));
+#endif
+
+} // namespace
+
 zportal::Result<zportal::Transmitter> zportal::Transmitter::create_transmitter(zportal::IoUring& ring,
                                                                                zportal::TunDevice& tun,
                                                                                zportal::Socket& sock,
-                                                                               std::uint16_t queue_length) noexcept {
+                                                                               std::span<const BufferClass> classes) noexcept {
+    auto transmitter = create_transmitter(ring, tun, classes, 1);
+    if (!transmitter) {
+        return fail(transmitter.error());
+    }
+
+    if (const auto result = transmitter->open_lane(0, sock); !result) {
+        return fail(result.error());
+    }
+
+    return transmitter;
+}
+
+zportal::Result<zportal::Transmitter> zportal::Transmitter::create_transmitter(zportal::IoUring& ring,
+                                                                               zportal::TunDevice& tun,
+                                                                               std::span<const BufferClass> classes,
+                                                                               std::uint16_t lanes) noexcept {
+    if (lanes == 0) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
     Transmitter transmitter;
     transmitter.ring_ = &ring;
     transmitter.tun_ = &tun;
-    transmitter.sock_ = &sock;
 
-    auto bg = transmitter.ring_->create_buffer_group(queue_length, transmitter.tun_->get_mtu());
+    const std::uint32_t mtu = transmitter.tun_->get_mtu();
+
+    // Classes at least as large as the MTU collapse into the read group, the rest are copy-break classes.
+    std::uint16_t read_count{};
+    std::vector<BufferClass> copy_classes;
+    try {
+        for (const auto& buffer_class : classes) {
+            if (buffer_class.buffer_size >= mtu) {
+                read_count = std::max(read_count, buffer_class.buffer_count);
+            } else {
+                copy_classes.push_back(buffer_class);
+            }
+        }
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    if (read_count == 0) {
+        return fail({ErrorCode::InvalidArgument, 0, "no TX buffer class fits the MTU"});
+    }
+
+    auto bg = transmitter.ring_->create_buffer_group(read_count, mtu);
     if (!bg) {
         return fail(bg.error());
     }
-    transmitter.bg_ = *bg;
+    transmitter.read_bg_ = *bg;
+    transmitter.lane_queue_limit_ = std::max<std::size_t>(read_count / 4, 1);
+
+    try {
+        transmitter.lanes_.resize(lanes);
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    if (!copy_classes.empty()) {
+        auto pool = BufferPool::create_buffer_pool(*transmitter.ring_, copy_classes, false);
+        if (!pool) {
+            return fail(pool.error());
+        }
+        transmitter.copy_pool_ = std::move(*pool);
+    }
 
     return transmitter;
 }
 
 zportal::Transmitter::Transmitter(Transmitter&& other) noexcept
     : ring_(std::exchange(other.ring_, nullptr)), tun_(std::exchange(other.tun_, nullptr)),
-      bg_(std::exchange(other.bg_, nullptr)), sock_(std::exchange(other.sock_, nullptr)),
-      frame_queue_(std::move(other.frame_queue_)), cooling_down_(std::exchange(other.cooling_down_, false)),
-      send_in_progress_(std::exchange(other.send_in_progress_, false)),
-      current_frame_state_(std::exchange(other.current_frame_state_, std::nullopt)) {}
+      read_bg_(std::exchange(other.read_bg_, nullptr)), copy_pool_(std::move(other.copy_pool_)),
+      session_index_(std::exchange(other.session_index_, 0)), cooling_down_(std::exchange(other.cooling_down_, false)),
+      read_user_data_(std::exchange(other.read_user_data_, 0)), reading_(std::exchange(other.reading_, false)),
+      read_stopped_(std::exchange(other.read_stopped_, false)), lanes_(std::move(other.lanes_)),
+      routes_(std::exchange(other.routes_, nullptr)), lane_queue_limit_(std::exchange(other.lane_queue_limit_, 0)),
+      send_timeout_(std::exchange(other.send_timeout_, {})),
+      keepalive_interval_(std::exchange(other.keepalive_interval_, {})),
+      hello_(std::exchange(other.hello_, std::nullopt)), incompressible_(other.incompressible_) {}
 
 zportal::Transmitter& zportal::Transmitter::operator=(Transmitter&& other) noexcept {
     if (&other == this) {
@@ -47,12 +145,20 @@ zportal::Transmitter& zportal::Transmitter::operator=(Transmitter&& other) noexc
 
     ring_ = std::exchange(other.ring_, nullptr);
     tun_ = std::exchange(other.tun_, nullptr);
-    bg_ = std::exchange(other.bg_, nullptr);
-    sock_ = std::exchange(other.sock_, nullptr);
-    frame_queue_ = std::move(other.frame_queue_);
+    read_bg_ = std::exchange(other.read_bg_, nullptr);
+    copy_pool_ = std::move(other.copy_pool_);
+    session_index_ = std::exchange(other.session_index_, 0);
     cooling_down_ = std::exchange(other.cooling_down_, false);
-    send_in_progress_ = std::exchange(other.send_in_progress_, false);
-    current_frame_state_ = std::exchange(other.current_frame_state_, std::nullopt);
+    read_user_data_ = std::exchange(other.read_user_data_, 0);
+    reading_ = std::exchange(other.reading_, false);
+    read_stopped_ = std::exchange(other.read_stopped_, false);
+    lanes_ = std::move(other.lanes_);
+    routes_ = std::exchange(other.routes_, nullptr);
+    lane_queue_limit_ = std::exchange(other.lane_queue_limit_, 0);
+    send_timeout_ = std::exchange(other.send_timeout_, {});
+    keepalive_interval_ = std::exchange(other.keepalive_interval_, {});
+    hello_ = std::exchange(other.hello_, std::nullopt);
+    incompressible_ = other.incompressible_;
 
     return *this;
 }
@@ -62,14 +168,17 @@ zportal::Result<void> zportal::Transmitter::arm_read() noexcept {
         return fail(ErrorCode::InvalidTransmitter);
     }
 
+    if (read_stopped_) {
+        return {};
+    }
+
     auto sqe = ring_->get_sqe();
     if (!sqe) {
         return fail(sqe.error());
     }
 
-    Operation op;
-    op.set_type(OperationType::READ);
-    ::io_uring_sqe_set_data64(*sqe, op.serialize());
+    read_user_data_ = Operation::make(OperationType::READ, session_index_, read_bg_->get_bgid()).serialize();
+    ::io_uring_sqe_set_data64(*sqe, read_user_data_);
 
 #if HAVE_IO_URING_PREP_READ_MULTISHOT
     const auto check_result = support_check::read_multishot();
@@ -78,16 +187,16 @@ zportal::Result<void> zportal::Transmitter::arm_read() noexcept {
     }
 
     if (*check_result) {
-        ::io_uring_prep_read_multishot(*sqe, tun_->get_fd(), 0, 0, bg_->get_bgid());
+        ::io_uring_prep_read_multishot(*sqe, tun_->get_fd(), 0, 0, read_bg_->get_bgid());
     } else {
         ::io_uring_prep_read(*sqe, tun_->get_fd(), nullptr, 0, 0);
         (*sqe)->flags |= IOSQE_BUFFER_SELECT;
-        (*sqe)->buf_group = bg_->get_bgid();
+        (*sqe)->buf_group = read_bg_->get_bgid();
     }
 #else
     ::io_uring_prep_read(*sqe, tun_->get_fd(), nullptr, 0, 0);
     (*sqe)->flags |= IOSQE_BUFFER_SELECT;
-    (*sqe)->buf_group = bg_->get_bgid();
+    (*sqe)->buf_group = read_bg_->get_bgid();
 #endif
 
     const auto submit_result = ring_->submit();
@@ -95,6 +204,33 @@ zportal::Result<void> zportal::Transmitter::arm_read() noexcept {
         return fail(submit_result.error());
     }
 
+    reading_ = true;
+
+    return {};
+}
+
+zportal::Result<void> zportal::Transmitter::stop_read() noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidTransmitter);
+    }
+
+    read_stopped_ = true;
+    if (!reading_) {
+        return {};
+    }
+
+    auto sqe = ring_->get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    ::io_uring_prep_cancel64(*sqe, read_user_data_, 0);
+    ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::NONE, session_index_).serialize());
+
+    if (const auto submit_result = ring_->submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
     return {};
 }
 
@@ -104,18 +240,272 @@ zportal::Result<void> zportal::Transmitter::handle_cqe(const Cqe& cqe) noexcept
     }
 
     const auto type = cqe.operation().get_type();
-    if (type != OperationType::SEND && type != OperationType::READ) {
+    if (type != OperationType::SEND && type != OperationType::READ && type != OperationType::SEND_TIMEOUT &&
+        type != OperationType::KEEPALIVE) {
         return fail(ErrorCode::WrongOperationType);
     }
 
     if (type == OperationType::SEND) {
         return handle_send_cqe_(cqe);
     }
+    if (type == OperationType::SEND_TIMEOUT) {
+        return handle_send_timeout_cqe_(cqe);
+    }
+    if (type == OperationType::KEEPALIVE) {
+        return handle_keepalive_cqe_(cqe);
+    }
     return handle_read_cqe_(cqe);
 }
 
+void zportal::Transmitter::set_send_timeout(std::chrono::milliseconds timeout) noexcept {
+    send_timeout_ = timeout;
+}
+
+void zportal::Transmitter::set_keepalive(std::chrono::milliseconds interval) noexcept {
+    keepalive_interval_ = interval;
+}
+
+zportal::Result<void> zportal::Transmitter::arm_keepalive() noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidTransmitter);
+    }
+
+    if (keepalive_interval_.count() <= 0 || read_stopped_) {
+        return {};
+    }
+
+    auto sqe = ring_->get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    // The kernel copies the timespec while submitting.
+    const auto interval = keepalive_interval_.count();
+    __kernel_timespec ts{.tv_sec = interval / 1000, .tv_nsec = (interval % 1000) * 1000000};
+    ::io_uring_prep_timeout(*sqe, &ts, 0, 0);
+    ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::KEEPALIVE, session_index_).serialize());
+
+    if (const auto submit_result = ring_->submit(); !submit_result) {
+        return fail(submit_result.error());
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Transmitter::send_pong(std::uint16_t lane, const Ping& ping) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidTransmitter);
+    }
+
+    if (lane >= lanes_.size()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    // Draining shuts the sockets down for writing, nothing but queued packets goes out anymore.
+    if (read_stopped_) {
+        return {};
+    }
+
+    // Only the latest PING needs an answer.
+    auto& target = lanes_[lane];
+    target.pong = ping.pong();
+
+    return kick_send_(target);
+}
+
+zportal::Result<void> zportal::Transmitter::send_address(std::uint16_t lane, const InnerAddress& address) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidTransmitter);
+    }
+
+    if (lane >= lanes_.size()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    if (read_stopped_) {
+        return {};
+    }
+
+    auto& target = lanes_[lane];
+    target.address = address;
+
+    return kick_send_(target);
+}
+
+void zportal::Transmitter::set_routes(const RouteTable* routes) noexcept {
+    routes_ = routes;
+}
+
+void zportal::Transmitter::set_hello(const Hello& hello) noexcept {
+    hello_ = hello;
+}
+
+zportal::Result<void> zportal::Transmitter::set_lane_features(std::uint16_t lane, const Hello& negotiated) noexcept {
+    if (lane >= lanes_.size()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    lanes_[lane].negotiated = negotiated;
+    if (negotiated.has(Hello::INNER_HEADERS)) {
+        return lanes_[lane].inner_contexts.reset();
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Transmitter::open_lane(std::uint16_t lane, Socket& sock) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidTransmitter);
+    }
+
+    if (lane >= lanes_.size() || !sock) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    auto& target = lanes_[lane];
+    if (target.state != LaneState::CLOSED && target.state != LaneState::SUSPENDED) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    const auto transport = sock.detect_transport();
+    if (!transport) {
+        return fail(transport.error());
+    }
+
+    // Without a known path MTU every frame goes out on its own.
+    target.datagram = *transport == Transport::UDP;
+    const auto limit = target.datagram ? sock.get_datagram_limit() : Result<std::size_t>{0};
+    target.datagram_limit = limit ? *limit : 0;
+
+    // Frames queued for another association keep their stream, clamped when sent.
+    const auto streams = *transport == Transport::SCTP ? sock.get_stream_count() : Result<std::uint16_t>{1};
+    if (!streams) {
+        return fail(streams.error());
+    }
+    target.streams = *streams;
+
+    // The peer on a new socket negotiates again.
+    target.sock = &sock;
+    target.state = LaneState::OPEN;
+    target.hello_pending = hello_.has_value();
+    target.ping_pending = false;
+    target.pong = std::nullopt;
+    target.address = std::nullopt;
+    target.negotiated = Hello{};
+    target.compact = false;
+    target.integrity = Integrity::FULL;
+
+    return kick_send_(target);
+}
+
+zportal::Result<void> zportal::Transmitter::open_lane(std::uint16_t lane, Socket& sock, ShmRing&& shm,
+                                                     int peer_doorbell) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidTransmitter);
+    }
+
+    if (lane >= lanes_.size() || !shm || peer_doorbell < 0) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    if (lanes_[lane].state != LaneState::CLOSED) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    lanes_[lane].shm = std::move(shm);
+    lanes_[lane].peer_doorbell = peer_doorbell;
+
+    return open_lane(lane, sock);
+}
+
+zportal::Result<void> zportal::Transmitter::resume_rings() noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidTransmitter);
+    }
+
+    for (auto& lane : lanes_) {
+        if (!lane.shm) {
+            continue;
+        }
+
+        if (const auto result = kick_send_(lane); !result) {
+            return fail(result.error());
+        }
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Transmitter::suspend_lane(std::uint16_t lane) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidTransmitter);
+    }
+
+    if (lane >= lanes_.size()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    auto& target = lanes_[lane];
+    if (target.state == LaneState::SUSPENDED) {
+        return {};
+    }
+
+    if (target.state != LaneState::OPEN && target.state != LaneState::CLOSED) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    target.state = LaneState::SUSPENDED;
+    target.sock = nullptr;
+    if (!target.send_in_progress) {
+        target.current_frame_state = std::nullopt;
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Transmitter::close_lane(std::uint16_t lane) noexcept {
+    if (!is_valid()) {
+        return fail(ErrorCode::InvalidTransmitter);
+    }
+
+    if (lane >= lanes_.size()) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    auto& target = lanes_[lane];
+    if (target.state == LaneState::CLOSED) {
+        return {};
+    }
+
+    if (target.send_in_progress) {
+        target.state = LaneState::CLOSING;
+        const std::size_t sending = target.current_frame_state ? target.current_frame_state->frames : 0;
+        if (const auto result = drop_queued_(target, sending); !result) {
+            return fail(result.error());
+        }
+    } else {
+        target.state = LaneState::CLOSED;
+        target.sock = nullptr;
+        if (const auto result = drop_queued_(target, 0); !result) {
+            return fail(result.error());
+        }
+    }
+
+    return resume_read_();
+}
+
+bool zportal::Transmitter::is_lane_idle(std::uint16_t lane) const noexcept {
+    return lane >= lanes_.size() || !lanes_[lane].send_in_progress;
+}
+
+bool zportal::Transmitter::is_drained() const noexcept {
+    return std::ranges::all_of(lanes_, [](const Lane& lane) {
+        return !lane.send_in_progress && lane.frame_queue.empty() && !lane.current_frame_state;
+    });
+}
+
 bool zportal::Transmitter::is_valid() const noexcept {
-    return (ring_ != nullptr) && (tun_ != nullptr) && (sock_ != nullptr) && (bg_ != nullptr);
+    return (ring_ != nullptr) && (tun_ != nullptr) && (read_bg_ != nullptr) && !lanes_.empty();
 }
 
 zportal::Transmitter::operator bool() const noexcept {
@@ -131,10 +521,18 @@ zportal::Result<void> zportal::Transmitter::handle_read_cqe_(const Cqe& cqe) noe
         return fail(ErrorCode::WrongOperationType);
     }
 
+    if (!cqe.more()) {
+        reading_ = false;
+    }
+
     if (!cqe.ok()) {
         if (cqe.error() == ENOBUFS && !cqe.more()) {
             cooling_down_ = true;
-            return kick_send_();
+            return {};
+        }
+
+        if (cqe.error() == ECANCELED && read_stopped_) {
+            return {};
         }
 
         return fail({ErrorCode::TunReadFailed, cqe.error()});
@@ -145,17 +543,60 @@ zportal::Result<void> zportal::Transmitter::handle_read_cqe_(const Cqe& cqe) noe
         return fail(ErrorCode::ReadCqeMissingBid);
     }
 
+    if (cqe.operation().get_slot() != read_bg_->get_bgid()) {
+        return fail(ErrorCode::InvalidBgid);
+    }
+
     const auto readen = static_cast<std::uint32_t>(cqe.result());
+    if (const auto take_result = read_bg_->take_buffer(*bid, readen); !take_result) {
+        return fail(take_result.error());
+    }
 
-    OutFrame out_frame{.bid = *bid, .size = readen};
+    const OutFrame frame{.id = {.bgid = read_bg_->get_bgid(), .bid = *bid}, .size = readen};
+    const auto lane = route_(frame);
+    if (!lane) {
+        return fail(lane.error());
+    }
 
-    try {
-        frame_queue_.push(out_frame);
-    } catch (const std::bad_alloc&) {
-        const auto result = bg_->return_buffer(*bid);
-        (void)result;
+    if (*lane == nullptr) {
+        if (const auto result = read_bg_->return_buffer(*bid); !result) {
+            return fail(result.error());
+        }
+    } else {
+        auto out_frame = copy_break_(frame);
+        if (!out_frame) {
+            return fail(out_frame.error());
+        }
 
-        return fail(ErrorCode::NotEnoughMemory);
+        auto& queue = (*lane)->frame_queue;
+        const auto buffer = get_frame_buffer_(*out_frame);
+        if (buffer) {
+            out_frame->flow = flow_hash(*buffer);
+            if ((*lane)->streams > 1) {
+                out_frame->stream = static_cast<std::uint16_t>(out_frame->flow % (*lane)->streams);
+            }
+        }
+        try {
+            // Behind the frames in flight and the interactive ones already queued, ahead of bulk ones. A flow
+            // with bulk frames still queued, say the small tail of a transfer, stays behind them in order.
+            const auto& state = (*lane)->current_frame_state;
+            const auto position = std::max((*lane)->priority_end, state ? state->frames : 0);
+            auto& bulk = (*lane)->bulk_flows[out_frame->flow % flow_buckets];
+            if (buffer && is_interactive(*buffer) && (*lane)->priority_burst < max_priority_burst && bulk == 0) {
+                queue.insert(queue.begin() + static_cast<std::ptrdiff_t>(position), *out_frame);
+                (*lane)->priority_end = position + 1;
+                (*lane)->priority_burst++;
+            } else {
+                out_frame->bulk = true;
+                queue.push_back(*out_frame);
+                bulk++;
+            }
+        } catch (const std::bad_alloc&) {
+            const auto result = return_frame_buffer_(*out_frame);
+            (void)result;
+
+            return fail(ErrorCode::NotEnoughMemory);
+        }
     }
 
     if (!cqe.more() && !cooling_down_) {
@@ -164,94 +605,467 @@ zportal::Result<void> zportal::Transmitter::handle_read_cqe_(const Cqe& cqe) noe
         }
     }
 
-    return kick_send_();
+    if (*lane == nullptr) {
+        return {};
+    }
+
+    return kick_send_(**lane);
 }
 
-zportal::Result<zportal::FrameHeader> zportal::Transmitter::create_frame_header_(const OutFrame& frame) noexcept {
-    const auto buffer = bg_->get_buffer(frame.bid, frame.size);
-    if (!buffer) {
-        return fail(buffer.error());
+zportal::Result<zportal::Transmitter::OutFrame> zportal::Transmitter::copy_break_(const OutFrame& frame) noexcept {
+    if (!copy_pool_) {
+        return frame;
     }
 
-    FrameHeader header;
-    header.set_size(frame.size);
-    header.set_crc(crc32c(*buffer));
+    auto* bg = copy_pool_.select_fitting(frame.size);
+    if (bg == nullptr) {
+        return frame;
+    }
 
-    return header;
+    const auto bid = bg->acquire_buffer();
+    if (!bid) {
+        return fail(bid.error());
+    }
+
+    const auto source = read_bg_->get_buffer(frame.id.bid, frame.size);
+    if (!source) {
+        return fail(source.error());
+    }
+
+    const auto destination = bg->get_buffer(*bid, frame.size);
+    if (!destination) {
+        return fail(destination.error());
+    }
+
+    std::memcpy(destination->data(), source->data(), frame.size);
+
+    if (const auto result = read_bg_->return_buffer(frame.id.bid); !result) {
+        return fail(result.error());
+    }
+
+    return OutFrame{.id = {.bgid = bg->get_bgid(), .bid = *bid}, .size = frame.size};
+}
+
+zportal::Result<std::span<std::byte>> zportal::Transmitter::get_frame_buffer_(const OutFrame& frame) noexcept {
+    if (frame.id.bgid == read_bg_->get_bgid()) {
+        return read_bg_->get_buffer(frame.id.bid, frame.size);
+    }
+
+    return copy_pool_.get_buffer(frame.id, frame.size);
+}
+
+zportal::Result<void> zportal::Transmitter::return_frame_buffer_(const OutFrame& frame) noexcept {
+    if (frame.id.bgid == read_bg_->get_bgid()) {
+        return read_bg_->return_buffer(frame.id.bid);
+    }
+
+    return copy_pool_.return_buffer(frame.id);
+}
+
+std::size_t zportal::Transmitter::batch_size_(const Lane& lane) const noexcept {
+    if (!lane.negotiated.has(Hello::BATCHED_FRAMES)) {
+        return 1;
+    }
+
+    // Packets restarting their flow's context grow a little.
+    const std::size_t growth = lane.negotiated.has(Hello::INNER_HEADERS) ? InnerHeaderContexts::max_growth : 0;
+
+    std::size_t frames{};
+    std::size_t packets{};
+    const auto stream = lane.frame_queue.front().stream;
+    while (frames < lane.frame_queue.size() && frames < BatchTable::max_count &&
+           lane.frame_queue[frames].stream == stream) {
+        const std::size_t next = packets + lane.frame_queue[frames].size + growth;
+        if (BatchTable::wire_size(frames + 1) + next > lane.negotiated.get_max_frame_size()) {
+            break;
+        }
+
+        packets = next;
+        frames++;
+    }
+
+    return std::max<std::size_t>(frames, 1);
+}
+
+zportal::Result<void> zportal::Transmitter::build_frame_(Lane& lane, CurrentFrameState& state) noexcept {
+    try {
+        if (lane.hello_pending) {
+            std::ranges::copy(hello_->serialize(), state.control_payload.begin());
+            state.header.set_flags(FrameHeader::control_flag);
+            state.payload.push_back({.iov_base = state.control_payload.data(), .iov_len = Hello::wire_size});
+        } else if (lane.address) {
+            std::ranges::copy(lane.address->serialize(), state.control_payload.begin());
+            lane.address = std::nullopt;
+
+            state.header.set_flags(FrameHeader::control_flag);
+            state.payload.push_back({.iov_base = state.control_payload.data(), .iov_len = InnerAddress::wire_size});
+        } else if (lane.pong || lane.ping_pending) {
+            // Stamped as late as possible, a PING waiting here would add to the RTT it measures.
+            const auto ping = lane.pong ? *lane.pong : Ping::now();
+            lane.pong = std::nullopt;
+            lane.ping_pending = false;
+
+            std::ranges::copy(ping.serialize(), state.control_payload.begin());
+            state.header.set_flags(FrameHeader::control_flag);
+            state.payload.push_back({.iov_base = state.control_payload.data(), .iov_len = Ping::wire_size});
+        } else {
+            // A single frame goes out as is, the table would only add to it.
+            state.frames = batch_size_(lane);
+            state.stream = static_cast<std::uint16_t>(lane.frame_queue.front().stream % lane.streams);
+            const bool inner = lane.negotiated.has(Hello::INNER_HEADERS);
+            if (inner) {
+                lane.inner_headers.resize(state.frames);
+            }
+
+            // Packets may each start with their compressed headers, the table follows their final lengths.
+            state.payload.reserve(2 * state.frames + 1);
+            if (state.frames > 1) {
+                state.header.set_flags(Hello::BATCHED_FRAMES);
+                state.payload.emplace_back();
+            }
+
+            for (std::size_t i = 0; i < state.frames; i++) {
+                const auto buffer = get_frame_buffer_(lane.frame_queue[i]);
+                if (!buffer) {
+                    return fail(buffer.error());
+                }
+
+                std::span<std::byte> packet = *buffer;
+                std::size_t length = packet.size();
+                if (const auto prefix = inner ? lane.inner_contexts.compress(packet, lane.inner_headers[i])
+                                              : std::nullopt) {
+                    state.header.set_flags(state.header.get_flags() | Hello::INNER_HEADERS);
+                    state.payload.push_back({.iov_base = lane.inner_headers[i].data(), .iov_len = prefix->size});
+                    packet = packet.subspan(prefix->replaced);
+                    length = prefix->size + packet.size();
+                }
+
+                if (!packet.empty()) {
+                    state.payload.push_back({.iov_base = packet.data(), .iov_len = packet.size()});
+                }
+                if (state.frames > 1) {
+                    state.table.add(static_cast<std::uint16_t>(length));
+                }
+            }
+
+            if (state.frames > 1) {
+                state.payload.front() = {.iov_base = state.table.data().data(), .iov_len = state.table.data().size()};
+            }
+        }
+
+        state.segments.reserve(state.payload.size() + 1);
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    std::size_t size{};
+    for (const auto& segment : state.payload) {
+        size += segment.iov_len;
+    }
+
+    if (state.frames > 0 && size >= min_compress_size && lane.negotiated.has(Hello::COMPRESSION)) {
+        if (const auto result = compress_frame_(lane, state, size); !result) {
+            return fail(result.error());
+        }
+
+        size = state.payload.front().iov_len;
+    }
+
+    state.header.set_size(static_cast<std::uint32_t>(size));
+
+    const bool compact = lane.compact;
+    if (!compact && lane.negotiated.has(Hello::COMPACT_HEADER)) {
+        state.header.set_flags(state.header.get_flags() | Hello::COMPACT_HEADER);
+        lane.compact = true;
+    }
+
+    // The frame switching to a weaker check announces it, the header check then covers its flags.
+    const auto integrity = lane.negotiated.get_integrity();
+    if (integrity != lane.integrity) {
+        const auto flag = integrity == Integrity::NONE ? Hello::NO_CHECKSUM : Hello::HEADER_CHECKSUM;
+        state.header.set_flags(state.header.get_flags() | flag);
+        lane.integrity = integrity;
+    }
+
+    switch (integrity) {
+    case Integrity::FULL:
+        state.header.set_crc(crc32c(state.payload));
+        break;
+    case Integrity::HEADER:
+        state.header.set_crc(state.header.header_crc());
+        break;
+    case Integrity::NONE:
+        state.header.set_crc(0);
+        break;
+    }
+
+    if (compact) {
+        state.compact = true;
+        state.header_size = state.header.encode_compact(state.compact_header);
+    }
+
+    if (lane.datagram && state.frames == 1 && state.header.get_flags() == 0) {
+        return build_train_(lane, state);
+    }
+
+    return {};
 }
 
-zportal::Result<void> zportal::Transmitter::kick_send_() noexcept {
-    if (send_in_progress_) {
+zportal::Result<void> zportal::Transmitter::build_train_(Lane& lane, CurrentFrameState& state) noexcept {
+#if defined(UDP_SEGMENT)
+    // Bulk transfers fill the queue with MTU sized packets, which the kernel splits back into datagrams.
+    const std::uint32_t size = state.header.get_size();
+    const std::size_t segment = state.header_size + size;
+    if (segment > lane.datagram_limit) {
         return {};
     }
 
-    if (frame_queue_.empty()) {
+    std::size_t count = 1;
+    while (count < lane.frame_queue.size() && count < max_gso_segments && (count + 1) * segment <= max_gso_size &&
+           lane.frame_queue[count].size == size) {
+        count++;
+    }
+    if (count == 1) {
         return {};
     }
 
-    if (!current_frame_state_) {
-        const auto frame = frame_queue_.front();
-        const auto header = create_frame_header_(frame);
-        if (!header) {
-            return fail(header.error());
+    // Reserved up front, the payload points into the train's headers.
+    try {
+        state.train.resize(count - 1);
+        state.payload.reserve(state.payload.size() + 2 * (count - 1));
+        state.segments.reserve(state.payload.capacity() + 1);
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    for (std::size_t i = 1; i < count; i++) {
+        const auto buffer = get_frame_buffer_(lane.frame_queue[i]);
+        if (!buffer) {
+            return fail(buffer.error());
         }
 
-        CurrentFrameState state;
-        state.frame = frame;
-        state.header = *header;
-        try {
-            state.segments.reserve(2);
-        } catch (const std::bad_alloc&) {
-            return fail(ErrorCode::NotEnoughMemory);
+        auto& header = state.train[i - 1];
+        header.set_size(size);
+        header.set_crc(crc32c(*buffer));
+        state.payload.push_back({.iov_base = header.data().data(), .iov_len = FrameHeader::wire_size});
+        state.payload.push_back({.iov_base = buffer->data(), .iov_len = buffer->size()});
+    }
+
+    state.frames = count;
+    state.train_size = (count - 1) * segment;
+    state.segment_size = static_cast<std::uint16_t>(segment);
+#else
+    (void)lane;
+    (void)state;
+#endif
+
+    return {};
+}
+
+zportal::Result<void> zportal::Transmitter::compress_frame_(Lane& lane, CurrentFrameState& state,
+                                                           std::size_t size) noexcept {
+    // The first packet's flow stands for the whole frame.
+    const auto first = get_frame_buffer_(lane.frame_queue.front());
+    if (!first) {
+        return fail(first.error());
+    }
+
+    auto& backoff = incompressible_[flow_hash(*first) % incompressible_.size()];
+    if (backoff > 0) {
+        backoff--;
+        return {};
+    }
+
+    try {
+        lane.compressed.resize(compression::bound(size));
+        if (state.payload.size() > 1) {
+            lane.gathered.resize(size);
         }
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
 
-        current_frame_state_ = state;
+    std::span<const std::byte> input{static_cast<const std::byte*>(state.payload.front().iov_base),
+                                     state.payload.front().iov_len};
+    if (state.payload.size() > 1) {
+        std::size_t gathered{};
+        for (const auto& segment : state.payload) {
+            std::memcpy(lane.gathered.data() + gathered, segment.iov_base, segment.iov_len);
+            gathered += segment.iov_len;
+        }
+        input = std::span<const std::byte>{lane.gathered}.first(size);
     }
 
-    auto& state = *current_frame_state_;
-    const auto payload = bg_->get_buffer(state.frame.bid, state.frame.size);
-    if (!payload) {
-        return fail(payload.error());
+    // Output capped below the saving we ask for, LZ4 gives up once it runs out of room.
+    const auto output = std::span<std::byte>{lane.compressed}.first(size - size / min_compress_saving);
+    const auto compressed = compression::compress(input, output);
+    if (compressed == 0) {
+        backoff = incompressible_backoff;
+        return {};
     }
 
-    if (state.bytes_sent >= FrameHeader::wire_size + static_cast<std::size_t>(state.frame.size)) {
+    state.payload.clear();
+    state.payload.push_back({.iov_base = lane.compressed.data(), .iov_len = compressed});
+    state.header.set_flags(state.header.get_flags() | Hello::COMPRESSION);
+
+    return {};
+}
+
+zportal::Result<void> zportal::Transmitter::prepare_segments_(CurrentFrameState& state) noexcept {
+    if (state.bytes_sent >= state.header_size + static_cast<std::size_t>(state.header.get_size()) + state.train_size) {
         return fail(ErrorCode::InvalidState);
     }
 
+    // Capacity was reserved with the payload, a partial send resumes inside the segment it stopped in.
     state.segments.clear();
-    if (state.bytes_sent < FrameHeader::wire_size) {
-        state.segments.push_back({.iov_base = state.header.data().data() + state.bytes_sent,
-                                  .iov_len = FrameHeader::wire_size - state.bytes_sent});
-        state.segments.push_back({.iov_base = payload->data(), .iov_len = payload->size()});
-    } else {
-        state.segments.push_back({.iov_base = payload->data() + (state.bytes_sent - FrameHeader::wire_size),
-                                  .iov_len = payload->size() - (state.bytes_sent - FrameHeader::wire_size)});
+    state.segments.push_back({.iov_base = state.compact ? state.compact_header.data() : state.header.data().data(),
+                              .iov_len = state.header_size});
+    state.segments.insert(state.segments.end(), state.payload.begin(), state.payload.end());
+
+    std::size_t skip = state.bytes_sent;
+    auto first = state.segments.begin();
+    while (skip >= first->iov_len) {
+        skip -= first->iov_len;
+        ++first;
+    }
+    first->iov_base = static_cast<std::byte*>(first->iov_base) + skip;
+    first->iov_len -= skip;
+    state.segments.erase(state.segments.begin(), first);
+
+    return {};
+}
+
+zportal::Result<void> zportal::Transmitter::kick_send_(Lane& lane) noexcept {
+    if (lane.state != LaneState::OPEN || lane.send_in_progress) {
+        return {};
+    }
+
+    if (!lane.current_frame_state && !lane.hello_pending && !lane.address && !lane.pong && !lane.ping_pending &&
+        lane.frame_queue.empty()) {
+        return {};
+    }
+
+    if (lane.shm) {
+        return kick_ring_(lane);
+    }
+
+    if (!lane.current_frame_state) {
+        if (const auto result = build_frame_(lane, lane.current_frame_state.emplace()); !result) {
+            lane.current_frame_state = std::nullopt;
+            return fail(result.error());
+        }
+    }
+
+    auto& state = *lane.current_frame_state;
+    if (const auto result = prepare_segments_(state); !result) {
+        return fail(result.error());
     }
 
     state.message_header = msghdr{};
     state.message_header.msg_iov = state.segments.data();
     state.message_header.msg_iovlen = state.segments.size();
 
+#if defined(UDP_SEGMENT)
+    if (state.segment_size != 0) {
+        state.message_header.msg_control = state.control.data();
+        state.message_header.msg_controllen = CMSG_SPACE(sizeof(state.segment_size));
+
+        auto* control = CMSG_FIRSTHDR(&state.message_header);
+        control->cmsg_level = IPPROTO_UDP;
+        control->cmsg_type = UDP_SEGMENT;
+        control->cmsg_len = CMSG_LEN(sizeof(state.segment_size));
+        std::memcpy(CMSG_DATA(control), &state.segment_size, sizeof(state.segment_size));
+    }
+#endif
+
+#if HAVE_LINUX_SCTP_H
+    // SCTP sends a message whole or not at all, a partial send never splits a frame between streams.
+    if (lane.streams > 1) {
+        sctp_sndinfo info{};
+        info.snd_sid = state.stream;
+
+        state.message_header.msg_control = state.control.data();
+        state.message_header.msg_controllen = CMSG_SPACE(sizeof(info));
+
+        auto* control = CMSG_FIRSTHDR(&state.message_header);
+        control->cmsg_level = IPPROTO_SCTP;
+        control->cmsg_type = SCTP_SNDINFO;
+        control->cmsg_len = CMSG_LEN(sizeof(info));
+        std::memcpy(CMSG_DATA(control), &info, sizeof(info));
+    }
+#endif
+
     auto sqe = ring_->get_sqe();
     if (!sqe) {
         return fail(sqe.error());
     }
 
-    Operation operation;
-    operation.set_type(OperationType::SEND);
+    const auto lane_index = static_cast<std::uint16_t>(&lane - lanes_.data());
+    const auto operation = Operation::make(OperationType::SEND, session_index_, lane_index);
 
-    ::io_uring_prep_sendmsg(*sqe, sock_->get(), &state.message_header, MSG_NOSIGNAL);
+    ::io_uring_prep_sendmsg(*sqe, lane.sock->get(), &state.message_header, MSG_NOSIGNAL);
     ::io_uring_sqe_set_data64(*sqe, operation.serialize());
 
+    // The kernel copies the timespec while submitting, so it only has to outlive submit() below.
+    __kernel_timespec ts{.tv_sec = send_timeout_.count() / 1000, .tv_nsec = (send_timeout_.count() % 1000) * 1000000};
+    if (send_timeout_.count() > 0) {
+        auto timeout_sqe = ring_->get_sqe();
+        if (!timeout_sqe) {
+            return fail(timeout_sqe.error());
+        }
+
+        const auto timeout_operation = Operation::make(OperationType::SEND_TIMEOUT, session_index_, lane_index);
+
+        (*sqe)->flags |= IOSQE_IO_LINK;
+        ::io_uring_prep_link_timeout(*timeout_sqe, &ts, 0);
+        ::io_uring_sqe_set_data64(*timeout_sqe, timeout_operation.serialize());
+    }
+
     if (const auto submit_result = ring_->submit(); !submit_result) {
         return fail(submit_result.error());
     }
 
-    send_in_progress_ = true;
+    lane.send_in_progress = true;
 
     return {};
 }
 
+zportal::Result<void> zportal::Transmitter::kick_ring_(Lane& lane) noexcept {
+    while (lane.current_frame_state || lane.hello_pending || lane.address || lane.pong || lane.ping_pending ||
+           !lane.frame_queue.empty()) {
+        if (!lane.current_frame_state) {
+            if (const auto result = build_frame_(lane, lane.current_frame_state.emplace()); !result) {
+                lane.current_frame_state = std::nullopt;
+                return fail(result.error());
+            }
+        }
+
+        auto& state = *lane.current_frame_state;
+        if (const auto result = prepare_segments_(state); !result) {
+            return fail(result.error());
+        }
+
+        const auto written = lane.shm.write(state.segments);
+        if (written == 0) {
+            // The flag goes up before the last look, a peer reading in between would otherwise never ring.
+            if (lane.shm.wait_for_space()) {
+                break;
+            }
+            continue;
+        }
+
+        if (lane.shm.take_reader_waiting() && ::eventfd_write(lane.peer_doorbell, 1) != 0) {
+            return fail({ErrorCode::EventFdFailed, errno});
+        }
+
+        if (const auto result = complete_send_(lane, written); !result) {
+            return fail(result.error());
+        }
+    }
+
+    return resume_read_();
+}
+
 zportal::Result<void> zportal::Transmitter::handle_send_cqe_(const Cqe& cqe) noexcept {
     if (!is_valid()) {
         return fail(ErrorCode::InvalidTransmitter);
@@ -261,49 +1075,218 @@ zportal::Result<void> zportal::Transmitter::handle_send_cqe_(const Cqe& cqe) noe
         return fail(ErrorCode::WrongOperationType);
     }
 
-    send_in_progress_ = false;
+    const auto lane_index = cqe.operation().get_slot();
+    if (lane_index >= lanes_.size()) {
+        return fail(ErrorCode::InvalidState);
+    }
+
+    auto& lane = lanes_[lane_index];
+    lane.send_in_progress = false;
+
+    // The lane was closed while this SEND was in flight, whatever the result its frame is dropped now.
+    if (lane.state == LaneState::CLOSING) {
+        lane.state = LaneState::CLOSED;
+        lane.sock = nullptr;
+        if (const auto result = drop_queued_(lane, 0); !result) {
+            return fail(result.error());
+        }
+
+        return resume_read_();
+    }
+
+    // Whatever part of the frame made it out went over the old socket, it's sent again once resumed.
+    if (lane.state == LaneState::SUSPENDED) {
+        lane.current_frame_state = std::nullopt;
+        return {};
+    }
 
     if (!cqe.ok()) {
+        if (cqe.error() == ECANCELED && send_timeout_.count() > 0) {
+            return fail({ErrorCode::SendTimeout, ETIMEDOUT});
+        }
+
         return fail({ErrorCode::SendFailed, cqe.error()});
     }
 
+    Monitor::record_latency(OperationType::SEND, cqe.operation().elapsed());
+
     const auto sent = static_cast<std::size_t>(cqe.result());
 
     if (sent == 0) {
         return fail(ErrorCode::SendReturnedZero);
     }
 
-    if (!current_frame_state_) {
+    if (const auto result = complete_send_(lane, sent); !result) {
+        return fail(result.error());
+    }
+
+    if (const auto result = resume_read_(); !result) {
+        return fail(result.error());
+    }
+
+    return kick_send_(lane);
+}
+
+zportal::Result<void> zportal::Transmitter::complete_send_(Lane& lane, std::size_t sent) noexcept {
+    if (!lane.current_frame_state) {
         return fail(ErrorCode::InvalidState);
     }
 
-    auto& state = *current_frame_state_;
+    auto& state = *lane.current_frame_state;
 
-    const std::size_t total = FrameHeader::wire_size + static_cast<std::size_t>(state.frame.size);
+    const std::size_t total = state.header_size + static_cast<std::size_t>(state.header.get_size()) + state.train_size;
     if (state.bytes_sent + sent > total) {
         return fail(ErrorCode::InvalidState);
     }
 
     state.bytes_sent += sent;
     if (state.bytes_sent == total) {
-        const auto bid = state.frame.bid;
-        current_frame_state_ = std::nullopt;
-        frame_queue_.pop();
+        const auto frames = state.frames;
+        lane.current_frame_state = std::nullopt;
 
-        if (const auto result = bg_->return_buffer(bid); !result) {
-            return fail(result.error());
+        // Nothing goes out before the hello, so a control frame completing while it's pending is the hello.
+        if (frames == 0) {
+            lane.hello_pending = false;
         }
-    }
 
-    if (cooling_down_) {
-        if (frame_queue_.size() <= bg_->get_buffer_count() / 2) {
-            if (const auto result = arm_read(); !result) {
+        // A bulk frame got its turn, interactive ones may jump ahead again.
+        if (frames > lane.priority_end) {
+            lane.priority_burst = 0;
+        }
+        lane.priority_end -= std::min(lane.priority_end, frames);
+
+        for (std::size_t i = 0; i < frames; i++) {
+            const auto frame = lane.frame_queue.front();
+            lane.frame_queue.pop_front();
+            if (frame.bulk) {
+                lane.bulk_flows[frame.flow % flow_buckets]--;
+            }
+
+            if (const auto result = return_frame_buffer_(frame); !result) {
                 return fail(result.error());
             }
+        }
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Transmitter::handle_send_timeout_cqe_(const Cqe& cqe) noexcept {
+    if (cqe.operation().get_type() != OperationType::SEND_TIMEOUT) {
+        return fail(ErrorCode::WrongOperationType);
+    }
+
+    // A closed lane's SEND already finished its frame, a late timer says nothing about the lanes still open.
+    // Once the SEND completed, its own CQE already reported the cancellation.
+    const auto lane_index = cqe.operation().get_slot();
+    if (lane_index >= lanes_.size() || lanes_[lane_index].state != LaneState::OPEN ||
+        !lanes_[lane_index].send_in_progress) {
+        return {};
+    }
 
-            cooling_down_ = false;
+    // -ETIME means the timer fired and cancelled the SEND, anything else means the SEND finished first.
+    if (!cqe.ok() && cqe.error() == ETIME) {
+        return fail({ErrorCode::SendTimeout, ETIMEDOUT});
+    }
+
+    return {};
+}
+
+zportal::Result<void> zportal::Transmitter::handle_keepalive_cqe_(const Cqe& cqe) noexcept {
+    if (cqe.operation().get_type() != OperationType::KEEPALIVE) {
+        return fail(ErrorCode::WrongOperationType);
+    }
+
+    if (read_stopped_) {
+        return {};
+    }
+
+    // A lane still waiting for its SEND pings once that completes, not once per missed interval.
+    for (auto& lane : lanes_) {
+        if (lane.state != LaneState::OPEN || !lane.negotiated.has(Hello::KEEPALIVE)) {
+            continue;
+        }
+
+        lane.ping_pending = true;
+        if (const auto result = kick_send_(lane); !result) {
+            return fail(result.error());
         }
     }
 
-    return kick_send_();
+    return arm_keepalive();
+}
+
+zportal::Result<void> zportal::Transmitter::resume_read_() noexcept {
+    if (!cooling_down_ || read_bg_->get_used_count() > read_bg_->get_buffer_count() / 2) {
+        return {};
+    }
+
+    if (const auto result = arm_read(); !result) {
+        return fail(result.error());
+    }
+
+    cooling_down_ = false;
+
+    return {};
+}
+
+zportal::Result<zportal::Transmitter::Lane*> zportal::Transmitter::route_(const OutFrame& frame) noexcept {
+    // Suspended lanes keep queueing, once the read group runs dry reads pause instead of dropping.
+    const auto accepts = [](const Lane& lane) noexcept {
+        return lane.state == LaneState::OPEN || lane.state == LaneState::SUSPENDED;
+    };
+
+    if (routes_ == nullptr && lanes_.size() == 1) {
+        auto& lane = lanes_.front();
+        return accepts(lane) ? &lane : nullptr;
+    }
+
+    const auto packet = read_bg_->get_buffer(frame.id.bid, frame.size);
+    if (!packet) {
+        return fail(packet.error());
+    }
+
+    if (routes_ == nullptr) {
+        auto& lane = lanes_[flow_hash(*packet) % lanes_.size()];
+        return accepts(lane) ? &lane : nullptr;
+    }
+
+    const auto destination = ip_destination(*packet);
+    if (!destination) {
+        return nullptr;
+    }
+
+    const auto index = routes_->lookup(*destination);
+    if (!index || *index >= lanes_.size()) {
+        return nullptr;
+    }
+
+    auto& lane = lanes_[*index];
+    if (lane.state != LaneState::OPEN || lane.frame_queue.size() >= lane_queue_limit_) {
+        return nullptr;
+    }
+
+    return &lane;
+}
+
+zportal::Result<void> zportal::Transmitter::drop_queued_(Lane& lane, std::size_t keep) noexcept {
+    while (lane.frame_queue.size() > keep) {
+        const auto frame = lane.frame_queue.back();
+        lane.frame_queue.pop_back();
+        if (frame.bulk) {
+            lane.bulk_flows[frame.flow % flow_buckets]--;
+        }
+
+        if (const auto result = return_frame_buffer_(frame); !result) {
+            return fail(result.error());
+        }
+    }
+    lane.priority_end = std::min(lane.priority_end, lane.frame_queue.size());
+
+    // An in flight hello keeps its state until its CQE.
+    if (lane.frame_queue.empty() && !lane.send_in_progress) {
+        lane.current_frame_state = std::nullopt;
+    }
+
+    return {};
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include <limits>
+#include <span>
+
+#include <cstddef>
+
+#if HAVE_LZ4
+    #include <lz4.h>
+#endif
+
+#include <zportal/tools/compression.hpp>
+#include <zportal/tools/error.hpp>
+
+namespace {
+
+constexpr std::size_t max_block_size = std::numeric_limits<int>::max();
+
+} // namespace
+
+bool zportal::compression::is_available() noexcept {
+    return HAVE_LZ4 != 0;
+}
+
+std::size_t zportal::compression::bound(std::size_t size) noexcept {
+#if HAVE_LZ4
+    if (size > LZ4_MAX_INPUT_SIZE) {
+        return 0;
+    }
+
+    return static_cast<std::size_t>(::LZ4_compressBound(static_cast<int>(size)));
+#else
+    return size;
+#endif
+}
+
+std::size_t zportal::compression::compress(std::span<const std::byte> input, std::span<std::byte> output) noexcept {
+#if HAVE_LZ4
+    if (input.size() > LZ4_MAX_INPUT_SIZE || output.size() > max_block_size) {
+        return 0;
+    }
+
+    const int size =
+        ::LZ4_compress_default(reinterpret_cast<const char*>(input.data()), reinterpret_cast<char*>(output.data()),
+                               static_cast<int>(input.size()), static_cast<int>(output.size()));
+    return size > 0 ? static_cast<std::size_t>(size) : 0;
+#else
+    (void)input;
+    (void)output;
+    return 0;
+#endif
+}
+
+zportal::Result<std::size_t> zportal::compression::decompress(std::span<const std::byte> input,
+                                                               std::span<std::byte> output) noexcept {
+#if HAVE_LZ4
+    if (input.size() > max_block_size || output.size() > max_block_size) {
+        return fail(ErrorCode::DecompressFailed);
+    }
+
+    const int size =
+        ::LZ4_decompress_safe(reinterpret_cast<const char*>(input.data()), reinterpret_cast<char*>(output.data()),
+                              static_cast<int>(input.size()), static_cast<int>(output.size()));
+    if (size <= 0) {
+        return fail(ErrorCode::DecompressFailed);
+    }
+
+    return static_cast<std::size_t>(size);
+#else
+    (void)input;
+    (void)output;
+    return fail(ErrorCode::DecompressFailed);
+#endif
+}
@@ -1,13 +1,22 @@
+#include <chrono>
 #include <exception>
 #include <iostream>
 #include <limits>
 #include <string>
+#include <variant>
 
+#include <cstddef>
 #include <cstdlib>
 
 #include <unistd.h>
 
 #include <zportal/tools/config.hpp>
+#include <zportal/tools/system.hpp>
+
+// MAX_TAP_QUEUES of the tun driver.
+constexpr long long max_tun_queues = 256;
+
+constexpr long long max_stripes = 64;
 
 constexpr auto help = [](zportal::Config& config, const std::string& program_name) {
     std::cout << "Usage:" << '\n';
@@ -20,6 +29,21 @@ constexpr auto help = [](zportal::Config& config, const std::string& program_nam
     std::cout << "-b <bind address> \tServer mode." << '\n';
     std::cout << "-c <connect address> \tClient mode." << '\n';
     std::cout << "-p <proxy> \t\tProxy address." << '\n';
+    std::cout << "-t <tcp|udp|sctp|shm> \tTunnel transport, UDP and SCTP send each frame on its own." << '\n';
+    std::cout << "\t\t\tSHM shares memory with a peer on this host, over a Unix socket address." << '\n';
+    std::cout << "-K \t\t\tLet the kernel allocate provided buffer rings." << '\n';
+    std::cout << "-N <node|ifname> \tPlace buffers on a NUMA node, or on the node of a NIC." << '\n';
+    std::cout << "-S <ms> \t\tFail when a send doesn't complete in time. 0 disables." << '\n';
+    std::cout << "-R <ms> \t\tFail when nothing is received in time. 0 disables." << '\n';
+    std::cout << "-k <ms> \t\tPing the peer every <ms> to measure RTT and keep -R fed. 0 disables." << '\n';
+    std::cout << "-I <full|header|none> \tWeakest frame check accepted, the peer's choice may be stricter." << '\n';
+    std::cout << "-r <ms> \t\tReconnect when the connection breaks, backing off up to <ms>. 0 disables." << '\n';
+    std::cout << "-D <ms> \t\tOn SIGTERM or SIGINT, drain queued frames for up to <ms> before exiting." << '\n';
+    std::cout << "-B <us> \t\tBusy-poll the tunnel socket for up to <us> microseconds." << '\n';
+    std::cout << "-P \t\t\tPrefer busy polling over interrupts, needs -B." << '\n';
+    std::cout << "-M <count> \t\tServe up to <count> peers at once, each given an address of -a. Needs -b." << '\n';
+    std::cout << "-T <count> \t\tRun <count> pinned threads, each with its own TUN queue and connection." << '\n';
+    std::cout << "-L <count> \t\tStripe inner flows over <count> parallel connections." << '\n';
     std::cout << '\n';
     std::cout << "-h \tPrint this help info." << '\n';
     std::cout << "-v \tPrint version." << '\n';
@@ -36,7 +60,7 @@ std::exception_ptr zportal::parse_cli_arguments(zportal::Config& config, int arg
     end = false;
     try {
         int opt;
-        while ((opt = ::getopt(argn, argv, ":n:m:a:c:b:p:hv")) != -1) {
+        while ((opt = ::getopt(argn, argv, ":n:m:a:c:b:p:t:KN:S:R:k:I:r:D:B:PM:T:L:hv")) != -1) {
             switch (opt) {
             case 'n': {
                 config.interface_name = optarg;
@@ -73,6 +97,142 @@ std::exception_ptr zportal::parse_cli_arguments(zportal::Config& config, int arg
                 break;
             }
 
+            case 't': {
+                const std::string transport = optarg;
+                if (transport == "tcp") {
+                    config.transport = zportal::Transport::TCP;
+                } else if (transport == "udp") {
+                    config.transport = zportal::Transport::UDP;
+                } else if (transport == "sctp") {
+                    config.transport = zportal::Transport::SCTP;
+                } else if (transport == "shm") {
+                    config.transport = zportal::Transport::SHM;
+                } else {
+                    throw std::invalid_argument("transport must be 'tcp', 'udp', 'sctp' or 'shm'");
+                }
+                break;
+            }
+
+            case 'K': {
+                config.kernel_buffer_rings = true;
+                break;
+            }
+
+            case 'N': {
+                const std::string node = optarg;
+                if (!node.empty() && node.find_first_not_of("0123456789") == std::string::npos) {
+                    config.numa_node = std::stoi(node);
+                } else {
+                    const auto nic_node = zportal::system::get_interface_numa_node(node);
+                    if (!nic_node) {
+                        throw std::invalid_argument("can't find NUMA node of '" + node + "'");
+                    }
+
+                    config.numa_node = *nic_node;
+                }
+                break;
+            }
+
+            case 'S':
+            case 'R': {
+                const auto timeout = std::stoll(optarg);
+                if (timeout < 0) {
+                    throw std::invalid_argument("timeout can't be negative");
+                }
+
+                (opt == 'S' ? config.send_timeout : config.recv_timeout) = std::chrono::milliseconds(timeout);
+                break;
+            }
+
+            case 'k': {
+                const auto interval = std::stoll(optarg);
+                if (interval < 0) {
+                    throw std::invalid_argument("keepalive interval can't be negative");
+                }
+
+                config.keepalive_interval = std::chrono::milliseconds(interval);
+                break;
+            }
+
+            case 'I': {
+                const std::string integrity = optarg;
+                if (integrity == "full") {
+                    config.integrity = zportal::Integrity::FULL;
+                } else if (integrity == "header") {
+                    config.integrity = zportal::Integrity::HEADER;
+                } else if (integrity == "none") {
+                    config.integrity = zportal::Integrity::NONE;
+                } else {
+                    throw std::invalid_argument("integrity must be 'full', 'header' or 'none'");
+                }
+                break;
+            }
+
+            case 'r': {
+                const auto backoff = std::stoll(optarg);
+                if (backoff < 0) {
+                    throw std::invalid_argument("reconnect backoff can't be negative");
+                }
+
+                config.reconnect_backoff = std::chrono::milliseconds(backoff);
+                break;
+            }
+
+            case 'D': {
+                const auto timeout = std::stoll(optarg);
+                if (timeout < 0) {
+                    throw std::invalid_argument("drain timeout can't be negative");
+                }
+
+                config.drain_timeout = std::chrono::milliseconds(timeout);
+                break;
+            }
+
+            case 'B': {
+                const auto timeout = std::stoll(optarg);
+                if (timeout < 0 || timeout > std::numeric_limits<int>::max()) {
+                    throw std::invalid_argument("busy poll timeout out of range");
+                }
+
+                config.busy_poll = std::chrono::microseconds(timeout);
+                break;
+            }
+
+            case 'P': {
+                config.prefer_busy_poll = true;
+                break;
+            }
+
+            case 'M': {
+                const auto peers = std::stoll(optarg);
+                if (peers < 1 || peers > std::numeric_limits<std::uint16_t>::max()) {
+                    throw std::invalid_argument("peer count must be min 1 max 65535");
+                }
+
+                config.max_peers = static_cast<std::uint16_t>(peers);
+                break;
+            }
+
+            case 'T': {
+                const auto shards = std::stoll(optarg);
+                if (shards < 1 || shards > max_tun_queues) {
+                    throw std::invalid_argument("thread count must be min 1 max " + std::to_string(max_tun_queues));
+                }
+
+                config.shards = static_cast<std::uint16_t>(shards);
+                break;
+            }
+
+            case 'L': {
+                const auto stripes = std::stoll(optarg);
+                if (stripes < 1 || stripes > max_stripes) {
+                    throw std::invalid_argument("connection count must be min 1 max " + std::to_string(max_stripes));
+                }
+
+                config.stripes = static_cast<std::uint16_t>(stripes);
+                break;
+            }
+
             case 'h': {
                 help(config, argv[0]);
                 end = true;
@@ -120,6 +280,65 @@ std::exception_ptr zportal::parse_cli_arguments(zportal::Config& config, int arg
             throw std::invalid_argument("exactly one of '-b' or '-c' must be set");
         }
 
+        if (config.prefer_busy_poll && config.busy_poll.count() == 0) {
+            throw std::invalid_argument("'-P' needs a busy poll timeout set with '-B'");
+        }
+
+        if (config.max_peers > 0 && !config.bind_address) {
+            throw std::invalid_argument("'-M' needs server mode set with '-b'");
+        }
+
+        if (config.max_peers > 0 && config.shards > 1) {
+            throw std::invalid_argument("'-M' and '-T' can't be combined");
+        }
+
+        // Every peer slot takes an address of the '-a' network besides the server's own, an IPv4
+        // network also loses its network and broadcast addresses.
+        if (config.max_peers > 0) {
+            const bool ip4 = config.inner_address.is_ip4();
+            const std::size_t host_bits = (ip4 ? 32 : 128) - config.inner_address.get_prefix();
+            const std::size_t needed = std::size_t{config.max_peers} + (ip4 ? 3 : 2);
+            if (host_bits < 32 && needed > (std::size_t{1} << host_bits)) {
+                throw std::invalid_argument("'-a' network has no room for '-M' peers");
+            }
+        }
+
+        if (config.stripes > 1 && (config.max_peers > 0 || config.shards > 1)) {
+            throw std::invalid_argument("'-L' can't be combined with '-M' or '-T'");
+        }
+
+        if (config.reconnect_backoff.count() > 0 && (config.max_peers > 0 || config.shards > 1)) {
+            throw std::invalid_argument("'-r' can't be combined with '-M' or '-T'");
+        }
+
+        if (config.transport == zportal::Transport::UDP) {
+            if (!config.proxies.empty() || config.max_peers > 0 || config.shards > 1 || config.stripes > 1 ||
+                config.reconnect_backoff.count() > 0 || config.integrity != zportal::Integrity::FULL) {
+                throw std::invalid_argument("'-t udp' can't be combined with '-p', '-M', '-T', '-L', '-r' or '-I'");
+            }
+
+            // GRO hands over up to 64 KiB at once, smaller classes would cut such bursts short.
+            config.rx_buffer_classes.push_back({65536, 64});
+        }
+
+        if (config.transport == zportal::Transport::SCTP &&
+            (!config.proxies.empty() || config.shards > 1 || config.integrity != zportal::Integrity::FULL)) {
+            throw std::invalid_argument("'-t sctp' can't be combined with '-p', '-T' or '-I'");
+        }
+
+        if (config.transport == zportal::Transport::SHM) {
+            if (!config.proxies.empty() || config.max_peers > 0 || config.shards > 1 || config.stripes > 1 ||
+                config.reconnect_backoff.count() > 0) {
+                throw std::invalid_argument("'-t shm' can't be combined with '-p', '-M', '-T', '-L' or '-r'");
+            }
+
+            const auto& address = config.bind_address ? *config.bind_address : *config.connect_address;
+            const auto* sock_address = std::get_if<zportal::SockAddress>(&address);
+            if (sock_address == nullptr || !sock_address->is_unix()) {
+                throw std::invalid_argument("'-t shm' needs a Unix socket address");
+            }
+        }
+
     } catch (...) {
         return std::current_exception();
     }
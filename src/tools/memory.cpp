@@ -0,0 +1,133 @@
+#include <optional>
+#include <utility>
+
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <zportal/tools/debug.hpp>
+#include <zportal/tools/error.hpp>
+#include <zportal/tools/memory.hpp>
+
+static constexpr int max_numa_node = static_cast<int>(sizeof(unsigned long) * CHAR_BIT) - 1;
+
+zportal::Result<zportal::MappedMemory> zportal::MappedMemory::allocate(std::size_t size,
+                                                                       std::optional<int> numa_node) noexcept {
+    if (size == 0) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    if (numa_node && (*numa_node < 0 || *numa_node > max_numa_node)) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return fail({ErrorCode::MmapFailed, errno});
+    }
+
+    MappedMemory memory;
+    memory.data_ = static_cast<std::byte*>(ptr);
+    memory.size_ = size;
+
+    if (numa_node) {
+        // Pages are not faulted in yet, so the policy decides where they will land.
+        const unsigned long mask = 1UL << static_cast<unsigned>(*numa_node);
+        if (::syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, &mask, sizeof(mask) * CHAR_BIT, 0) != 0) {
+            return fail({ErrorCode::MbindFailed, errno});
+        }
+    }
+
+    std::memset(ptr, 0, size);
+
+    return memory;
+}
+
+zportal::MappedMemory::MappedMemory(MappedMemory&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+zportal::MappedMemory& zportal::MappedMemory::operator=(MappedMemory&& other) noexcept {
+    if (&other == this) {
+        return *this;
+    }
+
+    release();
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+
+    return *this;
+}
+
+zportal::MappedMemory::~MappedMemory() noexcept {
+    release();
+}
+
+void zportal::MappedMemory::release() noexcept {
+    if (data_ == nullptr) {
+        return;
+    }
+
+    if (::munmap(data_, size_) != 0) {
+        DEBUG_ERRNO(errno, "munmap()");
+    }
+
+    data_ = nullptr;
+    size_ = 0;
+}
+
+std::byte* zportal::MappedMemory::data() const noexcept {
+    return data_;
+}
+
+std::size_t zportal::MappedMemory::size() const noexcept {
+    return size_;
+}
+
+bool zportal::MappedMemory::empty() const noexcept {
+    return data_ == nullptr;
+}
+
+zportal::Result<zportal::PreferredNodeScope> zportal::PreferredNodeScope::enter(std::optional<int> numa_node) noexcept {
+    PreferredNodeScope scope;
+    if (!numa_node) {
+        return scope;
+    }
+
+    if (*numa_node < 0 || *numa_node > max_numa_node) {
+        return fail(ErrorCode::InvalidArgument);
+    }
+
+    if (::syscall(SYS_get_mempolicy, &scope.saved_mode_, &scope.saved_mask_, sizeof(scope.saved_mask_) * CHAR_BIT,
+                  nullptr, 0) != 0) {
+        return fail({ErrorCode::SetMempolicyFailed, errno});
+    }
+
+    const unsigned long mask = 1UL << static_cast<unsigned>(*numa_node);
+    if (::syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * CHAR_BIT) != 0) {
+        return fail({ErrorCode::SetMempolicyFailed, errno});
+    }
+
+    scope.active_ = true;
+
+    return scope;
+}
+
+zportal::PreferredNodeScope::PreferredNodeScope(PreferredNodeScope&& other) noexcept
+    : active_(std::exchange(other.active_, false)), saved_mode_(other.saved_mode_), saved_mask_(other.saved_mask_) {}
+
+zportal::PreferredNodeScope::~PreferredNodeScope() noexcept {
+    if (!active_) {
+        return;
+    }
+
+    const unsigned long* mask = saved_mode_ == MPOL_DEFAULT ? nullptr : &saved_mask_;
+    if (::syscall(SYS_set_mempolicy, saved_mode_, mask, mask == nullptr ? 0 : sizeof(saved_mask_) * CHAR_BIT) != 0) {
+        DEBUG_ERRNO(errno, "set_mempolicy()");
+    }
+}
@@ -1,5 +1,11 @@
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <iostream>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
 
 #include <liburing.h>
 
@@ -11,6 +17,7 @@
 #include <zportal/tools/monitor.hpp>
 
 const zportal::TunDevice* zportal::Monitor::tun_device_{nullptr};
+thread_local std::array<zportal::Monitor::LatencyStats, 8> zportal::Monitor::latency_{};
 
 zportal::Result<void> zportal::Monitor::print() noexcept {
     if (tun_device_ == nullptr) {
@@ -24,7 +31,20 @@ zportal::Result<void> zportal::Monitor::print() noexcept {
     }
 
     std::cout << "\r\033[KTotal RX: \033[32m" << stats->rx_bytes << " Bytes\033[0m\t Total TX: \033[31m"
-              << stats->tx_bytes << " Bytes\033[0m" << std::flush;
+              << stats->tx_bytes << " Bytes\033[0m";
+
+    for (const auto& [type, name] :
+         {std::pair{OperationType::SEND, "SEND"}, std::pair{OperationType::WRITE, "WRITE"}}) {
+        auto& latency = latency_[static_cast<std::size_t>(type)];
+        if (latency.count == 0) {
+            continue;
+        }
+
+        std::cout << "\t " << name << ": " << latency.total_us / latency.count << "/" << latency.max_us << " us";
+        latency = {};
+    }
+
+    std::cout << std::flush;
 
     return {};
 }
@@ -36,8 +56,7 @@ zportal::Result<void> zportal::Monitor::arm_timeout(zportal::IoUring& ring,
         return fail(sqe.error());
     }
 
-    Operation operation;
-    operation.set_type(OperationType::TIMEOUT);
+    const auto operation = Operation::make(OperationType::TIMEOUT);
 
     __kernel_timespec ts{.tv_sec = timeout.count() / 1000, .tv_nsec = (timeout.count() % 1000) * 1000000};
 
@@ -75,4 +94,17 @@ zportal::Result<void> zportal::Monitor::handle_cqe(zportal::IoUring& ring, const
 
 void zportal::Monitor::set_tun_device(const zportal::TunDevice& tun_device) noexcept {
     tun_device_ = &tun_device;
+}
+
+void zportal::Monitor::record_latency(OperationType type, std::chrono::microseconds latency) noexcept {
+    const auto index = static_cast<std::size_t>(type);
+    if (index >= latency_.size()) {
+        return;
+    }
+
+    const auto us = static_cast<std::uint64_t>(latency.count());
+    auto& stats = latency_[index];
+    stats.count++;
+    stats.total_us += us;
+    stats.max_us = std::max(stats.max_us, us);
 }
\ No newline at end of file
@@ -92,6 +92,70 @@ zportal::Result<bool> zportal::support_check::recv_multishot() noexcept {
     return *cache;
 }
 
+zportal::Result<bool> zportal::support_check::accept_multishot() noexcept {
+    static std::optional<bool> cache{};
+    if (cache) {
+        return *cache;
+    }
+
+#if HAVE_IO_URING_PREP_MULTISHOT_ACCEPT
+    auto ring = IoUring::create_queue(1);
+    if (!ring) {
+        return fail(ring.error());
+    }
+
+    auto listener = Socket::create_socket(AF_UNIX, SOCK_CLOEXEC);
+    if (!listener) {
+        return fail(listener.error());
+    }
+
+    // Binding only the family autobinds an abstract address.
+    const sa_family_t family = AF_UNIX;
+    if (::bind(listener->get(), reinterpret_cast<const sockaddr*>(&family), sizeof(family)) != 0) {
+        return fail({ErrorCode::BindFailed, errno});
+    }
+    if (::listen(listener->get(), 1) != 0) {
+        return fail({ErrorCode::ListenFailed, errno});
+    }
+
+    const auto address = listener->get_local_address();
+    if (!address) {
+        return fail(address.error());
+    }
+
+    auto sqe = ring->get_sqe();
+    if (!sqe) {
+        return fail(sqe.error());
+    }
+
+    ::io_uring_prep_multishot_accept(*sqe, listener->get(), nullptr, nullptr, SOCK_CLOEXEC);
+    if (auto result = ring->submit(); !result) {
+        return fail(result.error());
+    }
+
+    auto client = Socket::create_socket(AF_UNIX, SOCK_CLOEXEC);
+    if (!client) {
+        return fail(client.error());
+    }
+    if (::connect(client->get(), address->get(), address->length()) != 0) {
+        return fail({ErrorCode::ConnectFailed, errno});
+    }
+
+    const auto cqe = ring->wait();
+    if (!cqe) {
+        return fail(cqe.error());
+    }
+
+    // Kernels without multishot accept reject the flag with -EINVAL.
+    const Socket accepted(cqe->ok() ? cqe->result() : -1);
+    cache = cqe->ok() && cqe->more();
+#else
+    cache = false;
+#endif
+
+    return *cache;
+}
+
 #if defined(__x86_64__) || defined(__i386__)
     #include <cpuid.h>
 #endif
@@ -1,9 +1,17 @@
+#include <fstream>
+#include <new>
+#include <string>
+
 #include <cerrno>
+#include <csignal>
 #include <cstddef>
 
+#include <pthread.h>
+#include <sys/signalfd.h>
 #include <unistd.h>
 
 #include <zportal/tools/error.hpp>
+#include <zportal/tools/file_descriptor.hpp>
 #include <zportal/tools/system.hpp>
 
 zportal::Result<std::size_t> zportal::system::get_page_size() noexcept {
@@ -13,4 +21,50 @@ zportal::Result<std::size_t> zportal::system::get_page_size() noexcept {
     }
 
     return static_cast<std::size_t>(result);
-}
\ No newline at end of file
+}
+
+zportal::Result<int> zportal::system::get_interface_numa_node(const std::string& ifname) noexcept {
+    int node = -1;
+
+    try {
+        std::ifstream file("/sys/class/net/" + ifname + "/device/numa_node");
+        if (!file) {
+            return fail({ErrorCode::NumaNodeUnknown, errno});
+        }
+
+        file >> node;
+        if (!file) {
+            return fail(ErrorCode::NumaNodeUnknown);
+        }
+    } catch (const std::bad_alloc&) {
+        return fail(ErrorCode::NotEnoughMemory);
+    }
+
+    // Virtual devices and single node machines report -1.
+    if (node < 0) {
+        return fail(ErrorCode::NumaNodeUnknown);
+    }
+
+    return node;
+}
+
+zportal::Result<zportal::FileDescriptor> zportal::system::create_signal_fd(std::span<const int> signals) noexcept {
+    sigset_t set;
+    ::sigemptyset(&set);
+    for (const int signal : signals) {
+        if (::sigaddset(&set, signal) != 0) {
+            return fail({ErrorCode::SignalFdFailed, errno});
+        }
+    }
+
+    if (const int error = ::pthread_sigmask(SIG_BLOCK, &set, nullptr); error != 0) {
+        return fail({ErrorCode::SignalFdFailed, error});
+    }
+
+    const int fd = ::signalfd(-1, &set, SFD_CLOEXEC);
+    if (fd < 0) {
+        return fail({ErrorCode::SignalFdFailed, errno});
+    }
+
+    return FileDescriptor(fd);
+}
@@ -0,0 +1,88 @@
+# Shared by the e2e benchmarks, sourced once NS_SERVER, NS_CLIENT, SERVER_LOG and CLIENT_LOG are set.
+# Scripts add their own logs to E2E_LOGS as "name:path", the names of other PID variables to E2E_PIDS
+# and any other files to E2E_PATHS. All of them are cleaned up on exit, the logs dumped on failure.
+
+SERVER_PID=
+CLIENT_PID=
+
+E2E_LOGS=("server:${SERVER_LOG}" "client:${CLIENT_LOG}")
+E2E_PIDS=()
+E2E_PATHS=()
+
+dump_logs() {
+    local entry
+    for entry in "${E2E_LOGS[@]}"; do
+        echo "--- ${entry%%:*} log ---"
+        if [[ -f ${entry#*:} ]]; then
+            cat "${entry#*:}"
+        else
+            echo "<missing>"
+        fi
+    done
+}
+
+stop_pid() {
+    if [[ -n $1 ]]; then
+        kill "$1" 2>/dev/null
+        wait "$1" 2>/dev/null
+    fi
+}
+
+stop_tunnel() {
+    set +e
+
+    stop_pid "${SERVER_PID}"
+    stop_pid "${CLIENT_PID}"
+
+    SERVER_PID=
+    CLIENT_PID=
+
+    set -e
+}
+
+cleanup() {
+    stop_tunnel
+    set +e
+
+    local name
+    for name in "${E2E_PIDS[@]}"; do
+        stop_pid "${!name}"
+    done
+
+    ip netns del "${NS_SERVER}" 2>/dev/null
+    ip netns del "${NS_CLIENT}" 2>/dev/null
+
+    local entry
+    for entry in "${E2E_LOGS[@]}"; do
+        rm -f "${entry#*:}"
+    done
+    if [[ ${#E2E_PATHS[@]} -gt 0 ]]; then
+        rm -rf "${E2E_PATHS[@]}"
+    fi
+}
+
+on_exit() {
+    status=$?
+    if [[ ${status} -ne 0 ]]; then
+        dump_logs
+    fi
+    cleanup
+    exit "${status}"
+}
+
+trap on_exit EXIT
+
+wait_for() {
+    local description=$1
+    shift
+
+    for _ in $(seq 1 100); do
+        if "$@" >/dev/null 2>&1; then
+            return 0
+        fi
+        sleep 0.1
+    done
+
+    echo "Timed out waiting for ${description}" >&2
+    return 1
+}
@@ -0,0 +1,105 @@
+#!/usr/bin/env bash
+set -Eeuo pipefail
+
+if [[ $# -lt 1 ]]; then
+    echo "Usage: $0 <path-to-zportald> [thread counts...]" >&2
+    exit 2
+fi
+
+if [[ ${EUID} -ne 0 ]]; then
+    echo "This benchmark needs root privileges for TUN, veth and network namespaces. Run it with sudo." >&2
+    exit 2
+fi
+
+ZPORTALD=$1
+shift
+if [[ ! -x ${ZPORTALD} ]]; then
+    echo "zportald is not executable: ${ZPORTALD}" >&2
+    exit 2
+fi
+
+if ! command -v iperf3 >/dev/null 2>&1; then
+    echo "This benchmark needs iperf3." >&2
+    exit 2
+fi
+
+THREADS=("$@")
+if [[ ${#THREADS[@]} -eq 0 ]]; then
+    THREADS=(1 2 4)
+fi
+
+FLOWS=${FLOWS:-32}
+DURATION=${DURATION:-10}
+
+TEST_ID="zportal-shards-$$"
+NS_SERVER="${TEST_ID}-server"
+NS_CLIENT="${TEST_ID}-client"
+SERVER_LOG="/tmp/${TEST_ID}-server.log"
+CLIENT_LOG="/tmp/${TEST_ID}-client.log"
+IPERF_LOG="/tmp/${TEST_ID}-iperf.json"
+
+source "$(dirname "${BASH_SOURCE[0]}")/lib.sh"
+
+IPERF_PID=
+E2E_PIDS+=(IPERF_PID)
+E2E_PATHS+=("${IPERF_LOG}")
+
+ip netns add "${NS_SERVER}"
+ip netns add "${NS_CLIENT}"
+
+ip link add zpshard0 netns "${NS_SERVER}" type veth peer name zpshard1 netns "${NS_CLIENT}"
+ip -n "${NS_SERVER}" addr add 192.0.2.1/24 dev zpshard0
+ip -n "${NS_CLIENT}" addr add 192.0.2.2/24 dev zpshard1
+ip -n "${NS_SERVER}" link set zpshard0 up
+ip -n "${NS_CLIENT}" link set zpshard1 up
+
+ip netns exec "${NS_SERVER}" iperf3 -s >/dev/null 2>&1 &
+IPERF_PID=$!
+
+# Runs one tunnel with the given thread count and stores the received throughput in Gbit/s in GBPS.
+measure() {
+    local threads=$1
+
+    ip netns exec "${NS_SERVER}" "${ZPORTALD}" \
+        -n zptshard0 \
+        -m 1400 \
+        -a 10.90.0.1/24 \
+        -b 192.0.2.1:7200 \
+        -T "${threads}" \
+        >"${SERVER_LOG}" 2>&1 &
+    SERVER_PID=$!
+
+    wait_for "server listener" ip netns exec "${NS_SERVER}" ss -Htln 'sport = :7200'
+
+    ip netns exec "${NS_CLIENT}" "${ZPORTALD}" \
+        -n zptshard1 \
+        -m 1400 \
+        -a 10.90.0.2/24 \
+        -c 192.0.2.1:7200 \
+        -T "${threads}" \
+        >"${CLIENT_LOG}" 2>&1 &
+    CLIENT_PID=$!
+
+    wait_for "tunnel" ip netns exec "${NS_CLIENT}" ping -c 1 -W 1 10.90.0.1
+
+    # Many flows with distinct ports, so the flow hash spreads them over every TUN queue.
+    ip netns exec "${NS_CLIENT}" iperf3 -c 10.90.0.1 -P "${FLOWS}" -t "${DURATION}" -J >"${IPERF_LOG}"
+
+    stop_tunnel
+
+    GBPS=$(sed -n '/"sum_received"/,/}/s/.*"bits_per_second":[[:space:]]*\([0-9.e+]*\).*/\1/p' "${IPERF_LOG}" |
+        head -n 1 | awk '{ printf "%.2f", $1 / 1e9 }')
+}
+
+printf "%-10s %14s %10s\n" "threads" "throughput" "scaling"
+
+BASELINE=
+for threads in "${THREADS[@]}"; do
+    measure "${threads}"
+
+    if [[ -z ${BASELINE} ]]; then
+        BASELINE=${GBPS}
+    fi
+
+    printf "%-10s %9s Gb/s %9sx\n" "${threads}" "${GBPS}" "$(awk -v a="${GBPS}" -v b="${BASELINE}" 'BEGIN { printf "%.2f", a / b }')"
+done
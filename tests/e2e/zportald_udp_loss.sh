@@ -0,0 +1,104 @@
+#!/usr/bin/env bash
+set -Eeuo pipefail
+
+if [[ $# -ne 1 ]]; then
+    echo "Usage: $0 <path-to-zportald>" >&2
+    exit 2
+fi
+
+if [[ ${EUID} -ne 0 ]]; then
+    echo "This benchmark needs root privileges for TUN, veth and network namespaces. Run it with sudo." >&2
+    exit 2
+fi
+
+ZPORTALD=$1
+if [[ ! -x ${ZPORTALD} ]]; then
+    echo "zportald is not executable: ${ZPORTALD}" >&2
+    exit 2
+fi
+
+if ! command -v iperf3 >/dev/null 2>&1; then
+    echo "This benchmark needs iperf3." >&2
+    exit 2
+fi
+
+LOSS=${LOSS:-1%}
+DELAY=${DELAY:-10ms}
+DURATION=${DURATION:-10}
+
+TEST_ID="zportal-loss-$$"
+NS_SERVER="${TEST_ID}-server"
+NS_CLIENT="${TEST_ID}-client"
+SERVER_LOG="/tmp/${TEST_ID}-server.log"
+CLIENT_LOG="/tmp/${TEST_ID}-client.log"
+IPERF_LOG="/tmp/${TEST_ID}-iperf.json"
+
+source "$(dirname "${BASH_SOURCE[0]}")/lib.sh"
+
+IPERF_PID=
+E2E_PIDS+=(IPERF_PID)
+E2E_PATHS+=("${IPERF_LOG}")
+
+ip netns add "${NS_SERVER}"
+ip netns add "${NS_CLIENT}"
+
+ip link add zploss0 netns "${NS_SERVER}" type veth peer name zploss1 netns "${NS_CLIENT}"
+ip -n "${NS_SERVER}" addr add 192.0.2.1/24 dev zploss0
+ip -n "${NS_CLIENT}" addr add 192.0.2.2/24 dev zploss1
+ip -n "${NS_SERVER}" link set zploss0 up
+ip -n "${NS_CLIENT}" link set zploss1 up
+
+# Loss and delay on both directions of the underlay, so the inner TCP sees the path the tunnel does.
+ip netns exec "${NS_SERVER}" tc qdisc add dev zploss0 root netem delay "${DELAY}" loss "${LOSS}"
+ip netns exec "${NS_CLIENT}" tc qdisc add dev zploss1 root netem delay "${DELAY}" loss "${LOSS}"
+
+ip netns exec "${NS_SERVER}" iperf3 -s >/dev/null 2>&1 &
+IPERF_PID=$!
+
+# Runs one tunnel over the given transport and stores the received throughput in Mbit/s in MBPS.
+measure() {
+    local transport=$1
+    local listener=(ss -Htln 'sport = :7300')
+    if [[ ${transport} == udp ]]; then
+        listener=(ss -Huln 'sport = :7300')
+    fi
+
+    ip netns exec "${NS_SERVER}" "${ZPORTALD}" \
+        -n zptloss0 \
+        -m 1400 \
+        -a 10.91.0.1/24 \
+        -b 192.0.2.1:7300 \
+        -t "${transport}" \
+        >"${SERVER_LOG}" 2>&1 &
+    SERVER_PID=$!
+
+    wait_for "server listener" ip netns exec "${NS_SERVER}" "${listener[@]}"
+
+    ip netns exec "${NS_CLIENT}" "${ZPORTALD}" \
+        -n zptloss1 \
+        -m 1400 \
+        -a 10.91.0.2/24 \
+        -c 192.0.2.1:7300 \
+        -t "${transport}" \
+        >"${CLIENT_LOG}" 2>&1 &
+    CLIENT_PID=$!
+
+    wait_for "tunnel" ip netns exec "${NS_CLIENT}" ping -c 1 -W 1 10.91.0.1
+
+    ip netns exec "${NS_CLIENT}" iperf3 -c 10.91.0.1 -t "${DURATION}" -J >"${IPERF_LOG}"
+
+    stop_tunnel
+
+    MBPS=$(sed -n '/"sum_received"/,/}/s/.*"bits_per_second":[[:space:]]*\([0-9.e+]*\).*/\1/p' "${IPERF_LOG}" |
+        head -n 1 | awk '{ printf "%.1f", $1 / 1e6 }')
+}
+
+measure tcp
+TCP_MBPS=${MBPS}
+
+measure udp
+UDP_MBPS=${MBPS}
+
+printf "%-24s %16s\n" "transport" "throughput"
+printf "%-24s %11s Mb/s\n" "tcp, ${LOSS} loss" "${TCP_MBPS}"
+printf "%-24s %11s Mb/s\n" "udp, ${LOSS} loss" "${UDP_MBPS}"
@@ -0,0 +1,102 @@
+#!/usr/bin/env bash
+set -Eeuo pipefail
+
+if [[ $# -lt 1 || $# -gt 2 ]]; then
+    echo "Usage: $0 <path-to-zportald> [busy-poll-us]" >&2
+    exit 2
+fi
+
+if [[ ${EUID} -ne 0 ]]; then
+    echo "This benchmark needs root privileges for TUN, veth and network namespaces. Run it with sudo." >&2
+    exit 2
+fi
+
+ZPORTALD=$1
+BUSY_POLL_US=${2:-50}
+if [[ ! -x ${ZPORTALD} ]]; then
+    echo "zportald is not executable: ${ZPORTALD}" >&2
+    exit 2
+fi
+
+PING_COUNT=${PING_COUNT:-2000}
+PING_INTERVAL=${PING_INTERVAL:-0.002}
+
+TEST_ID="zportal-bench-$$"
+NS_SERVER="${TEST_ID}-server"
+NS_CLIENT="${TEST_ID}-client"
+SERVER_LOG="/tmp/${TEST_ID}-server.log"
+CLIENT_LOG="/tmp/${TEST_ID}-client.log"
+PING_LOG="/tmp/${TEST_ID}-ping.log"
+
+source "$(dirname "${BASH_SOURCE[0]}")/lib.sh"
+
+E2E_PATHS+=("${PING_LOG}")
+
+ip netns add "${NS_SERVER}"
+ip netns add "${NS_CLIENT}"
+
+ip link add zpbench0 netns "${NS_SERVER}" type veth peer name zpbench1 netns "${NS_CLIENT}"
+ip -n "${NS_SERVER}" addr add 192.0.2.1/24 dev zpbench0
+ip -n "${NS_CLIENT}" addr add 192.0.2.2/24 dev zpbench1
+ip -n "${NS_SERVER}" link set zpbench0 up
+ip -n "${NS_CLIENT}" link set zpbench1 up
+
+# veth only runs its NAPI instance with GRO (or XDP) enabled, without it busy polling has nothing to poll.
+if command -v ethtool >/dev/null 2>&1; then
+    ip netns exec "${NS_SERVER}" ethtool -K zpbench0 gro on >/dev/null 2>&1 || true
+    ip netns exec "${NS_CLIENT}" ethtool -K zpbench1 gro on >/dev/null 2>&1 || true
+fi
+
+# Runs one tunnel with the given extra zportald options and stores p50/p99 in milliseconds in P50/P99.
+measure() {
+    ip netns exec "${NS_SERVER}" "${ZPORTALD}" \
+        -n zptbench0 \
+        -m 1400 \
+        -a 10.89.0.1/24 \
+        -b 192.0.2.1:7100 \
+        "$@" \
+        >"${SERVER_LOG}" 2>&1 &
+    SERVER_PID=$!
+
+    wait_for "server listener" ip netns exec "${NS_SERVER}" ss -Htln 'sport = :7100'
+
+    ip netns exec "${NS_CLIENT}" "${ZPORTALD}" \
+        -n zptbench1 \
+        -m 1400 \
+        -a 10.89.0.2/24 \
+        -c 192.0.2.1:7100 \
+        "$@" \
+        >"${CLIENT_LOG}" 2>&1 &
+    CLIENT_PID=$!
+
+    wait_for "server TUN device" ip netns exec "${NS_SERVER}" ip link show zptbench0
+    wait_for "client TUN device" ip netns exec "${NS_CLIENT}" ip link show zptbench1
+    wait_for "tunnel" ip netns exec "${NS_CLIENT}" ping -c 1 -W 1 10.89.0.1
+
+    ip netns exec "${NS_CLIENT}" ping -n -c "${PING_COUNT}" -i "${PING_INTERVAL}" 10.89.0.1 >"${PING_LOG}"
+
+    stop_tunnel
+
+    read -r P50 P99 < <(sed -n 's/.*time=\([0-9.]*\) ms.*/\1/p' "${PING_LOG}" | sort -n | awk '
+        { samples[NR] = $1 }
+        END {
+            if (NR == 0) {
+                exit 1
+            }
+            p50 = samples[int((NR - 1) * 0.50) + 1]
+            p99 = samples[int((NR - 1) * 0.99) + 1]
+            printf "%s %s\n", p50, p99
+        }')
+}
+
+measure
+DEFAULT_P50=${P50}
+DEFAULT_P99=${P99}
+
+measure -B "${BUSY_POLL_US}" -P
+BUSY_P50=${P50}
+BUSY_P99=${P99}
+
+printf "%-24s %10s %10s\n" "mode" "p50 [ms]" "p99 [ms]"
+printf "%-24s %10s %10s\n" "interrupt driven" "${DEFAULT_P50}" "${DEFAULT_P99}"
+printf "%-24s %10s %10s\n" "busy poll ${BUSY_POLL_US} us" "${BUSY_P50}" "${BUSY_P99}"
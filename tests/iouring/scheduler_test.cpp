@@ -0,0 +1,133 @@
+#include <array>
+#include <chrono>
+#include <span>
+#include <string_view>
+
+#include <cstddef>
+
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+
+#include <zportal/iouring/frame_allocator.hpp>
+#include <zportal/iouring/iouring.hpp>
+#include <zportal/iouring/scheduler.hpp>
+#include <zportal/iouring/task.hpp>
+#include <zportal/tools/error.hpp>
+#include <zportal/tools/file_descriptor.hpp>
+
+using namespace zportal;
+
+namespace {
+
+Task<std::size_t> echo_once(Scheduler& scheduler, int fd) {
+    std::array<std::byte, 64> buffer{};
+
+    const auto received = co_await scheduler.recv(fd, buffer);
+    if (!received) {
+        co_return fail(received.error());
+    }
+
+    const auto sent = co_await scheduler.send(fd, std::span(buffer).first(*received));
+    if (!sent) {
+        co_return fail(sent.error());
+    }
+
+    co_return *sent;
+}
+
+Task<void> ping(Scheduler& scheduler, int fd, std::string_view message, std::size_t& echoed, bool& done) {
+    const auto bytes = std::as_bytes(std::span(message));
+    if (const auto sent = co_await scheduler.send(fd, bytes); !sent) {
+        co_return fail(sent.error());
+    }
+
+    std::array<std::byte, 64> buffer{};
+    const auto received = co_await scheduler.recv(fd, buffer);
+    if (!received) {
+        co_return fail(received.error());
+    }
+
+    echoed = *received;
+    done = true;
+    co_return {};
+}
+
+Task<void> pong(Scheduler& scheduler, int fd) {
+    const auto echoed = co_await echo_once(scheduler, fd);
+    if (!echoed) {
+        co_return fail(echoed.error());
+    }
+
+    co_return {};
+}
+
+Task<void> sleep_for(Scheduler& scheduler, std::chrono::milliseconds duration, bool& done) {
+    if (const auto result = co_await scheduler.timeout(duration); !result) {
+        co_return fail(result.error());
+    }
+
+    done = true;
+    co_return {};
+}
+
+} // namespace
+
+TEST(Scheduler, EchoOverSocketPair) {
+    auto ring = IoUring::create_queue(16);
+    if (!ring) {
+        GTEST_SKIP() << ring.error().to_string();
+    }
+
+    auto scheduler = Scheduler::create_scheduler(*ring, 8);
+    ASSERT_TRUE(scheduler) << scheduler.error().to_string();
+
+    std::array<int, 2> fds{};
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data()), 0);
+    FileDescriptor left{fds[0]};
+    FileDescriptor right{fds[1]};
+
+    std::size_t echoed{};
+    bool done = false;
+    ASSERT_TRUE(scheduler->spawn(pong(*scheduler, right.get())));
+    ASSERT_TRUE(scheduler->spawn(ping(*scheduler, left.get(), "zportal", echoed, done)));
+
+    while (!done) {
+        const auto result = scheduler->run_once();
+        ASSERT_TRUE(result) << result.error().to_string();
+    }
+
+    EXPECT_EQ(echoed, 7U);
+    EXPECT_EQ(scheduler->get_in_flight(), 0U);
+}
+
+TEST(Scheduler, Timeout) {
+    auto ring = IoUring::create_queue(8);
+    if (!ring) {
+        GTEST_SKIP() << ring.error().to_string();
+    }
+
+    auto scheduler = Scheduler::create_scheduler(*ring, 4);
+    ASSERT_TRUE(scheduler) << scheduler.error().to_string();
+
+    bool done = false;
+    ASSERT_TRUE(scheduler->spawn(sleep_for(*scheduler, std::chrono::milliseconds(1), done)));
+
+    while (!done) {
+        const auto result = scheduler->run_once();
+        ASSERT_TRUE(result) << result.error().to_string();
+    }
+}
+
+TEST(FrameAllocator, ReusesFrames) {
+    const auto cached = FrameAllocator::get_cached_count();
+
+    void* first = FrameAllocator::allocate(200);
+    ASSERT_NE(first, nullptr);
+    FrameAllocator::deallocate(first, 200);
+    EXPECT_EQ(FrameAllocator::get_cached_count(), cached + 1);
+
+    void* second = FrameAllocator::allocate(220);
+    EXPECT_EQ(second, first);
+    EXPECT_EQ(FrameAllocator::get_cached_count(), cached);
+    FrameAllocator::deallocate(second, 220);
+}
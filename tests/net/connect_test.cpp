@@ -0,0 +1,89 @@
+#include <vector>
+
+#include <sys/socket.h>
+
+#include <gtest/gtest.h>
+
+#include <zportal/net/address.hpp>
+#include <zportal/net/connection.hpp>
+#include <zportal/net/socket.hpp>
+
+using namespace zportal;
+
+TEST(ConnectAny, RefusedCandidateFallsThrough) {
+    auto listener = create_listener(SockAddress::ip4_numeric("127.0.0.1", 0));
+    ASSERT_TRUE(listener) << listener.error().to_string();
+    const auto listening = listener->get_local_address();
+    ASSERT_TRUE(listening) << listening.error().to_string();
+
+    // Bound but not listening, connecting to it is refused at once.
+    auto closed = Socket::create_socket(AF_INET);
+    ASSERT_TRUE(closed) << closed.error().to_string();
+    const auto any = SockAddress::ip4_numeric("127.0.0.1", 0);
+    ASSERT_EQ(::bind(closed->get(), any.get(), any.length()), 0);
+    const auto refused = closed->get_local_address();
+    ASSERT_TRUE(refused) << refused.error().to_string();
+
+    const std::vector<SockAddress> candidates = {*refused, *listening};
+    auto sock = connect_any(candidates);
+    ASSERT_TRUE(sock) << sock.error().to_string();
+
+    const auto remote = sock->get_remote_address();
+    ASSERT_TRUE(remote) << remote.error().to_string();
+    EXPECT_EQ(remote->str(), listening->str());
+
+    const auto only_refused = connect_any({*refused});
+    ASSERT_FALSE(only_refused);
+    EXPECT_EQ(only_refused.error().code(), ErrorCode::ConnectFailed);
+}
+
+TEST(ConnectDatagram, ConnectedSocketKnowsItsLimit) {
+    auto sock = connect_datagram(SockAddress::ip4_numeric("127.0.0.1", 9));
+    ASSERT_TRUE(sock) << sock.error().to_string();
+
+    const auto transport = sock->detect_transport();
+    ASSERT_TRUE(transport) << transport.error().to_string();
+    EXPECT_EQ(*transport, Transport::UDP);
+
+    const auto limit = sock->get_datagram_limit();
+    ASSERT_TRUE(limit) << limit.error().to_string();
+    EXPECT_NE(*limit, 0U);
+
+    const auto unix_datagram = Socket::create_socket(AF_UNIX, 0, Transport::UDP);
+    ASSERT_FALSE(unix_datagram);
+    EXPECT_EQ(unix_datagram.error().code(), ErrorCode::InvalidSocketFamily);
+}
+
+TEST(ConnectSctp, MessagesKeepTheirBoundaries) {
+    auto listener = create_listener(SockAddress::ip4_numeric("127.0.0.1", 0), 1, Transport::SCTP);
+    if (!listener && listener.error().code() == ErrorCode::SocketCreateFailed) {
+        GTEST_SKIP() << listener.error().to_string();
+    }
+    ASSERT_TRUE(listener) << listener.error().to_string();
+    const auto listening = listener->get_local_address();
+    ASSERT_TRUE(listening) << listening.error().to_string();
+
+    auto client = Socket::create_socket(AF_INET, SOCK_CLOEXEC, Transport::SCTP);
+    ASSERT_TRUE(client) << client.error().to_string();
+    ASSERT_EQ(::connect(client->get(), listening->get(), listening->length()), 0);
+    auto server = accept_from(*listener);
+    ASSERT_TRUE(server) << server.error().to_string();
+
+    const auto transport = server->detect_transport();
+    ASSERT_TRUE(transport) << transport.error().to_string();
+    EXPECT_EQ(*transport, Transport::SCTP);
+    const auto streams = client->get_stream_count();
+    ASSERT_TRUE(streams) << streams.error().to_string();
+    EXPECT_EQ(*streams, Socket::sctp_streams);
+
+    // Two sends arrive as two receives, however much room the buffer has.
+    ASSERT_EQ(::send(client->get(), "ab", 2, 0), 2);
+    ASSERT_EQ(::send(client->get(), "cde", 3, 0), 3);
+    char buffer[64];
+    EXPECT_EQ(::recv(server->get(), buffer, sizeof(buffer), 0), 2);
+    EXPECT_EQ(::recv(server->get(), buffer, sizeof(buffer), 0), 3);
+
+    const auto unix_sctp = Socket::create_socket(AF_UNIX, 0, Transport::SCTP);
+    ASSERT_FALSE(unix_sctp);
+    EXPECT_EQ(unix_sctp.error().code(), ErrorCode::InvalidSocketFamily);
+}
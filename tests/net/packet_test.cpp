@@ -0,0 +1,72 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <zportal/net/packet.hpp>
+
+using namespace zportal;
+
+namespace {
+
+std::array<std::byte, 40> make_udp4(std::uint8_t source_host, std::uint16_t source_port) {
+    std::array<std::byte, 40> packet{};
+    packet[0] = std::byte{0x45};
+    packet[9] = std::byte{17};
+    packet[12] = std::byte{10};
+    packet[15] = std::byte{source_host};
+    packet[16] = std::byte{10};
+    packet[19] = std::byte{1};
+    packet[20] = std::byte{static_cast<std::uint8_t>(source_port >> 8)};
+    packet[21] = std::byte{static_cast<std::uint8_t>(source_port)};
+    packet[23] = std::byte{53};
+    return packet;
+}
+
+} // namespace
+
+TEST(Packet, FlowHashFollowsFiveTuple) {
+    const auto packet = make_udp4(2, 40000);
+    auto same_flow = packet;
+    same_flow[30] = std::byte{0xff};
+
+    EXPECT_EQ(flow_hash(packet), flow_hash(same_flow));
+    EXPECT_NE(flow_hash(packet), flow_hash(make_udp4(2, 40001)));
+    EXPECT_NE(flow_hash(packet), flow_hash(make_udp4(3, 40000)));
+}
+
+TEST(Packet, FlowHashIgnoresPortsOfFragments) {
+    auto first = make_udp4(2, 40000);
+    first[6] = std::byte{0x20};
+    auto other_ports = make_udp4(2, 40001);
+    other_ports[6] = std::byte{0x20};
+
+    EXPECT_EQ(flow_hash(first), flow_hash(other_ports));
+    EXPECT_EQ(flow_hash(std::span(first).first(10)), 0U);
+}
+
+TEST(Packet, InteractivePackets) {
+    std::vector<std::byte> bulk(1400);
+    bulk[0] = std::byte{0x45};
+    bulk[9] = std::byte{6};
+    bulk[32] = std::byte{0x50};
+    EXPECT_FALSE(is_interactive(bulk));
+
+    // Pure ACK, as long as its options.
+    auto ack = bulk;
+    ack.resize(20 + 20 + 120);
+    ack[32] = std::byte{0xa0};
+    EXPECT_FALSE(is_interactive(ack));
+    ack.resize(20 + 40);
+    EXPECT_TRUE(is_interactive(ack));
+
+    auto voice = bulk;
+    voice[1] = std::byte{46 << 2};
+    EXPECT_TRUE(is_interactive(voice));
+
+    EXPECT_TRUE(is_interactive(make_udp4(2, 40000)));
+    EXPECT_FALSE(is_interactive(std::vector<std::byte>(40)));
+}
@@ -0,0 +1,56 @@
+#include <array>
+#include <cstddef>
+
+#include <gtest/gtest.h>
+
+#include <zportal/net/address.hpp>
+#include <zportal/net/packet.hpp>
+#include <zportal/net/route_table.hpp>
+
+using namespace zportal;
+
+TEST(RouteTable, LongestPrefixWins) {
+    RouteTable table;
+    ASSERT_TRUE(table.insert(parse_cidr("10.0.0.0/8"), 1));
+    ASSERT_TRUE(table.insert(parse_cidr("10.1.0.0/16"), 2));
+    ASSERT_TRUE(table.insert(parse_cidr("10.1.2.3/32"), 3));
+
+    EXPECT_EQ(table.lookup(SockAddress::ip4_numeric("10.9.9.9", 0)), 1);
+    EXPECT_EQ(table.lookup(SockAddress::ip4_numeric("10.1.9.9", 0)), 2);
+    EXPECT_EQ(table.lookup(SockAddress::ip4_numeric("10.1.2.3", 0)), 3);
+    EXPECT_FALSE(table.lookup(SockAddress::ip4_numeric("192.168.0.1", 0)));
+    EXPECT_EQ(table.size(), 3U);
+}
+
+TEST(RouteTable, Ip6AndErase) {
+    RouteTable table;
+    ASSERT_TRUE(table.insert(parse_cidr("fd00::/64"), 7));
+    ASSERT_TRUE(table.insert(parse_cidr("fd00::5/128"), 8));
+
+    EXPECT_EQ(table.lookup(SockAddress::ip6_numeric("fd00::5", 0)), 8);
+    EXPECT_EQ(table.lookup(SockAddress::ip6_numeric("fd00::6", 0)), 7);
+    EXPECT_FALSE(table.lookup(SockAddress::ip6_numeric("fd01::5", 0)));
+
+    EXPECT_TRUE(table.erase(parse_cidr("fd00::5/128")));
+    EXPECT_EQ(table.lookup(SockAddress::ip6_numeric("fd00::5", 0)), 7);
+
+    EXPECT_EQ(table.erase_value(7), 1U);
+    EXPECT_TRUE(table.empty());
+}
+
+TEST(RouteTable, LookupPacketDestination) {
+    RouteTable table;
+    ASSERT_TRUE(table.insert(parse_cidr("10.88.0.2/32"), 4));
+
+    std::array<std::byte, 20> packet{};
+    packet[0] = std::byte{0x45};
+    packet[16] = std::byte{10};
+    packet[17] = std::byte{88};
+    packet[18] = std::byte{0};
+    packet[19] = std::byte{2};
+
+    const auto destination = ip_destination(packet);
+    ASSERT_TRUE(destination);
+    EXPECT_EQ(table.lookup(*destination), 4);
+    EXPECT_FALSE(ip_destination(std::span(packet).first(10)));
+}
@@ -0,0 +1,140 @@
+#include <array>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <zportal/net/address.hpp>
+#include <zportal/net/connection.hpp>
+#include <zportal/net/shm_ring.hpp>
+#include <zportal/tools/file_descriptor.hpp>
+
+using namespace zportal;
+
+namespace {
+
+std::size_t write_bytes(ShmRing& ring, std::span<const std::byte> bytes) {
+    const iovec segment{.iov_base = const_cast<std::byte*>(bytes.data()), .iov_len = bytes.size()};
+    return ring.write(std::span{&segment, 1});
+}
+
+} // namespace
+
+TEST(ShmRing, WrapsAroundThroughTheSharedMapping) {
+    auto writer = ShmRing::create_shm_ring(100);
+    ASSERT_TRUE(writer) << writer.error().to_string();
+    EXPECT_EQ(writer->get_capacity(), 128U);
+
+    auto reader = ShmRing::attach_shm_ring(FileDescriptor(::dup(writer->get_fd())));
+    ASSERT_TRUE(reader) << reader.error().to_string();
+
+    std::array<std::byte, 96> first{};
+    first.fill(std::byte{0x11});
+    EXPECT_EQ(write_bytes(*writer, first), first.size());
+
+    std::array<std::byte, 96> out{};
+    EXPECT_EQ(reader->read(out), first.size());
+
+    // Starts at 96 of 128, so it wraps and only what fits goes in.
+    std::array<std::byte, 160> second{};
+    for (std::size_t i = 0; i < second.size(); i++) {
+        second[i] = static_cast<std::byte>(i);
+    }
+    EXPECT_EQ(write_bytes(*writer, second), 128U);
+    EXPECT_TRUE(writer->wait_for_space());
+    EXPECT_EQ(reader->get_readable(), 128U);
+
+    std::array<std::byte, 128> wrapped{};
+    EXPECT_EQ(reader->read(wrapped), wrapped.size());
+    EXPECT_EQ(std::memcmp(wrapped.data(), second.data(), wrapped.size()), 0);
+    EXPECT_TRUE(reader->take_writer_waiting());
+    EXPECT_FALSE(reader->take_writer_waiting());
+
+    // Only a reader that went to sleep asks to be woken.
+    EXPECT_FALSE(writer->take_reader_waiting());
+    EXPECT_TRUE(reader->wait_for_data());
+    EXPECT_EQ(write_bytes(*writer, std::span{first}.first(1)), 1U);
+    EXPECT_TRUE(writer->take_reader_waiting());
+    EXPECT_FALSE(reader->wait_for_data());
+}
+
+TEST(ShmRing, ForeignFileIsRejected) {
+    const int fd = ::memfd_create("not-a-ring", MFD_CLOEXEC);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::ftruncate(fd, 4096 + 128), 0);
+
+    // Unsealed, its owner could shrink it under the mapping.
+    const auto ring = ShmRing::attach_shm_ring(FileDescriptor(fd));
+    ASSERT_FALSE(ring);
+    EXPECT_EQ(ring.error().code(), ErrorCode::InvalidShmRing);
+}
+
+TEST(ShmChannel, PeersSwapTheirRingsAndDoorbells) {
+    const auto address = SockAddress::unix_abstract("zportal-shm-test-" + std::to_string(::getpid()));
+
+    // Listening before the client starts, so its connect can't race the server.
+    auto listener = create_listener(address);
+    ASSERT_TRUE(listener) << listener.error().to_string();
+
+    std::optional<Result<ShmChannel>> client;
+    std::thread connecting([&]() { client = connect_shm(address, 4096); });
+    auto accepted = accept_shm(*listener, 4096);
+    // A connection still in the backlog is reset, the client's exchange fails instead of waiting.
+    listener->close();
+    connecting.join();
+    ASSERT_TRUE(client && *client) << (client ? client->error().to_string() : "");
+    ASSERT_TRUE(accepted) << accepted.error().to_string();
+    auto& peer = *accepted;
+
+    const std::array<std::byte, 3> frame{std::byte{1}, std::byte{2}, std::byte{3}};
+    EXPECT_EQ(write_bytes((*client)->tx, frame), frame.size());
+    std::array<std::byte, 8> out{};
+    EXPECT_EQ(peer.rx.read(out), frame.size());
+    EXPECT_EQ(std::memcmp(out.data(), frame.data(), frame.size()), 0);
+
+    ASSERT_EQ(::eventfd_write((*client)->peer_doorbell.get(), 1), 0);
+    eventfd_t rung{};
+    ASSERT_EQ(::eventfd_read(peer.doorbell.get(), &rung), 0);
+    EXPECT_EQ(rung, 1U);
+}
+
+TEST(ShmRing, AcquiredBytesStayTakenUntilReleased) {
+    auto writer = ShmRing::create_shm_ring(128);
+    ASSERT_TRUE(writer) << writer.error().to_string();
+    auto reader = ShmRing::attach_shm_ring(FileDescriptor(::dup(writer->get_fd())));
+    ASSERT_TRUE(reader) << reader.error().to_string();
+
+    std::array<std::byte, 96> first{};
+    first.fill(std::byte{0x22});
+    EXPECT_EQ(write_bytes(*writer, first), first.size());
+    const auto chunk = reader->acquire();
+    EXPECT_EQ(chunk.size(), first.size());
+    EXPECT_EQ(reader->get_readable(), 0U);
+    EXPECT_TRUE(reader->wait_for_data());
+
+    // The acquired bytes are still the writer's to wait for.
+    std::array<std::byte, 64> second{};
+    second.fill(std::byte{0x33});
+    EXPECT_EQ(write_bytes(*writer, second), 32U);
+    reader->release(64);
+    EXPECT_EQ(write_bytes(*writer, std::span{second}.subspan(32)), 32U);
+
+    // In place and up to the wrap, the rest comes from the start of the ring.
+    const auto tail = reader->acquire();
+    ASSERT_EQ(tail.size(), 32U);
+    EXPECT_EQ(tail.front(), std::byte{0x33});
+    EXPECT_EQ(reader->acquire().size(), 32U);
+    EXPECT_TRUE(reader->acquire().empty());
+}
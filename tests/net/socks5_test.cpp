@@ -0,0 +1,322 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <cerrno>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <gtest/gtest.h>
+
+#include <zportal/iouring/iouring.hpp>
+#include <zportal/net/address.hpp>
+#include <zportal/net/connection.hpp>
+#include <zportal/net/socket.hpp>
+#include <zportal/net/socks5.hpp>
+#include <zportal/session/connector.hpp>
+#include <zportal/session/operation.hpp>
+
+using namespace zportal;
+
+namespace {
+
+constexpr int wait_ms = 5000;
+
+bool wait_readable(int fd) {
+    pollfd pfd{.fd = fd, .events = POLLIN, .revents = 0};
+    return ::poll(&pfd, 1, wait_ms) == 1;
+}
+
+SockAddress local_address(const Socket& socket) {
+    const auto address = socket.get_local_address();
+    return address ? *address : SockAddress{};
+}
+
+/*
+  SOCKS5 stand-in on loopback for one client and IPv4 destinations only. Everything that arrived
+  by the time it wakes up is answered at once, after `delay` standing in for the round trip.
+*/
+class StandInProxy {
+  public:
+    explicit StandInProxy(std::chrono::milliseconds delay) : delay_(delay) {
+        auto listener = create_listener(SockAddress::ip4_numeric("127.0.0.1", 0));
+        if (listener) {
+            listener_ = std::move(*listener);
+        }
+        thread_ = std::thread([this] { serve(); });
+    }
+
+    ~StandInProxy() {
+        thread_.join();
+    }
+
+    SockAddress address() const {
+        return local_address(listener_);
+    }
+
+    int rounds() const {
+        return rounds_.load();
+    }
+
+  private:
+    std::chrono::milliseconds delay_;
+    Socket listener_;
+    std::thread thread_;
+    std::atomic<int> rounds_{0};
+
+    void serve() {
+        if (!listener_ || !wait_readable(listener_.get())) {
+            return;
+        }
+        auto client = accept_from(listener_);
+        if (!client) {
+            return;
+        }
+
+        Socket destination;
+        std::vector<std::uint8_t> pending;
+        bool greeted = false;
+        while (!destination) {
+            std::array<std::uint8_t, 512> buffer{};
+            if (!wait_readable(client->get())) {
+                return;
+            }
+            const auto n = ::recv(client->get(), buffer.data(), buffer.size(), 0);
+            if (n <= 0) {
+                return;
+            }
+            pending.insert(pending.end(), buffer.begin(), buffer.begin() + n);
+
+            std::vector<std::uint8_t> reply;
+            if (!greeted && pending.size() >= 3) {
+                pending.erase(pending.begin(), pending.begin() + 3);
+                reply.insert(reply.end(), {0x05, 0x00});
+                greeted = true;
+            }
+            if (greeted && pending.size() >= 4 + 4 + 2) {
+                sockaddr_in sin{};
+                sin.sin_family = AF_INET;
+                std::memcpy(&sin.sin_addr.s_addr, pending.data() + 4, 4);
+                std::memcpy(&sin.sin_port, pending.data() + 4 + 4, 2);
+                pending.erase(pending.begin(), pending.begin() + 4 + 4 + 2);
+
+                auto sock = Socket::create_socket(AF_INET);
+                if (!sock || ::connect(sock->get(), reinterpret_cast<const sockaddr*>(&sin), sizeof(sin)) != 0) {
+                    return;
+                }
+                destination = std::move(*sock);
+                reply.insert(reply.end(), {0x05, 0x00, 0x00, 0x01, 0, 0, 0, 0, 0, 0});
+            }
+
+            if (!reply.empty()) {
+                std::this_thread::sleep_for(delay_);
+                rounds_++;
+                ::send(client->get(), reply.data(), reply.size(), MSG_NOSIGNAL);
+            }
+        }
+
+        if (!pending.empty()) {
+            ::send(destination.get(), pending.data(), pending.size(), MSG_NOSIGNAL);
+        }
+        relay(*client, destination);
+    }
+
+    static void relay(const Socket& client, const Socket& destination) {
+        std::array<pollfd, 2> pfds{{{.fd = client.get(), .events = POLLIN, .revents = 0},
+                                    {.fd = destination.get(), .events = POLLIN, .revents = 0}}};
+        for (;;) {
+            if (::poll(pfds.data(), pfds.size(), wait_ms) <= 0) {
+                return;
+            }
+
+            for (std::size_t i = 0; i < pfds.size(); i++) {
+                if (pfds[i].revents == 0) {
+                    continue;
+                }
+
+                std::array<std::uint8_t, 512> buffer{};
+                const auto n = ::recv(pfds[i].fd, buffer.data(), buffer.size(), 0);
+                if (n <= 0) {
+                    return;
+                }
+                ::send(pfds[1 - i].fd, buffer.data(), static_cast<std::size_t>(n), MSG_NOSIGNAL);
+            }
+        }
+    }
+};
+
+// Hands completions to the connector until its attempt finished, cancel requests complete as NONE.
+::testing::AssertionResult finish(IoUring& ring, Connector& connector) {
+    while (!connector.is_finished()) {
+        const auto cqe = ring.wait();
+        if (!cqe) {
+            return ::testing::AssertionFailure() << cqe.error().to_string();
+        }
+        if (cqe->operation().get_type() == OperationType::NONE) {
+            continue;
+        }
+        if (const auto result = connector.handle_cqe(*cqe); !result) {
+            return ::testing::AssertionFailure() << result.error().to_string();
+        }
+    }
+
+    return ::testing::AssertionSuccess();
+}
+
+} // namespace
+
+TEST(Socks5, ReplyIsReadInPieces) {
+    auto handshake = Socks5Handshake::create_socks5_handshake(HostPair{.hostname = "example.org", .port = 443});
+    ASSERT_TRUE(handshake) << handshake.error().to_string();
+
+    const auto request = handshake->request();
+    ASSERT_EQ(request.size(), 3U + 4 + 1 + 11 + 2);
+    EXPECT_EQ(request[6], 0x03);
+    EXPECT_EQ(request[7], 11);
+
+    const std::array<std::uint8_t, 16> reply = {0x05, 0x00, 0x05, 0x00, 0x00, 0x03, 0x07, 'a', 'b',
+                                                'c', '.', 'o', 'r', 'g', 0x01, 0xbb};
+    std::size_t offset = 0;
+    while (!handshake->is_done()) {
+        const auto buffer = handshake->reply_buffer();
+        ASSERT_FALSE(buffer.empty());
+        ASSERT_LE(offset + buffer.size(), reply.size());
+
+        buffer[0] = reply[offset++];
+        ASSERT_TRUE(handshake->commit(1));
+    }
+
+    EXPECT_EQ(offset, reply.size());
+}
+
+TEST(Socks5, RejectedMethodFailsBeforeTheReply) {
+    auto handshake = Socks5Handshake::create_socks5_handshake(SockAddress::ip4_numeric("10.0.0.1", 80));
+    ASSERT_TRUE(handshake) << handshake.error().to_string();
+
+    auto buffer = handshake->reply_buffer();
+    buffer[0] = 0x05;
+    buffer[1] = 0xFF;
+
+    const auto result = handshake->commit(2);
+    ASSERT_FALSE(result);
+    EXPECT_EQ(result.error().code(), ErrorCode::SocksAuthMethodUnsupported);
+}
+
+TEST(Socks5, ChainTakesOneRoundTripPerHop) {
+    constexpr std::chrono::milliseconds delay{50};
+
+    auto target = create_listener(SockAddress::ip4_numeric("127.0.0.1", 0));
+    ASSERT_TRUE(target) << target.error().to_string();
+
+    StandInProxy second(delay);
+    StandInProxy first(delay);
+
+    const auto start = std::chrono::steady_clock::now();
+    auto client = connect_to(local_address(*target), {first.address(), second.address()});
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_TRUE(client) << client.error().to_string();
+
+    EXPECT_EQ(first.rounds(), 1);
+    EXPECT_EQ(second.rounds(), 1);
+    EXPECT_LT(elapsed, 3 * delay);
+
+    ASSERT_TRUE(wait_readable(target->get()));
+    auto peer = accept_from(*target);
+    ASSERT_TRUE(peer) << peer.error().to_string();
+
+    const std::array<std::uint8_t, 4> ping = {'p', 'i', 'n', 'g'};
+    ASSERT_EQ(::send(client->get(), ping.data(), ping.size(), MSG_NOSIGNAL), static_cast<ssize_t>(ping.size()));
+
+    std::array<std::uint8_t, 4> received{};
+    ASSERT_TRUE(wait_readable(peer->get()));
+    ASSERT_EQ(::recv(peer->get(), received.data(), received.size(), MSG_WAITALL),
+              static_cast<ssize_t>(received.size()));
+    EXPECT_EQ(received, ping);
+
+    client->close();
+    peer->close();
+}
+
+TEST(Socks5, ConnectorChainTakesOneRoundTripPerHop) {
+    constexpr std::chrono::milliseconds delay{50};
+
+    auto ring = IoUring::create_queue(64);
+    if (!ring) {
+        GTEST_SKIP() << ring.error().to_string();
+    }
+
+    auto target = create_listener(SockAddress::ip4_numeric("127.0.0.1", 0));
+    ASSERT_TRUE(target) << target.error().to_string();
+
+    StandInProxy second(delay);
+    StandInProxy first(delay);
+
+    auto connector = Connector::create_connector(*ring, local_address(*target), {first.address(), second.address()},
+                                                 std::chrono::milliseconds(wait_ms));
+    ASSERT_TRUE(connector) << connector.error().to_string();
+
+    const auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(connector->start(1));
+    ASSERT_TRUE(finish(*ring, *connector));
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    auto sockets = connector->take();
+    ASSERT_TRUE(sockets) << sockets.error().to_string();
+    ASSERT_EQ(sockets->size(), 1U);
+
+    EXPECT_EQ(first.rounds(), 1);
+    EXPECT_EQ(second.rounds(), 1);
+    EXPECT_LT(elapsed, 3 * delay);
+
+    ASSERT_TRUE(wait_readable(target->get()));
+    auto peer = accept_from(*target);
+    ASSERT_TRUE(peer) << peer.error().to_string();
+
+    auto& client = sockets->front();
+    const std::array<std::uint8_t, 4> ping = {'p', 'i', 'n', 'g'};
+    ASSERT_EQ(::send(client.get(), ping.data(), ping.size(), MSG_NOSIGNAL), static_cast<ssize_t>(ping.size()));
+
+    std::array<std::uint8_t, 4> received{};
+    ASSERT_TRUE(wait_readable(peer->get()));
+    ASSERT_EQ(::recv(peer->get(), received.data(), received.size(), MSG_WAITALL),
+              static_cast<ssize_t>(received.size()));
+    EXPECT_EQ(received, ping);
+
+    client.close();
+    peer->close();
+}
+
+TEST(Socks5, ConnectorHopTimesOutOnASilentProxy) {
+    constexpr std::chrono::milliseconds timeout{100};
+
+    auto ring = IoUring::create_queue(64);
+    if (!ring) {
+        GTEST_SKIP() << ring.error().to_string();
+    }
+
+    // The kernel completes the handshake from the backlog, nothing ever answers the greeting.
+    auto silent = create_listener(SockAddress::ip4_numeric("127.0.0.1", 0));
+    ASSERT_TRUE(silent) << silent.error().to_string();
+
+    auto connector = Connector::create_connector(*ring, SockAddress::ip4_numeric("127.0.0.1", 9),
+                                                 {local_address(*silent)}, timeout);
+    ASSERT_TRUE(connector) << connector.error().to_string();
+
+    const auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(connector->start(1));
+    ASSERT_TRUE(finish(*ring, *connector));
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    const auto sockets = connector->take();
+    ASSERT_FALSE(sockets);
+    EXPECT_EQ(sockets.error().code(), ErrorCode::RecvFailed);
+    EXPECT_EQ(sockets.error().sys_errno(), ETIMEDOUT);
+    EXPECT_GE(elapsed, timeout);
+    EXPECT_LT(elapsed, std::chrono::milliseconds(wait_ms));
+}
@@ -0,0 +1,45 @@
+#include <array>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+#include <zportal/session/batch.hpp>
+
+using namespace zportal;
+
+TEST(BatchTable, RoundTrip) {
+    BatchTable table;
+    ASSERT_TRUE(table.add(40));
+    ASSERT_TRUE(table.add(1500));
+    EXPECT_EQ(table.data().size(), BatchTable::wire_size(2));
+
+    const auto parsed = BatchTable::parse(table.data());
+    ASSERT_TRUE(parsed) << parsed.error().to_string();
+    ASSERT_EQ(parsed->get_count(), 2U);
+    EXPECT_EQ(parsed->get_length(0), 40);
+    EXPECT_EQ(parsed->get_length(1), 1500);
+}
+
+TEST(BatchTable, StopsAtMaxCount) {
+    BatchTable table;
+    for (std::size_t i = 0; i < BatchTable::max_count; i++) {
+        ASSERT_TRUE(table.add(64));
+    }
+    EXPECT_FALSE(table.add(64));
+    EXPECT_EQ(table.data().size(), BatchTable::max_wire_size);
+}
+
+TEST(BatchTable, TruncatedOrEmptyIsRejected) {
+    BatchTable table;
+    ASSERT_TRUE(table.add(40));
+    ASSERT_TRUE(table.add(40));
+    EXPECT_FALSE(BatchTable::parse(table.data().first(BatchTable::wire_size(1))));
+
+    const std::array<std::byte, 2> empty{};
+    const auto parsed = BatchTable::parse(empty);
+    ASSERT_FALSE(parsed);
+    EXPECT_EQ(parsed.error().code(), ErrorCode::InvalidBatch);
+}
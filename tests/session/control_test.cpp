@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <array>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+#include <zportal/session/control.hpp>
+
+using namespace zportal;
+
+TEST(Hello, RoundTrip) {
+    const Hello hello{Hello::BATCHED_FRAMES | Hello::GSO_PASSTHROUGH, 1500};
+
+    const auto parsed = Hello::parse(hello.serialize());
+    ASSERT_TRUE(parsed) << parsed.error().to_string();
+    EXPECT_EQ(parsed->get_features(), hello.get_features());
+    EXPECT_EQ(parsed->get_max_frame_size(), 1500U);
+}
+
+TEST(Hello, NewerVersionKeepsThePrefix) {
+    std::array<std::byte, Hello::wire_size + 4> payload{};
+    const auto hello = Hello{0xFFFF0000 | Hello::COMPRESSION, 9000}.serialize();
+    std::ranges::copy(hello, payload.begin());
+    payload[1] = std::byte{Hello::version + 1};
+
+    const auto parsed = Hello::parse(payload);
+    ASSERT_TRUE(parsed) << parsed.error().to_string();
+
+    const auto negotiated = Hello{Hello::COMPRESSION | Hello::BATCHED_FRAMES, 1500}.negotiate(*parsed);
+    EXPECT_EQ(negotiated.get_features(), Hello::COMPRESSION);
+    EXPECT_TRUE(negotiated.has(Hello::COMPRESSION));
+    EXPECT_EQ(negotiated.get_max_frame_size(), 1500U);
+}
+
+TEST(Hello, ShortOrOlderIsRejected) {
+    auto payload = Hello{0, 1500}.serialize();
+    EXPECT_FALSE(Hello::parse(std::span<const std::byte>{payload}.first(Hello::wire_size - 1)));
+
+    payload[1] = std::byte{1};
+    const auto parsed = Hello::parse(payload);
+    ASSERT_FALSE(parsed);
+    EXPECT_EQ(parsed.error().code(), ErrorCode::InvalidHello);
+}
+
+TEST(Hello, StricterIntegrityWins) {
+    const auto full = Hello::offer(1500);
+    const auto header = Hello::offer(1500, Integrity::HEADER);
+    const auto none = Hello::offer(1500, Integrity::NONE);
+
+    EXPECT_EQ(full.negotiate(none).get_integrity(), Integrity::FULL);
+    EXPECT_EQ(header.negotiate(none).get_integrity(), Integrity::HEADER);
+    EXPECT_EQ(none.negotiate(header).get_integrity(), Integrity::HEADER);
+    EXPECT_EQ(none.negotiate(none).get_integrity(), Integrity::NONE);
+}
+
+TEST(Hello, DatagramOfferKeepsNoStateAcrossFrames) {
+    const auto offer = Hello::offer(1400, Integrity::NONE, Transport::UDP);
+    EXPECT_EQ(offer.get_features() & ~Hello::datagram_features, 0U);
+    EXPECT_TRUE(offer.has(Hello::BATCHED_FRAMES));
+    EXPECT_EQ(offer.get_integrity(), Integrity::FULL);
+    EXPECT_EQ(offer.get_max_frame_size(), 1400U);
+
+    // SCTP fragments large messages itself, only the order across streams is lost.
+    const auto sctp = Hello::offer(1400, Integrity::FULL, Transport::SCTP);
+    EXPECT_EQ(sctp.get_features() & ~Hello::datagram_features, 0U);
+    EXPECT_EQ(sctp.get_max_frame_size(), Hello::offer(1400).get_max_frame_size());
+
+    // The rings of SHM keep their order like a TCP stream.
+    const auto shm = Hello::offer(1400, Integrity::FULL, Transport::SHM);
+    EXPECT_EQ(shm.get_features(), Hello::offer(1400).get_features());
+}
+
+TEST(Ping, PongEchoesTheTimestamp) {
+    const Ping ping{ControlType::PING, 0x0102030405060708};
+
+    const auto parsed = Ping::parse(ping.serialize());
+    ASSERT_TRUE(parsed) << parsed.error().to_string();
+    EXPECT_EQ(parsed->get_type(), ControlType::PING);
+
+    const auto pong = Ping::parse(parsed->pong().serialize());
+    ASSERT_TRUE(pong) << pong.error().to_string();
+    EXPECT_EQ(pong->get_type(), ControlType::PONG);
+    EXPECT_EQ(pong->get_timestamp(), 0x0102030405060708U);
+
+    EXPECT_GE(Ping::now().pong().elapsed().count(), 0);
+}
+
+TEST(Ping, ShortOrOtherTypeIsRejected) {
+    auto payload = Ping::now().serialize();
+    EXPECT_FALSE(Ping::parse(std::span<const std::byte>{payload}.first(Ping::wire_size - 1)));
+
+    payload[0] = static_cast<std::byte>(ControlType::HELLO);
+    const auto parsed = Ping::parse(payload);
+    ASSERT_FALSE(parsed);
+    EXPECT_EQ(parsed.error().code(), ErrorCode::InvalidPing);
+}
+
+TEST(InnerAddress, RoundTrip) {
+    const std::array<std::byte, 4> address{std::byte{10}, std::byte{0}, std::byte{0}, std::byte{2}};
+
+    const auto parsed = InnerAddress::parse(InnerAddress{address, 24}.serialize());
+    ASSERT_TRUE(parsed) << parsed.error().to_string();
+    EXPECT_TRUE(std::ranges::equal(parsed->get_address(), address));
+    EXPECT_EQ(parsed->get_prefix(), 24);
+
+    const auto cidr = parsed->get_cidr();
+    ASSERT_TRUE(cidr) << cidr.error().to_string();
+    EXPECT_EQ(cidr->str(), "10.0.0.2/24");
+}
+
+TEST(InnerAddress, BadLengthOrPrefixIsRejected) {
+    const std::array<std::byte, 16> address{};
+
+    auto payload = InnerAddress{address, 64}.serialize();
+    payload[2] = std::byte{8};
+    EXPECT_FALSE(InnerAddress::parse(payload));
+
+    payload = InnerAddress{std::span<const std::byte>{address}.first(4), 32}.serialize();
+    payload[1] = std::byte{33};
+    const auto parsed = InnerAddress::parse(payload);
+    ASSERT_FALSE(parsed);
+    EXPECT_EQ(parsed.error().code(), ErrorCode::InvalidInnerAddress);
+}
@@ -0,0 +1,70 @@
+#include <array>
+#include <optional>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+#include <zportal/session/frame_header.hpp>
+
+using namespace zportal;
+
+namespace {
+
+constexpr FrameHeader make_header(std::uint32_t size, std::uint32_t flags, std::uint32_t crc) noexcept {
+    FrameHeader header;
+    header.set_size(size);
+    header.set_flags(flags);
+    header.set_crc(crc);
+    return header;
+}
+
+constexpr bool round_trips(const FrameHeader& header) noexcept {
+    std::array<std::byte, FrameHeader::max_compact_size> wire{};
+    const auto length = header.encode_compact(wire);
+
+    FrameHeader decoded;
+    const auto taken = decoded.decode_compact(wire);
+    return taken && *taken == length && decoded.is_magic_valid() && decoded.get_size() == header.get_size() &&
+           decoded.get_flags() == header.get_flags() &&
+           decoded.get_crc() == (header.get_crc() & FrameHeader::compact_crc_mask);
+}
+
+static_assert(round_trips(make_header(1, 0, 0xFFFFFFFF)));
+static_assert(round_trips(make_header(0xFFFFFFFF, FrameHeader::control_flag | 0x3, 0x12345678)));
+
+} // namespace
+
+TEST(FrameHeader, CompactHeaderOfSmallPacketsIsThreeBytes) {
+    std::array<std::byte, FrameHeader::max_compact_size> wire{};
+
+    EXPECT_EQ(make_header(40, 0, 0xCAFEBABE).encode_compact(wire), 3U);
+    EXPECT_EQ(make_header(1400, 0, 0xCAFEBABE).encode_compact(wire), 4U);
+    EXPECT_EQ(make_header(1400, 0x1, 0xCAFEBABE).encode_compact(wire), 5U);
+    EXPECT_LT(make_header(0xFFFFFFFF, 0xFFFFFFFF, 0).encode_compact(wire), FrameHeader::wire_size);
+}
+
+TEST(FrameHeader, CompactHeaderArrivesInPieces) {
+    std::array<std::byte, FrameHeader::max_compact_size> wire{};
+    const auto length = make_header(70000, 0x1, 0xABCD).encode_compact(wire);
+
+    for (std::size_t available = 0; available < length; available++) {
+        FrameHeader decoded;
+        const auto taken = decoded.decode_compact(std::span<const std::byte>(wire).first(available));
+        EXPECT_EQ(taken, std::optional<std::size_t>{0});
+    }
+
+    FrameHeader decoded;
+    EXPECT_EQ(decoded.decode_compact(wire), std::optional<std::size_t>{length});
+    EXPECT_EQ(decoded.get_size(), 70000U);
+}
+
+TEST(FrameHeader, OverlongVarintIsRejected) {
+    std::array<std::byte, FrameHeader::max_compact_size> wire{};
+    wire.fill(std::byte{0x80});
+
+    FrameHeader decoded;
+    EXPECT_FALSE(decoded.decode_compact(wire));
+}
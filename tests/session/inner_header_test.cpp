@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <array>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+#include <zportal/session/inner_header.hpp>
+
+using namespace zportal;
+
+namespace {
+
+void put_u16(std::vector<std::byte>& packet, std::size_t offset, std::uint32_t value) {
+    packet[offset] = static_cast<std::byte>(value >> 8);
+    packet[offset + 1] = static_cast<std::byte>(value);
+}
+
+void put_u32(std::vector<std::byte>& packet, std::size_t offset, std::uint32_t value) {
+    put_u16(packet, offset, value >> 16);
+    put_u16(packet, offset + 2, value & 0xFFFF);
+}
+
+// TCP over IPv4 with a timestamp option, as TUN reads it.
+std::vector<std::byte> tcp_packet(std::uint16_t id, std::uint32_t seq, std::uint32_t ack, std::size_t payload) {
+    std::vector<std::byte> packet(20 + 32 + payload, std::byte{0x5A});
+    std::ranges::fill(std::span{packet}.first(52), std::byte{0});
+
+    packet[0] = std::byte{0x45};
+    put_u16(packet, 2, static_cast<std::uint32_t>(packet.size()));
+    put_u16(packet, 4, id);
+    packet[6] = std::byte{0x40};
+    packet[8] = std::byte{64};
+    packet[9] = std::byte{6};
+    put_u32(packet, 12, 0x0A000001);
+    put_u32(packet, 16, 0x0A000002);
+
+    std::uint32_t sum{};
+    for (std::size_t offset = 0; offset < 20; offset += 2) {
+        sum += std::to_integer<std::uint32_t>(packet[offset]) << 8 | std::to_integer<std::uint32_t>(packet[offset + 1]);
+    }
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    put_u16(packet, 10, ~sum & 0xFFFF);
+
+    put_u16(packet, 20, 40000);
+    put_u16(packet, 22, 443);
+    put_u32(packet, 24, seq);
+    put_u32(packet, 28, ack);
+    packet[32] = std::byte{0x80};
+    packet[33] = std::byte{0x10};
+    put_u16(packet, 34, 502);
+    put_u16(packet, 36, 0xBEEF);
+    packet[40] = std::byte{1};
+    packet[41] = std::byte{1};
+    packet[42] = std::byte{8};
+    packet[43] = std::byte{10};
+    put_u32(packet, 44, seq ^ ack);
+
+    return packet;
+}
+
+// Sends `packet` from `sender` to `receiver`, returning what the receiver writes to TUN and the wire size.
+std::pair<std::vector<std::byte>, std::size_t> transfer(InnerHeaderContexts& sender, InnerHeaderContexts& receiver,
+                                                         const std::vector<std::byte>& packet) {
+    std::array<std::byte, InnerHeaderContexts::max_compressed_size> prefix{};
+    std::vector<std::byte> wire;
+    if (const auto compressed = sender.compress(packet, prefix)) {
+        wire.assign(prefix.begin(), prefix.begin() + static_cast<std::ptrdiff_t>(compressed->size));
+        wire.insert(wire.end(), packet.begin() + static_cast<std::ptrdiff_t>(compressed->replaced), packet.end());
+    } else {
+        wire = packet;
+    }
+
+    std::array<std::byte, InnerHeaderContexts::max_header_size> header{};
+    const std::size_t head_size = std::min(wire.size(), InnerHeaderContexts::max_prefix_size);
+    const auto head = std::span<const std::byte>{wire}.first(head_size);
+    const auto restored = receiver.restore(head, wire.size(), header);
+    EXPECT_TRUE(restored) << restored.error().to_string();
+    if (!restored) {
+        return {};
+    }
+
+    std::vector<std::byte> output(header.begin(), header.begin() + static_cast<std::ptrdiff_t>(restored->size));
+    output.insert(output.end(), wire.begin() + static_cast<std::ptrdiff_t>(restored->replaced), wire.end());
+
+    return {output, wire.size()};
+}
+
+} // namespace
+
+TEST(InnerHeaderContexts, FlowShrinksAfterItsFirstPacket) {
+    InnerHeaderContexts sender;
+    InnerHeaderContexts receiver;
+    ASSERT_TRUE(sender.reset());
+    ASSERT_TRUE(receiver.reset());
+
+    const auto first = tcp_packet(7, 1000, 5000, 100);
+    const auto [restored_first, first_size] = transfer(sender, receiver, first);
+    EXPECT_EQ(restored_first, first);
+    EXPECT_EQ(first_size, first.size() + InnerHeaderContexts::max_growth);
+
+    // A pure ACK, then a data packet whose sequence moved on.
+    const auto ack = tcp_packet(8, 1000, 6448, 0);
+    const auto [restored_ack, ack_size] = transfer(sender, receiver, ack);
+    EXPECT_EQ(restored_ack, ack);
+    EXPECT_LT(ack_size, 24U);
+
+    const auto data = tcp_packet(20, 1100, 6448, 1200);
+    const auto [restored_data, data_size] = transfer(sender, receiver, data);
+    EXPECT_EQ(restored_data, data);
+    EXPECT_LT(data_size, data.size() - 30);
+}
+
+TEST(InnerHeaderContexts, OtherPacketsPassUntouched) {
+    InnerHeaderContexts sender;
+    InnerHeaderContexts receiver;
+    ASSERT_TRUE(sender.reset());
+    ASSERT_TRUE(receiver.reset());
+
+    auto udp = tcp_packet(1, 0, 0, 10);
+    udp[9] = std::byte{17};
+
+    std::array<std::byte, InnerHeaderContexts::max_compressed_size> prefix{};
+    EXPECT_FALSE(sender.compress(udp, prefix));
+
+    const auto [restored, size] = transfer(sender, receiver, udp);
+    EXPECT_EQ(restored, udp);
+    EXPECT_EQ(size, udp.size());
+}
+
+TEST(InnerHeaderContexts, UnknownContextIsRejected) {
+    InnerHeaderContexts receiver;
+    ASSERT_TRUE(receiver.reset());
+
+    const std::array<std::byte, 8> wire{std::byte{0x20}, std::byte{3}};
+    std::array<std::byte, InnerHeaderContexts::max_header_size> header{};
+    const auto restored = receiver.restore(wire, wire.size(), header);
+    ASSERT_FALSE(restored);
+    EXPECT_EQ(restored.error().code(), ErrorCode::InvalidInnerHeader);
+}
@@ -0,0 +1,42 @@
+#include <chrono>
+
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+#include <zportal/session/operation.hpp>
+
+using namespace zportal;
+
+TEST(Operation, RoundTrip) {
+    Operation operation;
+    operation.set_type(OperationType::RECV);
+    operation.set_session(0x1234);
+    operation.set_slot(0xBEEF);
+    operation.set_stamp(0xCAFE);
+
+    const Operation parsed(operation.serialize());
+    EXPECT_EQ(parsed.get_type(), OperationType::RECV);
+    EXPECT_EQ(parsed.get_version(), Operation::current_version);
+    EXPECT_EQ(parsed.get_session(), 0x1234);
+    EXPECT_EQ(parsed.get_slot(), 0xBEEF);
+    EXPECT_EQ(parsed.get_stamp(), 0xCAFE);
+}
+
+TEST(Operation, LegacyValue) {
+    const Operation parsed(static_cast<std::uint64_t>(OperationType::WRITE));
+
+    EXPECT_EQ(parsed.get_type(), OperationType::WRITE);
+    EXPECT_EQ(parsed.get_version(), 0);
+    EXPECT_EQ(parsed.get_session(), 0);
+    EXPECT_EQ(parsed.get_slot(), 0);
+    EXPECT_EQ(parsed.get_stamp(), 0);
+}
+
+TEST(Operation, ElapsedWrapsAround) {
+    Operation operation;
+    operation.set_stamp(0xFFFE);
+
+    EXPECT_EQ(operation.elapsed(0x0001), std::chrono::microseconds(3 * 16));
+    EXPECT_EQ(operation.elapsed(0xFFFE), std::chrono::microseconds(0));
+}
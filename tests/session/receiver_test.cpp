@@ -0,0 +1,211 @@
+#include <array>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <liburing.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <gtest/gtest.h>
+
+#include <zportal/iouring/buffer_pool.hpp>
+#include <zportal/iouring/iouring.hpp>
+#include <zportal/net/address.hpp>
+#include <zportal/net/connection.hpp>
+#include <zportal/net/socket.hpp>
+#include <zportal/net/tun.hpp>
+#include <zportal/session/batch.hpp>
+#include <zportal/session/control.hpp>
+#include <zportal/session/frame_header.hpp>
+#include <zportal/session/operation.hpp>
+#include <zportal/session/receiver.hpp>
+#include <zportal/tools/compression.hpp>
+#include <zportal/tools/crc.hpp>
+#include <zportal/tools/error.hpp>
+
+using namespace zportal;
+
+namespace {
+
+// An IPv4 header is all TUN looks at before taking the packet.
+std::vector<std::byte> make_packet(std::size_t size) {
+    std::vector<std::byte> packet(size, std::byte{0x5A});
+    packet[0] = std::byte{0x45};
+    packet[2] = static_cast<std::byte>(size >> 8);
+    packet[3] = static_cast<std::byte>(size & 0xFF);
+    return packet;
+}
+
+bool send_frame(const Socket& socket, const std::vector<std::byte>& packet, std::uint32_t flags = 0) {
+    FrameHeader header;
+    header.set_flags(flags);
+    header.set_size(static_cast<std::uint32_t>(packet.size()));
+    header.set_crc(crc32c(packet));
+
+    std::array<iovec, 2> segments{{
+        {.iov_base = header.data().data(), .iov_len = FrameHeader::wire_size},
+        {.iov_base = const_cast<std::byte*>(packet.data()), .iov_len = packet.size()},
+    }};
+    msghdr message{};
+    message.msg_iov = segments.data();
+    message.msg_iovlen = segments.size();
+
+    const auto sent = ::sendmsg(socket.get(), &message, 0);
+    return sent == static_cast<ssize_t>(FrameHeader::wire_size + packet.size());
+}
+
+// Hands completions to the receiver until TUN took `packets`. A tick every 10 ms bounds the wait, a
+// datagram the receiver dropped produces nothing else to wake up for.
+::testing::AssertionResult deliver(IoUring& ring, Receiver& receiver, TunDevice& tun, std::uint64_t packets) {
+    bool ticking = false;
+    for (int ticks = 0; ticks < 200;) {
+        const auto stats = tun.get_stats();
+        if (!stats) {
+            return ::testing::AssertionFailure() << stats.error().to_string();
+        }
+        if (stats->rx_packets >= packets) {
+            return ::testing::AssertionSuccess();
+        }
+
+        if (!ticking) {
+            auto sqe = ring.get_sqe();
+            if (!sqe) {
+                return ::testing::AssertionFailure() << sqe.error().to_string();
+            }
+            __kernel_timespec ts{.tv_sec = 0, .tv_nsec = 10'000'000};
+            ::io_uring_prep_timeout(*sqe, &ts, 0, 0);
+            ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::TIMEOUT).serialize());
+            if (const auto submit_result = ring.submit(); !submit_result) {
+                return ::testing::AssertionFailure() << submit_result.error().to_string();
+            }
+            ticking = true;
+        }
+
+        const auto cqe = ring.wait();
+        if (!cqe) {
+            return ::testing::AssertionFailure() << cqe.error().to_string();
+        }
+
+        const auto type = cqe->operation().get_type();
+        if (type == OperationType::TIMEOUT) {
+            ticking = false;
+            ticks++;
+            continue;
+        }
+        if (type == OperationType::NONE) {
+            continue;
+        }
+        if (const auto result = receiver.handle_cqe(*cqe); !result) {
+            return ::testing::AssertionFailure() << result.error().to_string();
+        }
+    }
+
+    return ::testing::AssertionFailure() << "TUN never took " << packets << " packets";
+}
+
+} // namespace
+
+TEST(Receiver, FullSizeDatagramAfterSmallOnesStillFits) {
+    auto ring = IoUring::create_queue(64);
+    if (!ring) {
+        GTEST_SKIP() << ring.error().to_string();
+    }
+
+    auto tun = TunDevice::create_tun_device("zprt%d", parse_cidr("10.199.0.1/24"), 1500);
+    if (!tun) {
+        GTEST_SKIP() << tun.error().to_string();
+    }
+    ASSERT_TRUE(tun->set_up());
+
+    auto server = Socket::create_socket(AF_INET, SOCK_CLOEXEC, Transport::UDP);
+    ASSERT_TRUE(server) << server.error().to_string();
+    const auto any = SockAddress::ip4_numeric("127.0.0.1", 0);
+    ASSERT_EQ(::bind(server->get(), any.get(), any.length()), 0);
+    const auto bound = server->get_local_address();
+    ASSERT_TRUE(bound) << bound.error().to_string();
+    auto client = connect_datagram(*bound);
+    ASSERT_TRUE(client) << client.error().to_string();
+
+    const std::array<BufferClass, 3> classes{{{512, 16}, {4096, 16}, {65536, 4}}};
+    auto receiver = Receiver::create_receiver(*ring, *tun, *server, classes);
+    if (!receiver && receiver.error().code() == ErrorCode::RingProbeNotSupported) {
+        GTEST_SKIP() << receiver.error().to_string();
+    }
+    ASSERT_TRUE(receiver) << receiver.error().to_string();
+    ASSERT_TRUE(receiver->arm_recv());
+
+    const auto before = tun->get_stats();
+    ASSERT_TRUE(before) << before.error().to_string();
+
+    // Keepalive sized traffic, enough to pull an averaged size hint down to the smallest class.
+    constexpr std::uint64_t small_count = 64;
+    const auto small = make_packet(40);
+    for (std::uint64_t i = 0; i < small_count; i++) {
+        ASSERT_TRUE(send_frame(*client, small));
+        ASSERT_TRUE(deliver(*ring, *receiver, *tun, before->rx_packets + i + 1));
+    }
+
+    ASSERT_TRUE(send_frame(*client, make_packet(1400)));
+    EXPECT_TRUE(deliver(*ring, *receiver, *tun, before->rx_packets + small_count + 1));
+}
+
+TEST(Receiver, CompressedBatchBeforeTheHelloOverUdp) {
+    if (!compression::is_available()) {
+        GTEST_SKIP() << "built without liblz4";
+    }
+
+    auto ring = IoUring::create_queue(64);
+    if (!ring) {
+        GTEST_SKIP() << ring.error().to_string();
+    }
+
+    auto tun = TunDevice::create_tun_device("zprt%d", parse_cidr("10.197.0.1/24"), 1500);
+    if (!tun) {
+        GTEST_SKIP() << tun.error().to_string();
+    }
+    ASSERT_TRUE(tun->set_up());
+
+    auto server = Socket::create_socket(AF_INET, SOCK_CLOEXEC, Transport::UDP);
+    ASSERT_TRUE(server) << server.error().to_string();
+    const auto any = SockAddress::ip4_numeric("127.0.0.1", 0);
+    ASSERT_EQ(::bind(server->get(), any.get(), any.length()), 0);
+    const auto bound = server->get_local_address();
+    ASSERT_TRUE(bound) << bound.error().to_string();
+    auto client = connect_datagram(*bound);
+    ASSERT_TRUE(client) << client.error().to_string();
+
+    const std::array<BufferClass, 3> classes{{{512, 16}, {4096, 16}, {65536, 4}}};
+    auto receiver = Receiver::create_receiver(*ring, *tun, *server, classes);
+    if (!receiver && receiver.error().code() == ErrorCode::RingProbeNotSupported) {
+        GTEST_SKIP() << receiver.error().to_string();
+    }
+    ASSERT_TRUE(receiver) << receiver.error().to_string();
+    receiver->set_hello(Hello{Hello::BATCHED_FRAMES | Hello::COMPRESSION, BatchTable::max_frame_size});
+    ASSERT_TRUE(receiver->arm_recv());
+
+    const auto before = tun->get_stats();
+    ASSERT_TRUE(before) << before.error().to_string();
+
+    // No hello ever arrives, as if its datagram was lost.
+    constexpr std::size_t count = 4;
+    const auto packet = make_packet(1000);
+    BatchTable table;
+    std::vector<std::byte> batch;
+    for (std::size_t i = 0; i < count; i++) {
+        ASSERT_TRUE(table.add(static_cast<std::uint16_t>(packet.size())));
+    }
+    batch.insert(batch.end(), table.data().begin(), table.data().end());
+    for (std::size_t i = 0; i < count; i++) {
+        batch.insert(batch.end(), packet.begin(), packet.end());
+    }
+
+    std::vector<std::byte> compressed(compression::bound(batch.size()));
+    const auto size = compression::compress(batch, compressed);
+    ASSERT_GT(size, 0U);
+    compressed.resize(size);
+
+    ASSERT_TRUE(send_frame(*client, compressed, Hello::BATCHED_FRAMES | Hello::COMPRESSION));
+    EXPECT_TRUE(deliver(*ring, *receiver, *tun, before->rx_packets + count));
+}
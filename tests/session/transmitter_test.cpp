@@ -0,0 +1,207 @@
+#include <array>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <liburing.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#if __has_include(<linux/sctp.h>)
+#include <linux/sctp.h>
+#define ZPORTAL_TEST_SCTP 1
+#else
+#define ZPORTAL_TEST_SCTP 0
+#endif
+
+#include <gtest/gtest.h>
+
+#include <zportal/iouring/buffer_pool.hpp>
+#include <zportal/iouring/iouring.hpp>
+#include <zportal/net/address.hpp>
+#include <zportal/net/connection.hpp>
+#include <zportal/net/packet.hpp>
+#include <zportal/net/socket.hpp>
+#include <zportal/net/tun.hpp>
+#include <zportal/session/batch.hpp>
+#include <zportal/session/control.hpp>
+#include <zportal/session/frame_header.hpp>
+#include <zportal/session/operation.hpp>
+#include <zportal/session/transmitter.hpp>
+#include <zportal/tools/error.hpp>
+
+using namespace zportal;
+
+#if ZPORTAL_TEST_SCTP
+
+namespace {
+
+struct Received {
+    std::size_t packets{};
+    std::size_t batches{};
+};
+
+// Checks every packet of every message waiting on `socket` against the stream it arrived on.
+::testing::AssertionResult check_messages(const Socket& socket, std::uint16_t streams, Received& received) {
+    std::vector<std::byte> message(128 * 1024);
+    for (;;) {
+        std::array<char, CMSG_SPACE(sizeof(sctp_rcvinfo))> control{};
+        iovec segment{.iov_base = message.data(), .iov_len = message.size()};
+        msghdr header{};
+        header.msg_iov = &segment;
+        header.msg_iovlen = 1;
+        header.msg_control = control.data();
+        header.msg_controllen = control.size();
+
+        const auto size = ::recvmsg(socket.get(), &header, MSG_DONTWAIT);
+        if (size < 0) {
+            return ::testing::AssertionSuccess();
+        }
+        if (static_cast<std::size_t>(size) < FrameHeader::wire_size) {
+            return ::testing::AssertionFailure() << "message of " << size << " bytes";
+        }
+
+        std::optional<std::uint16_t> stream;
+        for (auto* cmsg = CMSG_FIRSTHDR(&header); cmsg != nullptr; cmsg = CMSG_NXTHDR(&header, cmsg)) {
+            if (cmsg->cmsg_level == IPPROTO_SCTP && cmsg->cmsg_type == SCTP_RCVINFO) {
+                sctp_rcvinfo info{};
+                std::memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+                stream = info.rcv_sid;
+            }
+        }
+        if (!stream) {
+            return ::testing::AssertionFailure() << "message without SCTP_RCVINFO";
+        }
+
+        FrameHeader frame;
+        std::memcpy(frame.data().data(), message.data(), FrameHeader::wire_size);
+        if (static_cast<std::size_t>(size) != FrameHeader::wire_size + frame.get_size()) {
+            return ::testing::AssertionFailure() << "message of " << size << " bytes holds a frame of "
+                                                 << frame.get_size();
+        }
+        const auto payload = std::span<const std::byte>(message).subspan(FrameHeader::wire_size, frame.get_size());
+        if ((frame.get_flags() & FrameHeader::control_flag) != 0) {
+            continue;
+        }
+
+        std::vector<std::span<const std::byte>> packets;
+        if ((frame.get_flags() & Hello::BATCHED_FRAMES) != 0) {
+            const auto table = BatchTable::parse(payload);
+            if (!table) {
+                return ::testing::AssertionFailure() << table.error().to_string();
+            }
+            std::size_t offset = BatchTable::wire_size(table->get_count());
+            for (std::size_t i = 0; i < table->get_count(); i++) {
+                packets.push_back(payload.subspan(offset, table->get_length(i)));
+                offset += table->get_length(i);
+            }
+            received.batches++;
+        } else {
+            packets.push_back(payload);
+        }
+
+        for (const auto packet : packets) {
+            if (flow_hash(packet) % streams != *stream) {
+                return ::testing::AssertionFailure() << "packet of stream " << flow_hash(packet) % streams
+                                                     << " sent on stream " << *stream;
+            }
+            received.packets++;
+        }
+    }
+}
+
+} // namespace
+
+TEST(Transmitter, SctpFramesGoOnTheirFlowsStream) {
+    auto ring = IoUring::create_queue(256);
+    if (!ring) {
+        GTEST_SKIP() << ring.error().to_string();
+    }
+
+    auto listener = create_listener(SockAddress::ip4_numeric("127.0.0.1", 0), 1, Transport::SCTP);
+    if (!listener && listener.error().code() == ErrorCode::SocketCreateFailed) {
+        GTEST_SKIP() << listener.error().to_string();
+    }
+    ASSERT_TRUE(listener) << listener.error().to_string();
+    const auto listening = listener->get_local_address();
+    ASSERT_TRUE(listening) << listening.error().to_string();
+
+    auto client = Socket::create_socket(AF_INET, SOCK_CLOEXEC, Transport::SCTP);
+    ASSERT_TRUE(client) << client.error().to_string();
+    ASSERT_EQ(::connect(client->get(), listening->get(), listening->length()), 0);
+    auto server = accept_from(*listener);
+    ASSERT_TRUE(server) << server.error().to_string();
+    const int on = 1;
+    ASSERT_EQ(::setsockopt(server->get(), IPPROTO_SCTP, SCTP_RECVRCVINFO, &on, sizeof(on)), 0);
+    const auto streams = client->get_stream_count();
+    ASSERT_TRUE(streams) << streams.error().to_string();
+    ASSERT_GT(*streams, 1);
+
+    auto tun = TunDevice::create_tun_device("zprt%d", parse_cidr("10.198.0.1/24"), 1500);
+    if (!tun) {
+        GTEST_SKIP() << tun.error().to_string();
+    }
+    ASSERT_TRUE(tun->set_up());
+
+    const std::array<BufferClass, 2> classes{{{512, 128}, {2048, 64}}};
+    auto transmitter = Transmitter::create_transmitter(*ring, *tun, *client, classes);
+    if (!transmitter && transmitter.error().code() == ErrorCode::RingProbeNotSupported) {
+        GTEST_SKIP() << transmitter.error().to_string();
+    }
+    ASSERT_TRUE(transmitter) << transmitter.error().to_string();
+    ASSERT_TRUE(transmitter->set_lane_features(0, Hello{Hello::BATCHED_FRAMES, 1500}));
+    ASSERT_TRUE(transmitter->arm_read());
+
+    // Interleaved flows routed into TUN all at once, so they queue behind the first SEND and batch.
+    auto sender = Socket::create_socket(AF_INET, SOCK_CLOEXEC, Transport::UDP);
+    ASSERT_TRUE(sender) << sender.error().to_string();
+    constexpr std::size_t flows = 8;
+    constexpr std::size_t per_flow = 8;
+    const std::array<std::byte, 100> datagram{};
+    for (std::size_t i = 0; i < per_flow; i++) {
+        for (std::size_t flow = 0; flow < flows; flow++) {
+            const auto target = SockAddress::ip4_numeric("10.198.0.2", static_cast<std::uint16_t>(9000 + flow));
+            ASSERT_EQ(::sendto(sender->get(), datagram.data(), datagram.size(), 0, target.get(), target.length()),
+                      static_cast<ssize_t>(datagram.size()));
+        }
+    }
+
+    Received received;
+    // Read by the kernel when submitted, so it outlives the block preparing it.
+    __kernel_timespec tick{.tv_sec = 0, .tv_nsec = 10'000'000};
+    bool ticking = false;
+    for (int ticks = 0; ticks < 200 && received.packets < flows * per_flow;) {
+        if (!ticking) {
+            auto sqe = ring->get_sqe();
+            ASSERT_TRUE(sqe) << sqe.error().to_string();
+            ::io_uring_prep_timeout(*sqe, &tick, 0, 0);
+            ::io_uring_sqe_set_data64(*sqe, Operation::make(OperationType::TIMEOUT).serialize());
+            ticking = true;
+        }
+        ASSERT_TRUE(ring->submit());
+
+        const auto cqe = ring->wait();
+        ASSERT_TRUE(cqe) << cqe.error().to_string();
+        const auto type = cqe->operation().get_type();
+        if (type == OperationType::TIMEOUT) {
+            ticking = false;
+            ticks++;
+        } else if (type != OperationType::NONE) {
+            const auto result = transmitter->handle_cqe(*cqe);
+            ASSERT_TRUE(result) << result.error().to_string();
+        }
+
+        ASSERT_TRUE(check_messages(*server, *streams, received));
+    }
+
+    // Other traffic the kernel routes into TUN may add to the count, never take from it.
+    EXPECT_GE(received.packets, flows * per_flow);
+    EXPECT_GT(received.batches, 0U);
+}
+
+#endif
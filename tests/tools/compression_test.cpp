@@ -0,0 +1,58 @@
+#include <random>
+#include <span>
+#include <vector>
+
+#include <cstddef>
+
+#include <gtest/gtest.h>
+
+#include <zportal/tools/compression.hpp>
+
+using namespace zportal;
+
+TEST(Compression, RoundTrip) {
+    if (!compression::is_available()) {
+        GTEST_SKIP() << "built without liblz4";
+    }
+
+    std::vector<std::byte> input(1400);
+    for (std::size_t i = 0; i < input.size(); ++i) {
+        input[i] = static_cast<std::byte>(i % 16);
+    }
+
+    std::vector<std::byte> compressed(compression::bound(input.size()));
+    const auto size = compression::compress(input, compressed);
+    ASSERT_NE(size, 0U);
+    EXPECT_LT(size, input.size());
+
+    std::vector<std::byte> output(input.size());
+    const auto decompressed = compression::decompress(std::span{compressed}.first(size), output);
+    ASSERT_TRUE(decompressed) << decompressed.error().to_string();
+    EXPECT_EQ(*decompressed, input.size());
+    EXPECT_EQ(output, input);
+}
+
+TEST(Compression, RandomDataDoesNotFit) {
+    if (!compression::is_available()) {
+        GTEST_SKIP() << "built without liblz4";
+    }
+
+    std::mt19937 generator{42};
+    std::vector<std::byte> input(1400);
+    for (auto& byte : input) {
+        byte = static_cast<std::byte>(generator());
+    }
+
+    std::vector<std::byte> compressed(input.size() - input.size() / 8);
+    EXPECT_EQ(compression::compress(input, compressed), 0U);
+}
+
+TEST(Compression, MalformedInputFails) {
+    if (!compression::is_available()) {
+        GTEST_SKIP() << "built without liblz4";
+    }
+
+    const std::vector<std::byte> input(16, std::byte{0xFF});
+    std::vector<std::byte> output(64);
+    EXPECT_FALSE(compression::decompress(input, output));
+}